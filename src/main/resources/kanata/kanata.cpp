@@ -0,0 +1,230 @@
+////////////////////////////////////////////////////////////////////////////////
+// Kanata log writer for the kanata_event DPI function, see KanataTrace in kanata.scala
+//
+// Build the core with CoreParams(kanata = true) and add this file to the Verilator sources:
+//   verilator --cc Core.sv --exe sim_main.cpp .../src/main/resources/kanata/kanata.cpp ...
+// The log is written to $KANATA_LOG, kanata.log by default, and can be opened with Konata.
+//
+// Fetch blocks and uops are rows of the log, in the order they were started.
+// The events of a cycle are applied together when the cycle ends: starts first, flushes last,
+// so a uop that retires in the same cycle as the restart it caused is not dropped.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+
+namespace {
+
+// Same numbers as in KanataTrace
+enum Kind {BLOCK_START = 0, BLOCK_END, BLOCK_FLUSH, UOP_START, STAGE, RETIRE, FLUSH, FLUSH_FROM};
+const char* const stageNames[] = {"Pf", "F", "Lb", "D", "X", "R"};
+const int stageCount = sizeof(stageNames) / sizeof(stageNames[0]);
+
+// Order of the kinds inside a cycle
+int priority(int kind) {
+    switch(kind) {
+        case BLOCK_START:   return 0;
+        case UOP_START:     return 0;
+        case STAGE:         return 1;
+        case RETIRE:        return 2;
+        case BLOCK_END:     return 2;
+        default:            return 3;
+    }
+}
+
+struct Event {
+    int kind;
+    uint32_t seq;
+    int stage;
+    uint64_t pc;
+    uint32_t instr;
+};
+
+struct Row {
+    uint64_t id;    // Kanata id, in the start order
+    int stage;      // Current stage, -1 when none
+};
+
+class KanataWriter {
+public:
+    ~KanataWriter() {
+        if(!f)
+            return;
+        endCycle();
+        // Whatever is still open at the end of the simulation never retired
+        for(auto& b : blocks)
+            close(b.second, false);
+        for(auto& u : uops)
+            close(u.second, false);
+        fclose(f);
+    }
+
+    void event(uint64_t cycle, const Event& e) {
+        if(!f && !open(cycle))
+            return;
+        if(cycle != lastCycle) {
+            endCycle();
+            fprintf(f, "C\t%llu\n", (unsigned long long)(cycle - lastCycle));
+            lastCycle = cycle;
+        }
+        pending.push_back(e);
+    }
+
+private:
+    FILE* f = nullptr;
+    bool failed = false;
+    uint64_t lastCycle = 0;
+    uint64_t nextId = 0;
+    uint64_t retired = 0;
+    std::vector<Event> pending;
+
+    std::map<uint32_t, Row> blocks;         // Open blocks by seq
+    std::map<uint32_t, Row> uops;           // Open uops by seq
+    std::map<uint32_t, uint64_t> closedIds; // Uops closed in the current cycle, for the flushes
+
+    bool open(uint64_t cycle) {
+        if(failed)
+            return false;
+        const char* path = getenv("KANATA_LOG");
+        if(!path)
+            path = "kanata.log";
+        f = fopen(path, "w");
+        if(!f) {
+            fprintf(stderr, "KANATA: can not open %s, the trace is disabled\n", path);
+            failed = true;
+            return false;
+        }
+        fprintf(f, "Kanata\t0004\nC=\t%llu\n", (unsigned long long)cycle);
+        lastCycle = cycle;
+        return true;
+    }
+
+    Row start(const char* label) {
+        Row r = {nextId++, -1};
+        fprintf(f, "I\t%llu\t%llu\t0\n", (unsigned long long)r.id, (unsigned long long)r.id);
+        fprintf(f, "L\t%llu\t0\t%s\n", (unsigned long long)r.id, label);
+        return r;
+    }
+
+    void stage(Row& r, int s) {
+        if(s == r.stage || s < 0 || s >= stageCount)
+            return;
+        if(r.stage >= 0)
+            fprintf(f, "E\t%llu\t0\t%s\n", (unsigned long long)r.id, stageNames[r.stage]);
+        fprintf(f, "S\t%llu\t0\t%s\n", (unsigned long long)r.id, stageNames[s]);
+        r.stage = s;
+    }
+
+    void close(Row& r, bool retire) {
+        if(r.stage >= 0)
+            fprintf(f, "E\t%llu\t0\t%s\n", (unsigned long long)r.id, stageNames[r.stage]);
+        fprintf(f, "R\t%llu\t%llu\t%d\n", (unsigned long long)r.id,
+            (unsigned long long)(retire ? retired++ : 0), retire ? 0 : 1);
+    }
+
+    void flushBlocks(bool keep, uint32_t seq) {
+        for(auto it = blocks.begin(); it != blocks.end();) {
+            if(keep && it->first == seq) {
+                ++it;
+            } else {
+                close(it->second, false);
+                it = blocks.erase(it);
+            }
+        }
+    }
+
+    // Drops the open uops started after seq, and seq itself when inclusive
+    void flushUops(uint32_t seq, bool inclusive) {
+        uint64_t from = 0;
+        auto u = uops.find(seq);
+        auto c = closedIds.find(seq);
+        if(u != uops.end())
+            from = u->second.id + (inclusive ? 0 : 1);
+        else if(c != closedIds.end())
+            from = c->second + 1;
+        // Unknown seq: everything is dropped
+        for(auto it = uops.begin(); it != uops.end();) {
+            if(it->second.id >= from) {
+                close(it->second, false);
+                it = uops.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void apply(const Event& e) {
+        char label[64];
+        switch(e.kind) {
+            case BLOCK_START: {
+                snprintf(label, sizeof(label), "block %llx", (unsigned long long)e.pc);
+                Row r = start(label);
+                stage(r, e.stage);
+                blocks[e.seq] = r;
+                break;
+            }
+            case UOP_START: {
+                snprintf(label, sizeof(label), "%llx: %08x", (unsigned long long)e.pc, e.instr);
+                Row r = start(label);
+                stage(r, e.stage);
+                uops[e.seq] = r;
+                break;
+            }
+            case STAGE: {
+                auto it = uops.find(e.seq);
+                if(it != uops.end())
+                    stage(it->second, e.stage);
+                break;
+            }
+            case RETIRE: {
+                auto it = uops.find(e.seq);
+                if(it != uops.end()) {
+                    close(it->second, true);
+                    closedIds[e.seq] = it->second.id;
+                    uops.erase(it);
+                }
+                break;
+            }
+            case BLOCK_END: {
+                auto it = blocks.find(e.seq);
+                if(it != blocks.end()) {
+                    close(it->second, true);
+                    blocks.erase(it);
+                }
+                break;
+            }
+            case BLOCK_FLUSH:
+                flushBlocks(true, e.seq);
+                break;
+            case FLUSH:
+            case FLUSH_FROM:
+                flushBlocks(false, 0);
+                flushUops(e.seq, e.kind == FLUSH_FROM);
+                break;
+        }
+    }
+
+    void endCycle() {
+        std::stable_sort(pending.begin(), pending.end(),
+            [](const Event& a, const Event& b) { return priority(a.kind) < priority(b.kind); });
+        for(const Event& e : pending)
+            apply(e);
+        pending.clear();
+        closedIds.clear();
+    }
+};
+
+KanataWriter writer;
+
+} // namespace
+
+
+extern "C" void kanata_event(long long cycle, char kind, int seq, char stage, long long pc, int instr) {
+    Event e = {(uint8_t)kind, (uint32_t)seq, (uint8_t)stage, (uint64_t)pc, (uint32_t)instr};
+    writer.event((uint64_t)cycle, e);
+}
@@ -22,6 +22,7 @@ object busConst extends ChiselEnum {
   val DIRTYBITNUM = 3
   val UNIQUEBITNUM = 4
   val RETURNDATABITNUM = 5
+  val SNOOPEDBITNUM = 6 // rresp of the L3: other cores had to give the line up, see AtomicPredictor
 
   val ReadOnce         = 1.U(8.W) // Only used in non coherent buses
   val WriteOnce        = 16.U(8.W)
@@ -30,6 +31,18 @@ object busConst extends ChiselEnum {
   val ReadUnique            = 3.U(8.W) // Read with intention to write, Ask the peers to release their instances of the cache
   val Invalidate            = 4.U(8.W) // Ask peer caches to release their instances of the cache line
   val WriteBack             = 17.U(8.W) // Writeback. L1 still holds the line
+
+  // Cache block operations. Sent on AW without W beats, acknowledged on B once every copy above the L3 is given up.
+  // Clean and Flush write the dirty data to memory first, Inval drops it
+  val CleanLine             = 18.U(8.W) // The line stays in the L3, clean
+  val FlushLine             = 19.U(8.W)
+  val InvalLine             = 20.U(8.W)
+  def isLineOp(op: UInt): Bool = (op === CleanLine) || (op === FlushLine) || (op === InvalLine)
+
+  // Far AMO, executed by the L3 bank on its copy of the line. op(4, 0) is the funct5 of the AMO.
+  // W carries the operand in its byte lanes, the old line is returned on R, then the write is acknowledged on B
+  val AtomicLoad            = 64.U(8.W)
+  def isAtomicLoad(op: UInt): Bool = op(7, 5) === 2.U
   
   val Flush                 = 32.U(8.W) // L3 cache has to flush itself before returning anything
   val FlushRemove           = 33.U(8.W) // L3 Cache has to writeback everything AND then remove every entry before returning anything
@@ -73,7 +73,58 @@ class CoreParams(
   val l1tlb: AssociativeMemoryParameters = new AssociativeMemoryParameters(ways = 2, sets = 4),
   val prefetchStorageEntries: Int = 16,
   val fetchStorageEntries: Int = 16,
+  val loadQueueEntries: Int = 4, // Committed loads waiting for the D-cache refill
+  val storeBufferEntries: Int = 4, // Committed stores waiting to be written to the D-cache
+  val lrscCycles: Int = 64, // After an LR the snoops to the reserved line wait this long, so that the SC can succeed
+  val wrsCycles: Int = 256, // Longest wait of wrs.sto and pause for the reservation to be lost
+
+  /**************************************************************************/
+  /*                Front-end configuration                                 */
+  /**************************************************************************/
+  val macroOpFusion: Boolean = true, // Decode fuses common instruction pairs into one uop. Not used with RVFI
+  val earlyRedirect: Boolean = true, // Fetch redirects Prefetch on JAL and backward branches
+  val loopBuffer: Boolean = true, // Short loops are replayed into Decode while the front-end is stopped
+  val loopBufferEntries: Int = 16,
+  val ftqEntries: Int = 4, // Fetch blocks predicted ahead of the I-cache access
+  val btbEntries: Int = 32, // Blocks that end with a jump predicted taken
+  val icachePrefetch: Boolean = true, // Fetch target queue prefetches the predicted lines into the I-cache
+
+  /**************************************************************************/
+  /*                Execution units configuration                           */
+  /**************************************************************************/
+  val mulLatency: Int = 2, // Multiplier pipeline depth in cycles
+  val fpu: Boolean = true, // F/D extensions. Without it mstatus.FS is hardwired to Off and FP instructions trap
+  val fmaLatency: Int = 3, // Fused multiply-add pipeline depth in cycles
+  val vector: Boolean = true, // V subset. Without it mstatus.VS is hardwired to Off and vector instructions trap
+  val vLen: Int = 128, // Bits per vector register
+
+  /**************************************************************************/
+  /*                Back-end configuration                                  */
+  /**************************************************************************/
+  val outOfOrder: Boolean = false, // Reorder buffer and issue queue instead of the in-order Execute stage
+  val robEntries: Int = 16,
+  val issueQueueEntries: Int = 8,
+  val issueWidth: Int = 2, // Issue ports, each one has the full set of the execution units
+  val retireWidth: Int = 1, // Uops committed per cycle. Only the oldest one can trap or access memory. In-order Execute feeds one
+  val hpmCounters: Int = 29, // mhpmcounter3 and up, the rest are hardwired to zero
+  val kanata: Boolean = false, // Simulation only: pipeline trace through DPI, see KanataTrace
+  val topDownReport: Boolean = false, // Simulation only: top-down summary printed at the end, see TopDownReport
 ) {
+  require(mulLatency >= 1)
+  require(fmaLatency >= 1)
+  require(isPow2(vLen) && vLen >= 64 && vLen <= 8 * cacheLineBytes) // A register fits into a cache line
+  require(isPow2(loopBufferEntries) && loopBufferEntries >= 2)
+  require(isPow2(ftqEntries) && ftqEntries >= 2)
+  require(isPow2(btbEntries) && btbEntries >= 2)
+  require(isPow2(robEntries) && robEntries >= 2)
+  require(issueQueueEntries >= 2 && issueWidth >= 1)
+  require(retireWidth >= 1)
+  require(hpmCounters >= 0 && hpmCounters <= 29)
+  require(isPow2(loadQueueEntries) && loadQueueEntries >= 2)
+  require(isPow2(storeBufferEntries) && storeBufferEntries >= 2)
+  require(lrscCycles >= 16) // Enough for the constrained LR/SC loops
+  require(wrsCycles >= 1)
+
   println("Generating using PMA Configuration default:")
   var regionnum = 0
   for(m <- pmaConfig) {
@@ -107,6 +158,13 @@ class CCXModule(implicit val ccx: CCXParams) extends Module {
   def log(str: Printable): Unit = {
     printf(cf"[$logcycle%x $name] ${str}\n")
   }
+
+  // Pipeline trace event, see KanataTrace. Nothing is generated without CoreParams.kanata
+  def kanata(en: Bool, kind: UInt, seq: UInt, stage: UInt, pc: UInt = 0.U, instr: UInt = 0.U): Unit = {
+    if(ccx.core.kanata) {
+      KanataTrace(clock, en, logcycle, kind, seq, stage, pc, instr)
+    }
+  }
 }
 
 class CCX(implicit ccx: CCXParams) extends CCXModule {
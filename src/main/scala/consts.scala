@@ -17,6 +17,9 @@ object Consts {
   val xLenBytes = xLen / 8
   val xLenBytesLog2 = log2Ceil(xLenBytes)
 
+  val physRegs: Int = 64 // Renamed register file. x0 is always mapped to the physical register 0
+  val physRegsLog2 = log2Ceil(physRegs)
+
 
   val PTESIZE = 64 // bits. Only used by RVFI
 }
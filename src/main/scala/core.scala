@@ -62,7 +62,8 @@ class Core(implicit ccx: CCXParams) extends CCXModule {
   val dynRegs       = IO(Input(new DynamicROCsrRegisters))
   val staticRegs    = IO(Input(new StaticCsrRegisters))
 
-  val rvfi            = if(ccx.rvfi_enabled) IO(Output(new rvfi_o)) else Wire(new rvfi_o)
+  // riscv-formal channels, one per uop retired in the cycle
+  val rvfi            = if(ccx.rvfi_enabled) IO(Output(Vec(ccx.core.retireWidth, new rvfi_o))) else Wire(Vec(ccx.core.retireWidth, new rvfi_o))
 
   
   if(!ccx.rvfi_enabled && ccx.rvfi_dont_touch) {
@@ -77,13 +78,20 @@ class Core(implicit ccx: CCXParams) extends CCXModule {
   /**************************************************************************/
   
   val regfile   = Module(new Regfile)
+  val fpRegfile = Module(new FpRegfile)
   
 
+  val ftq       = Module(new FetchTargetQueue)
   val prefetch  = Module(new Prefetch)
   val fetch     = Module(new Fetch)
+  val loopBuffer = Module(new LoopBuffer)
   val decode    = Module(new Decode)
-  val execute   = Module(new Execute)
+  val execute: ExecuteBackEnd = Module(if(ccx.core.outOfOrder) new OooBackend else new Execute)
   val retire    = Module(new Retirement)
+  val loadQueue = Module(new LoadQueue)
+  val storeBuffer = Module(new StoreBuffer)
+  val vectorUnit = if(ccx.core.vector) Some(Module(new VectorUnit)) else None
+  val topDown   = Module(new TopDownAccounting(5))
 
   val prefetch_storage = Module(new Queue(
     prefetch.out.bits.cloneType,
@@ -91,13 +99,14 @@ class Core(implicit ccx: CCXParams) extends CCXModule {
     pipe = true, flow = true, useSyncReadMem = true, hasFlush = true))
   
   val fetch_storage = Module(new Queue(
-    prefetch.out.bits.cloneType,
+    fetch.out.bits.cloneType,
     entries = ccx.core.fetchStorageEntries,
     pipe = true, flow = false, useSyncReadMem = true, hasFlush = true))
   
   
   val icache    = Module(new Cache()(ccx = ccx, cp = ccx.core.icache))
   val dcache    = Module(new Cache()(ccx = ccx, cp = ccx.core.dcache))
+  val dcachePort = Module(new CachePortArbiter(if(ccx.core.vector) 3 else 2))
   val l2tlbGigapage  = Module(new L2Tlb(new TlbGigaEntry, ccx.core.l2tlb.giga, 2))
   val l2tlbMegapage  = Module(new L2Tlb(new TlbMegaEntry, ccx.core.l2tlb.mega, 2))
   val l2tlbKilopage  = Module(new L2Tlb(new TlbKiloEntry, ccx.core.l2tlb.kilo, 2))
@@ -118,17 +127,33 @@ class Core(implicit ccx: CCXParams) extends CCXModule {
   /*                UOP pipeline                                            */
   /*                                                                        */
   /**************************************************************************/
+  ftq.out                 <> prefetch.in
   prefetch.out            <> prefetch_storage.io.enq
   prefetch_storage.io.deq <> fetch.in
   fetch.out               <> fetch_storage.io.enq
-  fetch_storage.io.deq    <> decode.in
+  fetch_storage.io.deq    <> loopBuffer.in
+  loopBuffer.out          <> decode.in
   decode.out              <> execute.in
   execute.out             <> retire.in
+  execute.outExtra        <> retire.inExtra
 
   
   val storage_flush = retire.ctrl.flush || retire.ctrl.jump || retire.ctrl.kill
 
-  prefetch_storage.flush := storage_flush
+  // Fetch redirect only drops the instructions younger than the jump
+  prefetch_storage.flush := storage_flush || fetch.redirect.valid || execute.redirect.valid || loopBuffer.flushFrontEnd
+  fetch_storage.flush := storage_flush || execute.redirect.valid || loopBuffer.flushFrontEnd
+  prefetch.redirect := fetch.redirect
+  ftq.redirect      := fetch.redirect
+  ftq.update        := fetch.btbUpdate
+  // Nothing is fetched while the loop buffer replays
+  prefetch.fetchReady := fetch.blockReady && !loopBuffer.active
+  prefetch.cacheIdle  := !prefetch_storage.io.deq.valid
+  prefetch.hint.valid := ftq.hint.valid && !loopBuffer.active
+  prefetch.hint.bits  := ftq.hint.bits
+  ftq.hint.ready      := prefetch.hint.ready && !loopBuffer.active
+  prefetch.swHint     := retire.prefetchI
+  prefetch.park       := retire.parked
   
   /**************************************************************************/
   /*                                                                        */
@@ -142,6 +167,7 @@ class Core(implicit ccx: CCXParams) extends CCXModule {
   retire.staticRegs <> staticRegs
   fetch.dynRegs     <> dynRegs
   prefetch.dynRegs  <> dynRegs
+  ftq.dynRegs       <> dynRegs
   fetch.csr         <> retire.csrRegs
   prefetch.csr      <> retire.csrRegs
 
@@ -157,6 +183,64 @@ class Core(implicit ccx: CCXParams) extends CCXModule {
 
   ibus              <> icache.bus
   */
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                DCACHE                                                  */
+  /*                                                                        */
+  /**************************************************************************/
+  dcachePort.io.inReq(0)  <> loadQueue.cacheReq
+  dcachePort.io.inResp(0) <> loadQueue.cacheResp
+  dcachePort.io.inReq(1)  <> storeBuffer.cacheReq
+  dcachePort.io.inResp(1) <> storeBuffer.cacheResp
+  vectorUnit.foreach(v => {
+    dcachePort.io.inReq(2)  <> v.cacheReq
+    dcachePort.io.inResp(2) <> v.cacheResp
+  })
+  /*
+  dcachePort.io.outReq  <> dcache.req
+  dcachePort.io.outResp <> dcache.resp
+  */
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Load queue                                              */
+  /*                                                                        */
+  /**************************************************************************/
+  loadQueue.req       <> retire.lqReq
+  retire.lqResolve    := loadQueue.resolve
+  retire.lqEmpty      := loadQueue.empty
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Store buffer                                            */
+  /*                                                                        */
+  /**************************************************************************/
+  storeBuffer.req     <> retire.sbReq
+  retire.sbResolve    := storeBuffer.resolve
+  retire.sbEmpty      := storeBuffer.empty
+  retire.reservationValid := dcache.reservationValid
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Vector unit                                             */
+  /*                                                                        */
+  /**************************************************************************/
+  // Without the unit mstatus.VS stays Off, so Retirement never sends a request
+  vectorUnit match {
+    case Some(v) =>
+      v.req             <> retire.vecReq
+      retire.vecResp    := v.resp
+    case None =>
+      retire.vecReq.ready := false.B
+      retire.vecResp    := 0.U.asTypeOf(retire.vecResp)
+  }
+
+  loadQueue.fwd       <> storeBuffer.fwd
+  loadQueue.lineCheck.vaddr := storeBuffer.req.bits.vaddr
+  loadQueue.lineCheck.instr := storeBuffer.req.bits.instr
+  storeBuffer.loadConflict  := loadQueue.lineCheck.busy
+  storeBuffer.loadsPending  := loadQueue.committed
   /**************************************************************************/
   /*                                                                        */
   /*                regfile                                                 */
@@ -164,6 +248,21 @@ class Core(implicit ccx: CCXParams) extends CCXModule {
   /**************************************************************************/
   regfile.retire          <> retire.regs_retire
   regfile.decode          <> decode.regs_decode
+  regfile.load.wb         := loadQueue.wb
+  regfile.load.pending    := loadQueue.pending
+
+  fpRegfile.decode        <> decode.fregs_decode
+  fpRegfile.retire        := retire.fregs_retire
+  fpRegfile.load          := loadQueue.fpWb
+  fpRegfile.loadPending   := loadQueue.fpPending
+  execute.frm             := retire.csrRegs.frm
+
+  execute match {
+    case backend: OooBackend =>
+      backend.physBusy    := regfile.physBusy
+      backend.regWrites   := regfile.writes
+    case _ =>
+  }
   
   
   /**************************************************************************/
@@ -173,19 +272,54 @@ class Core(implicit ccx: CCXParams) extends CCXModule {
   /**************************************************************************/
   rvfi                := retire.rvfi
   retire.int          := int
+
+  // Retirement adds the flushes and its own mispredictions
+  retire.perf                   := 0.U.asTypeOf(retire.perf)
+  retire.perf.icacheHit         := icache.perf.hit
+  retire.perf.icacheMiss        := icache.perf.miss
+  retire.perf.dcacheHit         := dcache.perf.hit
+  retire.perf.dcacheMiss        := dcache.perf.miss
+  retire.perf.itlbMiss          := icache.perf.tlbMiss
+  retire.perf.dtlbMiss          := dcache.perf.tlbMiss
+  retire.perf.ptwCycle          := icache.perf.ptwCycle || dcache.perf.ptwCycle
+  retire.perf.branchMispredict  := execute.redirect.valid
+  retire.perf.decodeStall       := decode.stallReserve
+  retire.perf.l3Snoop           := icache.perf.snoop || dcache.perf.snoop
+  retire.perf.topDown           := topDown.cycleClass
+
+  // Oldest stage first
+  topDown.stage     := VecInit(retire.topDown, execute.topDown, decode.topDown, fetch.topDown, prefetch.topDown)
+  topDown.restart   := retire.ctrl.kill || retire.ctrl.flush || retire.ctrl.jump || execute.redirect.valid
+  topDown.refilled  := decode.out.fire
+  decode.memPending := !loadQueue.empty
   retire.debugReq     := debugReq
   retire.dmHaltAddr   := dmHaltAddr
 
-  prefetch.ctrl               <> retire.ctrl
-  fetch.ctrl                  <> retire.ctrl
-  decode.ctrl                 <> retire.ctrl
+  // Execute redirects the front-end when it resolves a branch. Retirement jumps take priority
+  // Loop buffer only flushes the stages before it, they restart from the loop exit
+  def frontEndCtrl(c: PipelineControlIO, loopFlush: Bool = false.B): Unit = {
+    c.kill    := retire.ctrl.kill
+    c.flush   := retire.ctrl.flush
+    c.jump    := retire.ctrl.jump || execute.redirect.valid || loopFlush
+    c.newPc   := Mux(retire.ctrl.kill || retire.ctrl.flush || retire.ctrl.jump, retire.ctrl.newPc,
+                 Mux(execute.redirect.valid, execute.redirect.bits, loopBuffer.exitPc))
+  }
+  frontEndCtrl(ftq.ctrl, loopBuffer.flushFrontEnd)
+  frontEndCtrl(prefetch.ctrl, loopBuffer.flushFrontEnd)
+  frontEndCtrl(fetch.ctrl, loopBuffer.flushFrontEnd)
+  frontEndCtrl(loopBuffer.ctrl)
+  frontEndCtrl(decode.ctrl)
   execute.ctrl                <> retire.ctrl
   //icache.ctrl                 <> retire.ctrl
   regfile.ctrl                <> retire.ctrl
+  fpRegfile.ctrl              <> retire.ctrl
+  loadQueue.ctrl              <> retire.ctrl
+  storeBuffer.ctrl            <> retire.ctrl
   
 
 
-  retire.ctrl.busy := prefetch.ctrl.busy || (prefetch_storage.io.count > 0.U) || fetch.ctrl.busy || (fetch_storage.io.count > 0.U) || decode.ctrl.busy || execute.ctrl.busy /*|| icache.ctrl.busy*/ || regfile.ctrl.busy
+  retire.ctrl.busy := prefetch.ctrl.busy || (prefetch_storage.io.count > 0.U) || fetch.ctrl.busy || (fetch_storage.io.count > 0.U) || loopBuffer.ctrl.busy || decode.ctrl.busy || execute.ctrl.busy /*|| icache.ctrl.busy*/ || regfile.ctrl.busy
+  // Committed loads/stores do not keep the pipeline busy. FENCE waits for them instead
 }
 
 
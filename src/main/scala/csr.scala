@@ -62,6 +62,27 @@ class InterruptsInputs extends Bundle {
   val ssip = Bool()
 }
 
+// One bit per event and cycle, from the pipeline stages and the caches. Counted by mhpmcounter3..31
+class PerfEvents extends Bundle {
+  val icacheHit         = Bool()
+  val icacheMiss        = Bool()
+  val dcacheHit         = Bool()
+  val dcacheMiss        = Bool()
+  val itlbMiss          = Bool()
+  val dtlbMiss          = Bool()
+  val ptwCycle          = Bool() // Page table walk in progress
+  val branchMispredict  = Bool()
+  val decodeStall       = Bool() // Uop in decode waits for a reserved register
+  val flush             = Bool()
+  val l3Snoop           = Bool() // Snoop received from the L3
+  val topDown           = UInt(3.W) // Class of the cycle, see TopDown. One event per class
+
+  // mhpmevent value of an event is its position here plus one. Zero and the unknown values count nothing
+  def all: Seq[Bool] = Seq(icacheHit, icacheMiss, dcacheHit, dcacheMiss, itlbMiss, dtlbMiss, ptwCycle,
+                           branchMispredict, decodeStall, flush, l3Snoop) ++
+                       TopDown.names.indices.map(i => topDown === (i + 1).U)
+}
+
 /**************************************************************************/
 /*                                                                        */
 /*               CSR related enums and constants                          */
@@ -83,6 +104,8 @@ class exc_code(implicit val ccx: CCXParams) extends ChiselEnum{
 
   val MACHINE_EXTERNAL_INTERRUPT = ((9.U)| INTERRUPT)
   val SUPERVISOR_EXTERNAL_INTERRUPT = ((11.U) | INTERRUPT)
+
+  val LOCAL_COUNTER_OVERFLOW_INTERRUPT = ((13.U) | INTERRUPT) // Sscofpmf
   
   val INSTR_MISALIGNED              = 0.U
   val INSTR_ACCESS_FAULT            = 1.U
@@ -134,6 +157,32 @@ class CsrRegs(implicit val ccx: CCXParams) extends Bundle {
   /*                                                                        */
   /**************************************************************************/
   val pmp = Vec(ccx.pmpCount, new CsrPmp)
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*               Floating point                                           */
+  /*                                                                        */
+  /**************************************************************************/
+  val fs = UInt(2.W) // mstatus.FS, Off disables the FP instructions
+  val frm = UInt(3.W)
+  val fflags = UInt(5.W)
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*               Vector                                                   */
+  /*                                                                        */
+  /**************************************************************************/
+  val vs = UInt(2.W) // mstatus.VS, Off disables the vector instructions
+  val vstart = UInt(log2Ceil(ccx.core.vLen).W)
+  val vec = new VecConfig
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*               Environment configuration                                */
+  /*                                                                        */
+  /**************************************************************************/
+  val menvcfg = new EnvCfg // For S and U
+  val senvcfg = new EnvCfg // For U
 }
 
 
@@ -142,24 +191,43 @@ class CsrRegsOutput(implicit ccx: CCXParams) extends CsrRegs {
   val vmEnabled = Bool()
 }
 
-class SlicedCounter64IO extends Bundle {
-  val incr = Input(Bool())               // increment enable
+class SlicedCounter64IO(incrBits: Int) extends Bundle {
+  val incr = Input(UInt(incrBits.W))     // increment amount, several uops (some fused) retire per cycle
   val set  = Flipped(Valid(UInt(64.W)))  // direct assignment
   val out  = Output(UInt(64.W))          // current value
 }
 
+// menvcfg/senvcfg: Zicbom/Zicboz enables for the less privileged modes. FIOM reads as zero
+class EnvCfg extends Bundle {
+  val cbze  = Bool()    // cbo.zero
+  val cbcfe = Bool()    // cbo.clean/cbo.flush
+  val cbie  = UInt(2.W) // cbo.inval: 0 illegal, 1 executed as a flush, 3 invalidates. 2 is reserved, it acts as 0
+
+  def value: UInt = Cat(cbze, cbcfe, cbie, 0.U(4.W))
+}
+
+// mhpmevent: selected event and the Sscofpmf overflow/mode inhibit bits
+class HpmEvent extends Bundle {
+  val of    = Bool() // Counter overflowed, LCOFIP was set
+  val minh  = Bool()
+  val sinh  = Bool()
+  val uinh  = Bool()
+  val event = UInt(8.W)
+}
+
 // 64-bit sliced counter (same-cycle ripple carry) with assign support
-class SlicedCounter64(sliceBits: Int = 16) extends Module {
+class SlicedCounter64(sliceBits: Int = 16, incrBits: Int = 1) extends Module {
   require(64 % sliceBits == 0, "sliceBits must divide 64")
 
-  val io = IO(new SlicedCounter64IO)
+  val io = IO(new SlicedCounter64IO(incrBits))
 
   val slices = 64 / sliceBits
   val segs   = Seq.fill(slices)(RegInit(0.U(sliceBits.W)))
 
   // increment logic
-  val next0  = segs(0) + io.incr.asUInt
-  val c0     = io.incr && (next0 === 0.U)
+  val sum0   = segs(0) +& io.incr
+  val next0  = sum0(sliceBits - 1, 0)
+  val c0     = sum0(sliceBits)
 
   when (io.set.valid) {
     // assign slices from io.set.bits
@@ -197,8 +265,15 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     val int               = Input  (new InterruptsInputs)
 
     // To retirement unit
-    val instRetIncr       = Input  (Bool())
+    val instRetIncr       = Input  (UInt(log2Ceil(2 * ccx.core.retireWidth + 1).W)) // Up to two per fused uop
     val interruptPending  = Output (Bool())
+    val interruptWake     = Output (Bool())    // Pending and enabled in mie, whatever the privilege and mstatus. Wakes WFI
+    val fflags            = Input  (UInt(5.W)) // Accrued FP exception flags of the retired instruction
+    val fsDirty           = Input  (Bool())    // Retired instruction changed the FP state
+    val vecConfig         = Input  (Valid(new VecConfig))  // vsetvl*
+    val vstart            = Input  (Valid(UInt(log2Ceil(ccx.core.vLen).W))) // Vector instruction completed or trapped
+    val vsDirty           = Input  (Bool())    // Retired instruction changed the vector state
+    val perf              = Input  (new PerfEvents)
 
     val cmd           = Input  (chiselTypeOf(csr_cmd.none))
     val addr          = Input  (UInt(12.W))
@@ -237,6 +312,7 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
   /**************************************************************************/
   val regsReset         = 0.U.asTypeOf(new CsrRegs)
   regsReset.priv        := Privilege.M
+  regsReset.vec.vill    := true.B // vsetvl* has to run first
 
   for(i <- 0 until ccx.pmpCount) {
     regsReset.pmp(i).pmpcfg := staticRegs.pmpcfg_default(i).asTypeOf(new CsrPmpCfg)
@@ -283,16 +359,70 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
   
 
   val cycle   = Module(new SlicedCounter64(16))
-  val instret = Module(new SlicedCounter64(16))
+  val instret = Module(new SlicedCounter64(16, io.instRetIncr.getWidth))
+  val hpm     = Seq.fill(ccx.core.hpmCounters)(Module(new SlicedCounter64(16)))
+
+  // Bit i stands for the counter at 0xB00 + i. TM is not here, time is not implemented
+  val counterMask         = ((((BigInt(1) << ccx.core.hpmCounters) - 1) << 3) | 5).U(32.W)
+  val mcountinhibit       = RegInit(0.U(32.W))
+  val mcounteren          = RegInit(0.U(32.W))
+  val scounteren          = RegInit(0.U(32.W))
+  val hpmEvent            = RegInit(VecInit(Seq.fill(ccx.core.hpmCounters)(0.U.asTypeOf(new HpmEvent))))
+  val lcofip              = RegInit(false.B)
   
-  cycle.io.incr := true.B
+  cycle.io.incr := !mcountinhibit(0)
   cycle.io.set.valid := false.B
   cycle.io.set.bits := 0.U
 
-  instret.io.incr := io.instRetIncr
+  instret.io.incr := Mux(mcountinhibit(2), 0.U, io.instRetIncr)
   instret.io.set.valid := false.B
   instret.io.set.bits := 0.U
+
+  val events = VecInit(false.B +: io.perf.all)
+  for((c, i) <- hpm.zipWithIndex) {
+    val e       = hpmEvent(i)
+    val modeInh = MuxLookup(regs.priv, e.uinh)(Seq(Privilege.M -> e.minh, Privilege.S -> e.sinh))
+    val incr    = (e.event < events.length.U) && events(e.event(log2Ceil(events.length) - 1, 0)) && !mcountinhibit(i + 3) && !modeInh
+
+    c.io.incr := incr
+    c.io.set.valid := false.B
+    c.io.set.bits := 0.U
+
+    // Sscofpmf: the wrap sets OF. LCOFIP is only raised by the OF that was clear, CSR writes below take priority
+    when(incr && c.io.out.andR) {
+      e.of := true.B
+      when(!e.of) {
+        lcofip := true.B
+      }
+    }
+  }
   
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Floating point state                                    */
+  /*                                                                        */
+  /**************************************************************************/
+  // CSR writes below take priority
+  regs.fflags := regs.fflags | io.fflags
+  when(io.fsDirty) {
+    regs.fs := 3.U // Dirty
+  }
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Vector state                                            */
+  /*                                                                        */
+  /**************************************************************************/
+  when(io.vecConfig.valid) {
+    regs.vec := io.vecConfig.bits
+  }
+  when(io.vstart.valid) {
+    regs.vstart := io.vstart.bits
+  }
+  when(io.vsDirty) {
+    regs.vs := 3.U // Dirty
+  }
+
   /**************************************************************************/
   /*                                                                        */
   /*                Interrupt logic/state                                   */
@@ -310,6 +440,8 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
   val stip                = RegInit(false.B)
   val ssip                = RegInit(false.B)
 
+  val lcofie              = RegInit(false.B)
+
 
   /**************************************************************************/
   /*                                                                        */
@@ -322,7 +454,7 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     "b0".U(1.W), // Y
     "b0".U(1.W), // X
     "b0".U(1.W), // W
-    "b0".U(1.W), // V
+    ccx.core.vector.B, // V - Vector, present if enabled
     "b1".U(1.W), // U - User mode, present
     "b0".U(1.W), // T
     "b1".U(1.W), // S - Supervisor mode, present
@@ -331,17 +463,17 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     "b0".U(1.W), // P
     "b0".U(1.W), // O
     "b0".U(1.W), // N
-    "b0".U(1.W), // M - Multiply/Divide, Present // TODO: Multiply/Divide in ISA
+    "b1".U(1.W), // M - Multiply/Divide, Present
     "b0".U(1.W), // L
     "b0".U(1.W), // K
     "b0".U(1.W), // J
     "b1".U(1.W), // I - RV64I
     "b0".U(1.W), // H
     "b0".U(1.W), // G
-    "b0".U(1.W), // F
+    ccx.core.fpu.B, // F - Single precision, present if enabled
     "b0".U(1.W), // E
-    "b0".U(1.W), // D
-    "b0".U(1.W), // C
+    ccx.core.fpu.B, // D - Double precision, present if enabled
+    "b1".U(1.W), // C - Compressed, present
     "b0".U(1.W), // B
     "b0".U(1.W)  // A // TODO: Atomic access in ISA
  ) | (("b10".U(2.W)) << (xLen - 3)) // MXLEN = 64, only valid value
@@ -360,7 +492,11 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
 
   val accesslevel_invalid =  (write || read) && (regs.priv  < io.addr(9, 8))
   val write_invalid       =  write           && (BigInt("11", 2).U === io.addr(11, 10))
-  val invalid             =  (read || write) && (accesslevel_invalid | write_invalid | !exists)
+  // User counters are enabled for S by mcounteren, and for U by both mcounteren and scounteren
+  val counteren_invalid   =  (io.addr(11, 5) === "h60".U) && MuxLookup(regs.priv, !(mcounteren & scounteren)(io.addr(4, 0)))(Seq(
+                              Privilege.M -> false.B,
+                              Privilege.S -> !mcounteren(io.addr(4, 0))))
+  val invalid             =  (read || write) && (accesslevel_invalid | write_invalid | counteren_invalid | !exists)
 
   def calculate_rmw_after(): UInt = {
     val rmw_after = Wire(UInt(xLen.W))
@@ -409,6 +545,7 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
   val calculated_seie = calculated_sie & seie
   val calculated_stie = calculated_sie & stie
   val calculated_ssie = calculated_sie & ssie
+  val calculated_lcofie = calculated_sie & lcofie
 
   
   val calculated_meip = io.int.meip
@@ -425,7 +562,17 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
         (calculated_msip & calculated_msie) |
         (calculated_seip & calculated_seie) |
         (calculated_stip & calculated_stie) |
-        (calculated_ssip & calculated_ssie);
+        (calculated_ssip & calculated_ssie) |
+        (lcofip & calculated_lcofie);
+
+  io.interruptWake :=
+        (calculated_meip & meie) |
+        (calculated_mtip & mtie) |
+        (calculated_msip & msie) |
+        (calculated_seip & seie) |
+        (calculated_stip & stie) |
+        (calculated_ssip & ssie) |
+        (lcofip & lcofie);
 
   /**************************************************************************/
   /*                                                                        */
@@ -463,14 +610,14 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     }
   }
 
-  def addr_reg(a: UInt, r: UInt): Unit = {
+  def addr_reg(a: UInt, r: UInt, alignMask: UInt = ~(3.U(xLen.W))): Unit = {
     when(io.addr === a) {
       exists := true.B
       io.out := r
       rmw_before := r
       when(!invalid && write) {
         // TODO: Is this an okay requirement?
-        r := calculate_rmw_after() & ~(3.U(xLen.W))
+        r := calculate_rmw_after() & alignMask
       }
     }
   }
@@ -483,7 +630,18 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
       when(!invalid && write) {
         calculate_rmw_after()
         counterio.set.bits := calculate_rmw_after()
-        counterio.set.valid
+        counterio.set.valid := true.B
+      }
+    }
+  }
+
+  def masked(a: UInt, r: UInt, mask: UInt): Unit = {
+    when(io.addr === a) {
+      exists := true.B
+      io.out := r
+      rmw_before := r
+      when(!invalid && write) {
+        r := (calculate_rmw_after() & mask)(r.getWidth - 1, 0)
       }
     }
   }
@@ -527,6 +685,9 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     } .elsewhen( calculated_stip &  calculated_stie) { // STI
         mcause := new exc_code().SUPERVISOR_TIMER_INTERRUPT; // Calculated by the CSR
         exc_int_error := false.B
+    } .elsewhen( lcofip &  calculated_lcofie) { // LCOFI
+        mcause := new exc_code().LOCAL_COUNTER_OVERFLOW_INTERRUPT; // Calculated by the CSR
+        exc_int_error := false.B
     } .otherwise {
         exc_int_error := true.B
     }
@@ -627,12 +788,13 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     /*                mstatus                                                 */
     /**************************************************************************/
     
+    val sd = (regs.fs === 3.U) || (regs.vs === 3.U) // XS is always Off
     val mstatus = Cat(
-      "h0".U(9.W), // Padding SD, 8 empty bits
+      sd, 0.U((xLen - 24).W), // SD, UXL/SXL and the empty bits
       regs.tsr, regs.tw, regs.tvm, // trap enable bits
       regs.mxr, regs.sum, regs.mprv, //machine privilege mode
-      "b00"U(2.W), "b00"U(2.W), // xs, fs
-      regs.mpp, "b00"U(2.W), spp, // MPP, 2 bits (reserved by spec), SPP
+      "b00"U(2.W), regs.fs, // xs, fs
+      regs.mpp, regs.vs, spp, // MPP, VS, SPP
       mpie, "b0"U(1.W), spie, "b0"U(1.W),
       mie, "b0"U(1.W), sie, "b0"U(1.W)
     )
@@ -642,6 +804,12 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     partial ("h300".U, 7, 7,    mstatus,      mpie)
     partial ("h300".U, 8, 8,    mstatus,      spp)
     partial ("h300".U, 12, 11,  mstatus, regs.mpp)
+    if(ccx.core.fpu) {
+      partial ("h300".U, 14, 13,  mstatus, regs.fs)
+    }
+    if(ccx.core.vector) {
+      partial ("h300".U, 10, 9,   mstatus, regs.vs)
+    }
     partial ("h300".U, 17, 17,  mstatus, regs.mprv)
     partial ("h300".U, 18, 18,  mstatus, regs.sum)
     partial ("h300".U, 19, 19,  mstatus, regs.mxr)
@@ -662,7 +830,7 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     
     addr_reg("h305".U, mtvec)
     scratch ("h340".U, mscratch)
-    addr_reg("h341".U, mepc)
+    addr_reg("h341".U, mepc, ~(1.U(xLen.W))) // IALIGN is 16 with RVC
     scratch ("h342".U, mcause)
     ro      ("h343".U, 0.U) // MTVAL is hardwired to zero, in case it never gets written
     ro      ("h302".U, 0.U) // MEDELEG
@@ -670,10 +838,12 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     
     // MIE:
     val mie_reg = Cat(
+      lcofie, 0.U(1.W),
       meie, 0.U(1.W), seie, 0.U(1.W),
       mtie, 0.U(1.W), stie, 0.U(1.W),
       msie, 0.U(1.W), ssie, 0.U(1.W),
     )
+    partial("h304".U, 13, 13, mie_reg, lcofie)
     partial("h304".U, 11, 11, mie_reg, meie)
     partial("h304".U,  9,  9, mie_reg, seie)
     partial("h304".U,  7,  7, mie_reg, mtie)
@@ -688,7 +858,7 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     /**************************************************************************/
     addr_reg("h105".U, stvec)
     scratch ("h140".U, sscratch)
-    addr_reg("h141".U, sepc)
+    addr_reg("h141".U, sepc, ~(1.U(xLen.W)))
     scratch ("h142".U, scause)
     scratch ("h143".U, stval)
     // STVAL is NOT hardwired to zero
@@ -705,21 +875,23 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     }
 
     val sie_reg = Cat(
+      lcofie, 0.U(1.W),
       0.U(2.W), seie, 0.U(1.W),
       0.U(2.W), stie, 0.U(1.W),
       0.U(2.W), ssie, 0.U(1.W),
     )
+    partial("h104".U, 13, 13, sie_reg, lcofie)
     partial("h104".U,  9,  9, sie_reg, seie)
     partial("h104".U,  5,  5, sie_reg, stie)
     partial("h104".U,  1,  1, sie_reg, ssie)
 
 
     val sstatus = Cat(
-      "h0".U(9.W), // Padding SD, 8 empty bits
+      sd, 0.U((xLen - 24).W), // SD, UXL and the empty bits
       "b000".U(3.W), // trap enable bits
       regs.mxr, regs.sum, 0.U(1.W), //machine privilege mode
-      "b00"U(2.W), "b00"U(2.W), // xs, fs
-      "b00"U(2.W), "b00"U(2.W), spp, // MPP, 2 bits (reserved by spec), SPP
+      "b00"U(2.W), regs.fs, // xs, fs
+      "b00"U(2.W), regs.vs, spp, // MPP, VS, SPP
       "b00"U(2.W), spie, "b0"U(1.W),
       "b00"U(2.W), sie, "b0"U(1.W)
     )
@@ -728,11 +900,54 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     partial ("h100".U, 8, 8,    sstatus,          spp)
     partial ("h100".U, 18, 18,  sstatus, regs.sum)
     partial ("h100".U, 19, 19,  sstatus, regs.mxr) // FIXME: Check if this needs to be removed from sstatus
+    if(ccx.core.fpu) {
+      partial ("h100".U, 14, 13,  sstatus, regs.fs)
+    }
+    if(ccx.core.vector) {
+      partial ("h100".U, 10, 9,   sstatus, regs.vs)
+    }
+
+    /**************************************************************************/
+    /*                Floating point                                          */
+    /**************************************************************************/
+    
+    val fcsr = Cat(regs.frm, regs.fflags)
+    partial ("h001".U, 4, 0,    regs.fflags,  regs.fflags)
+    partial ("h002".U, 2, 0,    regs.frm,     regs.frm)
+    partial ("h003".U, 4, 0,    fcsr,         regs.fflags)
+    partial ("h003".U, 7, 5,    fcsr,         regs.frm)
+    when((io.addr >= "h001".U) && (io.addr <= "h003".U)) {
+      // Not accessible while the FP unit is Off
+      when(regs.fs === 0.U) {
+        exists := false.B
+      } .elsewhen(!invalid && write) {
+        regs.fs := 3.U
+      }
+    }
+
+    /**************************************************************************/
+    /*                Vector                                                  */
+    /**************************************************************************/
+    
+    // vxrm/vxsat/vcsr are not implemented, there are no fixed-point instructions
+    partial ("h008".U, regs.vstart.getWidth - 1, 0, regs.vstart, regs.vstart)
+    ro      ("hC20".U, regs.vec.vl)
+    ro      ("hC21".U, regs.vec.asVtype)
+    ro      ("hC22".U, (ccx.core.vLen / 8).U) // vlenb
+    when((io.addr === "h008".U) || ((io.addr >= "hC20".U) && (io.addr <= "hC22".U))) {
+      // Not accessible while the vector unit is Off
+      when(regs.vs === 0.U) {
+        exists := false.B
+      } .elsewhen(!invalid && write) {
+        regs.vs := 3.U
+      }
+    }
 
     when(io.addr === "h344".U) { // MIP
       exists := true.B
 
       rmw_before := Cat(
+        lcofip, 0.U(1.W),
         io.int.meip, 0.U(1.W), seip, 0.U(1.W),
         io.int.mtip, 0.U(1.W), stip, 0.U(1.W),
         io.int.msip, 0.U(1.W), ssip, 0.U(1.W)
@@ -744,6 +959,7 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
         // csr_mip_m*ip is read only
         // From machine mode, s*ip can be both cleared and set
         calculate_rmw_after()
+        lcofip :=calculate_rmw_after()(13)
         seip :=calculate_rmw_after()(9)
         stip :=calculate_rmw_after()(5)
         ssip :=calculate_rmw_after()(1)
@@ -754,6 +970,7 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
       exists := true.B
 
       rmw_before := Cat(
+        lcofip, 0.U(1.W),
         0.U(2.W), seip, 0.U(1.W),
         0.U(2.W), stip, 0.U(1.W),
         0.U(2.W), ssip, 0.U(1.W)
@@ -763,6 +980,9 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
 
       when(!invalid && write) {
         // s*ip can only be cleared
+        when(calculate_rmw_after()(13) === 0.U) {
+          lcofip := false.B
+        }
         when(calculate_rmw_after()(9) === 0.U) {
           seip := calculate_rmw_after()(9)
         }
@@ -780,20 +1000,53 @@ class CSR(implicit ccx: CCXParams) extends CCXModule {
     /*                Counters                                                 */
     /**************************************************************************/
     
-    ro      ("h306".U, 0.U) // mcounteren
-    ro      ("h106".U, 0.U) // scounteren
+    masked  ("h306".U, mcounteren, counterMask)
+    masked  ("h106".U, scounteren, counterMask)
+    masked  ("h320".U, mcountinhibit, counterMask)
 
     // TODO: Test coverage of this
     counter ("hB00".U, cycle.io)
     counter ("hB02".U, instret.io)
-    
-    // TODO: Proper HPM events support
+    ro      ("hC00".U, cycle.io.out)
+    ro      ("hC02".U, instret.io.out)
+
+    // Counters above hpmCounters and their events read as zero
     when((io.addr >= "hB03".U) && (io.addr <= "hB1F".U)) { // HPM Counters
       exists := true.B
     }
+    when((io.addr >= "hC03".U) && (io.addr <= "hC1F".U)) { // HPM Counters, user read-only
+      exists := true.B
+    }
     when((io.addr >= "h323".U) && (io.addr <= "h33F".U)) { // HPM Event Counters
       exists := true.B
     }
+    for((c, i) <- hpm.zipWithIndex) {
+      val e = hpmEvent(i)
+      val mhpmevent = Cat(e.of, e.minh, e.sinh, e.uinh, 0.U((xLen - 12).W), e.event)
+      counter ((0xB03 + i).U, c.io)
+      ro      ((0xC03 + i).U, c.io.out)
+      partial ((0x323 + i).U, 63, 63, mhpmevent, e.of)
+      partial ((0x323 + i).U, 62, 62, mhpmevent, e.minh)
+      partial ((0x323 + i).U, 61, 61, mhpmevent, e.sinh)
+      partial ((0x323 + i).U, 60, 60, mhpmevent, e.uinh)
+      partial ((0x323 + i).U,  7,  0, mhpmevent, e.event)
+    }
+
+    // Sscofpmf: OF bits of the counters that S-mode is allowed to read
+    val scountovf = Cat(hpmEvent.map(_.of).reverse :+ 0.U(3.W))
+    ro      ("hDA0".U, scountovf & Mux(machine, counterMask, mcounteren))
+
+    /**************************************************************************/
+    /*                Environment configuration                               */
+    /**************************************************************************/
+
+    partial ("h30A".U, 7, 7, regs.menvcfg.value, regs.menvcfg.cbze)
+    partial ("h30A".U, 6, 6, regs.menvcfg.value, regs.menvcfg.cbcfe)
+    partial ("h30A".U, 5, 4, regs.menvcfg.value, regs.menvcfg.cbie)
+    partial ("h10A".U, 7, 7, regs.senvcfg.value, regs.senvcfg.cbze)
+    partial ("h10A".U, 6, 6, regs.senvcfg.value, regs.senvcfg.cbcfe)
+    partial ("h10A".U, 5, 4, regs.senvcfg.value, regs.senvcfg.cbie)
+
     // FIXME: Add the Lock bit check
     // FIXME: Correct the pmpcfg
     /*for(i <- 0 until 16 by 2) {
@@ -0,0 +1,97 @@
+package armleocpu
+
+
+import chisel3._
+import chisel3.util._
+
+import Consts._
+
+class FpRegWrite extends Bundle {
+  val addr        = UInt(5.W)
+  val data        = UInt(xLen.W)
+}
+
+class fregs_decode_io extends Bundle {
+  val instr_i   = Input (UInt(iLen.W))
+  val commit    = Input (Bool())
+  val fp        = Input (new FpDecodedCtrl) // Operands of instr_i that are FP registers
+  val reserve   = Input (Valid(UInt(5.W)))  // Uop that writes the FP rd leaves decode
+
+  val reserved  = Output(Bool()) // One of the FP operands of instr_i is waiting for its value
+  val rs1       = Output(UInt(xLen.W))
+  val rs2       = Output(UInt(xLen.W))
+  val rs3       = Output(UInt(xLen.W))
+}
+
+/**
+ * F/D register file. Not renamed, a scoreboard keeps the register reserved from the time its producer leaves decode
+ * until the value is written by Retirement or the load queue. Decode stalls on reserved sources and on a reserved rd,
+ * so the values are read once all the older writes are done.
+ */
+class FpRegfile(implicit ccx: CCXParams) extends CCXModule {
+  /**************************************************************************/
+  /*                                                                        */
+  /*                INPUT/OUTPUT                                            */
+  /*                                                                        */
+  /**************************************************************************/
+  val ctrl          = IO(new PipelineControlIO) // Pipeline command interface form control unit
+  val decode        = IO(new fregs_decode_io)
+  val retire        = IO(Input(Valid(new FpRegWrite)))
+  val load          = IO(Input(Valid(new FpRegWrite)))
+  val loadPending   = IO(Input(UInt(32.W))) // Registers of the committed FP loads, kept reserved on kill/flush/jump
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                STATE                                                   */
+  /*                                                                        */
+  /**************************************************************************/
+  val regs          = Reg(Vec(32, UInt(xLen.W)))
+  val reserved      = RegInit(0.U(32.W))
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Scoreboard                                              */
+  /*                                                                        */
+  /**************************************************************************/
+  val instr         = decode.instr_i
+
+  decode.reserved   := (decode.fp.rs1 && reserved(instr(19, 15))) ||
+                       (decode.fp.rs2 && reserved(instr(24, 20))) ||
+                       (decode.fp.rs3 && reserved(instr(31, 27))) ||
+                       (decode.fp.rd  && reserved(instr(11, 7)))
+
+  val setMask       = Mux(decode.reserve.valid, UIntToOH(decode.reserve.bits, 32), 0.U)
+  val clearMask     = Mux(retire.valid, UIntToOH(retire.bits.addr, 32), 0.U) |
+                      Mux(load.valid, UIntToOH(load.bits.addr, 32), 0.U)
+
+  when(ctrl.kill || ctrl.flush || ctrl.jump) {
+    // Producers that are not retired are dropped, the committed loads still write
+    reserved := loadPending
+  } .otherwise {
+    reserved := (reserved | setMask) & ~clearMask
+  }
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Regs writing                                            */
+  /*                                                                        */
+  /**************************************************************************/
+  // Only one producer of a register is in flight, so the ports never conflict
+  when(retire.valid) {
+    regs(retire.bits.addr) := retire.bits.data
+  }
+  when(load.valid) {
+    regs(load.bits.addr) := load.bits.data
+  }
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Regs reading                                            */
+  /*                                                                        */
+  /**************************************************************************/
+  decode.rs1        := RegEnable(regs(instr(19, 15)), decode.commit)
+  decode.rs2        := RegEnable(regs(instr(24, 20)), decode.commit)
+  decode.rs3        := RegEnable(regs(instr(31, 27)), decode.commit)
+
+  ctrl.busy := false.B
+}
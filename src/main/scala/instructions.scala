@@ -77,7 +77,6 @@ object Instructions {
   def SLTI                = BitPat("b?????????????????010?????0010011")
   def SLTIU               = BitPat("b?????????????????011?????0010011")
 
-  /*
   // MULDIV
   def MUL                 = BitPat("b0000001??????????000?????0110011")
   def MULH                = BitPat("b0000001??????????001?????0110011")
@@ -94,18 +93,233 @@ object Instructions {
   def REMW                = BitPat("b0000001??????????110?????0111011")
   def DIVUW               = BitPat("b0000001??????????101?????0111011")
   def DIVW                = BitPat("b0000001??????????100?????0111011")
-  */
+
+  // Zba
+  def SH1ADD              = BitPat("b0010000??????????010?????0110011")
+  def SH2ADD              = BitPat("b0010000??????????100?????0110011")
+  def SH3ADD              = BitPat("b0010000??????????110?????0110011")
+  def ADD_UW              = BitPat("b0000100??????????000?????0111011")
+  def SH1ADD_UW           = BitPat("b0010000??????????010?????0111011")
+  def SH2ADD_UW           = BitPat("b0010000??????????100?????0111011")
+  def SH3ADD_UW           = BitPat("b0010000??????????110?????0111011")
+  def SLLI_UW             = BitPat("b000010???????????001?????0011011")
+
+  // Zbb
+  def ANDN                = BitPat("b0100000??????????111?????0110011")
+  def ORN                 = BitPat("b0100000??????????110?????0110011")
+  def XNOR                = BitPat("b0100000??????????100?????0110011")
+  def CLZ                 = BitPat("b011000000000?????001?????0010011")
+  def CTZ                 = BitPat("b011000000001?????001?????0010011")
+  def CPOP                = BitPat("b011000000010?????001?????0010011")
+  def CLZW                = BitPat("b011000000000?????001?????0011011")
+  def CTZW                = BitPat("b011000000001?????001?????0011011")
+  def CPOPW               = BitPat("b011000000010?????001?????0011011")
+  def MAX                 = BitPat("b0000101??????????110?????0110011")
+  def MAXU                = BitPat("b0000101??????????111?????0110011")
+  def MIN                 = BitPat("b0000101??????????100?????0110011")
+  def MINU                = BitPat("b0000101??????????101?????0110011")
+  def SEXT_B              = BitPat("b011000000100?????001?????0010011")
+  def SEXT_H              = BitPat("b011000000101?????001?????0010011")
+  def ZEXT_H              = BitPat("b000010000000?????100?????0111011")
+  def ROL                 = BitPat("b0110000??????????001?????0110011")
+  def ROR                 = BitPat("b0110000??????????101?????0110011")
+  def ROLW                = BitPat("b0110000??????????001?????0111011")
+  def RORW                = BitPat("b0110000??????????101?????0111011")
+  def RORI                = BitPat("b011000???????????101?????0010011")
+  def RORIW               = BitPat("b0110000??????????101?????0011011")
+  def ORC_B               = BitPat("b001010000111?????101?????0010011")
+  def REV8                = BitPat("b011010111000?????101?????0010011")
+
+  // Zbs
+  def BCLR                = BitPat("b0100100??????????001?????0110011")
+  def BEXT                = BitPat("b0100100??????????101?????0110011")
+  def BINV                = BitPat("b0110100??????????001?????0110011")
+  def BSET                = BitPat("b0010100??????????001?????0110011")
+  def BCLRI               = BitPat("b010010???????????001?????0010011")
+  def BEXTI               = BitPat("b010010???????????101?????0010011")
+  def BINVI               = BitPat("b011010???????????001?????0010011")
+  def BSETI               = BitPat("b001010???????????001?????0010011")
+
+  // F/D
+  def FLW                 = BitPat("b?????????????????010?????0000111")
+  def FLD                 = BitPat("b?????????????????011?????0000111")
+  def FSW                 = BitPat("b?????????????????010?????0100111")
+  def FSD                 = BitPat("b?????????????????011?????0100111")
+  def FMADD_S             = BitPat("b?????00??????????????????1000011")
+  def FMADD_D             = BitPat("b?????01??????????????????1000011")
+  def FMSUB_S             = BitPat("b?????00??????????????????1000111")
+  def FMSUB_D             = BitPat("b?????01??????????????????1000111")
+  def FNMSUB_S            = BitPat("b?????00??????????????????1001011")
+  def FNMSUB_D            = BitPat("b?????01??????????????????1001011")
+  def FNMADD_S            = BitPat("b?????00??????????????????1001111")
+  def FNMADD_D            = BitPat("b?????01??????????????????1001111")
+  def FADD_S              = BitPat("b0000000??????????????????1010011")
+  def FSUB_S              = BitPat("b0000100??????????????????1010011")
+  def FMUL_S              = BitPat("b0001000??????????????????1010011")
+  def FDIV_S              = BitPat("b0001100??????????????????1010011")
+  def FSQRT_S             = BitPat("b010110000000?????????????1010011")
+  def FSGNJ_S             = BitPat("b0010000??????????000?????1010011")
+  def FSGNJN_S            = BitPat("b0010000??????????001?????1010011")
+  def FSGNJX_S            = BitPat("b0010000??????????010?????1010011")
+  def FMIN_S              = BitPat("b0010100??????????000?????1010011")
+  def FMAX_S              = BitPat("b0010100??????????001?????1010011")
+  def FEQ_S               = BitPat("b1010000??????????010?????1010011")
+  def FLT_S               = BitPat("b1010000??????????001?????1010011")
+  def FLE_S               = BitPat("b1010000??????????000?????1010011")
+  def FCLASS_S            = BitPat("b111000000000?????001?????1010011")
+  def FCVT_W_S            = BitPat("b110000000000?????????????1010011")
+  def FCVT_WU_S           = BitPat("b110000000001?????????????1010011")
+  def FCVT_L_S            = BitPat("b110000000010?????????????1010011")
+  def FCVT_LU_S           = BitPat("b110000000011?????????????1010011")
+  def FCVT_S_W            = BitPat("b110100000000?????????????1010011")
+  def FCVT_S_WU           = BitPat("b110100000001?????????????1010011")
+  def FCVT_S_L            = BitPat("b110100000010?????????????1010011")
+  def FCVT_S_LU           = BitPat("b110100000011?????????????1010011")
+  def FADD_D              = BitPat("b0000001??????????????????1010011")
+  def FSUB_D              = BitPat("b0000101??????????????????1010011")
+  def FMUL_D              = BitPat("b0001001??????????????????1010011")
+  def FDIV_D              = BitPat("b0001101??????????????????1010011")
+  def FSQRT_D             = BitPat("b010110100000?????????????1010011")
+  def FSGNJ_D             = BitPat("b0010001??????????000?????1010011")
+  def FSGNJN_D            = BitPat("b0010001??????????001?????1010011")
+  def FSGNJX_D            = BitPat("b0010001??????????010?????1010011")
+  def FMIN_D              = BitPat("b0010101??????????000?????1010011")
+  def FMAX_D              = BitPat("b0010101??????????001?????1010011")
+  def FEQ_D               = BitPat("b1010001??????????010?????1010011")
+  def FLT_D               = BitPat("b1010001??????????001?????1010011")
+  def FLE_D               = BitPat("b1010001??????????000?????1010011")
+  def FCLASS_D            = BitPat("b111000100000?????001?????1010011")
+  def FCVT_W_D            = BitPat("b110000100000?????????????1010011")
+  def FCVT_WU_D           = BitPat("b110000100001?????????????1010011")
+  def FCVT_L_D            = BitPat("b110000100010?????????????1010011")
+  def FCVT_LU_D           = BitPat("b110000100011?????????????1010011")
+  def FCVT_D_W            = BitPat("b110100100000?????????????1010011")
+  def FCVT_D_WU           = BitPat("b110100100001?????????????1010011")
+  def FCVT_D_L            = BitPat("b110100100010?????????????1010011")
+  def FCVT_D_LU           = BitPat("b110100100011?????????????1010011")
+  def FCVT_S_D            = BitPat("b010000000001?????????????1010011")
+  def FCVT_D_S            = BitPat("b010000100000?????????????1010011")
+  def FMV_X_W             = BitPat("b111000000000?????000?????1010011")
+  def FMV_X_D             = BitPat("b111000100000?????000?????1010011")
+  def FMV_W_X             = BitPat("b111100000000?????000?????1010011")
+  def FMV_D_X             = BitPat("b111100100000?????000?????1010011")
+
+  // V subset. vm is instr(25), VMERGE with vm set is vmv.v.*
+  def VLE8_V              = BitPat("b000000?00000?????000?????0000111")
+  def VLE16_V             = BitPat("b000000?00000?????101?????0000111")
+  def VLE32_V             = BitPat("b000000?00000?????110?????0000111")
+  def VLE64_V             = BitPat("b000000?00000?????111?????0000111")
+  def VLSE8_V             = BitPat("b000010???????????000?????0000111")
+  def VLSE16_V            = BitPat("b000010???????????101?????0000111")
+  def VLSE32_V            = BitPat("b000010???????????110?????0000111")
+  def VLSE64_V            = BitPat("b000010???????????111?????0000111")
+  def VSE8_V              = BitPat("b000000?00000?????000?????0100111")
+  def VSE16_V             = BitPat("b000000?00000?????101?????0100111")
+  def VSE32_V             = BitPat("b000000?00000?????110?????0100111")
+  def VSE64_V             = BitPat("b000000?00000?????111?????0100111")
+  def VSSE8_V             = BitPat("b000010???????????000?????0100111")
+  def VSSE16_V            = BitPat("b000010???????????101?????0100111")
+  def VSSE32_V            = BitPat("b000010???????????110?????0100111")
+  def VSSE64_V            = BitPat("b000010???????????111?????0100111")
+  def VSETVLI             = BitPat("b0????????????????111?????1010111")
+  def VSETIVLI            = BitPat("b11???????????????111?????1010111")
+  def VSETVL              = BitPat("b1000000??????????111?????1010111")
+  def VADD_VV             = BitPat("b000000???????????000?????1010111")
+  def VADD_VX             = BitPat("b000000???????????100?????1010111")
+  def VADD_VI             = BitPat("b000000???????????011?????1010111")
+  def VSUB_VV             = BitPat("b000010???????????000?????1010111")
+  def VSUB_VX             = BitPat("b000010???????????100?????1010111")
+  def VRSUB_VX            = BitPat("b000011???????????100?????1010111")
+  def VRSUB_VI            = BitPat("b000011???????????011?????1010111")
+  def VMINU_VV            = BitPat("b000100???????????000?????1010111")
+  def VMINU_VX            = BitPat("b000100???????????100?????1010111")
+  def VMIN_VV             = BitPat("b000101???????????000?????1010111")
+  def VMIN_VX             = BitPat("b000101???????????100?????1010111")
+  def VMAXU_VV            = BitPat("b000110???????????000?????1010111")
+  def VMAXU_VX            = BitPat("b000110???????????100?????1010111")
+  def VMAX_VV             = BitPat("b000111???????????000?????1010111")
+  def VMAX_VX             = BitPat("b000111???????????100?????1010111")
+  def VAND_VV             = BitPat("b001001???????????000?????1010111")
+  def VAND_VX             = BitPat("b001001???????????100?????1010111")
+  def VAND_VI             = BitPat("b001001???????????011?????1010111")
+  def VOR_VV              = BitPat("b001010???????????000?????1010111")
+  def VOR_VX              = BitPat("b001010???????????100?????1010111")
+  def VOR_VI              = BitPat("b001010???????????011?????1010111")
+  def VXOR_VV             = BitPat("b001011???????????000?????1010111")
+  def VXOR_VX             = BitPat("b001011???????????100?????1010111")
+  def VXOR_VI             = BitPat("b001011???????????011?????1010111")
+  def VMERGE_VV           = BitPat("b010111???????????000?????1010111")
+  def VMERGE_VX           = BitPat("b010111???????????100?????1010111")
+  def VMERGE_VI           = BitPat("b010111???????????011?????1010111")
+  def VMSEQ_VV            = BitPat("b011000???????????000?????1010111")
+  def VMSEQ_VX            = BitPat("b011000???????????100?????1010111")
+  def VMSEQ_VI            = BitPat("b011000???????????011?????1010111")
+  def VMSNE_VV            = BitPat("b011001???????????000?????1010111")
+  def VMSNE_VX            = BitPat("b011001???????????100?????1010111")
+  def VMSNE_VI            = BitPat("b011001???????????011?????1010111")
+  def VMSLTU_VV           = BitPat("b011010???????????000?????1010111")
+  def VMSLTU_VX           = BitPat("b011010???????????100?????1010111")
+  def VMSLT_VV            = BitPat("b011011???????????000?????1010111")
+  def VMSLT_VX            = BitPat("b011011???????????100?????1010111")
+  def VMSLEU_VV           = BitPat("b011100???????????000?????1010111")
+  def VMSLEU_VX           = BitPat("b011100???????????100?????1010111")
+  def VMSLEU_VI           = BitPat("b011100???????????011?????1010111")
+  def VMSLE_VV            = BitPat("b011101???????????000?????1010111")
+  def VMSLE_VX            = BitPat("b011101???????????100?????1010111")
+  def VMSLE_VI            = BitPat("b011101???????????011?????1010111")
+  def VMSGTU_VX           = BitPat("b011110???????????100?????1010111")
+  def VMSGTU_VI           = BitPat("b011110???????????011?????1010111")
+  def VMSGT_VX            = BitPat("b011111???????????100?????1010111")
+  def VMSGT_VI            = BitPat("b011111???????????011?????1010111")
+  def VSLL_VV             = BitPat("b100101???????????000?????1010111")
+  def VSLL_VX             = BitPat("b100101???????????100?????1010111")
+  def VSLL_VI             = BitPat("b100101???????????011?????1010111")
+  def VSRL_VV             = BitPat("b101000???????????000?????1010111")
+  def VSRL_VX             = BitPat("b101000???????????100?????1010111")
+  def VSRL_VI             = BitPat("b101000???????????011?????1010111")
+  def VSRA_VV             = BitPat("b101001???????????000?????1010111")
+  def VSRA_VX             = BitPat("b101001???????????100?????1010111")
+  def VSRA_VI             = BitPat("b101001???????????011?????1010111")
+  def VMUL_VV             = BitPat("b100101???????????010?????1010111")
+  def VMUL_VX             = BitPat("b100101???????????110?????1010111")
+  def VREDSUM_VS          = BitPat("b000000???????????010?????1010111")
+  def VREDAND_VS          = BitPat("b000001???????????010?????1010111")
+  def VREDOR_VS           = BitPat("b000010???????????010?????1010111")
+  def VREDXOR_VS          = BitPat("b000011???????????010?????1010111")
+  def VREDMINU_VS         = BitPat("b000100???????????010?????1010111")
+  def VREDMIN_VS          = BitPat("b000101???????????010?????1010111")
+  def VREDMAXU_VS         = BitPat("b000110???????????010?????1010111")
+  def VREDMAX_VS          = BitPat("b000111???????????010?????1010111")
+  def VMV_X_S             = BitPat("b0100001?????00000010?????1010111")
+  def VMV_S_X             = BitPat("b010000100000?????110?????1010111")
 
   def EBREAK              = BitPat("b00000000000100000000000001110011")
   def ECALL               = BitPat("b00000000000000000000000001110011")
   def MRET                = BitPat("b00110000001000000000000001110011")
   def SRET                = BitPat("b00010000001000000000000001110011")
+  def WFI                 = BitPat("b00010000010100000000000001110011")
+
+  // Zawrs, and the Zihintpause hint: FENCE with pred = W, succ = 0
+  def WRS_NTO             = BitPat("b00000000110100000000000001110011")
+  def WRS_STO             = BitPat("b00000001110100000000000001110011")
+  def PAUSE               = BitPat("b00000001000000000000000000001111")
 
 
   def FENCE               = BitPat("b?????????????????000?????0001111")
   def FENCE_I             = BitPat("b?????????????????001?????0001111")
   def SFENCE_VMA          = BitPat("b0001001??????????000000001110011")
 
+  // Zicbom/Zicboz: rs1 is the address, imm selects the operation
+  def CBO_INVAL           = BitPat("b000000000000?????010000000001111")
+  def CBO_CLEAN           = BitPat("b000000000001?????010000000001111")
+  def CBO_FLUSH           = BitPat("b000000000010?????010000000001111")
+  def CBO_ZERO            = BitPat("b000000000100?????010000000001111")
+
+  // Zicbop: ORI hints with rd = 0, the offset is imm(11, 5)
+  def PREFETCH_I          = BitPat("b???????00000?????110000000010011")
+  def PREFETCH_R          = BitPat("b???????00001?????110000000010011")
+  def PREFETCH_W          = BitPat("b???????00011?????110000000010011")
+
   // ATOMIC
 
   def LR_D                = BitPat("b00010??00000?????011?????0101111")
@@ -124,7 +338,6 @@ object Instructions {
   def AMOMINU_W           = BitPat("b11000????????????010?????0101111")
   def AMOSWAP_W           = BitPat("b00001????????????010?????0101111")
 
-  /*
   def AMOADD_D            = BitPat("b00000????????????011?????0101111")
   def AMOAND_D            = BitPat("b01100????????????011?????0101111")
   def AMOOR_D             = BitPat("b01000????????????011?????0101111")
@@ -134,7 +347,10 @@ object Instructions {
   def AMOMIN_D            = BitPat("b10000????????????011?????0101111")
   def AMOMINU_D           = BitPat("b11000????????????011?????0101111")
   def AMOSWAP_D           = BitPat("b00001????????????011?????0101111")
-  */
+
+  // Any LR/SC/AMO of the size, funct5 selects the operation
+  def AMO_W               = BitPat("b?????????????????010?????0101111")
+  def AMO_D               = BitPat("b?????????????????011?????0101111")
 
   // CSR
   def CSRRW               = BitPat("b?????????????????001?????1110011")
@@ -0,0 +1,40 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+import Consts._
+
+/**
+ * Chooses where an AMO is executed. Near AMOs make the line unique in the L1 and modify it there,
+ * far AMOs are sent to the L3 bank as AtomicLoad and leave the line where it is.
+ * A line is predicted contended when it keeps being taken away by snoops between the AMOs to it.
+ * 2-bit saturating counters, indexed by the low bits of the line address.
+ */
+class AtomicPredictor(entriesLog2: Int)(implicit ccx: CCXParams) extends Module {
+  val io = IO(new Bundle {
+    val lookup    = Input(UInt((apLen - cacheLineLog2).W)) // Line of the AMO
+    val far       = Output(Bool())
+
+    // Near AMO hit on a unique line: not contended. Near AMO had to take the line back from a peer: contended.
+    // Far AMO: the contended hint of the bank, set when the line had to be taken from another core
+    val train     = Input(Valid(new Bundle {
+      val line      = UInt((apLen - cacheLineLog2).W)
+      val contended = Bool()
+    }))
+  })
+
+  val counters = RegInit(VecInit(Seq.fill(1 << entriesLog2)(0.U(2.W))))
+
+  def idx(line: UInt): UInt = line(entriesLog2 - 1, 0)
+
+  io.far := counters(idx(io.lookup))(1)
+
+  when(io.train.valid) {
+    val c = counters(idx(io.train.bits.line))
+    when(io.train.bits.contended && (c =/= 3.U)) {
+      c := c + 1.U
+    } .elsewhen(!io.train.bits.contended && (c =/= 0.U)) {
+      c := c - 1.U
+    }
+  }
+}
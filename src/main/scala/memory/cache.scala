@@ -10,7 +10,8 @@ import Consts._
 class CacheParams(
   val waysLog2: Int  = 1,
   val entriesLog2: Int = 6,
-  val l1tlbParams:AssociativeMemoryParameters = new AssociativeMemoryParameters(2, 2)
+  val l1tlbParams:AssociativeMemoryParameters = new AssociativeMemoryParameters(2, 2),
+  val atomicPredictorEntriesLog2: Int = 4 // Near/far AMO predictor, see AtomicPredictor
 ) {
   val ways = 1 << waysLog2
   val entries = 1 << entriesLog2
@@ -18,17 +19,39 @@ class CacheParams(
 
 class CacheMeta(implicit val ccx: CCXParams, implicit val cp: CacheParams) extends Bundle {
   val valid       = Bool()
-  // TODO: Writeback: Add the dirty, unique bits
+  val dirty       = Bool() // Modified since the refill, written back before the line is given up
+  val unique      = Bool() // No other cache holds the line. Only unique lines are written, see CacheWriter
   val ptag        = UInt((apLen - cacheLineLog2 - cp.entriesLog2).W)
 }
 
 
+// Cache block operations (Zicbom/Zicboz/Zicbop) on the whole line of vaddr
+object Cmo {
+  val NONE        = 0.U(3.W) // Data access
+  val CLEAN       = 1.U(3.W) // Dirty line is written to memory
+  val FLUSH       = 2.U(3.W) // Same, then every copy is invalidated
+  val INVAL       = 3.U(3.W) // Every copy is invalidated, the dirty data is dropped
+  val ZERO        = 4.U(3.W) // Line is made unique and zeroed, without reading it
+  val PREFETCH_R  = 5.U(3.W) // Non-blocking read, the data is dropped
+  val PREFETCH_W  = 6.U(3.W) // Same, the line is refilled unique
+  val PREFETCH_I  = 7.U(3.W) // Sent to the I-cache by Prefetch
+
+  def isPrefetch(op: UInt): Bool = op >= PREFETCH_R
+  def isManage(op: UInt): Bool = (op =/= NONE) && (op < PREFETCH_R) // CLEAN/FLUSH/INVAL/ZERO
+}
+
 class CacheReq(implicit val ccx: CCXParams) extends DecoupledIO(new Bundle {
     val read        = Bool() // Reads a data sample from the cache line
     val write       = Bool() // Writes a data sample to the cache line
 
-    val atomicRead  = Bool()
-    val atomicWrite = Bool()
+    val atomicRead  = Bool() // LR: read that also reserves the line
+    val atomicWrite = Bool() // SC: write only if the reservation is still held
+    val amo         = Bool() // Read-modify-write of a word on a unique line, returns the old data like a read
+
+    val nonBlocking = Bool() // On miss respond with miss set instead of waiting for the refill
+    val probe       = Bool() // Only translates and checks the write permission. The line is not accessed, it never misses
+    val line        = Bool() // Whole cache line access, the data goes through readLine/writeLine
+    val cmo         = UInt(3.W) // Cache block operation, see Cmo. Prefetches are reads, the others neither read nor write
 
     val vaddr       = UInt(apLen.W) // Virtual address or physical address for early resolves
 
@@ -42,12 +65,19 @@ class CacheResp(implicit val ccx: CCXParams) extends Bundle {
 
   val atomicRead  = Input(Bool())
   val atomicWrite = Input(Bool())
+  val amo         = Input(Bool())
+  val amoOp       = Input(UInt(5.W)) // funct5 of the AMO, writeData/writeMask hold the operand
+  val cmo         = Input(UInt(3.W)) // See Cmo
+  val probe       = Input(Bool()) // Write permission check, see CacheReq
   
   val valid               = Output(Bool()) // Previous operations result is valid
   val readData               = Output(Vec(xLenBytes, UInt(8.W))) // Read data from the cache
 
   val accessFault         = Output(Bool()) // Access fault, e.g. invalid address
   val pageFault           = Output(Bool()) // Page fault, e.g. invalid page
+  val miss                = Output(Bool()) // Non blocking request missed. Refill was started, request needs to be replayed
+  val scFail              = Output(Bool()) // atomicWrite found no reservation and did not write. SC never misses
+  val refill              = Output(Valid(UInt(apLen.W))) // Refill of the line with this physical address ended. Requests that missed on it can be replayed
 
   val rvfiPtes           = Output(Vec(3, UInt(PTESIZE.W)))
   
@@ -57,9 +87,23 @@ class CacheResp(implicit val ccx: CCXParams) extends Bundle {
   // Write data command only
   val writeData         = Input(Vec(xLenBytes, UInt(8.W)))
   val writeMask         = Input(UInt(xLenBytes.W))
+
+  // Line access only
+  val readLine          = Output(Vec(cacheLineBytes, UInt(8.W)))
+  val writeLine         = Input(Vec(cacheLineBytes, UInt(8.W)))
+  val writeLineMask     = Input(UInt(cacheLineBytes.W))
 }
 
 
+// Events of the cycle, see PerfEvents
+class CachePerf extends Bundle {
+  val hit       = Bool() // Read, write or AMO found its line
+  val miss      = Bool() // Refill ended
+  val tlbMiss   = Bool()
+  val ptwCycle  = Bool()
+  val snoop     = Bool() // Snoop of the L3 accepted
+}
+
 class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCXModule {
   /**************************************************************************/
   /* Parameters and imports                                                 */
@@ -97,6 +141,9 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
 
   val bus = IO(new Bus)
 
+  val reservationValid = IO(Output(Bool())) // To Retirement: LR reservation is held, see Reservation
+  val perf = IO(Output(new CachePerf))
+
   // TODO: PBUS: Add the peripheral bus for access that is not cached
 
   
@@ -125,6 +172,62 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
   
   val cacheWriteThrough = Module(new CacheWriteThrough)
 
+  // Stores, SCs, AMOs and cbo.zero are merged into the line in MAIN_WRITE
+  val writer = Module(new CacheWriter)
+  val s2_write = Reg(new Bundle {
+    val amo       = Bool()
+    val zero      = Bool()
+    val amoOp     = UInt(5.W)
+    val writeData = Vec(xLenBytes, UInt(8.W))
+    val writeMask = UInt(xLenBytes.W)
+    val row       = new CacheArrayResp
+  })
+  writer.io.valid       := false.B
+  writer.io.paddr       := s2_paddr
+  writer.io.amo         := s2_write.amo
+  writer.io.amoOp       := s2_write.amoOp
+  writer.io.zero        := s2_write.zero
+  writer.io.writeData   := s2_write.writeData
+  writer.io.writeMask   := s2_write.writeMask
+  writer.io.row         := s2_write.row
+  writer.io.array.ready := false.B // FIXME: Cache array arbiter
+
+  val atomicPredictor = Module(new AtomicPredictor(atomicPredictorEntriesLog2))
+  atomicPredictor.io.lookup := resp_paddr(apLen - 1, cacheLineLog2)
+  atomicPredictor.io.train.valid := false.B
+  atomicPredictor.io.train.bits := DontCare
+  val s2_trainNear = RegInit(false.B) // AMO miss: trained once the refill tells if a peer gave the line up
+
+  val farRequester = Module(new CacheFarRequester)
+  farRequester.io.req.valid := false.B
+  farRequester.io.req.bits.paddr := resp_paddr
+  farRequester.io.req.bits.amoOp := resp.amoOp
+  farRequester.io.req.bits.writeData := resp.writeData
+  farRequester.io.req.bits.writeMask := resp.writeMask
+  farRequester.io.req.bits.cmo := resp.cmo
+  // FIXME: Bus: farRequester.io.bus shares the bus with the refill and the writeback
+
+  val reservation = Module(new Reservation(ccx.core.lrscCycles))
+  reservation.io.lr.valid := false.B
+  reservation.io.lr.bits := resp_paddr(apLen - 1, cacheLineLog2)
+  reservation.io.sc.valid := false.B
+  reservation.io.sc.bits := resp_paddr(apLen - 1, cacheLineLog2)
+  // Valid victim of the refill is replaced
+  val victimMeta = meta.readwritePorts(0).readData(victimWayIdx) // FIXME: Cache array response
+  reservation.io.evict.valid := refill.io.cacheReq.fire && victimMeta.valid
+  reservation.io.evict.bits := Cat(victimMeta.ptag, getIdx(s2_paddr))
+  reservationValid := reservation.io.held
+
+  // Snoops of the L3 bank give the line up, the ones to the reserved line wait for the SC
+  val snooper = Module(new CacheSnooper)
+  snooper.io.creq <> bus.creq
+  bus.cresp <> snooper.io.cresp
+  bus.cdata <> snooper.io.cdata
+  reservation.io.snoop := snooper.io.snoop
+  snooper.io.snoopStall := reservation.io.snoopStall
+  snooper.io.array.ready := false.B // FIXME: Cache array arbiter, the snoops go first
+  snooper.io.arrayResp := DontCare
+
 
 
   /**************************************************************************/
@@ -137,6 +240,7 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
   val MAIN_REFILL = 2.U(4.W) // Refill state
   val MAIN_PTW = 3.U(4.W) // Page Table Walk state
   val MAIN_WRITE = 4.U(4.W)
+  val MAIN_FAR = 8.U(4.W) // Far AMO or cache block operation, waits for the L3 bank
 
   // TODO: Writeback: val MAIN_WRITEBACK = 5.U(4.W) // Flush state
   // TODO: Writeback: val MAIN_MAKE_UNIQUE = 6.U(4.W)
@@ -170,11 +274,19 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
   resp.valid            := false.B // Default to not valid
   resp.accessFault      := false.B // Default to no access fault
   resp.pageFault        := false.B // Default to no page fault
+  resp.miss             := false.B // Default to no miss. FIXME: Non blocking requests: respond with miss instead of waiting for the refill
+  resp.scFail           := false.B
 
   bus.req.valid        := false.B
   bus.req.bits         := 0.U.asTypeOf(bus.req.bits.cloneType)
   bus.resp.ready         := false.B
 
+  perf.hit              := false.B
+  perf.miss             := refill.io.cplt // PTW refills included
+  perf.tlbMiss          := false.B
+  perf.ptwCycle         := mainState === MAIN_PTW
+  perf.snoop            := snooper.io.creq.fire
+
 
   // FIXME: bus.ar.bits.addr    := Cat(resp_paddr).asSInt
 
@@ -209,6 +321,7 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
   val cacheHits = meta.readwritePorts(0).readData.zip(validreadData.asBools).map {case (entry, valid) => valid && entry.ptag === getPtag(resp_paddr)}
   val cacheHit = VecInit(cacheHits).asUInt.orR
   val cacheHitIdx = PriorityEncoder(cacheHits)
+  val cacheHitUnique = cacheHit && meta.readwritePorts(0).readData(cacheHitIdx).unique
 
   when(cacheHit) {
     assert((1.U << cacheHitIdx) === VecInit(cacheHits).asUInt, "Cache can only have one entry that matches")
@@ -216,6 +329,7 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
   
   // TODO: The resp readData muxing
   resp.readData := VecInit(Seq.fill(xLenBytes)(0.U(8.W))) // Default to zero read data
+  resp.readLine := VecInit(Seq.fill(cacheLineBytes)(0.U(8.W))) // TODO: Line accesses return the whole data array row
 
   // is Core request is used to decide if we need to wait for the storage lock or not
   def storageReadRequest(vaddr: UInt, isCoreRequest: Boolean = true): Bool = {
@@ -246,11 +360,14 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
   } .elsewhen(mainState === MAIN_ACTIVE) {
     // If we writing then we cannot accept new requests
     // If it is a miss then we cannot accept new requests
+    perf.hit := !ctrl.kill && cacheHit && (resp.read || resp.write || resp.amo)
     when(ctrl.kill) {
       log(cf"MAIN: Kill")
       // The operation was killed. No need to proceed.
     }.elsewhen(!false.B && resp_vm_enabled) { // FIXME: TLB HIT
       mainState := MAIN_PTW
+      perf.hit := false.B
+      perf.tlbMiss := true.B
       log(cf"MAIN: TLBMiss")
       assert(false.B, "TLB not implemented")
     } .elsewhen(false.B /*pageFault*/) { // PageFault
@@ -261,6 +378,82 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
       log(cf"MAIN: PMA accessFault")
     } .elsewhen(false.B /*!pma.memory*/) { // Not a cacheable location
       log(cf"MAIN: PMA marks this as non memory, therefore not cacheable")
+    } .elsewhen(resp.atomicWrite) {
+      // SC never misses. Without the reservation the line can be anywhere, the SC just fails
+      reservation.io.sc.valid := true.B
+      when(reservation.io.scOk) {
+        log(cf"MAIN: SC")
+        mainState := MAIN_WRITE
+        s2_paddr := resp_paddr
+        s2_write.amo := false.B
+        s2_write.zero := false.B
+        s2_write.writeData := resp.writeData
+        s2_write.writeMask := resp.writeMask
+        s2_write.row := cacheArrayResp // FIXME: Cache array response
+      } .otherwise {
+        log(cf"MAIN: SC fail")
+        resp.scFail := true.B
+      }
+    } .elsewhen(resp.atomicRead && !cacheHitUnique) {
+      log(cf"MAIN: LR miss")
+      // The line is requested unique, so that the SC can write it without a bus transaction
+      mainState := MAIN_REFILL // FIXME: Writeback: MAIN_MAKE_UNIQUE for the shared lines
+      s2_paddr := resp_paddr
+    } .elsewhen(resp.atomicRead) {
+      log(cf"MAIN: LR")
+      reservation.io.lr.valid := true.B
+    } .elsewhen(resp.amo && atomicPredictor.io.far) {
+      log(cf"MAIN: Far AMO")
+      // Contended line: executed by the L3 bank instead of taking the line unique here
+      farRequester.io.req.valid := true.B
+      mainState := MAIN_FAR
+      s2_paddr := resp_paddr
+    } .elsewhen(resp.amo && !cacheHitUnique) {
+      log(cf"MAIN: AMO miss")
+      // The line has to be unique before it is modified. The request is replayed after the refill
+      s2_trainNear := true.B
+      mainState := MAIN_REFILL // FIXME: Writeback: MAIN_MAKE_UNIQUE for the shared lines
+      s2_paddr := resp_paddr
+    } .elsewhen(resp.amo) {
+      log(cf"MAIN: AMO")
+      // Old word is returned as the read data, the writer puts the AmoAlu result to the same word in MAIN_WRITE.
+      // The line stays locked until then, so no snoop can come in between
+      s2_write.amo := true.B
+      s2_write.zero := false.B
+      s2_write.amoOp := resp.amoOp
+      s2_write.writeData := resp.writeData
+      s2_write.writeMask := resp.writeMask
+      s2_write.row := cacheArrayResp // FIXME: Cache array response
+      atomicPredictor.io.train.valid := true.B
+      atomicPredictor.io.train.bits.line := resp_paddr(apLen - 1, cacheLineLog2)
+      atomicPredictor.io.train.bits.contended := false.B
+      mainState := MAIN_WRITE
+      s2_paddr := resp_paddr
+    } .elsewhen(resp.cmo === Cmo.ZERO) {
+      log(cf"MAIN: CBO.ZERO hit=${cacheHit}")
+      // The writer zeroes the whole line, it becomes dirty. A line that is not unique is made unique first
+      // FIXME: Writeback: MAIN_MAKE_UNIQUE with bus Invalidate instead of the refill, the line is not read
+      mainState := MAIN_WRITE
+      s2_paddr := resp_paddr
+      s2_write.amo := false.B
+      s2_write.zero := true.B
+      s2_write.row := cacheArrayResp // FIXME: Cache array response
+    } .elsewhen(Cmo.isManage(resp.cmo)) {
+      log(cf"MAIN: CBO op=${resp.cmo}, hit=${cacheHit}")
+      // Done in L3 for every core: AW CleanLine/FlushLine/InvalLine, the response waits for B.
+      // The bank snoops this cache too, the snooper returns the dirty copy and drops the line
+      farRequester.io.req.valid := true.B
+      mainState := MAIN_FAR
+      s2_paddr := resp_paddr
+      reservation.io.evict.valid := cacheHit && (resp.cmo =/= Cmo.CLEAN)
+      reservation.io.evict.bits := resp_paddr(apLen - 1, cacheLineLog2)
+    } .elsewhen(Cmo.isPrefetch(resp.cmo) && !cacheHit) {
+      log(cf"MAIN: Prefetch miss")
+      // Non-blocking: responds with miss and refills in the background, the load queue drops the entry.
+      // PREFETCH_W asks for the line unique, so the following stores do not need the upgrade
+      // FIXME: Non blocking requests: respond with miss instead of waiting for the refill
+      mainState := MAIN_REFILL // FIXME: Writeback: ReadUnique for PREFETCH_W
+      s2_paddr := resp_paddr
     } .elsewhen(resp.read && !cacheHit) {
       log(cf"MAIN: CacheMiss")
       mainState := MAIN_REFILL
@@ -270,7 +463,11 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
       log(cf"MAIN: Write")
       mainState := MAIN_WRITE
       s2_paddr := resp_paddr
-      // FIXME: Modify the cache line after write
+      s2_write.amo := false.B
+      s2_write.zero := false.B
+      s2_write.writeData := resp.writeData
+      s2_write.writeMask := resp.writeMask
+      s2_write.row := cacheArrayResp // FIXME: Cache array response
     } .elsewhen(resp.read && cacheHit) {
       log(cf"MAIN: Hit")
       // Data array Hit, TLB hit, access allowed by PMA/PMP
@@ -279,6 +476,11 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
 
     when(refill.io.cplt) {
       victimWayIdxIncrement := true.B
+      // Near AMO had to take the line back from a peer: contended
+      atomicPredictor.io.train.valid := s2_trainNear
+      atomicPredictor.io.train.bits.line := s2_paddr(apLen - 1, cacheLineLog2)
+      atomicPredictor.io.train.bits.contended := refill.io.contended
+      s2_trainNear := false.B
     }
     rdata := refill.readData
     
@@ -287,7 +489,28 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
     // Refill the cache. After refilling, we can accept new requests
     newRequestAllowed := false.B
   } .elsewhen(mainState === MAIN_WRITE) {
-
+    // Store, SC or AMO, see CacheWriter. The AMO responds with the old word
+    writer.io.valid := true.B
+    resp.readData := writer.io.readData
+    when(writer.io.needUnique) {
+      log(cf"MAIN: Write needs the line unique")
+      mainState := MAIN_REFILL // FIXME: Writeback: MAIN_MAKE_UNIQUE for the shared lines, then replay
+    } .elsewhen(writer.io.array.fire) {
+      resp.valid := true.B
+      mainState := MAIN_IDLE
+    }
+  } .elsewhen(mainState === MAIN_FAR) {
+    // Far AMO or line op. The AMO is trained with the hint of the bank, so the line goes back
+    // to near AMOs once it stops being snooped away
+    when(farRequester.io.resp.valid) {
+      resp.valid := true.B
+      resp.readData := farRequester.io.resp.bits.readData
+      resp.accessFault := farRequester.io.resp.bits.accessFault
+      atomicPredictor.io.train.valid := resp.amo
+      atomicPredictor.io.train.bits.line := s2_paddr(apLen - 1, cacheLineLog2)
+      atomicPredictor.io.train.bits.contended := farRequester.io.resp.bits.contended
+      mainState := MAIN_IDLE
+    }
   } .elsewhen(mainState === MAIN_PTW) {
     // Page Table Walk state. We wont accept new requests as we may need to return the current one.
     newRequestAllowed := false.B
@@ -296,8 +519,8 @@ class Cache()(implicit ccx: CCXParams, implicit val cp: CacheParams) extends CCX
 
   when(req.valid) {
     when(newRequestAllowed) {
-      when(req.bits.read || req.bits.write) {
-        // Read or write command
+      when(req.bits.read || req.bits.write || req.bits.probe || (req.bits.cmo =/= Cmo.NONE)) {
+        // Read, write, probe or cache block command
         
         req.ready := storageReadRequest(req.bits.vaddr)
         when(req.ready) {
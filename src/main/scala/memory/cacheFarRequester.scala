@@ -0,0 +1,116 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import armleocpu.busConst._
+import Consts._
+
+class CacheFarReq(implicit val ccx: CCXParams, implicit val bp: BusParams) extends Bundle {
+  val paddr       = UInt(bp.addrWidth.W)
+  val amoOp       = UInt(5.W) // funct5 of the AMO
+  val writeData   = Vec(xLenBytes, UInt(8.W)) // Operand
+  val writeMask   = UInt(xLenBytes.W)
+  val cmo         = UInt(3.W) // CLEAN/FLUSH/INVAL are sent as the line op instead of the AMO, see Cmo
+}
+
+class CacheFarResp(implicit val ccx: CCXParams) extends Bundle {
+  val readData    = Vec(xLenBytes, UInt(8.W)) // Word before the AMO
+  val contended   = Bool() // Other cores had to give the line up, see AtomicPredictor. AMOs only
+  val accessFault = Bool()
+}
+
+/**
+ * Far AMOs of the D-cache, executed by the L3 bank on its copy of the line, see busConst.AtomicLoad.
+ * AW carries the op and W the operand in the lanes of its word. The old line comes back on R, then B ends it.
+ * The line is not refilled here, so a contended line stays where it is.
+ * cbo.clean/flush/inval go the same way as CleanLine/FlushLine/InvalLine, AW only and then B. The bank snoops
+ * every holder of the line, this cache included, so the local copy is written back or dropped by the snooper.
+ */
+class CacheFarRequester(implicit val ccx: CCXParams, implicit val bp: BusParams) extends Module {
+  val io = IO(new Bundle {
+    val req   = Flipped(Decoupled(new CacheFarReq))
+    val resp  = Valid(new CacheFarResp)
+    val bus   = new ReadWriteBus()(bp)
+  })
+
+  require(bp.busBytes == cacheLineBytes)
+  val lineWords = cacheLineBytes / xLenBytes
+
+  val sIdle :: sSend :: sWaitR :: sWaitB :: Nil = Enum(4)
+  val state = RegInit(sIdle)
+
+  val saved     = Reg(new CacheFarReq)
+  val awDone    = RegInit(false.B)
+  val wDone     = RegInit(false.B)
+  val readData  = Reg(Vec(xLenBytes, UInt(8.W)))
+  val contended = Reg(Bool())
+  val error     = Reg(Bool())
+
+  val word = saved.paddr(cacheLineLog2 - 1, xLenBytesLog2)
+  def isLineCmo(cmo: UInt): Bool = (cmo === Cmo.CLEAN) || (cmo === Cmo.FLUSH) || (cmo === Cmo.INVAL)
+  val lineOp = isLineCmo(saved.cmo)
+
+  io.req.ready := state === sIdle
+
+  io.bus.ar.valid := false.B
+  io.bus.ar.bits  := 0.U.asTypeOf(io.bus.ar.bits)
+
+  io.bus.aw.valid       := (state === sSend) && !awDone
+  io.bus.aw.bits        := 0.U.asTypeOf(io.bus.aw.bits)
+  io.bus.aw.bits.addr   := saved.paddr
+  io.bus.aw.bits.op     := MuxLookup(saved.cmo, AtomicLoad | saved.amoOp)(Seq(
+                              Cmo.CLEAN -> CleanLine,
+                              Cmo.FLUSH -> FlushLine,
+                              Cmo.INVAL -> InvalLine))
+
+  io.bus.w.valid        := (state === sSend) && !wDone
+  io.bus.w.bits.data    := Fill(lineWords, saved.writeData.asUInt)
+  io.bus.w.bits.strb    := VecInit(Seq.tabulate(lineWords)(i => Mux(word === i.U, saved.writeMask, 0.U(xLenBytes.W)))).asUInt
+  io.bus.w.bits.last    := true.B
+
+  io.bus.r.ready := state === sWaitR
+  io.bus.b.ready := state === sWaitB
+
+  io.resp.valid             := (state === sWaitB) && io.bus.b.valid
+  io.resp.bits.readData     := readData
+  io.resp.bits.contended    := contended
+  io.resp.bits.accessFault  := error || (io.bus.b.bits.resp(1, 0) =/= OKAY)
+
+  switch(state) {
+    is(sIdle) {
+      when(io.req.valid) {
+        saved     := io.req.bits
+        awDone    := false.B
+        wDone     := isLineCmo(io.req.bits.cmo) // No W beat
+        contended := false.B
+        error     := false.B
+        state     := sSend
+      }
+    }
+    is(sSend) {
+      when(io.bus.aw.fire) {
+        awDone := true.B
+      }
+      when(io.bus.w.fire) {
+        wDone := true.B
+      }
+      when((awDone || io.bus.aw.fire) && (wDone || io.bus.w.fire)) {
+        state := Mux(lineOp, sWaitB, sWaitR)
+      }
+    }
+    is(sWaitR) {
+      when(io.bus.r.valid) {
+        readData  := io.bus.r.bits.data.asTypeOf(Vec(lineWords, UInt(xLen.W)))(word).asTypeOf(readData)
+        contended := io.bus.r.bits.resp(SNOOPEDBITNUM)
+        error     := io.bus.r.bits.resp(1, 0) =/= OKAY
+        state     := sWaitB
+      }
+    }
+    is(sWaitB) {
+      when(io.bus.b.valid) {
+        state := sIdle
+      }
+    }
+  }
+}
@@ -0,0 +1,54 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+import Consts._
+
+// Shares one cache port between several clients.
+// Response phase commands are taken from the client that issued the request.
+class CachePortArbiter(numClients: Int)(implicit ccx: CCXParams) extends Module {
+  val io = IO(new Bundle {
+    val inReq   = Vec(numClients, Flipped(new CacheReq))
+    val inResp  = Vec(numClients, new CacheResp)
+
+    val outReq  = new CacheReq
+    val outResp = Flipped(new CacheResp)
+  })
+
+  val arb = Module(new RRArbiter(chiselTypeOf(io.outReq.bits), numClients))
+  for (i <- 0 until numClients) {
+    arb.io.in(i) <> io.inReq(i)
+  }
+  io.outReq <> arb.io.out
+
+  // Track which client should get the response
+  val respDest = RegEnable(arb.io.chosen, io.outReq.fire)
+  val src = io.inResp(respDest)
+
+  io.outResp.read         := src.read
+  io.outResp.write        := src.write
+  io.outResp.atomicRead   := src.atomicRead
+  io.outResp.atomicWrite  := src.atomicWrite
+  io.outResp.amo          := src.amo
+  io.outResp.amoOp        := src.amoOp
+  io.outResp.cmo          := src.cmo
+  io.outResp.probe        := src.probe
+  io.outResp.writeData    := src.writeData
+  io.outResp.writeMask    := src.writeMask
+  io.outResp.writeLine    := src.writeLine
+  io.outResp.writeLineMask := src.writeLineMask
+
+  // Deliver response
+  for (i <- 0 until numClients) {
+    io.inResp(i).valid        := io.outResp.valid && (respDest === i.U)
+    io.inResp(i).readData     := io.outResp.readData
+    io.inResp(i).readLine     := io.outResp.readLine
+    io.inResp(i).accessFault  := io.outResp.accessFault
+    io.inResp(i).pageFault    := io.outResp.pageFault
+    io.inResp(i).miss         := io.outResp.miss
+    io.inResp(i).scFail       := io.outResp.scFail
+    io.inResp(i).rvfiPtes     := io.outResp.rvfiPtes
+    // Every client is woken up by the refill, not only the one that owns the response
+    io.inResp(i).refill       := io.outResp.refill
+  }
+}
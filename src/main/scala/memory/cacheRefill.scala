@@ -31,6 +31,7 @@ class CacheRefill(implicit val ccx: CCXParams, implicit val cp: CacheParams) ext
     val cplt  = Output(Bool())
     val readData = Vec(xLenBytes, UInt(8.W)) // Preemptive response to be returned to requesting cache
     val err   = Output(Bool())
+    val contended = Output(Bool()) // Other cores had to give the line up, see busConst.SNOOPEDBITNUM
     //val bus   = new Bus
 
     val victimWayIdx = Input(UInt(cp.waysLog2.W))
@@ -41,6 +42,8 @@ class CacheRefill(implicit val ccx: CCXParams, implicit val cp: CacheParams) ext
   val metaWdata = Wire(new CacheMeta)
   metaWdata.ptag := getPtag(io.physicalAddr)
   metaWdata.valid := true.B
+  metaWdata.dirty := false.B
+  metaWdata.unique := false.B // TODO: Writeback: ReadUnique refills
 
   
   /**************************************************************************/
@@ -48,6 +51,7 @@ class CacheRefill(implicit val ccx: CCXParams, implicit val cp: CacheParams) ext
   /**************************************************************************/
   io.cplt := false.B
   io.err := false.B
+  io.contended := io.bus.resp.bits.resp(SNOOPEDBITNUM)
 
   /**************************************************************************/
   /*  Primary logic                                                         */
@@ -25,6 +25,8 @@ class CacheReset(implicit val ccx: CCXParams, implicit val cp: CacheParams) exte
   val invalidMeta = Wire(Vec(wayCount, new CacheMeta))
   for (w <- 0 until wayCount) {
     invalidMeta(w).valid  := false.B
+    invalidMeta(w).dirty  := false.B
+    invalidMeta(w).unique := false.B
     invalidMeta(w).ptag   := "hDDEADDEADBEEF".U
   }
 
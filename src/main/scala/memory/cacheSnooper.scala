@@ -0,0 +1,101 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import armleocpu.busConst._
+import Consts._
+
+/**
+ * Snoops of the L3 bank to the D-cache. ReadUnique and Invalidate both give the local copy up,
+ * a dirty copy is returned on cdata. Snoops to the reserved line wait while its LR/SC window is open
+ * and clear the reservation once they take the line, see Reservation.
+ */
+class CacheSnooper(implicit val ccx: CCXParams, implicit val cp: CacheParams, implicit val bp: BusParams) extends Module {
+  import CacheUtils._
+
+  val io = IO(new Bundle {
+    val creq        = Flipped(Decoupled(new CoherenceRequest))
+    val cresp       = Decoupled(new CoherenceResponse)
+    val cdata       = Decoupled(new CoherenceData)
+
+    val snoop       = Output(Valid(UInt((apLen - cacheLineLog2).W))) // To Reservation
+    val snoopStall  = Input(Bool())
+
+    val array       = Decoupled(new CacheArrayReq)
+    val arrayResp   = Input(Valid(new CacheArrayResp))
+  })
+
+  require(bp.busBytes == cacheLineBytes)
+  val lineBytes = 1 << cacheLineLog2
+
+  val sIdle :: sLookup :: sInvalidate :: sResp :: sData :: Nil = Enum(5)
+  val state = RegInit(sIdle)
+
+  val paddr   = Reg(UInt(apLen.W))
+  val dirty   = Reg(Bool())
+  val hitIdx  = Reg(UInt(cp.waysLog2.W))
+  val data    = Reg(Vec(lineBytes, UInt(8.W)))
+
+  val reqAddr = io.creq.bits.addr(bp.addrWidth - 1, cacheLineLog2)
+
+  io.snoop.valid  := (state === sIdle) && io.creq.valid
+  io.snoop.bits   := reqAddr
+
+  io.array.valid  := false.B
+  io.array.bits   := 0.U.asTypeOf(io.array.bits)
+  io.array.bits.addr := paddr
+
+  io.creq.ready   := false.B
+
+  io.cresp.valid  := state === sResp
+  io.cresp.bits.resp := Mux(dirty, (1.U << RETURNDATABITNUM) | (1.U << DIRTYBITNUM), 0.U)
+
+  io.cdata.valid  := state === sData
+  io.cdata.bits.data := data.asUInt
+
+  val hits        = io.arrayResp.bits.metaRdata.map(m => m.valid && (m.ptag === getPtag(paddr)))
+  val hit         = VecInit(hits).asUInt.orR
+  val lookupIdx   = PriorityEncoder(hits)
+
+  switch(state) {
+    is(sIdle) {
+      // Reserved line waits for the SC
+      when(io.creq.valid && !io.snoopStall) {
+        io.array.valid := true.B
+        io.array.bits.addr := Cat(reqAddr, 0.U(cacheLineLog2.W))
+        io.creq.ready := io.array.ready
+        when(io.array.ready) {
+          paddr := Cat(reqAddr, 0.U(cacheLineLog2.W))
+          state := sLookup
+        }
+      }
+    }
+    is(sLookup) {
+      when(io.arrayResp.valid) {
+        dirty   := hit && io.arrayResp.bits.metaRdata(lookupIdx).dirty
+        hitIdx  := lookupIdx
+        data    := VecInit(Seq.tabulate(lineBytes)(b => io.arrayResp.bits.dataRdata(Cat(lookupIdx, b.U(cacheLineLog2.W)))))
+        state   := Mux(hit, sInvalidate, sResp)
+      }
+    }
+    is(sInvalidate) {
+      io.array.valid := true.B
+      io.array.bits.metaWrite := true.B
+      io.array.bits.metaMask := UIntToOH(hitIdx, cp.ways)
+      when(io.array.ready) {
+        state := sResp
+      }
+    }
+    is(sResp) {
+      when(io.cresp.ready) {
+        state := Mux(dirty, sData, sIdle)
+      }
+    }
+    is(sData) {
+      when(io.cdata.ready) {
+        state := sIdle
+      }
+    }
+  }
+}
@@ -0,0 +1,65 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+import Consts._
+
+/**
+ * Write stage of the D-cache, one cycle after the array read of the request.
+ * Merges the store, SC or AMO into its word of the hit way. Lines are written only while they are held unique,
+ * otherwise needUnique is set and nothing is written: the line is made unique and the request is replayed.
+ * The written line becomes dirty. AMOs return the old word as the read data and write the AmoAlu result.
+ * cbo.zero writes zeros to the whole line instead, the line was made unique the same way.
+ */
+class CacheWriter(implicit val ccx: CCXParams, implicit val cp: CacheParams) extends Module {
+  import CacheUtils._
+
+  val io = IO(new Bundle {
+    val valid       = Input(Bool())
+    val paddr       = Input(UInt(apLen.W))
+    val amo         = Input(Bool())
+    val amoOp       = Input(UInt(5.W)) // funct5 of the AMO
+    val zero        = Input(Bool()) // cbo.zero: whole line, writeData/writeMask are ignored
+    val writeData   = Input(Vec(xLenBytes, UInt(8.W)))
+    val writeMask   = Input(UInt(xLenBytes.W))
+    val row         = Input(new CacheArrayResp) // Array read of the paddr set
+
+    val needUnique  = Output(Bool()) // Missed or the line is shared: nothing is written
+    val readData    = Output(Vec(xLenBytes, UInt(8.W))) // Word before the write
+    val array       = Decoupled(new CacheArrayReq)
+  })
+
+  val lineBytes   = 1 << cacheLineLog2
+
+  val hits        = io.row.metaRdata.map(m => m.valid && (m.ptag === getPtag(io.paddr)))
+  val hit         = VecInit(hits).asUInt.orR
+  val hitIdx      = PriorityEncoder(hits)
+  val hitMeta     = io.row.metaRdata(hitIdx)
+  val writable    = hit && hitMeta.unique
+
+  val wordIdx     = io.paddr(cacheLineLog2 - 1, xLenBytesLog2)
+  val old         = VecInit(Seq.tabulate(xLenBytes)(b => io.row.dataRdata(Cat(hitIdx, wordIdx, b.U(xLenBytesLog2.W)))))
+
+  val amoAlu = Module(new AmoAlu)
+  amoAlu.io.op    := io.amoOp
+  amoAlu.io.mask  := io.writeMask
+  amoAlu.io.old   := old.asUInt
+  amoAlu.io.src   := io.writeData.asUInt
+  val word        = Mux(io.amo, amoAlu.io.out, io.writeData.asUInt)
+
+  io.needUnique   := io.valid && !writable
+  io.readData     := old
+
+  val dirtyMeta   = WireDefault(hitMeta)
+  dirtyMeta.dirty := true.B
+
+  io.array.valid            := io.valid && writable
+  io.array.bits.addr        := io.paddr
+  io.array.bits.metaWrite   := true.B
+  io.array.bits.metaWdata   := VecInit(Seq.fill(cp.ways)(dirtyMeta))
+  io.array.bits.metaMask    := UIntToOH(hitIdx, cp.ways)
+  io.array.bits.dataWrite   := true.B
+  io.array.bits.dataWayIdx  := hitIdx
+  io.array.bits.dataWdata   := VecInit(Seq.tabulate(lineBytes)(b => Mux(io.zero, 0.U, word(8 * (b % xLenBytes) + 7, 8 * (b % xLenBytes)))))
+  io.array.bits.dataMask    := VecInit(Seq.tabulate(lineBytes)(b => io.zero || ((wordIdx === (b / xLenBytes).U) && io.writeMask(b % xLenBytes))))
+}
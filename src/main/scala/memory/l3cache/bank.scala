@@ -29,12 +29,7 @@ class Bank(implicit ccx: CCXParams, implicit val bp: BusParams) extends CCXModul
   io.down.ar.valid := false.B
   io.down.ar.bits  := 0.U.asTypeOf(io.down.ar.bits)
   io.down.r.ready  := true.B
-
-  io.down.aw.valid := false.B
-  io.down.aw.bits  := 0.U.asTypeOf(io.down.aw.bits)
-  io.down.w.valid  := false.B
-  io.down.w.bits   := 0.U.asTypeOf(io.down.w.bits)
-  io.down.b.ready  := true.B
+  // Write channels are driven by the writebacker
 
   for (idx <- 0 until ccx.coreCount) {
     io.up(idx).creq.bits := DontCare
@@ -46,10 +41,9 @@ class Bank(implicit ccx: CCXParams, implicit val bp: BusParams) extends CCXModul
     io.up(idx).b.bits := DontCare
     io.up(idx).b.bits.resp := OKAY
 
-
-    awArb.io.in(idx) <> io.up(idx).aw
-    arArb.io.in(idx) <> io.up(idx).ar
-
+    io.up(idx).r.valid := false.B
+    io.up(idx).r.bits := DontCare
+    io.up(idx).w.ready := false.B
   }
 
 
@@ -65,18 +59,50 @@ class Bank(implicit ccx: CCXParams, implicit val bp: BusParams) extends CCXModul
   val snoopResponse = Module(new SnoopResponse)
   val victimAvailability = Module(new VictimAvailability)
   val victimSelection = Module(new VictimSelection)
+  val amoAlu = Module(new AmoAlu)
+  val writebacker = Module(new Writebacker)
 
   /**************************************************************************/
   /* Default submodule IO                                                   */
   /**************************************************************************/
 
   victimAvailability.io.lookup.entries := dataArray.io.resp.bits.rdata
+  victimSelection.io.command.increment := false.B
+  victimSelection.io.command.clear := false.B
+
+  for (idx <- 0 until ccx.coreCount) {
+    awArb.io.in(idx) <> io.up(idx).aw
+    arArb.io.in(idx) <> io.up(idx).ar
+  }
+  awArb.io.out.ready := false.B
+  arArb.io.out.ready := false.B
+
+  dataArray.io.req.valid := false.B
+  dataArray.io.req.bits := 0.U.asTypeOf(dataArray.io.req.bits)
 
+  // Snoop modules stay idle until a request branch starts them
+  snoopRequest.io.command.valid := false.B
+  snoopRequest.io.command.bits := DontCare
+  snoopResponse.io.command.valid := false.B
+  snoopResponse.io.command.bits := DontCare
   for (idx <- 0 until ccx.coreCount) {
-    awArb.io.out.ready := false.B
-    arArb.io.out.ready := false.B
+    io.up(idx).creq <> snoopRequest.io.creq(idx)
+    snoopResponse.io.cresp(idx) <> io.up(idx).cresp
+    snoopResponse.io.cdata(idx) <> io.up(idx).cdata
   }
 
+  amoAlu.io := DontCare
+
+  // Writes to downstream are the dirty victims and the cache block operations
+  writebacker.io.req.valid := false.B
+  writebacker.io.req.bits := DontCare
+  io.down.aw <> writebacker.io.down.aw
+  io.down.w <> writebacker.io.down.w
+  writebacker.io.down.b <> io.down.b
+  writebacker.io.down.ar.ready := false.B
+  writebacker.io.down.r.valid := false.B
+  writebacker.io.down.r.bits := DontCare
+
 
 
   /**************************************************************************/
@@ -96,6 +122,40 @@ class Bank(implicit ccx: CCXParams, implicit val bp: BusParams) extends CCXModul
   val state       = RegInit(init)
   val activeReq   = RegInit(0.U.asTypeOf(new Req))
 
+  // Entry the request works on: the hit entry or the victim, updated by the snooped and refilled data.
+  // The line before the AMO for the R response
+  val lineEntry   = Reg(new Entry(bp.addrWidth - ccx.l3.cacheEntriesLog2 - cacheLineLog2))
+  val lineWay     = Reg(UInt(ccx.l3.cacheWaysLog2.W))
+  val lineSnooped = RegInit(0.U(ccx.coreCount.W)) // Other cores that gave the line up for this request
+  val amoOld      = Reg(UInt((cacheLineBytes * 8).W))
+
+  val requester   = UIntToOH(activeReq.core, ccx.coreCount)
+
+  def snoop(addr: UInt, targets: UInt, invalidate: Bool): Unit = {
+    snoopRequest.io.command.valid := true.B
+    snoopRequest.io.command.bits.addr := addr
+    snoopRequest.io.command.bits.targets := targets
+    snoopRequest.io.command.bits.invalidate := invalidate
+    snoopResponse.io.command.valid := true.B
+    snoopResponse.io.command.bits.targets := targets
+  }
+
+  // A unique holder returns its dirty copy
+  def mergeSnooped(): Unit = {
+    when(snoopResponse.io.status.hasData) {
+      lineEntry.data := snoopResponse.io.status.data
+      lineEntry.dirty := lineEntry.dirty || snoopResponse.io.status.dirty.orR
+    }
+  }
+
+  def writeLine(entry: Entry): Unit = {
+    dataArray.io.req.valid := true.B
+    dataArray.io.req.bits.addr := activeReq.addr
+    dataArray.io.req.bits.write := true.B
+    dataArray.io.req.bits.wayMask := UIntToOH(lineWay, 1 << ccx.l3.cacheWaysLog2)
+    dataArray.io.req.bits.wdata := entry
+  }
+
 
 
   /**************************************************************************/
@@ -130,17 +190,21 @@ class Bank(implicit ccx: CCXParams, implicit val bp: BusParams) extends CCXModul
       activeReq.core := awArb.io.chosen
       activeReq.addr := io.up(awArb.io.chosen).aw.bits.addr
       activeReq.op := io.up(awArb.io.chosen).aw.bits.op
+      activeReq.id := io.up(awArb.io.chosen).aw.bits.id
+      awArb.io.out.ready := true.B
 
       dataArray.io.req.valid := true.B
       dataArray.io.req.bits.addr := io.up(awArb.io.chosen).aw.bits.addr
 
       state := rResponseAnalysis
 
-      log(cf"Processing write from upstream ${arArb.io.chosen}")
+      log(cf"Processing write from upstream ${awArb.io.chosen}")
     } .elsewhen(arArb.io.out.valid) {
       activeReq.core    := arArb.io.chosen
       activeReq.addr    := io.up(arArb.io.chosen).ar.bits.addr
       activeReq.op      := io.up(arArb.io.chosen).ar.bits.op
+      activeReq.id      := io.up(arArb.io.chosen).ar.bits.id
+      arArb.io.out.ready := true.B
 
       dataArray.io.req.valid := true.B
       dataArray.io.req.bits.addr := io.up(arArb.io.chosen).ar.bits.addr
@@ -148,28 +212,213 @@ class Bank(implicit ccx: CCXParams, implicit val bp: BusParams) extends CCXModul
       state := rResponseAnalysis
 
       log(cf"Processing read from upstream ${arArb.io.chosen}")
-    } .otherwise { // Voluntary eviction of dirty sections
-      state := evict
-      // TODO: Implement
-      // returnState := idle
     }
+    // TODO: Voluntary eviction of the dirty lines while idle
   } .elsewhen(state === rResponseAnalysis) {
     // Cache array results are available
-
-
     assert(dataArray.io.resp.valid)
 
-    when (!dataArray.io.resp.bits.hit) {
+    val hitEntry = dataArray.io.resp.bits.rdata(dataArray.io.resp.bits.hitIdx)
+    lineEntry := hitEntry
+    lineWay := dataArray.io.resp.bits.hitIdx
+    lineSnooped := 0.U
+
+    when(isLineOp(activeReq.op)) {
+      // Cache block operation. Every core that holds the line gives it up, a unique holder returns its dirty copy.
+      // A miss has nothing to do: the L3 is inclusive, so no copy above it exists either
+      when(!dataArray.io.resp.bits.hit) {
+        state := cRespond
+      } .elsewhen(hitEntry.sharer =/= 0.U) {
+        snoop(activeReq.addr, hitEntry.sharer, activeReq.op === InvalLine)
+        state := cSnoop
+      } .otherwise {
+        state := cUpdate
+      }
+      log(cf"Line op=${activeReq.op} addr=0x${activeReq.addr}%x, hit=${dataArray.io.resp.bits.hit}, sharer=0x${hitEntry.sharer}%x")
+    } .elsewhen (!dataArray.io.resp.bits.hit) {
+      // The line is refilled from downstream first. Nobody above holds it, so no snoop is needed afterwards.
+      // The victim is a way that is free, or clean and not held above. Otherwise the round robin victim
+      // is taken back from its holders and written back if dirty
+      val victimWay = victimSelection.io.status.victimWay
+      val victim = dataArray.io.resp.bits.rdata(victimWay)
       when(victimAvailability.io.result.available) {
-        // TODO: If non dirty victim available, then select it.
+        lineWay := victimAvailability.io.result.availableIdx
+        state := rRefillStart
+      } .otherwise {
+        lineEntry := victim
+        lineWay := victimWay
+        victimSelection.io.command.increment := true.B
+        when(victim.sharer =/= 0.U) {
+          snoop(Cat(victim.tag, getCacheEntryIdx(activeReq.addr), 0.U(cacheLineLog2.W)), victim.sharer, !victim.unique)
+          state := evict
+        } .otherwise {
+          state := wChooseVictim
+        }
+      }
+      log(cf"Miss op=${activeReq.op} addr=0x${activeReq.addr}%x, available=${victimAvailability.io.result.available}, victim=${victimWay}")
+    } .elsewhen(isAtomicLoad(activeReq.op)) {
+      // Far AMO. The line is not migrated to the requester: only the cores that hold it are snooped,
+      // a unique holder returns its dirty copy. Nobody holds it afterwards, so the next far AMO needs no snoop
+      when(hitEntry.sharer =/= 0.U) {
+        snoop(activeReq.addr, hitEntry.sharer, !hitEntry.unique)
+        lineSnooped := hitEntry.sharer & ~requester
+        state := aSnoop
+      } .otherwise {
+        state := aExecute
+      }
+      log(cf"Far AMO addr=0x${activeReq.addr}%x, sharer=0x${hitEntry.sharer}%x, unique=${hitEntry.unique}")
+    } .elsewhen((activeReq.op === ReadShared) || (activeReq.op === ReadUnique)) {
+      // Other holders give the line up when it is requested unique or one of them holds it unique
+      val others = hitEntry.sharer & ~requester
+      when((others =/= 0.U) && ((activeReq.op === ReadUnique) || hitEntry.unique)) {
+        snoop(activeReq.addr, others, !hitEntry.unique)
+        lineSnooped := others
+        state := rSnoop
       } .otherwise {
-        // TODO: Otherwise go to bus read request.
-        io.down.ar.bits.addr := activeReq.addr
-        //io.down.ar.bits.op   := 
+        state := rStorageUpdate
       }
+      log(cf"Read op=${activeReq.op} addr=0x${activeReq.addr}%x, sharer=0x${hitEntry.sharer}%x, unique=${hitEntry.unique}")
     } .otherwise {
-      // TODO: If owned by current level, return it.
-      // TODO: If owned by level above (e.g. L1 or L2) then send a 
+      // TODO: WriteBack of the dirty lines from the cores
+    }
+  } .elsewhen(state === evict) {
+    // Holders of the victim give it up, the L3 is inclusive
+    when(snoopResponse.io.status.done) {
+      mergeSnooped()
+      state := wChooseVictim
+    }
+  } .elsewhen(state === wChooseVictim) {
+    // Writebacker keeps its own copy of the victim
+    writebacker.io.req.valid := lineEntry.dirty
+    writebacker.io.req.bits.addr := activeReq.addr
+    writebacker.io.req.bits.entry := lineEntry
+    state := Mux(lineEntry.dirty, wWaitB, rRefillStart)
+  } .elsewhen(state === wWaitB) {
+    when(writebacker.io.resp.valid) {
+      state := rRefillStart
+    }
+  } .elsewhen(state === rRefillStart) {
+    io.down.ar.valid := true.B
+    io.down.ar.bits.addr := Cat(activeReq.addr(bp.addrWidth - 1, cacheLineLog2), 0.U(cacheLineLog2.W))
+    io.down.ar.bits.op := ReadOnce
+    when(io.down.ar.ready) {
+      state := rWaitR
+    }
+  } .elsewhen(state === rWaitR) {
+    when(io.down.r.valid) {
+      lineEntry.tag := getCacheTag(activeReq.addr)
+      lineEntry.valid := true.B
+      lineEntry.dirty := false.B
+      lineEntry.unique := false.B
+      lineEntry.sharer := 0.U
+      lineEntry.data := io.down.r.bits.data
+      state := Mux(isAtomicLoad(activeReq.op), aExecute, rStorageUpdate)
+      log(cf"Refilled addr=0x${activeReq.addr}%x, way=${lineWay}")
+    }
+  } .elsewhen(state === rSnoop) {
+    when(snoopResponse.io.status.done) {
+      mergeSnooped()
+      lineEntry.sharer := lineEntry.sharer & ~lineSnooped
+      lineEntry.unique := false.B
+      state := rStorageUpdate
+    }
+  } .elsewhen(state === rStorageUpdate) {
+    // ReadUnique leaves the requester as the only holder
+    val unique = activeReq.op === ReadUnique
+    val entry = WireDefault(lineEntry)
+    entry.unique := unique
+    entry.sharer := Mux(unique, requester, lineEntry.sharer | requester)
+
+    val r = io.up(activeReq.core).r
+    r.valid := true.B
+    r.bits.data := lineEntry.data
+    r.bits.resp := OKAY | (unique << UNIQUEBITNUM) | ((lineSnooped =/= 0.U) << SNOOPEDBITNUM)
+    r.bits.id := activeReq.id
+    r.bits.last := true.B
+    when(r.ready) {
+      writeLine(entry)
+      state := idle
+      log(cf"Read done addr=0x${activeReq.addr}%x, unique=${unique}")
+    }
+  } .elsewhen(state === aSnoop) {
+    when(snoopResponse.io.status.done) {
+      mergeSnooped()
+      state := aExecute
+    }
+  } .elsewhen(state === cSnoop) {
+    when(snoopResponse.io.status.done) {
+      mergeSnooped()
+      state := cUpdate
+    }
+  } .elsewhen(state === cUpdate) {
+    // Nobody above holds the line anymore. Clean keeps it, Flush and Inval remove it
+    val writeback = lineEntry.dirty && (activeReq.op =/= InvalLine)
+    val entry = WireDefault(lineEntry)
+    entry.valid := activeReq.op === CleanLine
+    entry.dirty := false.B
+    entry.unique := false.B
+    entry.sharer := 0.U
+    writeLine(entry)
+
+    // Writebacker keeps its own copy of the entry
+    writebacker.io.req.valid := writeback
+    writebacker.io.req.bits.addr := activeReq.addr
+    writebacker.io.req.bits.entry := lineEntry
+    state := Mux(writeback, cWriteback, cRespond)
+  } .elsewhen(state === cWriteback) {
+    when(writebacker.io.resp.valid) {
+      state := cRespond
+    }
+  } .elsewhen(state === cRespond) {
+    val b = io.up(activeReq.core).b
+    b.valid := true.B
+    b.bits.id := activeReq.id
+    when(b.ready) {
+      state := idle
+      log(cf"Line op done addr=0x${activeReq.addr}%x")
+    }
+  } .elsewhen(state === aExecute) {
+    // The operand is in its lanes of the W beat, the AMO modifies one word of the line
+    val w = io.up(activeReq.core).w
+    val word = activeReq.addr(cacheLineLog2 - 1, 3)
+    val words = lineEntry.data.asTypeOf(Vec(cacheLineBytes / 8, UInt(64.W)))
+    val newWords = WireDefault(words)
+
+    amoAlu.io.op := activeReq.op(4, 0)
+    amoAlu.io.mask := (w.bits.strb >> Cat(word, 0.U(3.W)))(7, 0)
+    amoAlu.io.old := words(word)
+    amoAlu.io.src := (w.bits.data >> Cat(word, 0.U(6.W)))(63, 0)
+    newWords(word) := amoAlu.io.out
+
+    w.ready := true.B
+    when(w.valid) {
+      val entry = WireDefault(lineEntry)
+      entry.data := newWords.asUInt
+      entry.dirty := true.B
+      entry.unique := false.B
+      entry.sharer := 0.U
+      writeLine(entry)
+
+      amoOld := lineEntry.data
+      state := aRespond
+    }
+  } .elsewhen(state === aRespond) {
+    val r = io.up(activeReq.core).r
+    r.valid := true.B
+    r.bits.data := amoOld
+    r.bits.resp := OKAY | ((lineSnooped =/= 0.U) << SNOOPEDBITNUM)
+    r.bits.id := activeReq.id
+    r.bits.last := true.B
+    when(r.ready) {
+      state := aWaitB
+    }
+  } .elsewhen(state === aWaitB) {
+    val b = io.up(activeReq.core).b
+    b.valid := true.B
+    b.bits.id := activeReq.id
+    when(b.ready) {
+      state := idle
+      log(cf"Far AMO done addr=0x${activeReq.addr}%x")
     }
   }
 }
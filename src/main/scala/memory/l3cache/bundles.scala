@@ -29,4 +29,5 @@ class Req(implicit val ccx: CCXParams, implicit val bp: BusParams) extends Bundl
   val addr = UInt(bp.addrWidth.W)
   val core = UInt(log2Ceil(ccx.coreCount).W)
   val op = UInt(8.W)
+  val id = UInt(bp.idWidth.W)
 }
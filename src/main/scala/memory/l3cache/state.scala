@@ -8,6 +8,8 @@ object BankState extends ChiselEnum {
       evict, // Evictition path,
       // either from encountering all-ways-dirty condition, or voluntarily. Depends on the returnState
       wChooseVictim, wWaitB, wRefillAfterEviction,  // The writeback branch
-      rSnoop, rSnoopReturn, rRefillStart, rStorageUpdate, rWaitR // The read branch (can be interrupted to service writeback)
+      rSnoop, rSnoopReturn, rRefillStart, rStorageUpdate, rWaitR, // The read branch (can be interrupted to service writeback)
+      aSnoop, aExecute, aRespond, aWaitB, // The far atomic branch
+      cSnoop, cUpdate, cWriteback, cRespond // The cache block operation branch
       = Value
 }
@@ -26,7 +26,8 @@ class VictimAvailabilityIO(implicit val ccx: CCXParams, implicit val bp: BusPara
 class VictimAvailability(implicit ccx: CCXParams, bp: BusParams) extends Module {
   val io = IO(new VictimAvailabilityIO)
 
-  val availableWays = VecInit(io.lookup.entries.map(entry => !entry.valid || (entry.valid && !entry.dirty))).asUInt
+  // Lines held above are not available, the L3 is inclusive
+  val availableWays = VecInit(io.lookup.entries.map(entry => !entry.valid || (!entry.dirty && (entry.sharer === 0.U)))).asUInt
 
   io.result.availableWays := availableWays
   io.result.available := availableWays.orR
@@ -7,6 +7,35 @@ import armleocpu.Consts._
 import Instructions._
 
 
+// Accesses that do not fit into one xLen word are split into two word accesses.
+// Each one is translated and checked separately, so they can cross a line or a page
+object MemAccess {
+  // Size from funct3 of the load/store/AMO
+  def bytesMinus1(instr: UInt): UInt = (1.U(4.W) << instr(13, 12)) - 1.U
+
+  def lastByte(vaddr: UInt, instr: UInt): UInt = vaddr + bytesMinus1(instr)
+
+  // Access continues into the next word
+  def crosses(vaddr: UInt, instr: UInt): Bool = (vaddr(log2Ceil(xLenBytes) - 1, 0) +& bytesMinus1(instr)) >= xLenBytes.U
+
+  def nextWord(vaddr: UInt): UInt = Cat(vaddr(vaddr.getWidth - 1, log2Ceil(xLenBytes)) + 1.U, 0.U(log2Ceil(xLenBytes).W))
+
+  def isLr(instr: UInt): Bool = (instr === LR_W) || (instr === LR_D)
+  def isSc(instr: UInt): Bool = (instr === SC_W) || (instr === SC_D)
+
+  // Cache block operation of the instruction, see Cmo. NONE for the data accesses
+  def cmo(instr: UInt): UInt = MuxCase(Cmo.NONE, Seq(
+    (instr === CBO_CLEAN)   -> Cmo.CLEAN,
+    (instr === CBO_FLUSH)   -> Cmo.FLUSH,
+    (instr === CBO_INVAL)   -> Cmo.INVAL,
+    (instr === CBO_ZERO)    -> Cmo.ZERO,
+    (instr === PREFETCH_R)  -> Cmo.PREFETCH_R,
+    (instr === PREFETCH_W)  -> Cmo.PREFETCH_W,
+    (instr === PREFETCH_I)  -> Cmo.PREFETCH_I,
+  ))
+}
+
+
 class StoreGen() extends Module {
   val io = IO(new Bundle{
     val vaddr = Input(UInt(avLen.W))
@@ -14,32 +43,30 @@ class StoreGen() extends Module {
 
     val in = Input(UInt(xLen.W))
 
-    val out = Output(UInt(xLen.W))
-    val mask = Output(UInt(8.W))
-    val misaligned = Output(Bool())
+    val out = Output(UInt((2 * xLen).W)) // Word at vaddr, then the next word
+    val mask = Output(UInt(16.W))
+    val misaligned = Output(Bool()) // Only SC has to be aligned, other stores are split
   })
   
   val inword_offset = io.vaddr(2, 0)
   val bitoffset = (inword_offset << 3.U)
 
-  when(io.instr === SD || io.instr === SC_D) {
-    io.mask       := "b11111111".U
-    io.out        := io.in
-    io.misaligned := inword_offset.orR
-  } .elsewhen (io.instr === SW || io.instr === SC_W) {
+  io.out := (io.in.pad(2 * xLen) << bitoffset)(2 * xLen - 1, 0)
+
+  when(io.instr === SD || io.instr === SC_D || io.instr === FSD) {
+    io.mask       := "b11111111".U << inword_offset
+    io.misaligned := (io.instr === SC_D) && inword_offset.orR
+  } .elsewhen (io.instr === SW || io.instr === SC_W || io.instr === FSW) {
     io.mask       := ("b1111".U << inword_offset)
-    io.out        := io.in >> bitoffset
-    io.misaligned := inword_offset(1, 0).orR
+    io.misaligned := (io.instr === SC_W) && inword_offset(1, 0).orR
   } .elsewhen (io.instr === SH) {
     io.mask       := ("b11".U << inword_offset)
-    io.out        := io.in >> bitoffset
-    io.misaligned := inword_offset(0).orR
+    io.misaligned := false.B
   } .elsewhen (io.instr === SB) {
     io.mask       := "b1".U  << inword_offset
-    io.out        := io.in >> bitoffset
     io.misaligned := false.B
   } .otherwise {
-    io.mask       := "b00000000".U
+    io.mask       := 0.U
     io.out        := io.in
     io.misaligned := false.B
   }
@@ -52,28 +79,74 @@ class LoadGen() extends Module {
     val instr = Input(UInt(iLen.W))
 
 		val in = Input(UInt(xLen.W))
+    val inHi = Input(UInt(xLen.W)) // Next word, used when the load crosses into it
     val out = Output(UInt(xLen.W))
-    val misaligned = Output(Bool())
+    val mask = Output(UInt(16.W)) // Bytes read from the word and the next word
+    val misaligned = Output(Bool()) // Only LR/AMO have to be aligned, other loads are split
  	})
   
   require(xLen == 64)
   val inword_offset = io.vaddr(2, 0)
 
-  val rshift  = io.in >> (inword_offset << 3.U)
+  val rshift  = Cat(io.inHi, io.in) >> (inword_offset << 3.U)
 
-  io.out := rshift
+  io.out := rshift(xLen - 1, 0)
 
   when(io.instr === LB)   {io.out := rshift( 7, 0).asSInt.pad(xLen).asUInt}
   when(io.instr === LBU)  {io.out := rshift( 7, 0).asUInt.pad(xLen)}
   when(io.instr === LH)   {io.out := rshift(15, 0).asSInt.pad(xLen).asUInt}
   when(io.instr === LHU)  {io.out := rshift(15, 0).asUInt.pad(xLen)}
   when((io.instr === LW)
-  || (io.instr === LR_W)) {io.out := rshift(31, 0).asSInt.pad(xLen).asUInt}
+  || (io.instr === AMO_W)) {io.out := rshift(31, 0).asSInt.pad(xLen).asUInt}
   when(io.instr === LWU)  {io.out := rshift(31, 0).asUInt.pad(xLen)}
+  when(io.instr === FLW)  {io.out := Cat(Fill(xLen - 32, 1.U(1.W)), rshift(31, 0))} // NaN-boxed
   
+  io.mask := "b11111111".U << inword_offset
+  when((io.instr === LB) || (io.instr === LBU))                       {io.mask := "b1".U    << inword_offset}
+  when((io.instr === LH) || (io.instr === LHU))                       {io.mask := "b11".U   << inword_offset}
+  when((io.instr === LW) || (io.instr === LWU) || (io.instr === AMO_W) || (io.instr === FLW)) {io.mask := "b1111".U << inword_offset}
+
   io.misaligned :=
-      ((io.instr === LD || io.instr === LR_D) && (inword_offset.orR)) ||
-      ((io.instr === LW || io.instr === LWU || io.instr === LR_W) && (inword_offset(1, 0).orR)) ||
-      ((io.instr === LH || io.instr === LHU) && (inword_offset(0)))
+      ((io.instr === AMO_D) && (inword_offset.orR)) ||
+      ((io.instr === AMO_W) && (inword_offset(1, 0).orR))
+
+}
+
+
+// Modify step of the AMOs, done by the D-cache on the word it read from the line.
+// The operand is in its byte lanes of the word, like the write data. The mask selects the word or the doubleword
+class AmoAlu() extends Module {
+  val io = IO(new Bundle{
+    val op = Input(UInt(5.W)) // funct5 of the AMO
+    val mask = Input(UInt(xLenBytes.W))
+    val old = Input(UInt(xLen.W))
+    val src = Input(UInt(xLen.W))
+
+    val out = Output(UInt(xLen.W)) // Whole word to write, the bytes outside of the mask keep the old value
+  })
+
+  require(xLen == 64)
+  val double = io.mask.andR
+  val high = io.mask(4)
+
+  // Words are sign extended, so the same compares work for both sizes
+  def operand(x: UInt): UInt = Mux(double, x, Mux(high, x(63, 32), x(31, 0)).asSInt.pad(xLen).asUInt)
+  val a = operand(io.old)
+  val b = operand(io.src)
+  val lt = a.asSInt < b.asSInt
+  val ltu = a < b
+
+  val result = MuxLookup(io.op, b)(Seq(
+    "b00000".U -> (a + b),          // AMOADD
+    "b00001".U -> b,                // AMOSWAP
+    "b00100".U -> (a ^ b),          // AMOXOR
+    "b01000".U -> (a | b),          // AMOOR
+    "b01100".U -> (a & b),          // AMOAND
+    "b10000".U -> Mux(lt, a, b),    // AMOMIN
+    "b10100".U -> Mux(lt, b, a),    // AMOMAX
+    "b11000".U -> Mux(ltu, a, b),   // AMOMINU
+    "b11100".U -> Mux(ltu, b, a),   // AMOMAXU
+  ))
 
+  io.out := Mux(double, result, Mux(high, Cat(result(31, 0), io.old(31, 0)), Cat(io.old(63, 32), result(31, 0))))
 }
\ No newline at end of file
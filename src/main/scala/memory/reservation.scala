@@ -0,0 +1,52 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+import Consts._
+
+/**
+ * LR/SC reservation of the hart, kept next to its D-cache.
+ * LR that hits a unique line reserves it. The reservation is lost on any SC and when the line leaves the cache,
+ * either replaced or given up to a snoop. SC succeeds only while its line is reserved; the line is then still
+ * unique, so the write completes locally without a bus transaction.
+ * For lrscCycles after the LR the snoops to the reserved line are held back, so that the SC of a constrained
+ * LR/SC loop always finds its reservation. LRs inside the window do not extend it, so a snoop waits lrscCycles at most.
+ */
+class Reservation(lrscCycles: Int)(implicit ccx: CCXParams) extends Module {
+  val io = IO(new Bundle {
+    val lr          = Input(Valid(UInt((apLen - cacheLineLog2).W))) // LR hit on a unique line
+    val sc          = Input(Valid(UInt((apLen - cacheLineLog2).W))) // SC looked up, the reservation is cleared
+    val scOk        = Output(Bool()) // io.sc line is reserved: the SC writes
+    val held        = Output(Bool()) // Any line is reserved. WRS and pause wait for it to be lost
+
+    val evict       = Input(Valid(UInt((apLen - cacheLineLog2).W))) // Line replaced
+    val snoop       = Input(Valid(UInt((apLen - cacheLineLog2).W))) // Snoop that takes the line away
+    val snoopStall  = Output(Bool()) // io.snoop has to wait, the reserved line is in its window
+  })
+
+  val valid       = RegInit(false.B)
+  val line        = Reg(UInt((apLen - cacheLineLog2).W))
+  val window      = RegInit(0.U(log2Ceil(lrscCycles + 1).W))
+
+  val snoopHit    = io.snoop.valid && valid && (io.snoop.bits === line)
+  val evictHit    = io.evict.valid && valid && (io.evict.bits === line)
+
+  io.snoopStall   := snoopHit && (window =/= 0.U)
+  io.scOk         := valid && (io.sc.bits === line)
+  io.held         := valid
+
+  when(window =/= 0.U) {
+    window := window - 1.U
+  }
+
+  when(io.lr.valid) {
+    valid   := true.B
+    line    := io.lr.bits
+    when(window === 0.U) {
+      window := lrscCycles.U
+    }
+  } .elsewhen(io.sc.valid || evictHit || (snoopHit && !io.snoopStall)) {
+    valid   := false.B
+    window  := 0.U
+  }
+}
@@ -0,0 +1,69 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+import Consts._
+
+// Zba/Zbb/Zbs. All operations are single cycle
+class ExecuteBitManipUnit(implicit ccx: CCXParams) extends ExecUnit {
+
+  out.handled := false.B
+  out.branchTaken := false.B
+  out.aluOut := 0.S
+
+  // *W operations look at the lower 32 bits of op1, *.UW ones zero extend them
+  val word    = op1(31, 0)
+  val uw      = word.pad(xLen)
+  val bit     = UIntToOH(op2(5, 0), xLen)
+
+  // A one above the top bit, so that a zero input counts all the bits
+  val clz     = Mux(dec.word, PriorityEncoder(Cat(1.U(1.W), Reverse(word))), PriorityEncoder(Cat(1.U(1.W), Reverse(op1))))
+  val ctz     = Mux(dec.word, PriorityEncoder(Cat(1.U(1.W), word)), PriorityEncoder(Cat(1.U(1.W), op1)))
+  val cpop    = Mux(dec.word, PopCount(word), PopCount(op1))
+
+  val rol     = Mux(dec.word, word.rotateLeft(op2(4, 0)).pad(xLen), op1.rotateLeft(op2(5, 0)))
+  val ror     = Mux(dec.word, word.rotateRight(op2(4, 0)).pad(xLen), op1.rotateRight(op2(5, 0)))
+
+  val bytes   = (0 until xLenBytes).map(i => op1(8 * i + 7, 8 * i))
+
+  val result  = Wire(UInt(xLen.W))
+  result := 0.U
+  switch(dec.aluOp) {
+    is(BitOp.SH1ADD)    { result := (op1 << 1)(xLen - 1, 0) + op2 }
+    is(BitOp.SH2ADD)    { result := (op1 << 2)(xLen - 1, 0) + op2 }
+    is(BitOp.SH3ADD)    { result := (op1 << 3)(xLen - 1, 0) + op2 }
+    is(BitOp.ADDUW)     { result := uw + op2 }
+    is(BitOp.SH1ADDUW)  { result := (uw << 1)(xLen - 1, 0) + op2 }
+    is(BitOp.SH2ADDUW)  { result := (uw << 2)(xLen - 1, 0) + op2 }
+    is(BitOp.SH3ADDUW)  { result := (uw << 3)(xLen - 1, 0) + op2 }
+    is(BitOp.SLLIUW)    { result := (uw << op2(5, 0))(xLen - 1, 0) }
+
+    is(BitOp.ANDN)      { result := op1 & ~op2 }
+    is(BitOp.ORN)       { result := op1 | ~op2 }
+    is(BitOp.XNOR)      { result := ~(op1 ^ op2) }
+    is(BitOp.CLZ)       { result := clz }
+    is(BitOp.CTZ)       { result := ctz }
+    is(BitOp.CPOP)      { result := cpop }
+    is(BitOp.MAX)       { result := Mux(op1.asSInt < op2.asSInt, op2, op1) }
+    is(BitOp.MAXU)      { result := Mux(op1 < op2, op2, op1) }
+    is(BitOp.MIN)       { result := Mux(op1.asSInt < op2.asSInt, op1, op2) }
+    is(BitOp.MINU)      { result := Mux(op1 < op2, op1, op2) }
+    is(BitOp.SEXTB)     { result := op1(7, 0).asSInt.pad(xLen).asUInt }
+    is(BitOp.SEXTH)     { result := op1(15, 0).asSInt.pad(xLen).asUInt }
+    is(BitOp.ZEXTH)     { result := op1(15, 0).pad(xLen) }
+    is(BitOp.ROL)       { result := rol }
+    is(BitOp.ROR)       { result := ror }
+    is(BitOp.ORCB)      { result := Cat(bytes.reverse.map(b => Fill(8, b.orR))) }
+    is(BitOp.REV8)      { result := Cat(bytes) }
+
+    is(BitOp.BCLR)      { result := op1 & ~bit }
+    is(BitOp.BEXT)      { result := (op1 >> op2(5, 0))(0) }
+    is(BitOp.BINV)      { result := op1 ^ bit }
+    is(BitOp.BSET)      { result := op1 | bit }
+  }
+
+  when(selected(ExecUnitSel.BITMANIP)) {
+    out.aluOut := Mux(dec.word, result(31, 0).asSInt.pad(xLen), result.asSInt)
+    handle("BITMANIP")
+  }
+}
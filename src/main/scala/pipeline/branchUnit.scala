@@ -2,22 +2,22 @@ package armleocpu
 
 import chisel3._
 import chisel3.util._
-import Instructions._
 
 class ExecuteBranchUnit(implicit ccx: CCXParams) extends ExecUnit {
-  val i  = in.uop.instr
   val rs1 = in.uop.rs1; val rs2 = in.uop.rs2
 
-  out.aluOut := in.uop.pc.asSInt + Cat(i(31), i(7), i(30,25), i(11,8), 0.U(1.W)).asSInt
+  out.aluOut := (in.uop.pc + dec.imm).asSInt
   out.handled := false.B
   out.branchTaken := false.B
 
+  val taken = MuxLookup(dec.aluOp, false.B)(Seq(
+    AluOp.SEQ   -> (rs1 === rs2),
+    AluOp.SNE   -> (rs1 =/= rs2),
+    AluOp.SLT   -> (rs1.asSInt <  rs2.asSInt),
+    AluOp.SGE   -> (rs1.asSInt >= rs2.asSInt),
+    AluOp.SLTU  -> (rs1 <  rs2),
+    AluOp.SGEU  -> (rs1 >= rs2),
+  ))
 
-
-       when(i === BEQ)  { out.branchTaken := (rs1 === rs2);              handle("BEQ")  }
-  .elsewhen(i === BNE)  { out.branchTaken := (rs1 =/= rs2);              handle("BNE")  }
-  .elsewhen(i === BLT)  { out.branchTaken := (rs1.asSInt <  rs2.asSInt); handle("BLT")  }
-  .elsewhen(i === BLTU) { out.branchTaken := (rs1.asUInt < rs2.asUInt);  handle("BLTU") }
-  .elsewhen(i === BGE)  { out.branchTaken := (rs1.asSInt >= rs2.asSInt); handle("BGE")  }
-  .elsewhen(i === BGEU) { out.branchTaken := (rs1.asUInt >= rs2.asUInt); handle("BGEU") }
-}
\ No newline at end of file
+  when(selected(ExecUnitSel.BRANCH)) { out.branchTaken := taken; handle("BRANCH") }
+}
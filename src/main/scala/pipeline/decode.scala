@@ -5,12 +5,20 @@ import chisel3._
 import chisel3.util._
 import chisel3.experimental.dataview._
 
+import Instructions._
 import Consts._
 
 // DECODE
-class DecodeUop extends FetchUop {
+class DecodeUop(implicit ccx: CCXParams) extends FetchUop {
   val rs1        = UInt(xLen.W)
   val rs2        = UInt(xLen.W)
+  val rs3        = UInt(xLen.W) // FP fused multiply-add only
+  val dec        = new DecodedCtrl // Predecoded control, so later stages do not match the instruction again
+  val rs1Phys    = UInt(physRegsLog2.W) // Used by the out of order back-end to wait for the operands
+  val rs2Phys    = UInt(physRegsLog2.W)
+  val rdPhys     = UInt(physRegsLog2.W) // Renamed rd
+  val rdOldPhys  = UInt(physRegsLog2.W) // Previous mapping of rd, freed when this uop retires
+  val fused      = Bool() // Two instructions fused into this uop, pc is the first one, pcPlus4 follows the second
 }
 
 
@@ -25,6 +33,10 @@ class Decode(implicit ccx: CCXParams) extends CCXModule {
   val out             = IO(DecoupledIO(new DecodeUop))
   val ctrl              = IO(new PipelineControlIO) // Pipeline command interface form control unit
   val regs_decode       = IO(Flipped(new regs_decode_io))
+  val fregs_decode      = IO(Flipped(new fregs_decode_io))
+  val stallReserve      = IO(Output(Bool())) // Uop waits for a reserved register, counted by the HPM
+  val memPending        = IO(Input(Bool()))  // Committed loads are outstanding, the reserved register may be theirs
+  val topDown           = IO(Output(UInt(3.W))) // Class of the cycle, see TopDown
 
   /**************************************************************************/
   /*                                                                        */
@@ -33,6 +45,10 @@ class Decode(implicit ccx: CCXParams) extends CCXModule {
   /**************************************************************************/
 
   val decode_uop_bits_r         = Reg(new FetchUop)
+  val decode_uop_dec_r          = Reg(new DecodedCtrl)
+  val decode_uop_rd_phys_r      = Reg(UInt(physRegsLog2.W))
+  val decode_uop_rd_old_phys_r  = Reg(UInt(physRegsLog2.W))
+  val decode_uop_fused_r        = Reg(Bool())
   val decode_uop_valid_r        = Reg(Bool())
   
   /**************************************************************************/
@@ -41,20 +57,97 @@ class Decode(implicit ccx: CCXParams) extends CCXModule {
   /*                                                                        */
   /**************************************************************************/
   val kill              = ctrl.kill || ctrl.flush || ctrl.jump
-  ctrl.busy             := out.valid
+  ctrl.busy             := decode_uop_valid_r
+  stallReserve          := false.B
+  topDown               := Mux(stallReserve, Mux(memPending, TopDown.BACKEND_MEMORY, TopDown.BACKEND_CORE), TopDown.NONE)
+
+  // Compressed instructions are expanded here, later stages only see 32-bit instructions
+  val instr             = Mux(in.bits.rvc, RvcExpander(in.bits.instr(15, 0)), in.bits.instr)
+  val decoded           = DecodeTable(instr)
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Macro-op fusion                                         */
+  /*                                                                        */
+  /**************************************************************************/
+  // The uop in the output register is merged with the next instruction, if they form a known pair.
+  // The first instruction is already renamed. Both write the same rd, so the second one is not renamed.
+  // RVFI reports one instruction per retire, so fusion is disabled with it
+  val head              = decode_uop_bits_r
+  val headDec           = decode_uop_dec_r
+  val headRd            = head.instr(11, 7)
+  val tail              = WireInit(in.bits)
+  tail.instr            := instr
+
+  // Second instruction only reads and writes the rd of the first one
+  val chained           = (tail.instr(11, 7) === headRd) && (tail.instr(19, 15) === headRd) && (headRd =/= 0.U)
+  val sequential        = (tail.pc === head.pcPlus4) &&
+                          !head.ifetchAccessFault && !head.ifetchPageFault && !tail.ifetchAccessFault && !tail.ifetchPageFault
+  val shamtMatch        = (tail.instr(25, 20) === head.instr(25, 20)) && (head.instr(25, 20) =/= 0.U)
+
+  val luiAddi           = (head.instr === LUI) && ((tail.instr === ADDI) || (tail.instr === ADDIW))  // 32-bit constant
+  val auipcAddi         = (head.instr === AUIPC) && (tail.instr === ADDI)                           // PC relative address
+  val auipcJalr         = (head.instr === AUIPC) && (tail.instr === JALR)                           // Far call
+  val slliSrli          = (head.instr === SLLI) && (tail.instr === SRLI) && shamtMatch              // Zero extension
+
+  val fuse              = (if(ccx.core.macroOpFusion && !ccx.rvfi_enabled) true.B else false.B) &&
+                          decode_uop_valid_r && !decode_uop_fused_r && in.valid && chained && sequential &&
+                          (luiAddi || auipcAddi || auipcJalr || slliSrli)
+
+  val fusedDec          = WireInit(headDec)
+  // Immediates are already sign extended, so the sum is the full constant
+  fusedDec.imm          := headDec.imm + decoded.imm
+  when(luiAddi) {
+    fusedDec.word       := decoded.word
+  }
+  when(auipcJalr) {
+    fusedDec            := decoded
+    fusedDec.op1Sel     := Op1Sel.PC
+    fusedDec.imm        := headDec.imm + decoded.imm
+  }
+  when(slliSrli) {
+    fusedDec.aluOp      := AluOp.AND
+    fusedDec.imm        := Fill(xLen, 1.U(1.W)) >> head.instr(25, 20)
+  }
 
   out.bits.viewAsSupertype(new FetchUop)   := decode_uop_bits_r
-  out.valid                                      := decode_uop_valid_r
-  out.bits.rs1                              := regs_decode.rs1.value
-  out.bits.rs2                              := regs_decode.rs2.value
+  // The uop is merged this cycle, it is sent down the next cycle
+  out.valid                                      := decode_uop_valid_r && !fuse
+  out.bits.fused                            := decode_uop_fused_r
+  out.bits.rs1                              := Mux(decode_uop_dec_r.fp.rs1, fregs_decode.rs1, regs_decode.rs1.value)
+  out.bits.rs2                              := Mux(decode_uop_dec_r.fp.rs2, fregs_decode.rs2, regs_decode.rs2.value)
+  out.bits.rs3                              := fregs_decode.rs3
+  out.bits.rs1Phys                          := regs_decode.rs1.phys
+  out.bits.rs2Phys                          := regs_decode.rs2.phys
+  out.bits.dec                              := decode_uop_dec_r
+  out.bits.rdPhys                           := decode_uop_rd_phys_r
+  out.bits.rdOldPhys                        := decode_uop_rd_old_phys_r
   in.ready                                       := false.B
-  regs_decode.instr_i                                   := in.bits.instr
+  regs_decode.instr_i                                   := instr
   regs_decode.commit                                  := false.B
-  
+  regs_decode.rd_write                                := decoded.rdWrite
+  fregs_decode.instr_i                                  := instr
+  fregs_decode.commit                                 := false.B
+  fregs_decode.fp                                     := decoded.fp
+  // FP rd is reserved when the uop leaves, so a uop killed in decode does not keep it
+  fregs_decode.reserve.valid                          := out.fire && decode_uop_dec_r.fp.rd
+  fregs_decode.reserve.bits                           := headRd
+
+  // The uop in the output register does not reserve its FP rd yet
+  val fpHeadConflict    = decode_uop_valid_r && headDec.fp.rd &&
+                          ((decoded.fp.rs1 && (instr(19, 15) === headRd)) || (decoded.fp.rs2 && (instr(24, 20) === headRd)) ||
+                           (decoded.fp.rs3 && (instr(31, 27) === headRd)) || (decoded.fp.rd && (instr(11, 7) === headRd)))
 
 
 
-  when((!out.valid) || (out.valid && out.ready)) {
+  // Kill is not part of fuse: Execute redirect depends on out.valid
+  when(fuse && !kill) {
+    in.ready                                       := true.B
+    decode_uop_bits_r.pcPlus4                      := tail.pcPlus4
+    decode_uop_dec_r                               := fusedDec
+    decode_uop_fused_r                             := true.B
+    log(cf"FUSE instr=0x${head.instr}%x, pc=0x${head.pc}%x with instr=0x${tail.instr}%x, pc=0x${tail.pc}%x")
+  } .elsewhen((!out.valid) || (out.valid && out.ready)) {
     when(in.valid && !kill) {
       // IF REGISTER not reserved, then move the Uop downs stage
       // ELSE stall
@@ -62,21 +155,34 @@ class Decode(implicit ccx: CCXParams) extends CCXModule {
       // Only send the uop down the stage if no conflict with any of rs1/rs2/rd
       // otherwise the pipeline will issue instructions with old register values
       
-      // Also RD is checked so that the register that needs to be written is overwritten
+      // RD is renamed, so it only stalls when there is no free physical register
       
-      val stall         = regs_decode.rs1.reserved || regs_decode.rs2.reserved || regs_decode.rd.reserved
+      // Out of order back-end waits for the operands in the issue queue instead
+      // FP registers are not renamed: sources and rd wait for the older writes in both back-ends
+      // Vector register and immediate fields do not wait for the integer registers with the same number
+      val rs1Int        = !decoded.fp.rs1 && !decoded.vec.vs1
+      val rs2Int        = !decoded.fp.rs2 && !decoded.vec.vs2
+      val rsStall       = if(ccx.core.outOfOrder) false.B else ((regs_decode.rs1.reserved && rs1Int) || (regs_decode.rs2.reserved && rs2Int))
+      val fpStall       = fregs_decode.reserved || fpHeadConflict
+      val stall         = rsStall || fpStall || regs_decode.rd.reserved
       
       when (!stall) {
         regs_decode.commit := true.B
+        fregs_decode.commit := true.B
         
         // FIXME: In the future do not combinationally assign
-        decode_uop_bits_r                                      := in.bits
+        decode_uop_bits_r                                      := tail
+        decode_uop_dec_r                                       := decoded
+        decode_uop_rd_phys_r                                   := regs_decode.rd.phys
+        decode_uop_rd_old_phys_r                               := regs_decode.rd.oldPhys
+        decode_uop_fused_r                                     := false.B
 
         in.ready                                   := true.B
         decode_uop_valid_r                                := true.B
         log(cf"PASS instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x")
       } .otherwise {
         log(cf"STALL RESERVE instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x")
+        stallReserve := true.B
         decode_uop_valid_r := false.B
       }
     } .otherwise {
@@ -90,7 +196,11 @@ class Decode(implicit ccx: CCXParams) extends CCXModule {
     in.ready := true.B
     decode_uop_valid_r := false.B
     log(cf"KILL")
-  } .otherwise {
-    decode_uop_valid_r := false.B
   }
+  // Otherwise the next stage is not ready: the uop is held. Its rd is already renamed
+
+  // Trace: the uop is in Decode while it waits at its input. The writer ignores the repeats.
+  // A fused tail retires with its head, it is closed here
+  kanata(in.valid && !kill, KanataTrace.STAGE, in.bits.seq, KanataTrace.DECODE)
+  kanata(fuse && !kill, KanataTrace.RETIRE, in.bits.seq, KanataTrace.DECODE)
 }
\ No newline at end of file
@@ -0,0 +1,793 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import Instructions._
+import Consts._
+
+// One-hot execution unit select. Index of the bit in DecodedCtrl.unit
+object ExecUnitSel {
+  val ALU       = 0
+  val BRANCH    = 1
+  val JUMP      = 2
+  val LOADSTORE = 3
+  val MULDIV    = 4
+  val BITMANIP  = 5
+  val FPU       = 6
+  val VECTOR    = 7 // No unit in Execute, the vector unit executes it when it reaches Retirement
+
+  val count     = 8
+
+  def apply(idx: Int): UInt = (BigInt(1) << idx).U(count.W)
+  val NONE      = 0.U(count.W)
+}
+
+// Operation of the selected unit.
+// Branches reuse the compare operations, MULDIV has its own encodings, BITMANIP uses BitOp, FPU uses FpuOp, VECTOR uses VecOp
+object AluOp {
+  val width   = 5
+
+  val ADD     = 0.U(width.W)
+  val SUB     = 1.U(width.W)
+  val AND     = 2.U(width.W)
+  val OR      = 3.U(width.W)
+  val XOR     = 4.U(width.W)
+  val SLL     = 5.U(width.W)
+  val SRL     = 6.U(width.W)
+  val SRA     = 7.U(width.W)
+  val SLT     = 8.U(width.W)
+  val SLTU    = 9.U(width.W)
+  val SEQ     = 10.U(width.W)
+  val SNE     = 11.U(width.W)
+  val SGE     = 12.U(width.W)
+  val SGEU    = 13.U(width.W)
+
+  val MUL     = 16.U(width.W)
+  val MULH    = 17.U(width.W)
+  val MULHSU  = 18.U(width.W)
+  val MULHU   = 19.U(width.W)
+  val DIV     = 20.U(width.W)
+  val DIVU    = 21.U(width.W)
+  val REM     = 22.U(width.W)
+  val REMU    = 23.U(width.W)
+
+  val X       = 0.U(width.W)
+}
+
+// Zba/Zbb/Zbs operations, in the aluOp field of the BITMANIP unit
+object BitOp {
+  val SH1ADD    = 0.U(AluOp.width.W)
+  val SH2ADD    = 1.U(AluOp.width.W)
+  val SH3ADD    = 2.U(AluOp.width.W)
+  val ADDUW     = 3.U(AluOp.width.W)
+  val SH1ADDUW  = 4.U(AluOp.width.W)
+  val SH2ADDUW  = 5.U(AluOp.width.W)
+  val SH3ADDUW  = 6.U(AluOp.width.W)
+  val SLLIUW    = 7.U(AluOp.width.W)
+
+  val ANDN      = 8.U(AluOp.width.W)
+  val ORN       = 9.U(AluOp.width.W)
+  val XNOR      = 10.U(AluOp.width.W)
+  val CLZ       = 11.U(AluOp.width.W)
+  val CTZ       = 12.U(AluOp.width.W)
+  val CPOP      = 13.U(AluOp.width.W)
+  val MAX       = 14.U(AluOp.width.W)
+  val MAXU      = 15.U(AluOp.width.W)
+  val MIN       = 16.U(AluOp.width.W)
+  val MINU      = 17.U(AluOp.width.W)
+  val SEXTB     = 18.U(AluOp.width.W)
+  val SEXTH     = 19.U(AluOp.width.W)
+  val ZEXTH     = 20.U(AluOp.width.W)
+  val ROL       = 21.U(AluOp.width.W)
+  val ROR       = 22.U(AluOp.width.W)
+  val ORCB      = 23.U(AluOp.width.W)
+  val REV8      = 24.U(AluOp.width.W)
+
+  val BCLR      = 25.U(AluOp.width.W)
+  val BEXT      = 26.U(AluOp.width.W)
+  val BINV      = 27.U(AluOp.width.W)
+  val BSET      = 28.U(AluOp.width.W)
+}
+
+// F/D operations, in the aluOp field of the FPU unit. The format is instr(25), the integer type of conversions is instr(21, 20)
+object FpuOp {
+  val FADD      = 0.U(AluOp.width.W)
+  val FSUB      = 1.U(AluOp.width.W)
+  val FMUL      = 2.U(AluOp.width.W)
+  val FMADD     = 3.U(AluOp.width.W)
+  val FMSUB     = 4.U(AluOp.width.W)
+  val FNMSUB    = 5.U(AluOp.width.W)
+  val FNMADD    = 6.U(AluOp.width.W)
+
+  val FDIV      = 7.U(AluOp.width.W)
+  val FSQRT     = 8.U(AluOp.width.W)
+
+  val FSGNJ     = 9.U(AluOp.width.W)
+  val FSGNJN    = 10.U(AluOp.width.W)
+  val FSGNJX    = 11.U(AluOp.width.W)
+  val FMIN      = 12.U(AluOp.width.W)
+  val FMAX      = 13.U(AluOp.width.W)
+  val FEQ       = 14.U(AluOp.width.W)
+  val FLT       = 15.U(AluOp.width.W)
+  val FLE       = 16.U(AluOp.width.W)
+  val FCLASS    = 17.U(AluOp.width.W)
+  val FCVTFI    = 18.U(AluOp.width.W) // FP to integer
+  val FCVTIF    = 19.U(AluOp.width.W) // Integer to FP
+  val FCVTFF    = 20.U(AluOp.width.W) // FCVT.S.D/FCVT.D.S
+  val FMVFI     = 21.U(AluOp.width.W) // FMV.X.W/FMV.X.D
+  val FMVIF     = 22.U(AluOp.width.W) // FMV.W.X/FMV.D.X
+}
+
+// Vector operations, in the aluOp field of the VECTOR unit. The operand form is instr(14, 12).
+// Reductions use the element operation with VecDecodedCtrl.red set. Loads and stores have no operation
+object VecOp {
+  val ADD       = 0.U(AluOp.width.W)
+  val SUB       = 1.U(AluOp.width.W)
+  val RSUB      = 2.U(AluOp.width.W)
+  val MINU      = 3.U(AluOp.width.W)
+  val MIN       = 4.U(AluOp.width.W)
+  val MAXU      = 5.U(AluOp.width.W)
+  val MAX       = 6.U(AluOp.width.W)
+  val AND       = 7.U(AluOp.width.W)
+  val OR        = 8.U(AluOp.width.W)
+  val XOR       = 9.U(AluOp.width.W)
+  val SLL       = 10.U(AluOp.width.W)
+  val SRL       = 11.U(AluOp.width.W)
+  val SRA       = 12.U(AluOp.width.W)
+  val MERGE     = 13.U(AluOp.width.W) // vmerge, vmv.v.* when unmasked
+  val MUL       = 14.U(AluOp.width.W)
+
+  val MSEQ      = 15.U(AluOp.width.W) // Compares write a mask
+  val MSNE      = 16.U(AluOp.width.W)
+  val MSLTU     = 17.U(AluOp.width.W)
+  val MSLT      = 18.U(AluOp.width.W)
+  val MSLEU     = 19.U(AluOp.width.W)
+  val MSLE      = 20.U(AluOp.width.W)
+  val MSGTU     = 21.U(AluOp.width.W)
+  val MSGT      = 22.U(AluOp.width.W)
+
+  val MVXS      = 23.U(AluOp.width.W) // vmv.x.s
+  val MVSX      = 24.U(AluOp.width.W) // vmv.s.x
+  val SETVL     = 25.U(AluOp.width.W) // vsetvli/vsetivli/vsetvl
+}
+
+object Op1Sel {
+  val RS1   = 0.U(2.W)
+  val PC    = 1.U(2.W)
+  val ZERO  = 2.U(2.W)
+  val X     = 0.U(2.W)
+}
+
+object ImmType {
+  val I     = 0.U(3.W)
+  val S     = 1.U(3.W)
+  val B     = 2.U(3.W)
+  val U     = 3.U(3.W)
+  val J     = 4.U(3.W)
+  val Z     = 5.U(3.W) // Zero, the atomics and the cache block operations address rs1 without an offset
+  val P     = 6.U(3.W) // Prefetch offset, I-type without the low five bits
+  val X     = 0.U(3.W)
+}
+
+object MemSize {
+  val B     = 0.U(2.W)
+  val H     = 1.U(2.W)
+  val W     = 2.U(2.W)
+  val D     = 3.U(2.W)
+  val X     = 0.U(2.W)
+}
+
+// Produced once in Decode, carried down the pipeline in DecodeUop
+class DecodedCtrl extends Bundle {
+  val illegal   = Bool() // Instruction not known to decode, Retirement raises illegal instruction
+  val unit      = UInt(ExecUnitSel.count.W) // One-hot, see ExecUnitSel
+  val aluOp     = UInt(AluOp.width.W)
+  val word      = Bool() // *W operation, result is sign extended from 32 bits
+  val op1Sel    = UInt(2.W)
+  val op2Imm    = Bool() // Second operand is the immediate instead of rs2
+  val imm       = UInt(xLen.W) // Sign extended immediate
+  val rdWrite   = Bool()
+
+  val load      = Bool()
+  val store     = Bool()
+  val memSize   = UInt(2.W)
+  val memSigned = Bool()
+
+  val fence     = Bool() // FENCE/FENCE_I/SFENCE_VMA
+
+  val fp        = new FpDecodedCtrl
+  val vec       = new VecDecodedCtrl
+}
+
+// Which operands are in the FP register file
+class FpDecodedCtrl extends Bundle {
+  val rs1       = Bool()
+  val rs2       = Bool()
+  val rs3       = Bool()
+  val rd        = Bool()
+  val rm        = Bool() // Uses the rounding mode, instr(14, 12)
+
+  def any: Bool = rs1 || rs2 || rs3 || rd
+}
+
+// Vector instructions reuse the rs1/rs2 fields for vector registers and immediates
+class VecDecodedCtrl extends Bundle {
+  val vs1       = Bool() // rs1 field is not an integer register
+  val vs2       = Bool() // rs2 field is not an integer register
+  val red       = Bool() // Reduction
+}
+
+object DecodeTable {
+  val Y = true.B
+  val N = false.B
+
+  private val UALU  = ExecUnitSel(ExecUnitSel.ALU)
+  private val UBR   = ExecUnitSel(ExecUnitSel.BRANCH)
+  private val UJMP  = ExecUnitSel(ExecUnitSel.JUMP)
+  private val ULS   = ExecUnitSel(ExecUnitSel.LOADSTORE)
+  private val UMD   = ExecUnitSel(ExecUnitSel.MULDIV)
+  private val UBM   = ExecUnitSel(ExecUnitSel.BITMANIP)
+  private val UFPU  = ExecUnitSel(ExecUnitSel.FPU)
+  private val UVEC  = ExecUnitSel(ExecUnitSel.VECTOR)
+  private val UNONE = ExecUnitSel.NONE
+
+  //                         illegal  unit       aluOp          word op1Sel       op2Imm immType     rdWrite load store memSize     memSigned fence
+  val default: List[UInt] = List(Y,  UNONE,     AluOp.X,       N,  Op1Sel.X,     N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N)
+
+  val table: Array[(BitPat, List[UInt])] = Array(
+    LUI       -> List(N,  UALU,      AluOp.ADD,     N,  Op1Sel.ZERO, Y,     ImmType.U,  Y,      N,   N,    MemSize.X,  N,        N),
+    AUIPC     -> List(N,  UALU,      AluOp.ADD,     N,  Op1Sel.PC,   Y,     ImmType.U,  Y,      N,   N,    MemSize.X,  N,        N),
+
+    ADD       -> List(N,  UALU,      AluOp.ADD,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SUB       -> List(N,  UALU,      AluOp.SUB,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    AND       -> List(N,  UALU,      AluOp.AND,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    OR        -> List(N,  UALU,      AluOp.OR,      N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    XOR       -> List(N,  UALU,      AluOp.XOR,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SLL       -> List(N,  UALU,      AluOp.SLL,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SRL       -> List(N,  UALU,      AluOp.SRL,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SRA       -> List(N,  UALU,      AluOp.SRA,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SLT       -> List(N,  UALU,      AluOp.SLT,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SLTU      -> List(N,  UALU,      AluOp.SLTU,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+
+    ADDW      -> List(N,  UALU,      AluOp.ADD,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SUBW      -> List(N,  UALU,      AluOp.SUB,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SLLW      -> List(N,  UALU,      AluOp.SLL,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SRLW      -> List(N,  UALU,      AluOp.SRL,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SRAW      -> List(N,  UALU,      AluOp.SRA,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+
+    ADDI      -> List(N,  UALU,      AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    ANDI      -> List(N,  UALU,      AluOp.AND,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    // Prefetch hints are ORI with rd = 0, so they go first. A load that does not write rd, see MemAccess.cmo
+    PREFETCH_I-> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.P,  N,      Y,   N,    MemSize.X,  N,        N),
+    PREFETCH_R-> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.P,  N,      Y,   N,    MemSize.X,  N,        N),
+    PREFETCH_W-> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.P,  N,      Y,   N,    MemSize.X,  N,        N),
+    ORI       -> List(N,  UALU,      AluOp.OR,      N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    XORI      -> List(N,  UALU,      AluOp.XOR,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    SLTI      -> List(N,  UALU,      AluOp.SLT,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    SLTIU     -> List(N,  UALU,      AluOp.SLTU,    N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    SLLI      -> List(N,  UALU,      AluOp.SLL,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    SRLI      -> List(N,  UALU,      AluOp.SRL,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    SRAI      -> List(N,  UALU,      AluOp.SRA,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+
+    ADDIW     -> List(N,  UALU,      AluOp.ADD,     Y,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    SLLIW     -> List(N,  UALU,      AluOp.SLL,     Y,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    SRLIW     -> List(N,  UALU,      AluOp.SRL,     Y,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    SRAIW     -> List(N,  UALU,      AluOp.SRA,     Y,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+
+    JAL       -> List(N,  UJMP,      AluOp.ADD,     N,  Op1Sel.PC,   Y,     ImmType.J,  Y,      N,   N,    MemSize.X,  N,        N),
+    JALR      -> List(N,  UJMP,      AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+
+    BEQ       -> List(N,  UBR,       AluOp.SEQ,     N,  Op1Sel.RS1,  N,     ImmType.B,  N,      N,   N,    MemSize.X,  N,        N),
+    BNE       -> List(N,  UBR,       AluOp.SNE,     N,  Op1Sel.RS1,  N,     ImmType.B,  N,      N,   N,    MemSize.X,  N,        N),
+    BLT       -> List(N,  UBR,       AluOp.SLT,     N,  Op1Sel.RS1,  N,     ImmType.B,  N,      N,   N,    MemSize.X,  N,        N),
+    BGE       -> List(N,  UBR,       AluOp.SGE,     N,  Op1Sel.RS1,  N,     ImmType.B,  N,      N,   N,    MemSize.X,  N,        N),
+    BLTU      -> List(N,  UBR,       AluOp.SLTU,    N,  Op1Sel.RS1,  N,     ImmType.B,  N,      N,   N,    MemSize.X,  N,        N),
+    BGEU      -> List(N,  UBR,       AluOp.SGEU,    N,  Op1Sel.RS1,  N,     ImmType.B,  N,      N,   N,    MemSize.X,  N,        N),
+
+    LB        -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      Y,   N,    MemSize.B,  Y,        N),
+    LH        -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      Y,   N,    MemSize.H,  Y,        N),
+    LW        -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      Y,   N,    MemSize.W,  Y,        N),
+    LD        -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      Y,   N,    MemSize.D,  Y,        N),
+    LBU       -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      Y,   N,    MemSize.B,  N,        N),
+    LHU       -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      Y,   N,    MemSize.H,  N,        N),
+    LWU       -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      Y,   N,    MemSize.W,  N,        N),
+
+    SB        -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.S,  N,      N,   Y,    MemSize.B,  N,        N),
+    SH        -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.S,  N,      N,   Y,    MemSize.H,  N,        N),
+    SW        -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.S,  N,      N,   Y,    MemSize.W,  N,        N),
+    SD        -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.S,  N,      N,   Y,    MemSize.D,  N,        N),
+
+    // LR is a load. SC and the AMOs are both a load and a store, rs2 is the operand
+    LR_W      -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   N,    MemSize.W,  Y,        N),
+    LR_D      -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   N,    MemSize.D,  Y,        N),
+    SC_W      -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.W,  Y,        N),
+    SC_D      -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.D,  Y,        N),
+
+    AMOADD_W  -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.W,  Y,        N),
+    AMOSWAP_W -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.W,  Y,        N),
+    AMOXOR_W  -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.W,  Y,        N),
+    AMOOR_W   -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.W,  Y,        N),
+    AMOAND_W  -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.W,  Y,        N),
+    AMOMIN_W  -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.W,  Y,        N),
+    AMOMAX_W  -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.W,  Y,        N),
+    AMOMINU_W -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.W,  Y,        N),
+    AMOMAXU_W -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.W,  Y,        N),
+
+    AMOADD_D  -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.D,  Y,        N),
+    AMOSWAP_D -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.D,  Y,        N),
+    AMOXOR_D  -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.D,  Y,        N),
+    AMOOR_D   -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.D,  Y,        N),
+    AMOAND_D  -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.D,  Y,        N),
+    AMOMIN_D  -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.D,  Y,        N),
+    AMOMAX_D  -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.D,  Y,        N),
+    AMOMINU_D -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.D,  Y,        N),
+    AMOMAXU_D -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  Y,      Y,   Y,    MemSize.D,  Y,        N),
+
+    MUL       -> List(N,  UMD,       AluOp.MUL,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    MULH      -> List(N,  UMD,       AluOp.MULH,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    MULHSU    -> List(N,  UMD,       AluOp.MULHSU,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    MULHU     -> List(N,  UMD,       AluOp.MULHU,   N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    DIV       -> List(N,  UMD,       AluOp.DIV,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    DIVU      -> List(N,  UMD,       AluOp.DIVU,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    REM       -> List(N,  UMD,       AluOp.REM,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    REMU      -> List(N,  UMD,       AluOp.REMU,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    MULW      -> List(N,  UMD,       AluOp.MUL,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    DIVW      -> List(N,  UMD,       AluOp.DIV,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    DIVUW     -> List(N,  UMD,       AluOp.DIVU,    Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    REMW      -> List(N,  UMD,       AluOp.REM,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    REMUW     -> List(N,  UMD,       AluOp.REMU,    Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+
+    SH1ADD    -> List(N,  UBM,       BitOp.SH1ADD,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SH2ADD    -> List(N,  UBM,       BitOp.SH2ADD,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SH3ADD    -> List(N,  UBM,       BitOp.SH3ADD,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    ADD_UW    -> List(N,  UBM,       BitOp.ADDUW,   N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SH1ADD_UW -> List(N,  UBM,       BitOp.SH1ADDUW, N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SH2ADD_UW -> List(N,  UBM,       BitOp.SH2ADDUW, N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SH3ADD_UW -> List(N,  UBM,       BitOp.SH3ADDUW, N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SLLI_UW   -> List(N,  UBM,       BitOp.SLLIUW,  N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+
+    ANDN      -> List(N,  UBM,       BitOp.ANDN,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    ORN       -> List(N,  UBM,       BitOp.ORN,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    XNOR      -> List(N,  UBM,       BitOp.XNOR,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    CLZ       -> List(N,  UBM,       BitOp.CLZ,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    CTZ       -> List(N,  UBM,       BitOp.CTZ,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    CPOP      -> List(N,  UBM,       BitOp.CPOP,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    CLZW      -> List(N,  UBM,       BitOp.CLZ,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    CTZW      -> List(N,  UBM,       BitOp.CTZ,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    CPOPW     -> List(N,  UBM,       BitOp.CPOP,    Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    MAX       -> List(N,  UBM,       BitOp.MAX,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    MAXU      -> List(N,  UBM,       BitOp.MAXU,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    MIN       -> List(N,  UBM,       BitOp.MIN,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    MINU      -> List(N,  UBM,       BitOp.MINU,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SEXT_B    -> List(N,  UBM,       BitOp.SEXTB,   N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    SEXT_H    -> List(N,  UBM,       BitOp.SEXTH,   N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    ZEXT_H    -> List(N,  UBM,       BitOp.ZEXTH,   N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    ROL       -> List(N,  UBM,       BitOp.ROL,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    ROR       -> List(N,  UBM,       BitOp.ROR,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    ROLW      -> List(N,  UBM,       BitOp.ROL,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    RORW      -> List(N,  UBM,       BitOp.ROR,     Y,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    RORI      -> List(N,  UBM,       BitOp.ROR,     N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    RORIW     -> List(N,  UBM,       BitOp.ROR,     Y,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    ORC_B     -> List(N,  UBM,       BitOp.ORCB,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    REV8      -> List(N,  UBM,       BitOp.REV8,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+
+    BCLR      -> List(N,  UBM,       BitOp.BCLR,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    BEXT      -> List(N,  UBM,       BitOp.BEXT,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    BINV      -> List(N,  UBM,       BitOp.BINV,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    BSET      -> List(N,  UBM,       BitOp.BSET,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    BCLRI     -> List(N,  UBM,       BitOp.BCLR,    N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    BEXTI     -> List(N,  UBM,       BitOp.BEXT,    N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    BINVI     -> List(N,  UBM,       BitOp.BINV,    N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+    BSETI     -> List(N,  UBM,       BitOp.BSET,    N,  Op1Sel.RS1,  Y,     ImmType.I,  Y,      N,   N,    MemSize.X,  N,        N),
+
+    FLW       -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.I,  N,      Y,   N,    MemSize.W,  N,        N),
+    FLD       -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.I,  N,      Y,   N,    MemSize.D,  N,        N),
+    FSW       -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.S,  N,      N,   Y,    MemSize.W,  N,        N),
+    FSD       -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.S,  N,      N,   Y,    MemSize.D,  N,        N),
+
+    FADD_S    -> List(N,  UFPU,      FpuOp.FADD,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FSUB_S    -> List(N,  UFPU,      FpuOp.FSUB,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMUL_S    -> List(N,  UFPU,      FpuOp.FMUL,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMADD_S   -> List(N,  UFPU,      FpuOp.FMADD,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMSUB_S   -> List(N,  UFPU,      FpuOp.FMSUB,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FNMSUB_S  -> List(N,  UFPU,      FpuOp.FNMSUB,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FNMADD_S  -> List(N,  UFPU,      FpuOp.FNMADD,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FDIV_S    -> List(N,  UFPU,      FpuOp.FDIV,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FSQRT_S   -> List(N,  UFPU,      FpuOp.FSQRT,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FSGNJ_S   -> List(N,  UFPU,      FpuOp.FSGNJ,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FSGNJN_S  -> List(N,  UFPU,      FpuOp.FSGNJN,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FSGNJX_S  -> List(N,  UFPU,      FpuOp.FSGNJX,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMIN_S    -> List(N,  UFPU,      FpuOp.FMIN,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMAX_S    -> List(N,  UFPU,      FpuOp.FMAX,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FEQ_S     -> List(N,  UFPU,      FpuOp.FEQ,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FLT_S     -> List(N,  UFPU,      FpuOp.FLT,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FLE_S     -> List(N,  UFPU,      FpuOp.FLE,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCLASS_S  -> List(N,  UFPU,      FpuOp.FCLASS,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCVT_W_S  -> List(N,  UFPU,      FpuOp.FCVTFI,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCVT_WU_S -> List(N,  UFPU,      FpuOp.FCVTFI,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCVT_L_S  -> List(N,  UFPU,      FpuOp.FCVTFI,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCVT_LU_S -> List(N,  UFPU,      FpuOp.FCVTFI,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCVT_S_W  -> List(N,  UFPU,      FpuOp.FCVTIF,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FCVT_S_WU -> List(N,  UFPU,      FpuOp.FCVTIF,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FCVT_S_L  -> List(N,  UFPU,      FpuOp.FCVTIF,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FCVT_S_LU -> List(N,  UFPU,      FpuOp.FCVTIF,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+
+    FADD_D    -> List(N,  UFPU,      FpuOp.FADD,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FSUB_D    -> List(N,  UFPU,      FpuOp.FSUB,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMUL_D    -> List(N,  UFPU,      FpuOp.FMUL,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMADD_D   -> List(N,  UFPU,      FpuOp.FMADD,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMSUB_D   -> List(N,  UFPU,      FpuOp.FMSUB,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FNMSUB_D  -> List(N,  UFPU,      FpuOp.FNMSUB,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FNMADD_D  -> List(N,  UFPU,      FpuOp.FNMADD,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FDIV_D    -> List(N,  UFPU,      FpuOp.FDIV,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FSQRT_D   -> List(N,  UFPU,      FpuOp.FSQRT,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FSGNJ_D   -> List(N,  UFPU,      FpuOp.FSGNJ,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FSGNJN_D  -> List(N,  UFPU,      FpuOp.FSGNJN,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FSGNJX_D  -> List(N,  UFPU,      FpuOp.FSGNJX,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMIN_D    -> List(N,  UFPU,      FpuOp.FMIN,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMAX_D    -> List(N,  UFPU,      FpuOp.FMAX,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FEQ_D     -> List(N,  UFPU,      FpuOp.FEQ,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FLT_D     -> List(N,  UFPU,      FpuOp.FLT,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FLE_D     -> List(N,  UFPU,      FpuOp.FLE,     N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCLASS_D  -> List(N,  UFPU,      FpuOp.FCLASS,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCVT_W_D  -> List(N,  UFPU,      FpuOp.FCVTFI,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCVT_WU_D -> List(N,  UFPU,      FpuOp.FCVTFI,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCVT_L_D  -> List(N,  UFPU,      FpuOp.FCVTFI,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCVT_LU_D -> List(N,  UFPU,      FpuOp.FCVTFI,  N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FCVT_D_W  -> List(N,  UFPU,      FpuOp.FCVTIF,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FCVT_D_WU -> List(N,  UFPU,      FpuOp.FCVTIF,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FCVT_D_L  -> List(N,  UFPU,      FpuOp.FCVTIF,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FCVT_D_LU -> List(N,  UFPU,      FpuOp.FCVTIF,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+
+    FCVT_S_D  -> List(N,  UFPU,      FpuOp.FCVTFF,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FCVT_D_S  -> List(N,  UFPU,      FpuOp.FCVTFF,  N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMV_X_W   -> List(N,  UFPU,      FpuOp.FMVFI,   N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FMV_X_D   -> List(N,  UFPU,      FpuOp.FMVFI,   N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    FMV_W_X   -> List(N,  UFPU,      FpuOp.FMVIF,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    FMV_D_X   -> List(N,  UFPU,      FpuOp.FMVIF,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+
+    VLE8_V    -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      Y,   N,    MemSize.B,  N,        N),
+    VLE16_V   -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      Y,   N,    MemSize.H,  N,        N),
+    VLE32_V   -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      Y,   N,    MemSize.W,  N,        N),
+    VLE64_V   -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      Y,   N,    MemSize.D,  N,        N),
+    VLSE8_V   -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      Y,   N,    MemSize.B,  N,        N),
+    VLSE16_V  -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      Y,   N,    MemSize.H,  N,        N),
+    VLSE32_V  -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      Y,   N,    MemSize.W,  N,        N),
+    VLSE64_V  -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      Y,   N,    MemSize.D,  N,        N),
+    VSE8_V    -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   Y,    MemSize.B,  N,        N),
+    VSE16_V   -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   Y,    MemSize.H,  N,        N),
+    VSE32_V   -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   Y,    MemSize.W,  N,        N),
+    VSE64_V   -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   Y,    MemSize.D,  N,        N),
+    VSSE8_V   -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   Y,    MemSize.B,  N,        N),
+    VSSE16_V  -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   Y,    MemSize.H,  N,        N),
+    VSSE32_V  -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   Y,    MemSize.W,  N,        N),
+    VSSE64_V  -> List(N,  UVEC,      AluOp.X,       N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   Y,    MemSize.D,  N,        N),
+
+    VSETVLI   -> List(N,  UVEC,      VecOp.SETVL,   N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    VSETIVLI  -> List(N,  UVEC,      VecOp.SETVL,   N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    VSETVL    -> List(N,  UVEC,      VecOp.SETVL,   N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+
+    VADD_VV   -> List(N,  UVEC,      VecOp.ADD,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VADD_VX   -> List(N,  UVEC,      VecOp.ADD,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VADD_VI   -> List(N,  UVEC,      VecOp.ADD,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VSUB_VV   -> List(N,  UVEC,      VecOp.SUB,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VSUB_VX   -> List(N,  UVEC,      VecOp.SUB,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VRSUB_VX  -> List(N,  UVEC,      VecOp.RSUB,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VRSUB_VI  -> List(N,  UVEC,      VecOp.RSUB,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMINU_VV  -> List(N,  UVEC,      VecOp.MINU,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMINU_VX  -> List(N,  UVEC,      VecOp.MINU,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMIN_VV   -> List(N,  UVEC,      VecOp.MIN,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMIN_VX   -> List(N,  UVEC,      VecOp.MIN,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMAXU_VV  -> List(N,  UVEC,      VecOp.MAXU,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMAXU_VX  -> List(N,  UVEC,      VecOp.MAXU,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMAX_VV   -> List(N,  UVEC,      VecOp.MAX,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMAX_VX   -> List(N,  UVEC,      VecOp.MAX,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VAND_VV   -> List(N,  UVEC,      VecOp.AND,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VAND_VX   -> List(N,  UVEC,      VecOp.AND,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VAND_VI   -> List(N,  UVEC,      VecOp.AND,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VOR_VV    -> List(N,  UVEC,      VecOp.OR,      N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VOR_VX    -> List(N,  UVEC,      VecOp.OR,      N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VOR_VI    -> List(N,  UVEC,      VecOp.OR,      N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VXOR_VV   -> List(N,  UVEC,      VecOp.XOR,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VXOR_VX   -> List(N,  UVEC,      VecOp.XOR,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VXOR_VI   -> List(N,  UVEC,      VecOp.XOR,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VSLL_VV   -> List(N,  UVEC,      VecOp.SLL,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VSLL_VX   -> List(N,  UVEC,      VecOp.SLL,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VSLL_VI   -> List(N,  UVEC,      VecOp.SLL,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VSRL_VV   -> List(N,  UVEC,      VecOp.SRL,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VSRL_VX   -> List(N,  UVEC,      VecOp.SRL,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VSRL_VI   -> List(N,  UVEC,      VecOp.SRL,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VSRA_VV   -> List(N,  UVEC,      VecOp.SRA,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VSRA_VX   -> List(N,  UVEC,      VecOp.SRA,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VSRA_VI   -> List(N,  UVEC,      VecOp.SRA,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMERGE_VV -> List(N,  UVEC,      VecOp.MERGE,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMERGE_VX -> List(N,  UVEC,      VecOp.MERGE,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMERGE_VI -> List(N,  UVEC,      VecOp.MERGE,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMUL_VV   -> List(N,  UVEC,      VecOp.MUL,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMUL_VX   -> List(N,  UVEC,      VecOp.MUL,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSEQ_VV  -> List(N,  UVEC,      VecOp.MSEQ,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSEQ_VX  -> List(N,  UVEC,      VecOp.MSEQ,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSEQ_VI  -> List(N,  UVEC,      VecOp.MSEQ,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSNE_VV  -> List(N,  UVEC,      VecOp.MSNE,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSNE_VX  -> List(N,  UVEC,      VecOp.MSNE,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSNE_VI  -> List(N,  UVEC,      VecOp.MSNE,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSLTU_VV -> List(N,  UVEC,      VecOp.MSLTU,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSLTU_VX -> List(N,  UVEC,      VecOp.MSLTU,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSLT_VV  -> List(N,  UVEC,      VecOp.MSLT,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSLT_VX  -> List(N,  UVEC,      VecOp.MSLT,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSLEU_VV -> List(N,  UVEC,      VecOp.MSLEU,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSLEU_VX -> List(N,  UVEC,      VecOp.MSLEU,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSLEU_VI -> List(N,  UVEC,      VecOp.MSLEU,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSLE_VV  -> List(N,  UVEC,      VecOp.MSLE,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSLE_VX  -> List(N,  UVEC,      VecOp.MSLE,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSLE_VI  -> List(N,  UVEC,      VecOp.MSLE,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSGTU_VX -> List(N,  UVEC,      VecOp.MSGTU,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSGTU_VI -> List(N,  UVEC,      VecOp.MSGTU,   N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSGT_VX  -> List(N,  UVEC,      VecOp.MSGT,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VMSGT_VI  -> List(N,  UVEC,      VecOp.MSGT,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+
+    VREDSUM_VS-> List(N,  UVEC,      VecOp.ADD,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VREDAND_VS-> List(N,  UVEC,      VecOp.AND,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VREDOR_VS -> List(N,  UVEC,      VecOp.OR,      N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VREDXOR_VS-> List(N,  UVEC,      VecOp.XOR,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VREDMINU_VS-> List(N,  UVEC,      VecOp.MINU,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VREDMIN_VS-> List(N,  UVEC,      VecOp.MIN,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VREDMAXU_VS-> List(N,  UVEC,      VecOp.MAXU,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    VREDMAX_VS-> List(N,  UVEC,      VecOp.MAX,     N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+
+    VMV_X_S   -> List(N,  UVEC,      VecOp.MVXS,    N,  Op1Sel.RS1,  N,     ImmType.X,  Y,      N,   N,    MemSize.X,  N,        N),
+    VMV_S_X   -> List(N,  UVEC,      VecOp.MVSX,    N,  Op1Sel.RS1,  N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+
+    // Cache block operations are stores to the whole line, see MemAccess.cmo
+    CBO_INVAL -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  N,      N,   Y,    MemSize.X,  N,        N),
+    CBO_CLEAN -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  N,      N,   Y,    MemSize.X,  N,        N),
+    CBO_FLUSH -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  N,      N,   Y,    MemSize.X,  N,        N),
+    CBO_ZERO  -> List(N,  ULS,       AluOp.ADD,     N,  Op1Sel.RS1,  Y,     ImmType.Z,  N,      N,   Y,    MemSize.X,  N,        N),
+
+    // Wait instructions, Retirement parks the hart. PAUSE has to go before FENCE
+    WFI       -> List(N,  UNONE,     AluOp.X,       N,  Op1Sel.X,    N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    WRS_NTO   -> List(N,  UNONE,     AluOp.X,       N,  Op1Sel.X,    N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    WRS_STO   -> List(N,  UNONE,     AluOp.X,       N,  Op1Sel.X,    N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+    PAUSE     -> List(N,  UNONE,     AluOp.X,       N,  Op1Sel.X,    N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        N),
+
+    FENCE     -> List(N,  UNONE,     AluOp.X,       N,  Op1Sel.X,    N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        Y),
+    FENCE_I   -> List(N,  UNONE,     AluOp.X,       N,  Op1Sel.X,    N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        Y),
+    SFENCE_VMA-> List(N,  UNONE,     AluOp.X,       N,  Op1Sel.X,    N,     ImmType.X,  N,      N,   N,    MemSize.X,  N,        Y),
+  )
+
+  def imm(instr: UInt, immType: UInt): UInt = {
+    val i = instr
+    MuxLookup(immType, i(31, 20).asSInt.pad(xLen).asUInt)(Seq(
+      ImmType.S -> Cat(i(31, 25), i(11, 7)).asSInt.pad(xLen).asUInt,
+      ImmType.B -> Cat(i(31), i(7), i(30, 25), i(11, 8), 0.U(1.W)).asSInt.pad(xLen).asUInt,
+      ImmType.U -> Cat(i(31, 12), 0.U(12.W)).asSInt.pad(xLen).asUInt,
+      ImmType.J -> Cat(i(31), i(19, 12), i(20), i(30, 21), 0.U(1.W)).asSInt.pad(xLen).asUInt,
+      ImmType.Z -> 0.U(xLen.W),
+      ImmType.P -> Cat(i(31, 25), 0.U(5.W)).asSInt.pad(xLen).asUInt,
+    ))
+  }
+
+  def apply(instr: UInt): DecodedCtrl = {
+    val d = Wire(new DecodedCtrl)
+    val illegal :: unit :: aluOp :: word :: op1Sel :: op2Imm :: immType :: rdWrite :: load :: store :: memSize :: memSigned :: fence :: Nil =
+      ListLookup(instr, default, table)
+
+    d.illegal   := illegal.asBool
+    d.unit      := unit
+    d.aluOp     := aluOp
+    d.word      := word.asBool
+    d.op1Sel    := op1Sel
+    d.op2Imm    := op2Imm.asBool
+    d.imm       := imm(instr, immType)
+    d.rdWrite   := rdWrite.asBool && (instr(11, 7) =/= 0.U)
+    d.load      := load.asBool
+    d.store     := store.asBool
+    d.memSize   := memSize
+    d.memSigned := memSigned.asBool
+    d.fence     := fence.asBool
+    d.fp        := FpDecodeTable(instr)
+    d.vec       := VecDecodeTable(instr)
+    d
+  }
+}
+
+// Operands of the F/D instructions that are FP registers. Kept apart, so the main table stays integer only
+object FpDecodeTable {
+  val Y = true.B
+  val N = false.B
+
+  //                            rs1  rs2  rs3  rd   rm
+  val default: List[UInt] = List(N,   N,   N,   N,   N)
+
+  val table: Array[(BitPat, List[UInt])] = Array(
+    FLW       -> List(N,   N,   N,   Y,   N),
+    FLD       -> List(N,   N,   N,   Y,   N),
+    FSW       -> List(N,   Y,   N,   N,   N),
+    FSD       -> List(N,   Y,   N,   N,   N),
+
+    FMADD_S   -> List(Y,   Y,   Y,   Y,   Y),
+    FMSUB_S   -> List(Y,   Y,   Y,   Y,   Y),
+    FNMSUB_S  -> List(Y,   Y,   Y,   Y,   Y),
+    FNMADD_S  -> List(Y,   Y,   Y,   Y,   Y),
+    FADD_S    -> List(Y,   Y,   N,   Y,   Y),
+    FSUB_S    -> List(Y,   Y,   N,   Y,   Y),
+    FMUL_S    -> List(Y,   Y,   N,   Y,   Y),
+    FDIV_S    -> List(Y,   Y,   N,   Y,   Y),
+    FSQRT_S   -> List(Y,   N,   N,   Y,   Y),
+    FSGNJ_S   -> List(Y,   Y,   N,   Y,   N),
+    FSGNJN_S  -> List(Y,   Y,   N,   Y,   N),
+    FSGNJX_S  -> List(Y,   Y,   N,   Y,   N),
+    FMIN_S    -> List(Y,   Y,   N,   Y,   N),
+    FMAX_S    -> List(Y,   Y,   N,   Y,   N),
+    FEQ_S     -> List(Y,   Y,   N,   N,   N),
+    FLT_S     -> List(Y,   Y,   N,   N,   N),
+    FLE_S     -> List(Y,   Y,   N,   N,   N),
+    FCLASS_S  -> List(Y,   N,   N,   N,   N),
+    FCVT_W_S  -> List(Y,   N,   N,   N,   Y),
+    FCVT_WU_S -> List(Y,   N,   N,   N,   Y),
+    FCVT_L_S  -> List(Y,   N,   N,   N,   Y),
+    FCVT_LU_S -> List(Y,   N,   N,   N,   Y),
+    FCVT_S_W  -> List(N,   N,   N,   Y,   Y),
+    FCVT_S_WU -> List(N,   N,   N,   Y,   Y),
+    FCVT_S_L  -> List(N,   N,   N,   Y,   Y),
+    FCVT_S_LU -> List(N,   N,   N,   Y,   Y),
+
+    FMADD_D   -> List(Y,   Y,   Y,   Y,   Y),
+    FMSUB_D   -> List(Y,   Y,   Y,   Y,   Y),
+    FNMSUB_D  -> List(Y,   Y,   Y,   Y,   Y),
+    FNMADD_D  -> List(Y,   Y,   Y,   Y,   Y),
+    FADD_D    -> List(Y,   Y,   N,   Y,   Y),
+    FSUB_D    -> List(Y,   Y,   N,   Y,   Y),
+    FMUL_D    -> List(Y,   Y,   N,   Y,   Y),
+    FDIV_D    -> List(Y,   Y,   N,   Y,   Y),
+    FSQRT_D   -> List(Y,   N,   N,   Y,   Y),
+    FSGNJ_D   -> List(Y,   Y,   N,   Y,   N),
+    FSGNJN_D  -> List(Y,   Y,   N,   Y,   N),
+    FSGNJX_D  -> List(Y,   Y,   N,   Y,   N),
+    FMIN_D    -> List(Y,   Y,   N,   Y,   N),
+    FMAX_D    -> List(Y,   Y,   N,   Y,   N),
+    FEQ_D     -> List(Y,   Y,   N,   N,   N),
+    FLT_D     -> List(Y,   Y,   N,   N,   N),
+    FLE_D     -> List(Y,   Y,   N,   N,   N),
+    FCLASS_D  -> List(Y,   N,   N,   N,   N),
+    FCVT_W_D  -> List(Y,   N,   N,   N,   Y),
+    FCVT_WU_D -> List(Y,   N,   N,   N,   Y),
+    FCVT_L_D  -> List(Y,   N,   N,   N,   Y),
+    FCVT_LU_D -> List(Y,   N,   N,   N,   Y),
+    FCVT_D_W  -> List(N,   N,   N,   Y,   Y),
+    FCVT_D_WU -> List(N,   N,   N,   Y,   Y),
+    FCVT_D_L  -> List(N,   N,   N,   Y,   Y),
+    FCVT_D_LU -> List(N,   N,   N,   Y,   Y),
+
+    FCVT_S_D  -> List(Y,   N,   N,   Y,   Y),
+    FCVT_D_S  -> List(Y,   N,   N,   Y,   Y),
+    FMV_X_W   -> List(Y,   N,   N,   N,   N),
+    FMV_X_D   -> List(Y,   N,   N,   N,   N),
+    FMV_W_X   -> List(N,   N,   N,   Y,   N),
+    FMV_D_X   -> List(N,   N,   N,   Y,   N),
+  )
+
+  def apply(instr: UInt): FpDecodedCtrl = {
+    val d = Wire(new FpDecodedCtrl)
+    val rs1 :: rs2 :: rs3 :: rd :: rm :: Nil = ListLookup(instr, default, table)
+    d.rs1       := rs1.asBool
+    d.rs2       := rs2.asBool
+    d.rs3       := rs3.asBool
+    d.rd        := rd.asBool
+    d.rm        := rm.asBool
+    d
+  }
+}
+
+// Vector instructions that use the rs1/rs2 fields for something else than an integer register
+object VecDecodeTable {
+  val Y = true.B
+  val N = false.B
+
+  //                            vs1  vs2  red
+  val default: List[UInt] = List(N,   N,   N)
+
+  val table: Array[(BitPat, List[UInt])] = Array(
+    VLE8_V    -> List(N,   Y,   N),
+    VLE16_V   -> List(N,   Y,   N),
+    VLE32_V   -> List(N,   Y,   N),
+    VLE64_V   -> List(N,   Y,   N),
+    VLSE8_V   -> List(N,   N,   N),
+    VLSE16_V  -> List(N,   N,   N),
+    VLSE32_V  -> List(N,   N,   N),
+    VLSE64_V  -> List(N,   N,   N),
+    VSE8_V    -> List(N,   Y,   N),
+    VSE16_V   -> List(N,   Y,   N),
+    VSE32_V   -> List(N,   Y,   N),
+    VSE64_V   -> List(N,   Y,   N),
+    VSSE8_V   -> List(N,   N,   N),
+    VSSE16_V  -> List(N,   N,   N),
+    VSSE32_V  -> List(N,   N,   N),
+    VSSE64_V  -> List(N,   N,   N),
+
+    VSETVLI   -> List(N,   Y,   N),
+    VSETIVLI  -> List(Y,   Y,   N),
+    VSETVL    -> List(N,   N,   N),
+
+    VADD_VV   -> List(Y,   Y,   N),
+    VADD_VX   -> List(N,   Y,   N),
+    VADD_VI   -> List(Y,   Y,   N),
+    VSUB_VV   -> List(Y,   Y,   N),
+    VSUB_VX   -> List(N,   Y,   N),
+    VRSUB_VX  -> List(N,   Y,   N),
+    VRSUB_VI  -> List(Y,   Y,   N),
+    VMINU_VV  -> List(Y,   Y,   N),
+    VMINU_VX  -> List(N,   Y,   N),
+    VMIN_VV   -> List(Y,   Y,   N),
+    VMIN_VX   -> List(N,   Y,   N),
+    VMAXU_VV  -> List(Y,   Y,   N),
+    VMAXU_VX  -> List(N,   Y,   N),
+    VMAX_VV   -> List(Y,   Y,   N),
+    VMAX_VX   -> List(N,   Y,   N),
+    VAND_VV   -> List(Y,   Y,   N),
+    VAND_VX   -> List(N,   Y,   N),
+    VAND_VI   -> List(Y,   Y,   N),
+    VOR_VV    -> List(Y,   Y,   N),
+    VOR_VX    -> List(N,   Y,   N),
+    VOR_VI    -> List(Y,   Y,   N),
+    VXOR_VV   -> List(Y,   Y,   N),
+    VXOR_VX   -> List(N,   Y,   N),
+    VXOR_VI   -> List(Y,   Y,   N),
+    VSLL_VV   -> List(Y,   Y,   N),
+    VSLL_VX   -> List(N,   Y,   N),
+    VSLL_VI   -> List(Y,   Y,   N),
+    VSRL_VV   -> List(Y,   Y,   N),
+    VSRL_VX   -> List(N,   Y,   N),
+    VSRL_VI   -> List(Y,   Y,   N),
+    VSRA_VV   -> List(Y,   Y,   N),
+    VSRA_VX   -> List(N,   Y,   N),
+    VSRA_VI   -> List(Y,   Y,   N),
+    VMERGE_VV -> List(Y,   Y,   N),
+    VMERGE_VX -> List(N,   Y,   N),
+    VMERGE_VI -> List(Y,   Y,   N),
+    VMUL_VV   -> List(Y,   Y,   N),
+    VMUL_VX   -> List(N,   Y,   N),
+    VMSEQ_VV  -> List(Y,   Y,   N),
+    VMSEQ_VX  -> List(N,   Y,   N),
+    VMSEQ_VI  -> List(Y,   Y,   N),
+    VMSNE_VV  -> List(Y,   Y,   N),
+    VMSNE_VX  -> List(N,   Y,   N),
+    VMSNE_VI  -> List(Y,   Y,   N),
+    VMSLTU_VV -> List(Y,   Y,   N),
+    VMSLTU_VX -> List(N,   Y,   N),
+    VMSLT_VV  -> List(Y,   Y,   N),
+    VMSLT_VX  -> List(N,   Y,   N),
+    VMSLEU_VV -> List(Y,   Y,   N),
+    VMSLEU_VX -> List(N,   Y,   N),
+    VMSLEU_VI -> List(Y,   Y,   N),
+    VMSLE_VV  -> List(Y,   Y,   N),
+    VMSLE_VX  -> List(N,   Y,   N),
+    VMSLE_VI  -> List(Y,   Y,   N),
+    VMSGTU_VX -> List(N,   Y,   N),
+    VMSGTU_VI -> List(Y,   Y,   N),
+    VMSGT_VX  -> List(N,   Y,   N),
+    VMSGT_VI  -> List(Y,   Y,   N),
+
+    VREDSUM_VS-> List(Y,   Y,   Y),
+    VREDAND_VS-> List(Y,   Y,   Y),
+    VREDOR_VS -> List(Y,   Y,   Y),
+    VREDXOR_VS-> List(Y,   Y,   Y),
+    VREDMINU_VS-> List(Y,   Y,   Y),
+    VREDMIN_VS-> List(Y,   Y,   Y),
+    VREDMAXU_VS-> List(Y,   Y,   Y),
+    VREDMAX_VS-> List(Y,   Y,   Y),
+
+    VMV_X_S   -> List(Y,   Y,   N),
+    VMV_S_X   -> List(N,   Y,   N),
+  )
+
+  def apply(instr: UInt): VecDecodedCtrl = {
+    val d = Wire(new VecDecodedCtrl)
+    val vs1 :: vs2 :: red :: Nil = ListLookup(instr, default, table)
+    d.vs1       := vs1.asBool
+    d.vs2       := vs2.asBool
+    d.red       := red.asBool
+    d
+  }
+}
@@ -11,15 +11,21 @@ import Instructions._
 import Consts._
 
 /** Output of Execute stage (same as yours) */
-class ExecuteUop extends DecodeUop {
+class ExecuteUop(implicit ccx: CCXParams) extends DecodeUop {
   val aluOut      = SInt(xLen.W)
   val branchTaken = Bool()
+  val redirected  = Bool() // Execute already sent the front-end to the resolved path
+  val fflags      = UInt(5.W) // FP exception flags, accrued by Retirement
 }
 
 /** Precomputed inputs every unit can use (Single Responsibility: Execute preps these once) */
-class ExecCommonIn extends Bundle {
+class ExecCommonIn(implicit val ccx: CCXParams) extends Bundle {
   val valid  = Bool()
   val uop    = new DecodeUop
+
+  val kill      = Bool() // Pipeline is killed, multi-cycle units drop their in-flight work
+  val accepted  = Bool() // Execute has taken the result of this uop this cycle
+  val frm       = UInt(3.W) // Dynamic rounding mode
 }
 
 
@@ -27,7 +33,9 @@ class ExecCommonIn extends Bundle {
 class ExecUnitOut extends Bundle {
   val aluOut      = SInt(xLen.W)
   val branchTaken = Bool()
+  val fflags      = UInt(5.W)
   val handled      = Bool() // this unit recognized and handled the instruction
+  val done         = Bool() // result is available. Multi-cycle units keep it low until the result is computed
 }
 
 /** All execution units implement this Module interface (Dependency Inversion) */
@@ -35,6 +43,19 @@ abstract class ExecUnit(implicit ccx: CCXParams) extends CCXModule {
   val in  = IO(Input(new ExecCommonIn))
   val out = IO(Output(new ExecUnitOut))
 
+  out.done := true.B // Single cycle units are always done. Multi-cycle units override this
+  out.fflags := 0.U // Only the FPU raises FP exceptions
+
+  // Operands selected by the decode table
+  val dec = in.uop.dec
+  val op1 = MuxLookup(dec.op1Sel, in.uop.rs1)(Seq(
+    Op1Sel.PC   -> in.uop.pc.pad(xLen),
+    Op1Sel.ZERO -> 0.U(xLen.W),
+  ))
+  val op2 = Mux(dec.op2Imm, dec.imm, in.uop.rs2)
+
+  def selected(idx: Int): Bool = dec.unit(idx)
+
 
   def execute_debug(instr: String): Unit = {
     when(in.valid) {
@@ -48,18 +69,37 @@ abstract class ExecUnit(implicit ccx: CCXParams) extends CCXModule {
   }
 }
 
-class Execute(implicit ccx: CCXParams) extends CCXModule {
+object ExecUnits {
+  // One of each unit, in the ExecUnitSel order
+  def apply()(implicit ccx: CCXParams): Seq[ExecUnit] =
+    Seq(Module(new ExecuteAluUnit), Module(new ExecuteBranchUnit), Module(new ExecuteJalrUnit), Module(new ExecuteLoadStoreUnit), Module(new ExecuteMulDivUnit), Module(new ExecuteBitManipUnit)) ++
+    (if(ccx.core.fpu) Seq(Module(new ExecuteFpuUnit)) else Seq())
+}
+
+/** Everything between Decode and Retirement: the in-order Execute stage or the out of order back-end */
+abstract class ExecuteBackEnd(implicit ccx: CCXParams) extends CCXModule {
   val ctrl              = IO(new PipelineControlIO) // Pipeline command interface form control unit
 
   val in         = IO(Flipped(DecoupledIO(new DecodeUop)))
   val out         = IO(DecoupledIO(new ExecuteUop))
-  
+  val outExtra    = IO(Vec(ccx.core.retireWidth - 1, DecoupledIO(new ExecuteUop))) // Younger than out, retired in the same cycle
+  val redirect    = IO(Valid(UInt(apLen.W))) // To the front-end: resolved target that Fetch did not predict
+  val frm         = IO(Input(UInt(3.W)))     // From fcsr. Writes to it restart the pipeline, so younger uops see the new value
+  val topDown     = IO(Output(UInt(3.W)))    // Class of the cycle, see TopDown
+}
+
+class Execute(implicit ccx: CCXParams) extends ExecuteBackEnd {
 
   val outBits        = Reg(new ExecuteUop)
   val outValid       = RegInit(false.B)
 
   out.valid       := outValid
   out.bits        := outBits
+  // One uop per cycle
+  outExtra.foreach(o => {
+    o.valid       := false.B
+    o.bits        := outBits
+  })
   
   /**************************************************************************/
   /*                Decode pipeline combinational signals                   */
@@ -72,25 +112,58 @@ class Execute(implicit ccx: CCXParams) extends CCXModule {
 
   in.ready := false.B
   
-  val units: Seq[ExecUnit] = Seq(Module(new ExecuteAluUnit), Module(new ExecuteBranchUnit), Module(new ExecuteJalrUnit), Module(new ExecuteLoadStoreUnit))
+  val units: Seq[ExecUnit] = ExecUnits()
   units.foreach(f => {
     f.in.valid := in.valid
     f.in.uop := in.bits
+    f.in.kill := kill
+    f.in.accepted := in.fire
+    f.in.frm := frm
   })
+  // Unit select is one-hot from the decode table
   val handled = units.map(_.out.handled)
   val anyHandled = VecInit(handled).asUInt.orR
-  val handleIdx = PriorityEncoder(handled)
+  val unitOut = Mux1H(handled, units.map(_.out))
+  // Unknown instructions are passed down the pipeline, so Retirement can raise the illegal instruction
+  val unitDone = !anyHandled || unitOut.done
+  // Multi-cycle unit is still working on the uop
+  topDown := Mux(in.valid && !unitDone && !kill, TopDown.BACKEND_CORE, TopDown.NONE)
+
+  /**************************************************************************/
+  /*                Branch resolution                                       */
+  /**************************************************************************/
+  // Younger instructions are still in Decode and the front-end, they are flushed by the redirect.
+  // Older ones are already in Retirement, so only the wrong path is dropped
+  val isJump      = in.bits.dec.unit(ExecUnitSel.JUMP)
+  val isBranch    = in.bits.dec.unit(ExecUnitSel.BRANCH)
+  val taken       = isJump || (isBranch && unitOut.branchTaken)
+  val target      = Cat(unitOut.aluOut.asUInt(apLen - 1, 1), 0.U(1.W))
+  val mispredict  = (isJump || isBranch) && (taken =/= in.bits.predTaken)
+
+  redirect.valid  := in.fire && mispredict
+  redirect.bits   := Mux(taken, target, in.bits.pcPlus4)
+
+  when(redirect.valid) {
+    log(cf"Redirect pc=0x${in.bits.pc}%x, target=0x${redirect.bits}%x")
+  }
+  kanata(in.valid && !kill, KanataTrace.STAGE, in.bits.seq, KanataTrace.EXECUTE)
+  kanata(redirect.valid, KanataTrace.FLUSH, in.bits.seq, KanataTrace.EXECUTE)
 
   when(!outValid || (outValid && out.ready) || kill) {
-    when(in.valid && !kill) {
+    when(in.valid && !kill && !unitDone) {
+      // Multi-cycle unit is still computing. Execute is in order, the younger uops wait behind this one
+      outValid := false.B
+    } .elsewhen(in.valid && !kill) {
       in.ready := true.B
       outBits.viewAsSupertype(chiselTypeOf(in.bits)) := in.bits
       outValid        := true.B
     
       when(anyHandled) {
-        outBits.aluOut      := VecInit(units.map(f => f.out))(handleIdx).aluOut
-        outBits.branchTaken := VecInit(units.map(f => f.out))(handleIdx).branchTaken
+        outBits.aluOut      := unitOut.aluOut
+        outBits.branchTaken := unitOut.branchTaken
+        outBits.fflags      := unitOut.fflags
       }
+      outBits.redirected  := mispredict
 
     } .otherwise { // Decode has no instruction. Or killed
       outValid := false.B
@@ -2,16 +2,15 @@ package armleocpu
 
 import chisel3._
 import chisel3.util._
-import Instructions._
 
 class ExecuteLoadStoreUnit(implicit ccx: CCXParams) extends ExecUnit {
-  val i = in.uop.instr
-  val rs1 = in.uop.rs1
-
   out.handled := false.B
   out.branchTaken := false.B
   out.aluOut := 0.S
 
-  when(i === LOAD)       {  out.aluOut := rs1.asSInt + i(31,20).asSInt;                handle("LOAD")}
-  .elsewhen(i === STORE) {  out.aluOut := rs1.asSInt + Cat(i(31,25), i(11,7)).asSInt;  handle("STORE")}
-}
\ No newline at end of file
+  // Immediate is I-type for loads and S-type for stores, selected by the decode table. It is zero for the atomics
+  when(selected(ExecUnitSel.LOADSTORE)) {
+    out.aluOut := (op1 + op2).asSInt
+    when(dec.load && dec.store) { handle("AMO") } .elsewhen(dec.store) { handle("STORE") } .otherwise { handle("LOAD") }
+  }
+}
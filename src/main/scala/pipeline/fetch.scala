@@ -8,10 +8,12 @@ import chisel3.experimental.dataview._
 
 import Consts._
 
-class FetchUop() extends PrefetchUop {
+class FetchUop(implicit ccx: CCXParams) extends PrefetchUop {
   val instr               = UInt(iLen.W)
   val ifetchPageFault     = Bool()
   val ifetchAccessFault   = Bool()
+  val predTaken           = Bool() // Front-end already follows the jump/branch target
+  val rvc                 = Bool() // Compressed instruction in the low 16 bits of instr, Decode expands it
   
   override def toPrintable: Printable = {
     cf"  $instr%x @ $pc%x; " + 
@@ -23,6 +25,15 @@ class FetchUop() extends PrefetchUop {
 }
 
 
+// 16-bit piece of the instruction stream
+class FetchParcel extends Bundle {
+  val bits                = UInt(16.W)
+  val accessFault         = Bool()
+  val pageFault           = Bool()
+  val last                = Bool() // Ends a block predicted taken by the fetch target queue
+}
+
+
 class PipelineControlIO extends Bundle {
     val kill              = Input(Bool())
     val jump              = Input(Bool())
@@ -41,10 +52,14 @@ class Fetch(implicit ccx: CCXParams) extends CCXModule {
   
 
   val cacheResp         = IO(Flipped(new CacheResp)) // Cache response channel (it requires some input as the memory stage might use this to rollback commands that it ordered)
-  val in             = IO(Flipped(DecoupledIO(new PrefetchUop))) // From prefetch to fetch bus
+  val in             = IO(Flipped(DecoupledIO(new FetchTarget))) // From prefetch to fetch bus
   val out             = IO(DecoupledIO(new FetchUop)) // Fetch to decode bus
   val dynRegs           = IO(Input(new DynamicROCsrRegisters)) // For reset vectors
   val csr               = IO(Input(new CsrRegsOutput)) // From CSR
+  val redirect          = IO(Valid(UInt(apLen.W))) // To prefetch: target predicted from the instruction bits
+  val btbUpdate         = IO(Valid(new BtbUpdate)) // To the fetch target queue
+  val blockReady        = IO(Output(Bool())) // To prefetch: room for the next block
+  val topDown           = IO(Output(UInt(3.W))) // Class of the cycle, see TopDown
 
   /**************************************************************************/
   /*  Submodules                                                            */
@@ -65,8 +80,18 @@ class Fetch(implicit ccx: CCXParams) extends CCXModule {
   /**************************************************************************/
   /*  State                                                                 */
   /**************************************************************************/
-  val holdUop       = Reg(new FetchUop)
-  val holdUopValid  = RegInit(false.B)
+  // Prefetch sends aligned xLen blocks. Instructions are 16 or 32 bits and 16-bit aligned,
+  // so they are realigned here. A 32-bit instruction can cross the block and cache line boundary,
+  // so its first half waits in the buffer for the next block
+  val blockParcels  = xLenBytes / 2
+  val bufN          = blockParcels + 2 // Room for a full block, requested when at most one 32-bit instruction is left
+
+  val buf           = Reg(Vec(bufN, new FetchParcel))
+  val bufCount      = RegInit(0.U(log2Ceil(bufN + 1).W))
+  val bufPc         = Reg(UInt(apLen.W)) // Address of buf(0)
+  // Buffer ends with a block predicted taken. The next block is the target, so it waits for the buffer to drain
+  val takenPending  = RegInit(false.B)
+  val takenTarget   = Reg(UInt(apLen.W))
   val csrRegs       = Reg(new CsrRegsOutput)
 
   //val ppn  = Reg(chiselTypeOf(itlb.io.s0.wentry.ppn))
@@ -75,55 +100,157 @@ class Fetch(implicit ccx: CCXParams) extends CCXModule {
     // A: Turns out not every memory cell supports keeping output after read
     //    Yep, that is literally why we are wasting preciouse chip area... Portability
 
-  in.ready                   := false.B
-  out.valid                   := false.B
-  out.bits                    := holdUop
-
-  when(ctrl.kill || ctrl.flush || ctrl.jump) {
-    in.ready := true.B
-    holdUopValid := false.B
-    holdUop := DontCare
-    log(cf"KILL")
-  } .elsewhen(holdUopValid) {
-    out.bits := holdUop
-    out.valid := true.B
-    log(cf"HOLD     out: ${out.bits}")
-    // FIXME: UOP_I.READY
-  } .elsewhen(cacheResp.valid) {
-    out.bits.viewAsSupertype(new PrefetchUop) := in.bits
-    out.bits.ifetchAccessFault                := cacheResp.accessFault
-    out.bits.ifetchPageFault                  := cacheResp.pageFault
-    out.bits.instr       := cacheResp.readData.asTypeOf(Vec(xLen / iLen, UInt(iLen.W)))(out.bits.pc(log2Ceil(xLen / iLen) + log2Ceil(iLen / 8) - 1,log2Ceil(iLen / 8)))
-    holdUop                      := out.bits
-
-    when(!out.ready) {
-      holdUopValid  := true.B
-      in.ready     := true.B
-      log(cf"ACCEPTED out: ${out.bits}")
+  val kill          = ctrl.kill || ctrl.flush || ctrl.jump
+
+  /**************************************************************************/
+  /*  Realignment                                                           */
+  /**************************************************************************/
+  // Parcels of the incoming block, starting from the one at the fetch pc
+  val blockValid    = in.valid && cacheResp.valid && !in.bits.probe
+  val offset        = in.bits.pc(log2Ceil(xLenBytes) - 1, 1)
+  val block         = VecInit.tabulate(blockParcels) {i =>
+    val p = Wire(new FetchParcel)
+    p.bits          := Cat(cacheResp.readData(2 * i + 1), cacheResp.readData(2 * i))
+    p.accessFault   := cacheResp.accessFault
+    p.pageFault     := cacheResp.pageFault
+    p.last          := in.bits.predTaken && (i.U === in.bits.end)
+    p
+  }
+  // Parcels after the predicted jump are not used
+  val blockEnd      = Mux(in.bits.predTaken, in.bits.end +& 1.U, blockParcels.U)
+  val blockCount    = Mux(blockValid, blockEnd - offset, 0.U)
+
+  // Buffered parcels followed by the incoming ones. Two extra entries so that the shift below stays in range
+  val view          = VecInit.tabulate(bufN + 2) {i =>
+    if(i < bufN) Mux(i.U < bufCount, buf(i), block((i.U - bufCount + offset)(log2Ceil(blockParcels) - 1, 0))) else buf(0)
+  }
+  val viewCount     = bufCount + blockCount
+  val viewPc        = Mux(bufCount === 0.U, in.bits.pc, bufPc)
+
+  assert(!blockValid || (bufCount === 0.U) || (in.bits.pc === bufPc + (bufCount << 1)), "[BUG] Fetch block is not sequential")
+  assert(!blockValid || (bufCount <= 2.U), "[BUG] Fetch block does not fit")
+
+  /**************************************************************************/
+  /*  Instruction                                                           */
+  /**************************************************************************/
+  val first         = view(0)
+  val rvc           = first.bits(1, 0) =/= 3.U
+  // Faulting parcel is sent alone, Retirement traps on it
+  val single        = rvc || first.accessFault || first.pageFault
+  val needed        = Mux(single, 1.U, 2.U)
+  val raw           = Mux(single, first.bits.pad(iLen), Cat(view(1).bits, first.bits))
+  val accessFault   = first.accessFault || (!single && view(1).accessFault)
+  val pageFault     = first.pageFault || (!single && view(1).pageFault)
+  // Block was predicted to end with this instruction
+  val endsBlock     = Mux(single, first.last, view(1).last)
+  // or in the middle of it. The prediction is wrong, the instruction is fetched again
+  val splitEnd      = !single && first.last
+
+  /**************************************************************************/
+  /*  Predecode                                                             */
+  /**************************************************************************/
+  val instr         = Mux(rvc, RvcExpander(first.bits), raw)
+  val isJal         = instr(6, 0) === "b1101111".U
+  val isBranch      = instr(6, 0) === "b1100011".U
+  // JAL is always taken. Backward branches are predicted taken, they usually close a loop
+  val predTaken     = (if(ccx.core.earlyRedirect) true.B else false.B) && (isJal || (isBranch && instr(31)))
+  val target        = viewPc + Mux(isJal, DecodeTable.imm(instr, ImmType.J), DecodeTable.imm(instr, ImmType.B))(apLen - 1, 0)
+  // Fetch target queue already sent the target block. The taken block is either buffered or incoming
+  val ftqTarget     = Mux(takenPending, takenTarget, in.bits.pcPlus4)
+  val ftqHit        = endsBlock && out.bits.predTaken && (target === ftqTarget)
+
+  /**************************************************************************/
+  /*  Output                                                                */
+  /**************************************************************************/
+  out.valid                   := (viewCount >= needed) && !kill && !splitEnd
+  out.bits.pc                 := viewPc
+  out.bits.pcPlus4            := viewPc + Mux(rvc, 2.U, 4.U)
+  out.bits.instr              := raw
+  out.bits.rvc                := rvc
+  out.bits.ifetchAccessFault  := accessFault
+  out.bits.ifetchPageFault    := pageFault
+  // Misaligned targets and fetch faults are left to Retirement
+  out.bits.predTaken          := predTaken && !accessFault && !pageFault && (target(0) === 0.U)
+  out.bits.seq                := DontCare
+
+  // The block is always taken, the room for it was reserved when it was requested
+  in.ready                    := cacheResp.valid || kill
+  // Demand block that the I-cache did not return yet
+  topDown                     := Mux(in.valid && !in.bits.probe && !cacheResp.valid && !kill, TopDown.FRONTEND, TopDown.NONE)
+  blockReady                  := (bufCount <= 2.U) && !in.valid && !takenPending
+
+  // Only the younger instructions in prefetch are dropped. The queue is also redirected
+  // when it predicted a jump that is not there
+  val wrongEnd                = splitEnd && (viewCount =/= 0.U) && !kill
+  redirect.valid              := (out.fire && Mux(out.bits.predTaken, !ftqHit, endsBlock)) || wrongEnd
+  redirect.bits               := Mux(wrongEnd, viewPc, Mux(out.bits.predTaken, target, out.bits.pcPlus4))
 
+  // Every redirect is a wrong prediction of the queue
+  btbUpdate.valid             := redirect.valid
+  btbUpdate.bits.pc           := viewPc + Mux(single || wrongEnd, 0.U, 2.U)
+  btbUpdate.bits.target       := target
+  btbUpdate.bits.taken        := out.bits.predTaken && !wrongEnd
+
+  val consumed                = Mux(out.fire, needed, 0.U)
+
+  when(blockValid && in.bits.predTaken) {
+    takenPending  := true.B
+    takenTarget   := in.bits.pcPlus4
+  }
+  when(out.fire && endsBlock) {
+    takenPending  := false.B
+  }
+
+  when(kill || redirect.valid) {
+    bufCount      := 0.U
+    takenPending  := false.B
+    when(kill) {
+      log(cf"KILL")
     } .otherwise {
-      in.ready     := false.B
-      log(cf"HOLDREQ  out: ${out.bits}")
+      log(cf"REDIRECT pc=0x${viewPc}%x, target=0x${target}%x")
     }
-
-    assert(in.valid, "Cache request ready, while valid is low")
-    in.ready := true.B
   } .otherwise {
-    //log(cf"NOP")
-    in.ready := false.B
+    for(i <- 0 until bufN) {
+      buf(i) := view(i.U +& consumed)
+    }
+    bufCount  := viewCount - consumed
+    bufPc     := viewPc + (consumed << 1)
+  }
+
+  when(out.fire) {
+    log(cf"ACCEPTED out: ${out.bits}")
+  }
+
+  // Uop trace ids have the top bit clear, the loop buffer numbers its replays with it set.
+  // The open blocks, except the one in use, were dropped from Prefetch by the redirect
+  if(ccx.core.kanata) {
+    val uopSeq                = RegInit(0.U((KanataTrace.seqWidth - 1).W))
+    when(out.fire) {
+      uopSeq                  := uopSeq + 1.U
+    }
+    out.bits.seq              := Cat(0.U(1.W), uopSeq)
+    kanata(out.fire, KanataTrace.UOP_START, out.bits.seq, KanataTrace.FETCH, viewPc, raw)
+    kanata(in.fire && !in.bits.probe && !kill, KanataTrace.BLOCK_END, in.bits.seq, KanataTrace.FETCH)
+    kanata(redirect.valid, KanataTrace.BLOCK_FLUSH, in.bits.seq, KanataTrace.FETCH)
   }
 
   // Never written
   cacheResp.writeData := VecInit(Seq.fill(xLenBytes)(0.U(8.W)))
   cacheResp.writeMask := 0.U(xLenBytes.W)
+  cacheResp.writeLine := VecInit(Seq.fill(cacheLineBytes)(0.U(8.W)))
+  cacheResp.writeLineMask := 0.U(cacheLineBytes.W)
 
   cacheResp.read := in.valid
   cacheResp.write := false.B
 
   cacheResp.atomicRead := false.B
   cacheResp.atomicWrite := false.B
+  cacheResp.amo := false.B
+  cacheResp.amoOp := 0.U
+  cacheResp.cmo := Cmo.NONE
+  cacheResp.probe := false.B
 
-  ctrl.busy := cacheResp.valid || in.valid || out.valid
+  ctrl.busy := in.valid || (bufCount =/= 0.U)
 }
 
 import _root_.circt.stage.ChiselStage
@@ -0,0 +1,163 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import Consts._
+
+// Fetch block: Prefetch reads it from the I-cache, Fetch cuts it into instructions
+class FetchTarget(implicit ccx: CCXParams) extends PrefetchUop {
+  // pcPlus4 is the predicted pc of the next block
+  val predTaken           = Bool() // Block ends with a jump predicted taken, pcPlus4 is its target
+  val end                 = UInt(log2Ceil(xLenBytes / 2).W) // Last parcel of the block, when predTaken
+  val probe               = Bool() // I-cache prefetch, Fetch drops the data
+
+  override def toPrintable: Printable = {cf"@ $pc%x -> $pcPlus4%x, predTaken=$predTaken, end=$end, probe=$probe\n"}
+}
+
+// Fetch found a jump predicted taken (or found that the predicted one is not there)
+class BtbUpdate extends Bundle {
+  val pc                  = UInt(apLen.W) // Last parcel of the jump
+  val target              = UInt(apLen.W)
+  val taken               = Bool() // Otherwise the entry is removed
+}
+
+class BtbEntry(val tagW: Int) extends Bundle {
+  val valid               = Bool()
+  val tag                 = UInt(tagW.W)
+  val end                 = UInt(log2Ceil(xLenBytes / 2).W)
+  val target              = UInt(apLen.W)
+}
+
+/**
+ * Fetch target queue. Decouples the next block prediction from the I-cache access.
+ *
+ * The predictor runs ahead of Prefetch. Each cycle it looks up the branch target buffer (BTB) with the block
+ * address and queues the block with its predicted end and next pc. Prefetch takes the blocks from the queue
+ * when Fetch has room for them, so a cache miss does not stop the prediction.
+ * The BTB is trained by Fetch from the predecoded jumps. The newest predicted line is sent to Prefetch
+ * as a hint, so that a miss on the predicted path can be started before the block is needed.
+ */
+class FetchTargetQueue(implicit ccx: CCXParams) extends CCXModule {
+  /**************************************************************************/
+  /*  Interface                                                             */
+  /**************************************************************************/
+  val ctrl              = IO(new PipelineControlIO)
+  val out               = IO(DecoupledIO(new FetchTarget))          // To prefetch
+  val hint              = IO(DecoupledIO(UInt(apLen.W)))            // To prefetch: line of an upcoming block
+  val redirect          = IO(Flipped(Valid(UInt(apLen.W))))         // From fetch: restart the prediction
+  val update            = IO(Flipped(Valid(new BtbUpdate)))         // From fetch
+
+  val dynRegs           = IO(Input(new DynamicROCsrRegisters))
+
+  /**************************************************************************/
+  /*  State                                                                 */
+  /**************************************************************************/
+  val blockLog2         = log2Ceil(xLenBytes)
+  val btbN              = ccx.core.btbEntries
+  val btbIdxW           = log2Ceil(btbN)
+  val n                 = ccx.core.ftqEntries
+
+  val btb               = RegInit(VecInit(Seq.fill(btbN)(0.U.asTypeOf(new BtbEntry(apLen - blockLog2 - btbIdxW)))))
+
+  val entries           = Reg(Vec(n, new FetchTarget))
+  val head              = RegInit(0.U(log2Ceil(n).W)) // Oldest block, next one sent to prefetch
+  val tail              = RegInit(0.U(log2Ceil(n).W))
+  val count             = RegInit(0.U(log2Ceil(n + 1).W))
+
+  val pc                = Reg(UInt(apLen.W)) // Next block to predict
+
+  val hintValid         = RegInit(false.B)
+  val hintAddr          = Reg(UInt(apLen.W))
+  val hintLine          = Reg(UInt((apLen - cacheLineLog2).W)) // Last line sent as a hint
+
+  val kill              = ctrl.kill || ctrl.flush || ctrl.jump
+
+  def btbIdx(a: UInt): UInt = a(blockLog2 + btbIdxW - 1, blockLog2)
+  def btbTag(a: UInt): UInt = a(apLen - 1, blockLog2 + btbIdxW)
+  def nextBlock(a: UInt): UInt = Cat(a(apLen - 1, blockLog2) + 1.U, 0.U(blockLog2.W))
+
+  /**************************************************************************/
+  /*  Prediction                                                            */
+  /**************************************************************************/
+  val e                 = btb(btbIdx(pc))
+  val offset            = pc(blockLog2 - 1, 1)
+  // Jumps before the start of the block (e.g. the block is a jump target) are not in it
+  val hit               = e.valid && (e.tag === btbTag(pc)) && (e.end >= offset)
+
+  val predicted         = Wire(new FetchTarget)
+  predicted.pc          := pc
+  predicted.pcPlus4     := Mux(hit, e.target, nextBlock(pc))
+  predicted.predTaken   := hit
+  predicted.end         := e.end
+  predicted.probe       := false.B
+  predicted.seq         := DontCare // Prefetch numbers the blocks
+
+  val enq               = (count =/= n.U) && !kill && !redirect.valid
+
+  when(enq) {
+    entries(tail)       := predicted
+    tail                := tail + 1.U
+    pc                  := predicted.pcPlus4
+    when(hit) {
+      log(cf"Predict block=0x${pc}%x, end=${e.end}, target=0x${e.target}%x")
+    }
+  }
+
+  out.valid             := count =/= 0.U
+  out.bits              := entries(head)
+
+  when(out.fire) {
+    head                := head + 1.U
+  }
+
+  count                 := count + enq - out.fire
+
+  /**************************************************************************/
+  /*  I-cache prefetch hint                                                 */
+  /**************************************************************************/
+  // Only the newest line is kept, it is the furthest ahead of Fetch
+  val line              = pc(apLen - 1, cacheLineLog2)
+  when(hint.fire) {
+    hintValid           := false.B
+  }
+  when(enq && (line =/= hintLine) && ccx.core.icachePrefetch.B) {
+    hintValid           := true.B
+    hintAddr            := pc
+    hintLine            := line
+  }
+
+  hint.valid            := hintValid
+  hint.bits             := hintAddr
+
+  /**************************************************************************/
+  /*  Training                                                              */
+  /**************************************************************************/
+  when(update.valid) {
+    val u = btb(btbIdx(update.bits.pc))
+    u.valid             := update.bits.taken
+    u.tag               := btbTag(update.bits.pc)
+    u.end               := update.bits.pc(blockLog2 - 1, 1)
+    u.target            := update.bits.target
+    log(cf"Update pc=0x${update.bits.pc}%x, target=0x${update.bits.target}%x, taken=${update.bits.taken}")
+  }
+
+  /**************************************************************************/
+  /*  Flush                                                                 */
+  /**************************************************************************/
+  // Queued blocks are on the wrong path. Restart the prediction from the new pc
+  when(kill || redirect.valid) {
+    pc                  := Mux(kill, ctrl.newPc, redirect.bits)
+    head                := 0.U
+    tail                := 0.U
+    count               := 0.U
+    hintValid           := false.B
+  }
+
+  // Predictions only, nothing to wait for
+  ctrl.busy             := false.B
+
+  when(reset.asBool) {
+    pc := dynRegs.resetVector
+  }
+}
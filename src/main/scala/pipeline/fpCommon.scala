@@ -0,0 +1,208 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import Consts._
+
+// IEEE 754 binary interchange format
+case class FpFormat(expW: Int, fracW: Int) {
+  val width = 1 + expW + fracW
+  val prec  = fracW + 1 // Significand bits, the hidden one included
+  val bias  = (1 << (expW - 1)) - 1
+  val emin  = 1 - bias
+
+  def canonicalNaN: UInt = Cat(0.U(1.W), Fill(expW + 1, 1.U(1.W)), 0.U((fracW - 1).W))
+  def inf(sign: Bool): UInt = Cat(sign, Fill(expW, 1.U(1.W)), 0.U(fracW.W))
+  def maxFinite(sign: Bool): UInt = Cat(sign, Fill(expW - 1, 1.U(1.W)), 0.U(1.W), Fill(fracW, 1.U(1.W)))
+  def zero(sign: Bool): UInt = Cat(sign, 0.U((width - 1).W))
+}
+
+object FpFormat {
+  val S = FpFormat(8, 23)
+  val D = FpFormat(11, 52)
+}
+
+object FpRm {
+  val RNE   = 0.U(3.W)
+  val RTZ   = 1.U(3.W)
+  val RDN   = 2.U(3.W)
+  val RUP   = 3.U(3.W)
+  val RMM   = 4.U(3.W)
+  val DYN   = 7.U(3.W) // Use frm
+}
+
+// Exception flags, in the fflags order
+object FpFlags {
+  val NV    = "b10000".U(5.W)
+  val DZ    = "b01000".U(5.W)
+  val NONE  = 0.U(5.W)
+
+  def apply(nv: Bool, dz: Bool, of: Bool, uf: Bool, nx: Bool): UInt = Cat(nv, dz, of, uf, nx)
+}
+
+// Both formats are unpacked to the same representation: value = sig * 2^(exp - 52).
+// Subnormals are normalized, so sig(52) is set for every finite nonzero value
+class FpUnpacked extends Bundle {
+  val sign    = Bool()
+  val exp     = SInt(Fp.expW.W)
+  val sig     = UInt(Fp.sigW.W)
+  val isZero  = Bool()
+  val isInf   = Bool()
+  val isNaN   = Bool()
+  val isSNaN  = Bool()
+}
+
+object Fp {
+  val expW = 16 // Wide enough for the product and the quotient exponents
+  val sigW = FpFormat.D.prec
+
+  /**************************************************************************/
+  /*  Register format                                                       */
+  /**************************************************************************/
+  // Single precision values are NaN-boxed in the 64-bit registers. Values that are not boxed read as the canonical NaN
+  def unbox(x: UInt): UInt = Mux(x(xLen - 1, 32).andR, x(31, 0), FpFormat.S.canonicalNaN)
+  def box(x: UInt): UInt = Cat(Fill(xLen - 32, 1.U(1.W)), x(31, 0))
+
+  def canonicalNaN(double: Bool): UInt = Mux(double, FpFormat.D.canonicalNaN, box(FpFormat.S.canonicalNaN))
+  def inf(sign: Bool, double: Bool): UInt = Mux(double, FpFormat.D.inf(sign), box(FpFormat.S.inf(sign)))
+  def zero(sign: Bool, double: Bool): UInt = Mux(double, FpFormat.D.zero(sign), box(FpFormat.S.zero(sign)))
+
+  /**************************************************************************/
+  /*  Unpacking                                                             */
+  /**************************************************************************/
+  def unpack(x: UInt, f: FpFormat): FpUnpacked = {
+    val u       = Wire(new FpUnpacked)
+    val e       = x(f.width - 2, f.fracW)
+    val frac    = x(f.fracW - 1, 0)
+    val expZero = e === 0.U
+    val expOnes = e.andR
+    // Subnormals: the leading one is moved to the hidden bit
+    val lz      = PriorityEncoder(Reverse(frac))
+    val subFrac = (frac << (lz +& 1.U))(f.fracW - 1, 0)
+
+    u.sign      := x(f.width - 1)
+    u.exp       := Mux(expZero, (f.emin - 1).S(expW.W) - lz.zext, e.zext - f.bias.S(expW.W))
+    u.sig       := Cat(!expZero || (frac =/= 0.U), Mux(expZero, subFrac, frac)) << (sigW - f.prec)
+    u.isZero    := expZero && (frac === 0.U)
+    u.isInf     := expOnes && (frac === 0.U)
+    u.isNaN     := expOnes && (frac =/= 0.U)
+    u.isSNaN    := expOnes && (frac =/= 0.U) && !frac(f.fracW - 1)
+    u
+  }
+
+  // Operand in the 64-bit register
+  def unpack(x: UInt, double: Bool): FpUnpacked = Mux(double, unpack(x, FpFormat.D), unpack(unbox(x), FpFormat.S))
+
+  def one: FpUnpacked = {
+    val u       = Wire(new FpUnpacked)
+    u           := 0.U.asTypeOf(u)
+    u.sig       := (BigInt(1) << (sigW - 1)).U
+    u
+  }
+
+  /**************************************************************************/
+  /*  Rounding                                                              */
+  /**************************************************************************/
+  def roundIncrement(rm: UInt, sign: Bool, lsb: Bool, round: Bool, sticky: Bool): Bool = MuxLookup(rm, false.B)(Seq(
+    FpRm.RNE -> (round && (sticky || lsb)),
+    FpRm.RDN -> (sign && (round || sticky)),
+    FpRm.RUP -> (!sign && (round || sticky)),
+    FpRm.RMM -> round,
+  ))
+
+  // Rounds sign * sig * 2^(exp - sig.getWidth + 1) to the format. The top bit of sig is set, sticky is ORed below it.
+  // Returns the result and the OF/UF/NX flags
+  def round(sign: Bool, exp: SInt, sig: UInt, sticky: Bool, rm: UInt, f: FpFormat): (UInt, UInt) = {
+    val w         = sig.getWidth
+    val maxShift  = f.prec + 2 // Further shifts only add to the sticky bit
+    require(w >= maxShift)
+
+    // Values below the smallest normal are denormalized: shifted right so that the exponent is emin
+    val tiny      = exp < f.emin.S
+    val dist      = f.emin.S(expW.W) - exp
+    val shift     = Mux(!tiny, 0.U, Mux(dist > maxShift.S, maxShift.U, dist.asUInt(log2Ceil(maxShift + 1) - 1, 0)))
+    val ext       = Cat(sig, 0.U(maxShift.W)) >> shift
+    val top       = w + maxShift - 1
+
+    val mant      = ext(top, top - f.prec + 1)
+    val roundBit  = ext(top - f.prec)
+    val stickyBit = ext(top - f.prec - 1, 0).orR || sticky
+    val rounded   = mant +& roundIncrement(rm, sign, mant(0), roundBit, stickyBit)
+    val carry     = rounded(f.prec)
+    val normal    = rounded(f.prec - 1) || carry
+
+    val biased    = Mux(tiny, f.emin.S(expW.W), exp) + carry.zext + f.bias.S
+    val overflow  = biased >= ((1 << f.expW) - 1).S
+    val inexact   = roundBit || stickyBit
+
+    // Tininess is detected after rounding: the result would be below the smallest normal with an unbounded exponent
+    val nMant     = sig(w - 1, w - f.prec)
+    val nCarry    = nMant.andR && roundIncrement(rm, sign, nMant(0), sig(w - f.prec - 1), sig(w - f.prec - 2, 0).orR || sticky)
+    val underflow = tiny && !((exp === (f.emin - 1).S) && nCarry) && inexact
+
+    // Overflow goes to infinity or to the largest finite value, depending on the rounding direction
+    val ovfInf    = (rm === FpRm.RNE) || (rm === FpRm.RMM) || ((rm === FpRm.RDN) && sign) || ((rm === FpRm.RUP) && !sign)
+    val bits      = Mux(overflow, Mux(ovfInf, f.inf(sign), f.maxFinite(sign)),
+                    Cat(sign, Mux(normal, biased.asUInt(f.expW - 1, 0), 0.U(f.expW.W)), rounded(f.fracW - 1, 0)))
+    (bits, FpFlags(false.B, false.B, overflow, underflow, inexact || overflow))
+  }
+
+  // Result in the 64-bit register
+  def round(sign: Bool, exp: SInt, sig: UInt, sticky: Bool, rm: UInt, double: Bool): (UInt, UInt) = {
+    val (s, sFlags) = round(sign, exp, sig, sticky, rm, FpFormat.S)
+    val (d, dFlags) = round(sign, exp, sig, sticky, rm, FpFormat.D)
+    (Mux(double, d, box(s)), Mux(double, dFlags, sFlags))
+  }
+
+  /**************************************************************************/
+  /*  Format conversion                                                     */
+  /**************************************************************************/
+  // FCVT.S.D/FCVT.D.S: x is in the other format. The significand is padded to the width that rounding to D needs
+  def convert(x: UInt, rm: UInt, double: Bool): (UInt, UInt) = {
+    val src           = unpack(x, !double)
+    val (bits, flags) = round(src.sign, src.exp, Cat(src.sig, 0.U(2.W)), false.B, rm, double)
+    val result        = Mux(src.isNaN, canonicalNaN(double),
+                        Mux(src.isInf, inf(src.sign, double),
+                        Mux(src.isZero, zero(src.sign, double), bits)))
+    val outFlags      = Mux(src.isNaN, Mux(src.isSNaN, FpFlags.NV, FpFlags.NONE), Mux(src.isInf || src.isZero, FpFlags.NONE, flags))
+    (result, outFlags)
+  }
+
+  /**************************************************************************/
+  /*  Compare and classify                                                  */
+  /**************************************************************************/
+  // Raw values of the same format, neither is NaN. With orderedZeros -0 is below +0, as FMIN/FMAX want it
+  def lessThan(x: UInt, y: UInt, orderedZeros: Boolean): Bool = {
+    val w         = x.getWidth
+    val (sx, sy)  = (x(w - 1), y(w - 1))
+    val (mx, my)  = (x(w - 2, 0), y(w - 2, 0))
+    val bothZero  = (mx | my) === 0.U
+    Mux(sx =/= sy, sx && (if(orderedZeros) true.B else !bothZero), Mux(sx, mx > my, mx < my))
+  }
+
+  def equal(x: UInt, y: UInt): Bool = {
+    val w = x.getWidth
+    (x === y) || ((x(w - 2, 0) | y(w - 2, 0)) === 0.U)
+  }
+
+  // FCLASS mask
+  def classify(x: UInt, f: FpFormat): UInt = {
+    val sign      = x(f.width - 1)
+    val e         = x(f.width - 2, f.fracW)
+    val frac      = x(f.fracW - 1, 0)
+    val expZero   = e === 0.U
+    val expOnes   = e.andR
+    val fracZero  = frac === 0.U
+
+    val isInf     = expOnes && fracZero
+    val isNaN     = expOnes && !fracZero
+    val isSNaN    = isNaN && !frac(f.fracW - 1)
+    val isSub     = expZero && !fracZero
+    val isZero    = expZero && fracZero
+    val isNormal  = !expZero && !expOnes
+    Cat(isNaN && !isSNaN, isSNaN,
+        !sign && isInf, !sign && isNormal, !sign && isSub, !sign && isZero,
+        sign && isZero, sign && isSub, sign && isNormal, sign && isInf)
+  }
+}
@@ -0,0 +1,460 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+import Consts._
+
+/**
+ * Fused multiply-add: a * b + c with a single rounding. The signs of the product and the addend are set by the caller.
+ * The addend starts above the product and is only shifted right. The sum is normalized and rounded to the format.
+ */
+object FpFma {
+  def apply(a: FpUnpacked, b: FpUnpacked, c: FpUnpacked, rm: UInt, double: Bool): (UInt, UInt) = {
+    val w         = 3 * Fp.sigW + 4 // Addend, 2 guard bits, product
+    val prodW     = 2 * Fp.sigW + 2
+
+    val prodSign  = a.sign ^ b.sign
+    val prodZero  = a.isZero || b.isZero
+    val prodInf   = a.isInf || b.isInf
+    val anyNaN    = a.isNaN || b.isNaN || c.isNaN
+    val effSub    = prodSign =/= c.sign
+    val invalid   = a.isSNaN || b.isSNaN || c.isSNaN ||
+                    (a.isInf && b.isZero) || (a.isZero && b.isInf) ||
+                    (!anyNaN && prodInf && c.isInf && effSub)
+
+    // Bit i of the frame has the weight 2^(frameExp - 106 + i). The product is at [107:2]
+    val pSig      = a.sig * b.sig
+    val pExp      = a.exp + b.exp
+    val dist      = pExp - c.exp + (w - prodW + 1).S
+    // Addend is so far above the product, that the product only sets the sticky bit
+    val prodTiny  = !prodZero && (dist < 0.S)
+    val shift     = Mux(prodZero, (w - prodW + 1).U, Mux(dist < 0.S, 0.U, Mux(dist > w.S, w.U, dist.asUInt(log2Ceil(w + 1) - 1, 0))))
+    val frameExp  = Mux(prodZero, c.exp, Mux(prodTiny, c.exp - (w - prodW + 1).S, pExp))
+
+    val addend    = Cat(c.sig, 0.U((w - Fp.sigW).W)) >> shift
+    val addSticky = (c.sig =/= 0.U) && (shift > ((w - Fp.sigW).U +& PriorityEncoder(c.sig)))
+    val product   = Mux(prodTiny, 1.U(prodW.W), Cat(pSig, 0.U(2.W)))
+
+    // Two bits of headroom and the sticky bit below the frame
+    val x         = Cat(0.U(2.W), product.pad(w), 0.U(1.W))
+    val y         = Cat(0.U(2.W), addend, addSticky)
+    val diff      = x - y
+    val neg       = effSub && diff(w + 2)
+    val mag       = Mux(effSub, Mux(neg, y - x, diff), x + y)
+    val sign      = Mux(neg, c.sign, prodSign)
+
+    val lz        = PriorityEncoder(Reverse(mag))
+    val norm      = (mag << lz)(w + 2, 0)
+    val normExp   = frameExp + (w - prodW + 3).S - lz.zext
+
+    val (rBits, rFlags) = Fp.round(sign, normExp, norm, false.B, rm, double)
+
+    // Exact zero: x + x keeps the sign, x - x is +0 except when rounding down
+    val isZero    = mag === 0.U
+    val zeroSign  = Mux(effSub, rm === FpRm.RDN, prodSign)
+
+    val bits      = Mux(anyNaN || invalid, Fp.canonicalNaN(double),
+                    Mux(prodInf, Fp.inf(prodSign, double),
+                    Mux(c.isInf, Fp.inf(c.sign, double),
+                    Mux(isZero, Fp.zero(zeroSign, double), rBits))))
+    val flags     = Mux(invalid, FpFlags.NV, Mux(anyNaN || prodInf || c.isInf || isZero, FpFlags.NONE, rFlags))
+    (bits, flags)
+  }
+}
+
+/**
+ * Radix-4 division and square root on the significands. Two result bits are produced every cycle,
+ * the remainder gives the sticky bit. Special operands finish without iterations.
+ */
+class FpDivSqrt extends Module {
+  val io = IO(new Bundle {
+    val req = Flipped(DecoupledIO(new Bundle {
+      val a       = new FpUnpacked
+      val b       = new FpUnpacked
+      val sqrt    = Bool()
+      val rm      = UInt(3.W)
+      val double  = Bool()
+    }))
+    val resp = DecoupledIO(new Bundle {
+      val bits    = UInt(xLen.W)
+      val flags   = UInt(5.W)
+    })
+    val kill = Input(Bool())
+  })
+
+  val steps     = Fp.sigW + 3 // Result bits: significand, round bit and one more, so the count is even
+  val radW      = 2 * steps   // Square root consumes two radicand bits per result bit
+  val remW      = steps + 4
+
+  val sIdle :: sIter :: sDone :: Nil = Enum(3)
+  val state     = RegInit(sIdle)
+
+  val divisor   = Reg(UInt(Fp.sigW.W))
+  val remainder = Reg(UInt(remW.W))
+  val result    = Reg(UInt(steps.W)) // Quotient or root, shifted in from the bottom
+  val radicand  = Reg(UInt(radW.W))
+  val cycles    = Reg(UInt(log2Ceil(steps / 2 + 1).W))
+  val sqrt      = Reg(Bool())
+  val sign      = Reg(Bool())
+  val exp       = Reg(SInt(Fp.expW.W))
+  val rm        = Reg(UInt(3.W))
+  val double    = Reg(Bool())
+  val outBits   = Reg(UInt(xLen.W))
+  val outFlags  = Reg(UInt(5.W))
+
+  /**************************************************************************/
+  /* Iteration                                                              */
+  /**************************************************************************/
+  def step(r: UInt, q: UInt, x: UInt): (UInt, UInt, UInt) = {
+    // Square root: the next two radicand bits come in, the trial value is 4 * root + 1
+    val shifted = Mux(sqrt, Cat(r, x(radW - 1, radW - 2)), r)
+    val trial   = Mux(sqrt, Cat(q, 1.U(2.W)), divisor)
+    val ge      = shifted >= trial
+    val next    = Mux(ge, shifted - trial, shifted)
+    (Mux(sqrt, next, next << 1)(remW - 1, 0), Cat(q(steps - 2, 0), ge), (x << 2)(radW - 1, 0))
+  }
+
+  /**************************************************************************/
+  /* Operand preparation                                                    */
+  /**************************************************************************/
+  val a         = io.req.bits.a
+  val b         = io.req.bits.b
+  val reqDouble = io.req.bits.double
+
+  val divSign   = a.sign ^ b.sign
+  // Dividend is shifted when it is smaller, so the quotient is in [1, 2)
+  val divShift  = a.sig < b.sig
+  val divExp    = a.exp - b.exp - divShift.zext
+  // Exponent of the root is half of an even exponent
+  val sqrtOdd   = a.exp(0)
+  val sqrtExp   = (a.exp - sqrtOdd.zext) >> 1
+  val sqrtRad   = Cat(Mux(sqrtOdd, Cat(a.sig, 0.U(1.W)), a.sig.pad(Fp.sigW + 1)), 0.U((radW - Fp.sigW - 1).W))
+
+  val (r0, q0, x0) = step(remainder, result, radicand)
+  val (r1, q1, x1) = step(r0, q0, x0)
+  val (roundBits, roundFlags) = Fp.round(sign, exp, q1, r1 =/= 0.U, rm, double)
+
+  def special(bits: UInt, flags: UInt): Unit = {
+    outBits   := bits
+    outFlags  := flags
+    state     := sDone
+  }
+
+  io.req.ready  := state === sIdle
+  io.resp.valid := state === sDone
+  io.resp.bits.bits  := outBits
+  io.resp.bits.flags := outFlags
+
+  when(state === sIdle) {
+    when(io.req.valid && !io.kill) {
+      sqrt    := io.req.bits.sqrt
+      rm      := io.req.bits.rm
+      double  := reqDouble
+      when(io.req.bits.sqrt) {
+        when(a.isNaN) {
+          special(Fp.canonicalNaN(reqDouble), Mux(a.isSNaN, FpFlags.NV, FpFlags.NONE))
+        } .elsewhen(a.isZero) {
+          special(Fp.zero(a.sign, reqDouble), FpFlags.NONE)
+        } .elsewhen(a.sign) {
+          special(Fp.canonicalNaN(reqDouble), FpFlags.NV)
+        } .elsewhen(a.isInf) {
+          special(Fp.inf(false.B, reqDouble), FpFlags.NONE)
+        } .otherwise {
+          remainder := 0.U
+          result    := 0.U
+          radicand  := sqrtRad
+          sign      := false.B
+          exp       := sqrtExp
+          cycles    := (steps / 2).U
+          state     := sIter
+        }
+      } .otherwise {
+        when(a.isNaN || b.isNaN) {
+          special(Fp.canonicalNaN(reqDouble), Mux(a.isSNaN || b.isSNaN, FpFlags.NV, FpFlags.NONE))
+        } .elsewhen((a.isInf && b.isInf) || (a.isZero && b.isZero)) {
+          special(Fp.canonicalNaN(reqDouble), FpFlags.NV)
+        } .elsewhen(a.isInf || b.isZero) {
+          special(Fp.inf(divSign, reqDouble), Mux(b.isZero && !a.isInf, FpFlags.DZ, FpFlags.NONE))
+        } .elsewhen(a.isZero || b.isInf) {
+          special(Fp.zero(divSign, reqDouble), FpFlags.NONE)
+        } .otherwise {
+          divisor   := b.sig
+          remainder := Mux(divShift, Cat(a.sig, 0.U(1.W)), a.sig)
+          result    := 0.U
+          sign      := divSign
+          exp       := divExp
+          cycles    := (steps / 2).U
+          state     := sIter
+        }
+      }
+    }
+  } .elsewhen(state === sIter) {
+    remainder := r1
+    result    := q1
+    radicand  := x1
+    cycles    := cycles - 1.U
+    when(cycles === 1.U) {
+      special(roundBits, roundFlags)
+    }
+  } .elsewhen(state === sDone) {
+    when(io.resp.ready) {
+      state := sIdle
+    }
+  }
+
+  when(io.kill) {
+    state := sIdle
+  }
+}
+
+// F/D extensions. Sign injection, compare, classify, moves and conversions are single cycle
+class ExecuteFpuUnit(implicit ccx: CCXParams) extends ExecUnit {
+  val rs1     = in.uop.rs1
+  val rs2     = in.uop.rs2
+  val rs3     = in.uop.rs3
+  val op      = dec.aluOp
+  val instr   = in.uop.instr
+
+  out.handled := false.B
+  out.branchTaken := false.B
+  out.aluOut := 0.S
+  out.done := false.B
+
+  val double  = instr(25)
+  val rm      = Mux(instr(14, 12) === FpRm.DYN, in.frm, instr(14, 12))
+
+  val a       = Fp.unpack(rs1, double)
+  val b       = Fp.unpack(rs2, double)
+  val c       = Fp.unpack(rs3, double)
+
+  val isFma     = selected(ExecUnitSel.FPU) && (op <= FpuOp.FNMADD)
+  val isDivSqrt = selected(ExecUnitSel.FPU) && ((op === FpuOp.FDIV) || (op === FpuOp.FSQRT))
+  val isMisc    = selected(ExecUnitSel.FPU) && !isFma && !isDivSqrt
+
+  /**************************************************************************/
+  /* Fused multiply-add                                                     */
+  /**************************************************************************/
+  // Goes through fmaLatency registers like the multiplier. Execute holds the uop until the result is back,
+  // so only one FMA is in flight. FADD/FSUB multiply by one, FMUL adds a zero of the product sign
+  val fmaIssued   = RegInit(false.B)
+  val fmaDrop     = RegInit(false.B)
+  val fmaResult   = Reg(UInt(xLen.W))
+  val fmaFlags    = Reg(UInt(5.W))
+  val fmaDone     = RegInit(false.B)
+
+  val fmaStart    = in.valid && isFma && !fmaIssued && !fmaDone && !in.kill
+
+  val fmaA        = WireInit(a)
+  val fmaB        = WireInit(b)
+  val fmaC        = WireInit(c)
+  when((op === FpuOp.FADD) || (op === FpuOp.FSUB)) {
+    fmaB          := Fp.one
+    fmaC          := b
+    fmaC.sign     := b.sign ^ (op === FpuOp.FSUB)
+  }
+  when(op === FpuOp.FMUL) {
+    fmaC          := 0.U.asTypeOf(fmaC)
+    fmaC.isZero   := true.B
+    fmaC.sign     := a.sign ^ b.sign
+  }
+  when((op === FpuOp.FNMSUB) || (op === FpuOp.FNMADD)) {
+    fmaA.sign     := !a.sign
+  }
+  when((op === FpuOp.FMSUB) || (op === FpuOp.FNMADD)) {
+    fmaC.sign     := !c.sign
+  }
+
+  val fmaReq = Wire(new Bundle {
+    val bits  = UInt(xLen.W)
+    val flags = UInt(5.W)
+  })
+  val (fmaBits, fmaBitsFlags) = FpFma(fmaA, fmaB, fmaC, rm, double)
+  fmaReq.bits     := fmaBits
+  fmaReq.flags    := fmaBitsFlags
+
+  val fmaStages   = Pipe(fmaStart, fmaReq, ccx.core.fmaLatency)
+
+  when(fmaStart) {
+    fmaIssued := true.B
+  }
+
+  when(fmaStages.valid) {
+    fmaIssued := false.B
+    when(!fmaDrop && !in.kill) {
+      fmaDone   := true.B
+      fmaResult := fmaStages.bits.bits
+      fmaFlags  := fmaStages.bits.flags
+    }
+    fmaDrop := false.B
+  } .elsewhen(in.kill && fmaIssued) {
+    fmaDrop := true.B
+  }
+
+  when(in.accepted || in.kill) {
+    fmaDone := false.B
+  }
+
+  /**************************************************************************/
+  /* Division and square root                                               */
+  /**************************************************************************/
+  val divSqrt = Module(new FpDivSqrt)
+  val divIssued = RegInit(false.B)
+
+  divSqrt.io.kill               := in.kill
+  divSqrt.io.req.valid          := in.valid && isDivSqrt && !divIssued && !in.kill
+  divSqrt.io.req.bits.a         := a
+  divSqrt.io.req.bits.b         := b
+  divSqrt.io.req.bits.sqrt      := op === FpuOp.FSQRT
+  divSqrt.io.req.bits.rm        := rm
+  divSqrt.io.req.bits.double    := double
+  divSqrt.io.resp.ready         := in.accepted
+
+  when(divSqrt.io.req.fire) {
+    divIssued := true.B
+  }
+  when(in.accepted || in.kill) {
+    divIssued := false.B
+  }
+
+  /**************************************************************************/
+  /* Sign injection, min/max, compare, classify                             */
+  /**************************************************************************/
+  // Raw operands of the format. Single precision ones that are not NaN-boxed are the canonical NaN
+  val rawA      = Fp.unbox(rs1)
+  val rawB      = Fp.unbox(rs2)
+
+  val sgnB      = Mux(double, rs2(xLen - 1), rawB(31))
+  val sgnA      = Mux(double, rs1(xLen - 1), rawA(31))
+  val injSign   = MuxLookup(op, sgnB)(Seq(
+    FpuOp.FSGNJN -> !sgnB,
+    FpuOp.FSGNJX -> (sgnA ^ sgnB),
+  ))
+  val sgnj      = Mux(double, Cat(injSign, rs1(xLen - 2, 0)), Fp.box(Cat(injSign, rawA(30, 0))))
+
+  val anyNaN    = a.isNaN || b.isNaN
+  val anySNaN   = a.isSNaN || b.isSNaN
+  val lt        = Mux(double, Fp.lessThan(rs1, rs2, false), Fp.lessThan(rawA, rawB, false))
+  val eq        = Mux(double, Fp.equal(rs1, rs2), Fp.equal(rawA, rawB))
+  val minLt     = Mux(double, Fp.lessThan(rs1, rs2, true), Fp.lessThan(rawA, rawB, true))
+
+  // One NaN operand: the other one is the result
+  val opA       = Mux(double, rs1, Fp.box(rawA))
+  val opB       = Mux(double, rs2, Fp.box(rawB))
+  val pickA     = Mux(op === FpuOp.FMIN, minLt, !minLt)
+  val minMax    = Mux(a.isNaN && b.isNaN, Fp.canonicalNaN(double),
+                  Mux(a.isNaN, opB, Mux(b.isNaN, opA, Mux(pickA, opA, opB))))
+
+  val fclass    = Mux(double, Fp.classify(rs1, FpFormat.D), Fp.classify(rawA, FpFormat.S))
+
+  /**************************************************************************/
+  /* Conversions                                                            */
+  /**************************************************************************/
+  // Integer type is in the rs2 field: W, WU, L, LU
+  val intUnsigned = instr(20)
+  val intLong     = instr(21)
+
+  // FP to integer: integer part, the half bit and the sticky bit below it
+  val cvtBig      = a.exp > 63.S
+  val cvtSmall    = a.exp < -2.S
+  val cvtShift    = Mux(cvtBig || cvtSmall, 0.U, (a.exp + 2.S).asUInt(6, 0))
+  val cvtFixed    = a.sig << cvtShift
+  val cvtInt      = Mux(cvtSmall, 0.U, cvtFixed(Fp.sigW + 64, Fp.sigW + 1))
+  val cvtHalf     = !cvtSmall && cvtFixed(Fp.sigW)
+  val cvtSticky   = Mux(cvtSmall, !a.isZero, cvtFixed(Fp.sigW - 1, 0).orR)
+  val cvtMag      = cvtInt +& Fp.roundIncrement(rm, a.sign, cvtInt(0), cvtHalf, cvtSticky)
+
+  val cvtRange    = MuxCase(false.B, Seq(
+    (!intLong && !intUnsigned)  -> Mux(a.sign, cvtMag > (BigInt(1) << 31).U, cvtMag > ((BigInt(1) << 31) - 1).U),
+    (!intLong && intUnsigned)   -> Mux(a.sign, cvtMag =/= 0.U, cvtMag > ((BigInt(1) << 32) - 1).U),
+    (intLong && !intUnsigned)   -> Mux(a.sign, cvtMag > (BigInt(1) << 63).U, cvtMag > ((BigInt(1) << 63) - 1).U),
+    (intLong && intUnsigned)    -> Mux(a.sign, cvtMag =/= 0.U, cvtMag(64)),
+  ))
+  val cvtInvalid  = a.isNaN || a.isInf || cvtBig || cvtRange
+  // Out of range values saturate. NaN is the largest positive value
+  val cvtPos      = a.isNaN || !a.sign
+  val cvtSat      = MuxCase(0.U, Seq(
+    (!intLong && !intUnsigned)  -> Mux(cvtPos, "h7fffffff".U(xLen.W), "hffffffff80000000".U(xLen.W)),
+    (!intLong && intUnsigned)   -> Mux(cvtPos, Fill(xLen, 1.U(1.W)), 0.U(xLen.W)),
+    (intLong && !intUnsigned)   -> Mux(cvtPos, "h7fffffffffffffff".U(xLen.W), "h8000000000000000".U(xLen.W)),
+    (intLong && intUnsigned)    -> Mux(cvtPos, Fill(xLen, 1.U(1.W)), 0.U(xLen.W)),
+  ))
+  val cvtValue    = Mux(a.sign, 0.U - cvtMag(xLen - 1, 0), cvtMag(xLen - 1, 0))
+  // W results are sign extended, WU ones too
+  val fpToInt     = Mux(cvtInvalid, cvtSat, Mux(intLong, cvtValue, cvtValue(31, 0).asSInt.pad(xLen).asUInt))
+  val fpToIntFlags = Mux(cvtInvalid, FpFlags.NV, FpFlags(false.B, false.B, false.B, false.B, cvtHalf || cvtSticky))
+
+  // Integer to FP
+  val intSrc      = Mux(intLong, rs1, Mux(intUnsigned, rs1(31, 0).pad(xLen), rs1(31, 0).asSInt.pad(xLen).asUInt))
+  val intNeg      = !intUnsigned && intSrc(xLen - 1)
+  val intAbs      = Mux(intNeg, 0.U - intSrc, intSrc)
+  val intLz       = PriorityEncoder(Reverse(intAbs))
+  val (intToFpBits, intToFpFlags) = Fp.round(intNeg, (xLen - 1).S(Fp.expW.W) - intLz.zext, (intAbs << intLz)(xLen - 1, 0), false.B, rm, double)
+  val intToFp     = Mux(intAbs === 0.U, Fp.zero(false.B, double), intToFpBits)
+
+  // FCVT.S.D/FCVT.D.S: the source is the other format
+  val (fpToFp, fpToFpOutFlags) = Fp.convert(rs1, rm, double)
+
+  /**************************************************************************/
+  /* Single cycle result                                                    */
+  /**************************************************************************/
+  val misc      = Wire(UInt(xLen.W))
+  val miscFlags = Wire(UInt(5.W))
+  misc      := 0.U
+  miscFlags := FpFlags.NONE
+  switch(op) {
+    is(FpuOp.FSGNJ, FpuOp.FSGNJN, FpuOp.FSGNJX) { misc := sgnj }
+    is(FpuOp.FMIN, FpuOp.FMAX) {
+      misc      := minMax
+      miscFlags := Mux(anySNaN, FpFlags.NV, FpFlags.NONE)
+    }
+    // FEQ is a quiet compare, FLT/FLE signal on any NaN
+    is(FpuOp.FEQ) {
+      misc      := !anyNaN && eq
+      miscFlags := Mux(anySNaN, FpFlags.NV, FpFlags.NONE)
+    }
+    is(FpuOp.FLT) {
+      misc      := !anyNaN && lt
+      miscFlags := Mux(anyNaN, FpFlags.NV, FpFlags.NONE)
+    }
+    is(FpuOp.FLE) {
+      misc      := !anyNaN && (lt || eq)
+      miscFlags := Mux(anyNaN, FpFlags.NV, FpFlags.NONE)
+    }
+    is(FpuOp.FCLASS) { misc := fclass }
+    is(FpuOp.FCVTFI) {
+      misc      := fpToInt
+      miscFlags := fpToIntFlags
+    }
+    is(FpuOp.FCVTIF) {
+      misc      := intToFp
+      miscFlags := intToFpFlags
+    }
+    is(FpuOp.FCVTFF) {
+      misc      := fpToFp
+      miscFlags := fpToFpOutFlags
+    }
+    // Moves copy the bits, without unboxing
+    is(FpuOp.FMVFI) { misc := Mux(double, rs1, rs1(31, 0).asSInt.pad(xLen).asUInt) }
+    is(FpuOp.FMVIF) { misc := Mux(double, rs1, Fp.box(rs1)) }
+  }
+
+  /**************************************************************************/
+  /* Result                                                                 */
+  /**************************************************************************/
+  when(isFma) {
+    out.aluOut  := fmaResult.asSInt
+    out.fflags  := fmaFlags
+    out.done    := fmaDone
+    handle("FMA")
+  } .elsewhen(isDivSqrt) {
+    out.aluOut  := divSqrt.io.resp.bits.bits.asSInt
+    out.fflags  := divSqrt.io.resp.bits.flags
+    out.done    := divSqrt.io.resp.valid
+    handle("FDIV")
+  } .elsewhen(isMisc) {
+    out.aluOut  := misc.asSInt
+    out.fflags  := miscFlags
+    out.done    := true.B
+    handle("FPU")
+  }
+}
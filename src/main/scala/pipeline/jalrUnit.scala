@@ -2,16 +2,12 @@ package armleocpu
 
 import chisel3._
 import chisel3.util._
-import Instructions._
 
 class ExecuteJalrUnit(implicit ccx: CCXParams) extends ExecUnit {
-  val i = in.uop.instr
-  val rs1 = in.uop.rs1
-
   out.handled := false.B
   out.branchTaken := false.B
   out.aluOut := 0.S
 
-  when(i === JAL)       { out.aluOut := in.uop.pc.asSInt + Cat(i(31), i(19,12), i(20), i(30,21), 0.U(1.W)).asSInt; handle("JAL")}
-  .elsewhen(i === JALR) { out.aluOut := rs1.asSInt + i(31,20).asSInt;                                              handle("JALR")}
-}
\ No newline at end of file
+  // JAL: pc + imm, JALR: rs1 + imm. Operands are selected by the decode table
+  when(selected(ExecUnitSel.JUMP)) { out.aluOut := (op1 + op2).asSInt; handle("JAL/JALR") }
+}
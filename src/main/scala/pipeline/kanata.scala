@@ -0,0 +1,39 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+import chisel3.util.circt.dpi.RawClockedVoidFunctionCall
+
+/**
+ * Simulation only pipeline trace, enabled by CoreParams.kanata.
+ * Every fetch block gets a trace id in Prefetch and every uop one in Fetch, carried in PrefetchUop.seq.
+ * The stages report the events below through the kanata_event DPI function. The C++ writer in
+ * src/main/resources/kanata/kanata.cpp turns them into a Kanata log that Konata can open.
+ * Without the trace seq is zero width and no event is generated.
+ */
+object KanataTrace {
+  def seqWidth(implicit ccx: CCXParams): Int = if(ccx.core.kanata) 32 else 0
+
+  // Event kinds
+  val BLOCK_START = 0.U(8.W) // Prefetch sent the block to the I-cache
+  val BLOCK_END   = 1.U(8.W) // Fetch consumed the block
+  val BLOCK_FLUSH = 2.U(8.W) // Front-end dropped the blocks, except seq if it is one of them
+  val UOP_START   = 3.U(8.W) // New uop, pc and instr are its label
+  val STAGE       = 4.U(8.W) // Uop entered stage
+  val RETIRE      = 5.U(8.W)
+  val FLUSH       = 6.U(8.W) // Uops younger than seq and all the blocks are dropped
+  val FLUSH_FROM  = 7.U(8.W) // Same, seq is dropped too unless it retired
+
+  // Stages, the names are in the writer
+  val PREFETCH    = 0.U(8.W)
+  val FETCH       = 1.U(8.W)
+  val LOOPBUFFER  = 2.U(8.W)
+  val DECODE      = 3.U(8.W)
+  val EXECUTE     = 4.U(8.W)
+  val RETIREMENT  = 5.U(8.W)
+
+  def apply(clock: Clock, en: Bool, cycle: UInt, kind: UInt, seq: UInt, stage: UInt, pc: UInt, instr: UInt): Unit = {
+    RawClockedVoidFunctionCall("kanata_event", Some(Seq("cycle", "kind", "seq", "stage", "pc", "instr")))(
+      clock, en, cycle.pad(64)(63, 0), kind, seq.pad(32)(31, 0), stage, pc.pad(64)(63, 0), instr.pad(32)(31, 0))
+  }
+}
@@ -0,0 +1,315 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import Consts._
+
+class LoadQueueReq extends Bundle {
+  val instr       = UInt(iLen.W) // Used by LoadGen to select the size and extension
+  val rd          = UInt(physRegsLog2.W) // Physical register
+  val vaddr       = UInt(apLen.W)
+  val fp          = Bool() // FLW/FLD, rd is the architectural FP register
+  val amo         = Bool() // Read-modify-write done by the D-cache, rd gets the old value
+  val data        = UInt(xLen.W) // AMO operand
+  val cmo         = UInt(3.W) // Cache block operation, see Cmo
+}
+
+class MemResolve extends Bundle {
+  val misaligned  = Bool()
+  val accessFault = Bool()
+  val pageFault   = Bool()
+}
+
+class LoadQueueEntry extends LoadQueueReq {
+  val valid       = Bool()
+  val resolved    = Bool() // Translated and permission checked. The load is committed and can not be cancelled
+  val issued      = Bool() // Request is waiting for the cache response
+  val crosses     = Bool() // Misaligned load that continues into the next word. It is read as two words
+  val high        = Bool() // Low word was read, the next request reads the high word
+  val lowData     = Vec(xLenBytes, UInt(8.W))
+  val waitRefill  = Bool() // Missed, waits for the refill of its line before the replay
+  val early       = Bool() // Read before the older loads were done. The data was dropped, the load is read again once it is the oldest
+}
+
+/**
+ * Keeps the loads that missed in the D-cache, so that Retirement does not wait for the refill.
+ *
+ * Retirement sends the load here and waits for it to be resolved. The first cache response
+ * tells if the load faults. If it does not, Retirement commits the load and moves on. The physical rd stays
+ * busy in the regfile until the data arrives and is written through the load writeback port.
+ * Missed loads wait for the refill of their line and are replayed. Loads to the same cache line are sent in order.
+ * Loads are written back in program order, so that the loads stay ordered as TSO requires. A younger load can
+ * go to the cache while an older one waits for its refill. That resolves it and starts its own refill,
+ * but its data is dropped and it is read again once all the older loads are done.
+ * Bytes of the committed stores that are still in the store buffer are forwarded over the cache data.
+ * Misaligned loads that cross a word are read as two words, the low one first. Each word is translated separately,
+ * so the load can cross a line or a page. It is resolved when the high word is translated.
+ * AMOs are sent as one request that the D-cache executes on the line. An AMO is only resolved once it is done,
+ * so it is never replayed after the commit. Cache block operations are sent the same way.
+ * Prefetches are committed when they are allocated and dropped after their first response, hit, miss or fault.
+ */
+class LoadQueue(implicit ccx: CCXParams) extends CCXModule {
+  /**************************************************************************/
+  /*  Interface                                                             */
+  /**************************************************************************/
+  val ctrl        = IO(new PipelineControlIO)
+  val req         = IO(Flipped(DecoupledIO(new LoadQueueReq))) // From Retirement
+  val resolve     = IO(Valid(new MemResolve))                   // To Retirement
+  val wb          = IO(Valid(new RegWriteback))           // To regfile
+  val pending     = IO(Output(UInt(physRegs.W)))                // Physical registers waiting for committed loads
+  val fpWb        = IO(Valid(new FpRegWrite))                   // To FP regfile
+  val fpPending   = IO(Output(UInt(32.W)))                      // FP registers waiting for committed loads
+  val committed   = IO(Output(UInt(ccx.core.loadQueueEntries.W)))
+  val empty       = IO(Output(Bool()))
+
+  val fwd         = IO(new StoreForward)                        // From the store buffer
+  val lineCheck   = IO(new Bundle {
+    val vaddr     = Input(UInt(apLen.W))
+    val instr     = Input(UInt(iLen.W))
+    val busy      = Output(Bool()) // A load to the same line is in the queue
+  })
+
+  val cacheReq    = IO(new CacheReq)
+  val cacheResp   = IO(Flipped(new CacheResp))
+
+  /**************************************************************************/
+  /*  State                                                                 */
+  /**************************************************************************/
+  val n           = ccx.core.loadQueueEntries
+  val entries     = RegInit(VecInit(Seq.fill(n)(0.U.asTypeOf(new LoadQueueEntry))))
+  val head        = RegInit(0.U(log2Ceil(n).W)) // Oldest entry
+  val tail        = RegInit(0.U(log2Ceil(n).W)) // Next entry to allocate
+  val count       = RegInit(0.U(log2Ceil(n + 1).W)) // Slots from head to tail. Freed entries stay counted until head passes them
+
+  val inflight    = RegInit(false.B)
+  val inflightIdx = Reg(UInt(log2Ceil(n).W))
+  val fwdData     = Reg(Vec(xLenBytes, UInt(8.W)))
+  val fwdMask     = Reg(UInt(xLenBytes.W))
+
+  val loadGen     = Module(new LoadGen)
+
+  /**************************************************************************/
+  /*  Age and ordering                                                      */
+  /**************************************************************************/
+  def age(i: Int): UInt = i.U(log2Ceil(n).W) - head
+  def line(a: UInt): UInt = a(apLen - 1, cacheLineLog2)
+  // First and last line of the access, they differ only for the loads that cross a line
+  def lines(vaddr: UInt, instr: UInt): (UInt, UInt) = (line(vaddr), line(MemAccess.lastByte(vaddr, instr)))
+  def sameLine(a: (UInt, UInt), b: (UInt, UInt)): Bool = (a._1 === b._1) || (a._1 === b._2) || (a._2 === b._1) || (a._2 === b._2)
+  def entryLines(e: LoadQueueEntry): (UInt, UInt) = lines(e.vaddr, e.instr)
+
+  // An entry is blocked while any older entry to the same line is still in the queue
+  val blocked = VecInit.tabulate(n) {i => VecInit.tabulate(n) {j =>
+    (i != j).B && entries(j).valid && (age(j) < age(i)) && sameLine(entryLines(entries(j)), entryLines(entries(i)))
+  }.asUInt.orR}
+
+  // All the older loads are done. Only the oldest load keeps its data. Prefetches do not order anything
+  val oldest = VecInit.tabulate(n) {i => !VecInit.tabulate(n) {j =>
+    (i != j).B && entries(j).valid && (age(j) < age(i)) && !Cmo.isPrefetch(entries(j).cmo)
+  }.asUInt.orR}
+
+  // AMO, LR/SC and CLEAN/FLUSH/INVAL/ZERO act on the line, so they are never sent early
+  def oldestOnly(e: LoadQueueEntry): Bool = e.amo || MemAccess.isLr(e.instr) || MemAccess.isSc(e.instr) || Cmo.isManage(e.cmo)
+
+  // Early entry goes again only to translate its high word. The rest waits until it is the oldest
+  val canIssue    = VecInit.tabulate(n) {i =>
+    val e = entries(i)
+    e.valid && !e.issued && !e.waitRefill && !blocked(i) && (oldest(i) || (!oldestOnly(e) && (!e.early || e.high)))
+  }.asUInt
+  // Retirement waits for the unresolved entry, so it goes first
+  val unresolved  = VecInit(entries.map(e => e.valid && !e.resolved)).asUInt
+  val issueIdx    = Mux((canIssue & unresolved).orR, PriorityEncoder(canIssue & unresolved), PriorityEncoder(canIssue))
+
+  /**************************************************************************/
+  /*  Allocation                                                            */
+  /**************************************************************************/
+  req.ready       := (count =/= n.U) && !entries(tail).valid && !unresolved.orR
+
+  when(req.fire) {
+    entries(tail).valid     := true.B
+    entries(tail).resolved  := Cmo.isPrefetch(req.bits.cmo)
+    entries(tail).issued    := false.B
+    entries(tail).instr     := req.bits.instr
+    entries(tail).rd        := req.bits.rd
+    entries(tail).vaddr     := req.bits.vaddr
+    entries(tail).fp        := req.bits.fp
+    entries(tail).amo       := req.bits.amo
+    entries(tail).data      := req.bits.data
+    entries(tail).cmo       := req.bits.cmo
+    entries(tail).crosses   := MemAccess.crosses(req.bits.vaddr, req.bits.instr) && (req.bits.cmo === Cmo.NONE)
+    entries(tail).high      := false.B
+    entries(tail).waitRefill := false.B
+    entries(tail).early     := false.B
+    tail                    := tail + 1.U
+    log(cf"Allocate idx=${tail}, rd=${req.bits.rd}, vaddr=0x${req.bits.vaddr}%x, amo=${req.bits.amo}, cmo=${req.bits.cmo}")
+  }
+
+  // Entries are freed out of order (e.g. prefetches and faults), head skips them one per cycle
+  val headFree    = (count =/= 0.U) && !entries(head).valid
+  when(headFree) {
+    head := head + 1.U
+  }
+  count           := count + req.fire - headFree
+
+  /**************************************************************************/
+  /*  Cache request                                                         */
+  /**************************************************************************/
+  cacheReq.valid              := !inflight && canIssue.orR
+  // CLEAN/FLUSH/INVAL/ZERO neither read nor write the data, they block until the line operation is done
+  cacheReq.bits.read          := !Cmo.isManage(entries(issueIdx).cmo)
+  cacheReq.bits.write         := false.B
+  // LR and SC are sent as the atomic read/write. SC is a load and a store like the AMOs, but it is not an AMO to the cache
+  cacheReq.bits.atomicRead    := MemAccess.isLr(entries(issueIdx).instr)
+  cacheReq.bits.atomicWrite   := MemAccess.isSc(entries(issueIdx).instr)
+  cacheReq.bits.amo           := entries(issueIdx).amo && !MemAccess.isSc(entries(issueIdx).instr)
+  cacheReq.bits.nonBlocking   := !Cmo.isManage(entries(issueIdx).cmo)
+  cacheReq.bits.line          := false.B
+  cacheReq.bits.probe         := false.B
+  cacheReq.bits.cmo           := entries(issueIdx).cmo
+  def wordAddr(e: LoadQueueEntry): UInt = Mux(e.high, MemAccess.nextWord(e.vaddr), e.vaddr)
+  cacheReq.bits.vaddr         := wordAddr(entries(issueIdx))
+
+  // The store buffer is sampled together with the cache read. Stores to the lines in this queue wait for it,
+  // so only the older stores are forwarded
+  fwd.vaddr                   := wordAddr(entries(issueIdx))
+
+  when(cacheReq.fire) {
+    inflight                  := true.B
+    inflightIdx               := issueIdx
+    entries(issueIdx).issued  := true.B
+    // Low word is read again by the oldest entry, the data is kept from now on
+    when(oldest(issueIdx) && !entries(issueIdx).high) {
+      entries(issueIdx).early := false.B
+    }
+    fwdData                   := fwd.data
+    fwdMask                   := fwd.mask
+  }
+
+  /**************************************************************************/
+  /*  Cache response                                                        */
+  /**************************************************************************/
+  val e = entries(inflightIdx)
+
+  cacheResp.read              := inflight && !Cmo.isManage(e.cmo)
+  cacheResp.write             := false.B
+  cacheResp.atomicRead        := inflight && MemAccess.isLr(e.instr)
+  cacheResp.atomicWrite       := inflight && MemAccess.isSc(e.instr)
+  cacheResp.amo               := inflight && e.amo && !MemAccess.isSc(e.instr)
+  cacheResp.amoOp             := e.instr(31, 27)
+  cacheResp.cmo               := Mux(inflight, e.cmo, Cmo.NONE)
+  cacheResp.probe             := false.B
+  cacheResp.writeData         := (e.data << Cat(e.vaddr(2, 0), 0.U(3.W)))(xLen - 1, 0).asTypeOf(cacheResp.writeData)
+  cacheResp.writeMask         := loadGen.io.mask(xLenBytes - 1, 0)
+  cacheResp.writeLine         := 0.U.asTypeOf(cacheResp.writeLine)
+  cacheResp.writeLineMask     := 0.U
+
+  val wordData    = VecInit.tabulate(xLenBytes) {b => Mux(fwdMask(b), fwdData(b), cacheResp.readData(b))}
+
+  loadGen.io.vaddr            := e.vaddr(avLen - 1, 0)
+  loadGen.io.instr            := e.instr
+  loadGen.io.in               := Mux(e.high, e.lowData.asUInt, wordData.asUInt)
+  loadGen.io.inHi             := wordData.asUInt
+
+  val respValid   = inflight && cacheResp.valid && e.valid // Entry is gone if it was cancelled
+  // Cache block operations go through LoadGen as a word access. They name a whole line, any address is aligned
+  val misaligned  = loadGen.io.misaligned && (e.cmo === Cmo.NONE)
+  val fault       = misaligned || cacheResp.accessFault || cacheResp.pageFault
+  // Last word of the load. The first word of a crossing load does not resolve it
+  val last        = !e.crosses || e.high
+  val wordMask    = Mux(e.high, loadGen.io.mask(2 * xLenBytes - 1, xLenBytes), loadGen.io.mask(xLenBytes - 1, 0))
+  // All the bytes came from the store buffer, the miss does not matter. AMOs are sent with the store buffer empty.
+  // LR has to reach the cache to take the reservation
+  val hit         = !cacheResp.miss || (!e.amo && !MemAccess.isLr(e.instr) && ((wordMask & ~fwdMask) === 0.U))
+  // AMO that missed was not performed. It stays unresolved, so that Retirement waits for the replay
+  val resolves    = (last || fault) && (!e.amo || hit || fault)
+  // Data is kept only if every word was read by the oldest entry
+  val keep        = oldest(inflightIdx) && !e.early
+  val done        = hit && last && keep
+  // Refill of the missed line might end in the same cycle as the response
+  def refilled(vaddr: UInt): Bool = cacheResp.refill.valid && (vaddr(11, cacheLineLog2) === cacheResp.refill.bits(11, cacheLineLog2))
+
+  resolve.valid               := respValid && !e.resolved && resolves
+  resolve.bits.misaligned     := misaligned
+  resolve.bits.accessFault    := cacheResp.accessFault
+  resolve.bits.pageFault      := cacheResp.pageFault
+
+  wb.valid                    := respValid && !fault && done && !e.fp && (e.rd =/= 0.U)
+  wb.bits.rd                  := e.rd
+  // SC writes zero on success and one on failure
+  wb.bits.data                := Mux(MemAccess.isSc(e.instr), cacheResp.scFail.asUInt.pad(xLen), loadGen.io.out)
+
+  fpWb.valid                  := respValid && !fault && done && e.fp
+  fpWb.bits.addr              := e.rd(4, 0)
+  fpWb.bits.data              := loadGen.io.out
+
+  when(inflight && cacheResp.valid) {
+    inflight := false.B
+  }
+
+  assert(!(respValid && e.resolved && fault && !Cmo.isPrefetch(e.cmo)), "[BUG] Committed load faulted on replay")
+
+  when(respValid) {
+    e.resolved  := resolves
+    e.issued    := false.B
+    // Prefetch does not wait for its refill, the miss already started it
+    when(fault || done || Cmo.isPrefetch(e.cmo)) {
+      e.valid   := false.B
+    }
+    when(!fault && hit && !last) {
+      e.lowData := wordData
+      e.high    := true.B
+      e.early   := !keep
+    }
+    // Early load is resolved, it waits to be the oldest and is read again from the low word
+    when(!fault && hit && last && !keep) {
+      e.high    := false.B
+      e.early   := true.B
+    }
+    when(!fault && !hit) {
+      e.waitRefill := !refilled(wordAddr(e))
+    }
+    log(cf"Response idx=${inflightIdx}, rd=${e.rd}, vaddr=0x${e.vaddr}%x, miss=${cacheResp.miss}, keep=${keep}, fwdMask=0x${fwdMask}%x, fault=${fault}, data=0x${loadGen.io.out}%x")
+  }
+
+  // Compared on the untranslated index bits. A refill of another line in the same set only causes an extra replay
+  for(i <- 0 until n) {
+    when(entries(i).waitRefill && refilled(wordAddr(entries(i)))) {
+      entries(i).waitRefill := false.B
+    }
+  }
+
+  /**************************************************************************/
+  /*  Cancel                                                                */
+  /**************************************************************************/
+  // Retirement trapped (e.g. interrupt) before the load was resolved. Committed entries stay
+  when(ctrl.kill || ctrl.flush || ctrl.jump) {
+    for(i <- 0 until n) {
+      val resolvedNow = respValid && (inflightIdx === i.U) && !fault && resolves
+      when(entries(i).valid && !entries(i).resolved && !resolvedNow) {
+        entries(i).valid := false.B
+      }
+    }
+  }
+
+  /**************************************************************************/
+  /*  Regfile reservations                                                  */
+  /**************************************************************************/
+  // Busy registers are cleared on every jump/flush. Keep the ones that belong to committed loads
+  def waiting(i: Int): Bool = {
+    val resolvedNow = respValid && (inflightIdx === i.U) && !fault && resolves
+    val writtenNow  = respValid && (inflightIdx === i.U) && done
+    entries(i).valid && (entries(i).resolved || resolvedNow) && !writtenNow
+  }
+  pending := VecInit.tabulate(n) {i =>
+    Mux(waiting(i) && !entries(i).fp, UIntToOH(entries(i).rd, physRegs), 0.U(physRegs.W))
+  }.reduce(_ | _) & ~1.U(physRegs.W)
+  fpPending := VecInit.tabulate(n) {i =>
+    Mux(waiting(i) && entries(i).fp, UIntToOH(entries(i).rd(4, 0), 32), 0.U(32.W))
+  }.reduce(_ | _)
+
+  committed   := VecInit(entries.map(e => e.valid && e.resolved)).asUInt
+  lineCheck.busy := VecInit(entries.map(e => e.valid && sameLine(entryLines(e), lines(lineCheck.vaddr, lineCheck.instr)))).asUInt.orR
+  empty       := !VecInit(entries.map(_.valid)).asUInt.orR
+  ctrl.busy   := !empty
+}
@@ -0,0 +1,136 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import Consts._
+
+/**
+ * Replays short loops into Decode, so that the front-end can be stopped.
+ *
+ * When Fetch predicts a backward jump or branch taken, the instructions from its target up to the jump itself
+ * are captured on the next iteration. If the whole body fits and is sequential, the buffer becomes active:
+ * the front-end is flushed and stops fetching, and the captured uops are sent to Decode in a loop.
+ * The loop exits on any redirect (e.g. the loop branch resolved not taken) or trap, and the front-end restarts from newPc.
+ */
+class LoopBuffer(implicit ccx: CCXParams) extends CCXModule {
+  /**************************************************************************/
+  /*  Interface                                                             */
+  /**************************************************************************/
+  val ctrl          = IO(new PipelineControlIO)
+  val in            = IO(Flipped(DecoupledIO(new FetchUop))) // From fetch_storage
+  val out           = IO(DecoupledIO(new FetchUop))          // To decode
+  val active        = IO(Output(Bool()))                     // Front-end is not needed
+  val flushFrontEnd = IO(Output(Bool()))                     // Drop the fetched instructions, the buffer replays them
+  val exitPc        = IO(Output(UInt(apLen.W)))              // With flushFrontEnd: fall-through of the loop branch
+
+  /**************************************************************************/
+  /*  State                                                                 */
+  /**************************************************************************/
+  val n             = ccx.core.loopBufferEntries
+  val uops          = Reg(Vec(n, new FetchUop))
+  val count         = RegInit(0.U(log2Ceil(n + 1).W)) // Captured uops
+  val replayIdx     = RegInit(0.U(log2Ceil(n).W))
+  val branchPc      = Reg(UInt(apLen.W))              // Backward jump that closes the loop
+  val lastPcPlus4   = Reg(UInt(apLen.W))              // Next pc expected while capturing
+
+  val sIdle :: sArmed :: sCapture :: sActive :: Nil = Enum(4)
+  val state         = RegInit(sIdle)
+
+  val kill          = ctrl.kill || ctrl.flush || ctrl.jump
+  val enabled       = if(ccx.core.loopBuffer) true.B else false.B
+
+  /**************************************************************************/
+  /*  Datapath                                                              */
+  /**************************************************************************/
+  val replaying     = state === sActive
+  val u             = in.bits
+
+  // Fetched uops pass through until the loop is captured
+  out.valid         := Mux(replaying, !kill, in.valid)
+  out.bits          := Mux(replaying, uops(replayIdx), in.bits)
+  in.ready          := Mux(replaying, true.B, out.ready)
+
+  active            := replaying
+  flushFrontEnd     := false.B
+  // Front-end is parked there. Leaving the loop redirects it anyway
+  exitPc            := u.pcPlus4
+
+  /**************************************************************************/
+  /*  Capture                                                               */
+  /**************************************************************************/
+  val fault         = u.ifetchAccessFault || u.ifetchPageFault
+  // The body has at most one uop per 2 bytes, the loop branch included
+  val fits          = (u.pc <= branchPc) && ((branchPc - u.pc) <= ((n - 1) * 2).U)
+  val closing       = u.pc === branchPc
+
+  when(state === sIdle) {
+    when(enabled && out.fire && u.predTaken && !fault) {
+      branchPc      := u.pc
+      state         := sArmed
+    }
+  } .elsewhen(state === sArmed) {
+    // First uop after the predicted jump is its target
+    when(out.fire) {
+      when(fits && !fault && (!u.predTaken || closing)) {
+        uops(0)     := u
+        count       := 1.U
+        lastPcPlus4 := u.pcPlus4
+        state       := Mux(closing, sActive, sCapture)
+        when(closing) {
+          replayIdx     := 0.U
+          flushFrontEnd := true.B
+          log(cf"Active pc=0x${u.pc}%x, uops=1")
+        }
+      } .otherwise {
+        state       := Mux(u.predTaken && !fault, sArmed, sIdle)
+        branchPc    := u.pc
+      }
+    }
+  } .elsewhen(state === sCapture) {
+    when(out.fire) {
+      val sequential = u.pc === lastPcPlus4
+      when(!sequential || fault || (count === n.U) || (u.predTaken && !closing) || (closing && !u.predTaken)) {
+        // Not a simple loop, or it was left
+        state       := sIdle
+      } .otherwise {
+        uops(count) := u
+        count       := count + 1.U
+        lastPcPlus4 := u.pcPlus4
+        when(closing) {
+          // Younger instructions in the front-end are the next iteration, the buffer replays them instead
+          state         := sActive
+          replayIdx     := 0.U
+          flushFrontEnd := true.B
+          log(cf"Active start=0x${uops(0).pc}%x, branch=0x${u.pc}%x, uops=${count + 1.U}")
+        }
+      }
+    }
+  } .otherwise {
+    when(out.fire) {
+      replayIdx     := Mux(replayIdx === count - 1.U, 0.U, replayIdx + 1.U)
+    }
+  }
+
+  when(kill) {
+    when(state === sActive) {
+      log(cf"Exit newPc=0x${ctrl.newPc}%x")
+    }
+    state           := sIdle
+  }
+
+  // Every replay is a new uop in the trace. The fetched uops after the closing one are dropped
+  if(ccx.core.kanata) {
+    val replaySeq   = RegInit(0.U((KanataTrace.seqWidth - 1).W))
+    when(replaying && out.fire) {
+      replaySeq     := replaySeq + 1.U
+    }
+    when(replaying) {
+      out.bits.seq  := Cat(1.U(1.W), replaySeq)
+    }
+    kanata(replaying && out.fire, KanataTrace.UOP_START, out.bits.seq, KanataTrace.LOOPBUFFER, out.bits.pc, out.bits.instr)
+    kanata(flushFrontEnd, KanataTrace.FLUSH, u.seq, KanataTrace.LOOPBUFFER)
+  }
+
+  ctrl.busy         := replaying
+}
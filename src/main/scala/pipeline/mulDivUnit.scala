@@ -0,0 +1,214 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+import Consts._
+
+/**
+ * Radix-4 restoring divider. Two quotient bits are produced every cycle.
+ * Leading zeros of the dividend are skipped before the iterations start,
+ * so small dividends finish early.
+ */
+class Divider extends Module {
+  val io = IO(new Bundle {
+    val req = Flipped(DecoupledIO(new Bundle {
+      val dividend  = UInt(xLen.W)
+      val divisor   = UInt(xLen.W)
+      val signed    = Bool()
+      val rem       = Bool() // Return the remainder instead of the quotient
+      val word      = Bool() // *W variant: operate on lower 32 bits, sign extend the result
+    }))
+    val resp = DecoupledIO(UInt(xLen.W))
+    val kill = Input(Bool())
+  })
+
+  val sIdle :: sDiv :: sDone :: Nil = Enum(3)
+  val state = RegInit(sIdle)
+
+  val divisor   = Reg(UInt(xLen.W))
+  val remainder = Reg(UInt(xLen.W))
+  val quotient  = Reg(UInt(xLen.W)) // Dividend bits are shifted out from the top, quotient bits are shifted in from the bottom
+  val cycles    = Reg(UInt(log2Ceil(xLen / 2 + 1).W))
+  val negQuot   = Reg(Bool())
+  val negRem    = Reg(Bool())
+  val rem       = Reg(Bool())
+  val word      = Reg(Bool())
+  val result    = Reg(UInt(xLen.W))
+
+  /**************************************************************************/
+  /* Operand preparation                                                    */
+  /**************************************************************************/
+  def extend(x: UInt): UInt = Mux(io.req.bits.word,
+    Mux(io.req.bits.signed, x(31, 0).asSInt.pad(xLen).asUInt, x(31, 0).pad(xLen)),
+    x)
+
+  val a     = extend(io.req.bits.dividend)
+  val b     = extend(io.req.bits.divisor)
+  val negA  = io.req.bits.signed && a(xLen - 1)
+  val negB  = io.req.bits.signed && b(xLen - 1)
+  val absA  = Mux(negA, 0.U - a, a)
+  val absB  = Mux(negB, 0.U - b, b)
+
+  // Early termination: skip the leading zero pairs of the dividend
+  val skip  = PriorityEncoder(Reverse(absA)) & ~(1.U(log2Ceil(xLen).W))
+
+  def finish(q: UInt, r: UInt, nq: Bool, nr: Bool, isRem: Bool, isWord: Bool): UInt = {
+    val res = Mux(isRem, Mux(nr, 0.U - r, r), Mux(nq, 0.U - q, q))
+    Mux(isWord, res(31, 0).asSInt.pad(xLen).asUInt, res)
+  }
+
+  /**************************************************************************/
+  /* Iteration                                                              */
+  /**************************************************************************/
+  def step(r: UInt, q: UInt): (UInt, UInt) = {
+    val shifted = Cat(r, q(xLen - 1))
+    val diff    = Cat(0.U(1.W), shifted) - Cat(0.U(2.W), divisor)
+    val ge      = !diff(xLen + 1)
+    (Mux(ge, diff(xLen - 1, 0), shifted(xLen - 1, 0)), Cat(q(xLen - 2, 0), ge))
+  }
+
+  io.req.ready  := state === sIdle
+  io.resp.valid := state === sDone
+  io.resp.bits  := result
+
+  when(state === sIdle) {
+    when(io.req.valid && !io.kill) {
+      rem  := io.req.bits.rem
+      word := io.req.bits.word
+      when(b === 0.U) {
+        // Division by zero: quotient is all ones, remainder is the dividend. *W results are sign extended too
+        result    := finish(Fill(xLen, 1.U(1.W)), a, false.B, false.B, io.req.bits.rem, io.req.bits.word)
+        state     := sDone
+      } .elsewhen(absA < absB) {
+        // Quotient is zero, no iterations needed
+        result    := finish(0.U, absA, false.B, negA, io.req.bits.rem, io.req.bits.word)
+        state     := sDone
+      } .otherwise {
+        divisor   := absB
+        remainder := 0.U
+        quotient  := (absA << skip)(xLen - 1, 0)
+        cycles    := (xLen.U - skip) >> 1
+        negQuot   := negA ^ negB
+        negRem    := negA
+        state     := sDiv
+      }
+    }
+  } .elsewhen(state === sDiv) {
+    val (r0, q0) = step(remainder, quotient)
+    val (r1, q1) = step(r0, q0)
+    remainder := r1
+    quotient  := q1
+    cycles    := cycles - 1.U
+    when(cycles === 1.U) {
+      result  := finish(q1, r1, negQuot, negRem, rem, word)
+      state   := sDone
+    }
+  } .elsewhen(state === sDone) {
+    when(io.resp.ready) {
+      state := sIdle
+    }
+  }
+
+  when(io.kill) {
+    state := sIdle
+  }
+}
+
+class ExecuteMulDivUnit(implicit ccx: CCXParams) extends ExecUnit {
+  val rs1  = in.uop.rs1
+  val rs2  = in.uop.rs2
+  val op   = dec.aluOp
+
+  out.handled := false.B
+  out.branchTaken := false.B
+  out.aluOut := 0.S
+  out.done := false.B
+
+  val isMul = selected(ExecUnitSel.MULDIV) && ((op === AluOp.MUL) || (op === AluOp.MULH) || (op === AluOp.MULHSU) || (op === AluOp.MULHU))
+  val isDiv = selected(ExecUnitSel.MULDIV) && !isMul
+
+  /**************************************************************************/
+  /* Multiplier                                                             */
+  /**************************************************************************/
+  // The product goes through mulLatency registers, so synthesis can retime it. Execute holds the uop
+  // until the result is back, so the pipeline has one multiply in flight
+  val mulIssued   = RegInit(false.B) // Uop was sent down the multiplier pipeline
+  val mulDrop     = RegInit(false.B) // Uop in the multiplier pipeline was killed
+  val mulResult   = Reg(UInt(xLen.W))
+  val mulDone     = RegInit(false.B)
+
+  val mulSignedA  = (op === AluOp.MUL) || (op === AluOp.MULH) || (op === AluOp.MULHSU)
+  val mulSignedB  = (op === AluOp.MUL) || (op === AluOp.MULH)
+  val mulStart    = in.valid && isMul && !mulIssued && !mulDone && !in.kill
+
+  val mulA        = Cat(mulSignedA && rs1(xLen - 1), rs1).asSInt
+  val mulB        = Cat(mulSignedB && rs2(xLen - 1), rs2).asSInt
+
+  val mulReq = Wire(new Bundle {
+    val product = UInt((2 * xLen).W)
+    val high    = Bool()
+    val word    = Bool()
+  })
+  mulReq.product  := (mulA * mulB).asUInt(2 * xLen - 1, 0)
+  mulReq.high     := op =/= AluOp.MUL
+  mulReq.word     := dec.word
+
+  val mulStages = Pipe(mulStart, mulReq, ccx.core.mulLatency)
+  val product   = mulStages.bits.product
+
+  when(mulStart) {
+    mulIssued := true.B
+  }
+
+  when(mulStages.valid) {
+    mulIssued := false.B
+    when(!mulDrop && !in.kill) {
+      mulDone   := true.B
+      mulResult := Mux(mulStages.bits.word, product(31, 0).asSInt.pad(xLen).asUInt,
+                   Mux(mulStages.bits.high, product(2 * xLen - 1, xLen), product(xLen - 1, 0)))
+    }
+    mulDrop := false.B
+  } .elsewhen(in.kill && mulIssued) {
+    mulDrop := true.B
+  }
+
+  when(in.accepted || in.kill) {
+    mulDone := false.B
+  }
+
+  /**************************************************************************/
+  /* Divider                                                                */
+  /**************************************************************************/
+  // Iterative. Execute is in order, so the younger uops wait behind a divide
+  val divider = Module(new Divider)
+  val divIssued = RegInit(false.B)
+
+  divider.io.kill                 := in.kill
+  divider.io.req.valid            := in.valid && isDiv && !divIssued && !in.kill
+  divider.io.req.bits.dividend    := rs1
+  divider.io.req.bits.divisor     := rs2
+  divider.io.req.bits.signed      := (op === AluOp.DIV) || (op === AluOp.REM)
+  divider.io.req.bits.rem         := (op === AluOp.REM) || (op === AluOp.REMU)
+  divider.io.req.bits.word        := dec.word
+  divider.io.resp.ready           := in.accepted
+
+  when(divider.io.req.fire) {
+    divIssued := true.B
+  }
+  when(in.accepted || in.kill) {
+    divIssued := false.B
+  }
+
+  /**************************************************************************/
+  /* Result                                                                 */
+  /**************************************************************************/
+  when(isMul) {
+    out.aluOut  := mulResult.asSInt
+    out.done    := mulDone
+    handle("MUL")
+  } .elsewhen(isDiv) {
+    out.aluOut  := divider.io.resp.bits.asSInt
+    out.done    := divider.io.resp.valid
+    handle("DIV")
+  }
+}
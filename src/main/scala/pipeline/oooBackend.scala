@@ -0,0 +1,235 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+import chisel3.experimental.dataview._
+
+import Consts._
+
+class RobEntry(implicit val ccx: CCXParams) extends Bundle {
+  val valid       = Bool()
+  val done        = Bool() // Result is written, the entry can retire when it reaches the head
+  val uop         = new ExecuteUop
+}
+
+class IssueQueueEntry(implicit val ccx: CCXParams) extends Bundle {
+  val valid       = Bool()
+  val robIdx      = UInt(log2Ceil(ccx.core.robEntries).W)
+  val uop         = new DecodeUop // Operands are captured here as they become ready
+  val rs1Ready    = Bool()
+  val rs2Ready    = Bool()
+}
+
+/**
+ * Out of order replacement of the Execute stage.
+ *
+ * Decode sends the renamed uops in program order. Each uop gets a reorder buffer (ROB) entry and waits in the
+ * issue queue until its operands are ready. Operands are taken from the regfile read in Decode, from the finished
+ * ROB entries, or from the results broadcast when they are computed. Ready uops are issued oldest first
+ * to issueWidth ports, each with its own set of execution units.
+ * The ROB sends the finished uops to Retirement in program order, so traps stay precise.
+ * Loads and stores only compute the address here, the memory access is done in order by Retirement.
+ */
+class OooBackend(implicit ccx: CCXParams) extends ExecuteBackEnd {
+  /**************************************************************************/
+  /*  Interface                                                             */
+  /**************************************************************************/
+  val physBusy      = IO(Input(UInt(physRegs.W)))                    // Physical registers not written yet
+  val regWrites     = IO(Input(Vec(ccx.core.retireWidth + 1, Valid(new RegWriteback)))) // Retire and load queue writes
+
+  redirect.valid    := false.B
+  redirect.bits     := 0.U
+
+  /**************************************************************************/
+  /*  State                                                                 */
+  /**************************************************************************/
+  val robN          = ccx.core.robEntries
+  val iqN           = ccx.core.issueQueueEntries
+  val ports         = ccx.core.issueWidth
+
+  val rob           = RegInit(VecInit(Seq.fill(robN)(0.U.asTypeOf(new RobEntry))))
+  val robHead       = RegInit(0.U(log2Ceil(robN).W)) // Oldest uop, retires first
+  val robTail       = RegInit(0.U(log2Ceil(robN).W)) // Next entry to allocate
+  val robCount      = RegInit(0.U(log2Ceil(robN + 1).W))
+
+  val iq            = RegInit(VecInit(Seq.fill(iqN)(0.U.asTypeOf(new IssueQueueEntry))))
+
+  val portValid     = RegInit(VecInit(Seq.fill(ports)(false.B)))
+  val portRob       = Reg(Vec(ports, UInt(log2Ceil(robN).W)))
+  val portUop       = Reg(Vec(ports, new DecodeUop))
+
+  val kill          = ctrl.kill || ctrl.flush || ctrl.jump
+
+  /**************************************************************************/
+  /*  Execution ports                                                       */
+  /**************************************************************************/
+  val portDone      = Wire(Vec(ports, Bool()))
+  // rd is not known when the uop completes here. It is written after Retirement commits the uop
+  def lateResult(d: DecodedCtrl): Bool = d.load || d.unit(ExecUnitSel.VECTOR)
+  val complete      = Wire(Vec(ports, Valid(new RegWriteback))) // Results broadcast to the waiting uops
+
+  for(p <- 0 until ports) {
+    val units: Seq[ExecUnit] = ExecUnits()
+    units.foreach(f => {
+      f.in.valid    := portValid(p)
+      f.in.uop      := portUop(p)
+      f.in.kill     := kill
+      f.in.accepted := portDone(p)
+      f.in.frm      := frm
+    })
+    val handled     = units.map(_.out.handled)
+    val anyHandled  = VecInit(handled).asUInt.orR
+    val unitOut     = Mux1H(handled, units.map(_.out))
+
+    // Unknown instructions are passed to Retirement, so it can raise the illegal instruction
+    portDone(p)           := portValid(p) && (!anyHandled || unitOut.done) && !kill
+    // Load results come from the load queue, vector results from Retirement
+    complete(p).valid     := portDone(p) && portUop(p).dec.rdWrite && !lateResult(portUop(p).dec)
+    complete(p).bits.rd   := portUop(p).rdPhys
+    complete(p).bits.data := unitOut.aluOut.asUInt
+
+    when(portDone(p)) {
+      val e = rob(portRob(p))
+      e.done := true.B
+      e.uop.viewAsSupertype(new DecodeUop) := portUop(p)
+      e.uop.aluOut      := Mux(anyHandled, unitOut.aluOut, 0.S)
+      e.uop.branchTaken := anyHandled && unitOut.branchTaken
+      e.uop.fflags      := Mux(anyHandled, unitOut.fflags, 0.U)
+      e.uop.redirected  := false.B // Younger uops are already renamed and in the ROB, so branches are resolved by Retirement
+      portValid(p)      := false.B
+      log(cf"Complete port=${p}, rob=${portRob(p)}, pc=0x${portUop(p).pc}%x, rd=${portUop(p).rdPhys}, result=0x${unitOut.aluOut}%x")
+    }
+  }
+
+  /**************************************************************************/
+  /*  Operand readiness                                                     */
+  /**************************************************************************/
+  val wakeups       = complete ++ regWrites
+
+  def wakeupHit(phys: UInt): Bool = wakeups.map(w => w.valid && (w.bits.rd === phys)).reduce(_ || _)
+  def wakeupData(phys: UInt): UInt = Mux1H(wakeups.map(w => (w.valid && (w.bits.rd === phys)) -> w.bits.data))
+
+  // Finished uops that are not retired yet. A physical register has at most one producer in the ROB
+  def robHit(phys: UInt): UInt = VecInit(rob.map(e =>
+    e.valid && e.done && e.uop.dec.rdWrite && !lateResult(e.uop.dec) && (e.uop.rdPhys === phys))).asUInt
+
+  // Value read in Decode is valid once the register is no longer busy
+  def source(phys: UInt, value: UInt): (Bool, UInt) = {
+    val hitRob = robHit(phys)
+    val ready  = !physBusy(phys) || wakeupHit(phys) || hitRob.orR
+    val data   = Mux(wakeupHit(phys), wakeupData(phys),
+                 Mux(hitRob.orR, Mux1H(hitRob, rob.map(_.uop.aluOut.asUInt)), value))
+    (ready, data)
+  }
+
+  for(i <- 0 until iqN) {
+    val e = iq(i)
+    when(e.valid && !e.rs1Ready && wakeupHit(e.uop.rs1Phys)) {
+      e.rs1Ready  := true.B
+      e.uop.rs1   := wakeupData(e.uop.rs1Phys)
+    }
+    when(e.valid && !e.rs2Ready && wakeupHit(e.uop.rs2Phys)) {
+      e.rs2Ready  := true.B
+      e.uop.rs2   := wakeupData(e.uop.rs2Phys)
+    }
+  }
+
+  /**************************************************************************/
+  /*  Dispatch                                                              */
+  /**************************************************************************/
+  val iqFree        = VecInit(iq.map(!_.valid)).asUInt
+  val iqAlloc       = PriorityEncoder(iqFree)
+
+  in.ready          := (robCount =/= robN.U) && iqFree.orR && !kill
+
+  // FP operands are read in Decode after their producers have retired, they are ready.
+  // Vector register and immediate fields are not operands here
+  val (rs1IntReady, rs1Data) = source(in.bits.rs1Phys, in.bits.rs1)
+  val (rs2IntReady, rs2Data) = source(in.bits.rs2Phys, in.bits.rs2)
+  val rs1Ready      = rs1IntReady || in.bits.dec.fp.rs1 || in.bits.dec.vec.vs1
+  val rs2Ready      = rs2IntReady || in.bits.dec.fp.rs2 || in.bits.dec.vec.vs2
+
+  when(in.fire) {
+    rob(robTail).valid        := true.B
+    rob(robTail).done         := false.B
+    robTail                   := robTail + 1.U
+
+    iq(iqAlloc).valid         := true.B
+    iq(iqAlloc).robIdx        := robTail
+    iq(iqAlloc).uop           := in.bits
+    iq(iqAlloc).uop.rs1       := Mux(in.bits.dec.fp.rs1, in.bits.rs1, rs1Data)
+    iq(iqAlloc).uop.rs2       := Mux(in.bits.dec.fp.rs2, in.bits.rs2, rs2Data)
+    iq(iqAlloc).rs1Ready      := rs1Ready
+    iq(iqAlloc).rs2Ready      := rs2Ready
+    log(cf"Dispatch rob=${robTail}, iq=${iqAlloc}, pc=0x${in.bits.pc}%x, rs1Ready=${rs1Ready}, rs2Ready=${rs2Ready}")
+  }
+  kanata(in.fire, KanataTrace.STAGE, in.bits.seq, KanataTrace.EXECUTE)
+
+  /**************************************************************************/
+  /*  Issue                                                                 */
+  /**************************************************************************/
+  def age(robIdx: UInt): UInt = robIdx - robHead
+
+  // Oldest valid entry of the mask
+  def oldest(mask: UInt): (Bool, UInt) = {
+    val items = (0 until iqN).map(i => (mask(i), age(iq(i).robIdx), i.U(log2Ceil(iqN).W)))
+    val (valid, _, idx) = items.reduce((a, b) => {
+      val pickB = b._1 && (!a._1 || (b._2 < a._2))
+      (a._1 || b._1, Mux(pickB, b._2, a._2), Mux(pickB, b._3, a._3))
+    })
+    (valid, idx)
+  }
+
+  val readyMask     = VecInit(iq.map(e => e.valid && e.rs1Ready && e.rs2Ready)).asUInt
+  var taken         = 0.U(iqN.W)
+
+  for(p <- 0 until ports) {
+    val portFree    = !portValid(p) || portDone(p)
+    val (selValid, sel) = oldest(readyMask & ~taken)
+    val issue       = portFree && selValid && !kill
+
+    when(issue) {
+      portValid(p)  := true.B
+      portRob(p)    := iq(sel).robIdx
+      portUop(p)    := iq(sel).uop
+      iq(sel).valid := false.B
+      log(cf"Issue port=${p}, rob=${iq(sel).robIdx}, pc=0x${iq(sel).uop.pc}%x")
+    }
+    taken = taken | Mux(issue, UIntToOH(sel, iqN), 0.U)
+  }
+
+  /**************************************************************************/
+  /*  Retire                                                                */
+  /**************************************************************************/
+  // Retirement takes the finished uops from the head. The extra ones are only taken together with the older ones
+  val retirePorts   = out +: outExtra
+  for((o, i) <- retirePorts.zipWithIndex) {
+    val idx = robHead + i.U
+    o.valid         := rob(idx).valid && rob(idx).done
+    o.bits          := rob(idx).uop
+    when(o.fire) {
+      rob(idx).valid := false.B
+    }
+  }
+  val retired       = PopCount(retirePorts.map(_.fire))
+  robHead           := robHead + retired
+
+  robCount          := robCount + in.fire - retired
+
+  /**************************************************************************/
+  /*  Flush                                                                 */
+  /**************************************************************************/
+  // Retirement redirects or traps: everything younger than the retired uop is dropped
+  when(kill) {
+    rob.foreach(_.valid := false.B)
+    iq.foreach(_.valid := false.B)
+    portValid.foreach(_ := false.B)
+    robHead   := 0.U
+    robTail   := 0.U
+    robCount  := 0.U
+  }
+
+  ctrl.busy := robCount =/= 0.U
+  // Oldest uop is still waiting for its operands or its unit
+  topDown   := Mux((robCount =/= 0.U) && !rob(robHead).done, TopDown.BACKEND_CORE, TopDown.NONE)
+}
@@ -5,9 +5,10 @@ import chisel3.util._
 
 import Consts._
 // PREFETCH
-class PrefetchUop extends Bundle {
+class PrefetchUop(implicit val ccx: CCXParams) extends Bundle {
   val pc                  = UInt(apLen.W)
-  val pcPlus4           = UInt(apLen.W)
+  val pcPlus4           = UInt(apLen.W) // Next sequential instruction, pc + 2 for the compressed ones
+  val seq               = UInt(KanataTrace.seqWidth.W) // Trace id of the block/uop, zero width without the trace
 
   override def toPrintable: Printable = {cf"@ $pc%x\n"}
 }
@@ -21,9 +22,17 @@ class Prefetch(implicit ccx: CCXParams) extends CCXModule {
   /**************************************************************************/
 
   val ctrl              = IO(new PipelineControlIO)
-  val out               = IO(DecoupledIO(new PrefetchUop))
+  val in                = IO(Flipped(DecoupledIO(new FetchTarget))) // From the fetch target queue
+  val hint              = IO(Flipped(DecoupledIO(UInt(apLen.W)))) // From the fetch target queue: line to prefetch
+  val swHint            = IO(Flipped(Valid(UInt(apLen.W)))) // From Retirement: prefetch.i
+  val park              = IO(Input(Bool())) // From Retirement: hart waits in WFI/WRS/pause, nothing is fetched
+  val out               = IO(DecoupledIO(new FetchTarget))
 
   val cacheReq          = IO(new CacheReq)
+  val redirect          = IO(Flipped(Valid(UInt(apLen.W)))) // From fetch: predicted jump/branch target
+  val fetchReady        = IO(Input(Bool())) // Fetch has room for the next block and no block is waiting for the cache
+  val cacheIdle         = IO(Input(Bool())) // No response is expected, a hint can be sent
+  val topDown           = IO(Output(UInt(3.W))) // Class of the cycle, see TopDown
 
   val dynRegs           = IO(Input(new DynamicROCsrRegisters))
   val csr               = IO(Input(new CsrRegsOutput))
@@ -31,73 +40,94 @@ class Prefetch(implicit ccx: CCXParams) extends CCXModule {
   /**************************************************************************/
   /*  State                                                                 */
   /**************************************************************************/
-  val pc                    = Reg(UInt(apLen.W))
-  val pcPlus4               = Reg(UInt(apLen.W))
-  val pcRestart             = RegInit(true.B) // Next pc should be PC register
-  val active                = RegInit(false.B)
+  // Blocks are aligned xLen reads. With RVC they can start at any halfword,
+  // so the pc is only unaligned for the first block after a jump
+  val active                = RegInit(false.B) // Request was accepted by the cache in the previous cycle
 
-  cacheReq.valid            := false.B
-  cacheReq.bits.vaddr       := Mux(pcRestart, pc, pcPlus4)
+  val outReg                = Reg(new FetchTarget)
+  val outRegValid           = RegInit(false.B)
+
+  // Last prefetch.i. It outlives kills, the instruction is already retired
+  val swHintValid           = RegInit(false.B)
+  val swHintAddr            = Reg(UInt(apLen.W))
+
+  val kill                  = ctrl.kill || ctrl.jump || ctrl.flush
+  val free                  = !kill && !park && !redirect.valid && !(outRegValid && !out.ready)
+
+  // Demand blocks go first. Hints use the cache only while Fetch does not need it.
+  // They are non-blocking reads: a miss starts the refill and the data is dropped
+  val demand                = free && fetchReady && in.valid
+  // Software hint goes before the predicted line
+  val probe                 = free && !fetchReady && cacheIdle && !outRegValid && (swHintValid || hint.valid)
+  val probeAddr             = Mux(swHintValid, swHintAddr, hint.bits)
+
+  cacheReq.valid            := demand || probe
+  cacheReq.bits.vaddr       := Mux(demand, in.bits.pc, probeAddr)
   cacheReq.bits.read        := true.B
   cacheReq.bits.write       := false.B
   cacheReq.bits.atomicRead  := false.B
   cacheReq.bits.atomicWrite := false.B
+  cacheReq.bits.amo         := false.B
+  cacheReq.bits.nonBlocking := !demand
+  cacheReq.bits.line        := false.B
+  cacheReq.bits.cmo         := Cmo.NONE
+  cacheReq.bits.probe       := false.B
 
-  out.bits.pc               := pc
-  out.bits.pcPlus4          := pcPlus4
+  in.ready                  := demand && cacheReq.ready
+  topDown                   := Mux(demand && !cacheReq.ready, TopDown.FRONTEND, TopDown.NONE)
+  // Hint is dropped if the cache is busy, the demand read will bring the line anyway
+  hint.ready                := probe && !swHintValid
 
-  val stall                 = WireDefault(true.B)
+  active                    := false.B
 
-  val outReg                = Reg(new PrefetchUop)
-  val outRegValid           = RegInit(false.B)
+  when(out.fire) {
+    outRegValid             := false.B
+  }
+
+  when(cacheReq.fire) {
+    active                  := true.B
+    outReg                  := in.bits
+    outReg.probe            := probe
+    when(probe) {
+      outReg.pc             := probeAddr
+      swHintValid           := false.B
+    }
+    outRegValid             := true.B
+    log(cf"PREFETCH: 0x${cacheReq.bits.vaddr}%x accepted by ICACHE, probe=${probe}")
+  } .elsewhen(demand) {
+    log(cf"PREFETCH: 0x${in.bits.pc}%x rejected")
+  }
 
-  when(!stall) {
-    cacheReq.valid       := true.B
-    
-    when(cacheReq.ready) {
-      active                  := true.B
-      outReg.pc               := pc
-      outReg.pcPlus4          := pcPlus4
-      outRegValid             := true.B
-      pcRestart               := false.B
-
-      pc                      := pcPlus4
-      pcPlus4                 := pcPlus4 + 4.U
-      log(cf"PREFETCH: active from 0x${pc}%x and accepted by ICACHE")
-    } .otherwise {
-      pcRestart               := true.B // Prevent the PC to be incremented until the cache has accepted the request
-      active                  := false.B
-      log(cf"PREFETCH: active from 0x${pc}%x rejected")
+  // Trace ids of the demand blocks. Probes are dropped by Fetch, they are not traced
+  if(ccx.core.kanata) {
+    val blockSeq            = RegInit(0.U(KanataTrace.seqWidth.W))
+    when(cacheReq.fire && demand) {
+      outReg.seq            := blockSeq
+      blockSeq              := blockSeq + 1.U
     }
+    kanata(cacheReq.fire && demand, KanataTrace.BLOCK_START, blockSeq, KanataTrace.PREFETCH, in.bits.pc)
+  }
+
+  // After the probe above, a new prefetch.i wins over the one just sent
+  when(swHint.valid) {
+    swHintValid             := true.B
+    swHintAddr              := swHint.bits
+    log(cf"PREFETCH: prefetch.i 0x${swHint.bits}%x")
   }
 
   out.bits  := outReg
   out.valid := outRegValid
 
 
-  when(ctrl.kill) {
-    stall     := true.B
-    pc        := ctrl.newPc
-    pcPlus4   := ctrl.newPc + 4.U
-    pcRestart := true.B
-    active    := false.B // The cache operation has been killed
-  } .elsewhen(ctrl.jump || ctrl.flush) {
-    pc        := ctrl.newPc
-    pcPlus4   := ctrl.newPc + 4.U
-    pcRestart := true.B
-    stall     := !ctrl.jump
-    active    := false.B // The cache operation has been killed
-  } .otherwise {
-    stall     := !(!active || (out.valid && out.ready))
+  when(kill || redirect.valid) {
+    // The cache operation has been killed. The fetch target queue restarts from the new pc
+    active      := false.B
+    outRegValid := false.B
+    when(!kill) {
+      log(cf"PREFETCH: redirect to 0x${redirect.bits}%x")
+    }
   }
 
   
   ctrl.busy   := active || out.valid
-
-  when(reset.asBool) {
-    pc := dynRegs.resetVector
-    pcPlus4 := dynRegs.resetVector + 4.U
-    pcRestart := true.B
-  }
 }
-
@@ -27,14 +27,29 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
   val debugReq     = IO(Input(Bool()))
   val dmHaltAddr   = IO(Input(UInt(apLen.W))) // FIXME: use this for halting
   //val debug_state_o   = IO(Output(UInt(2.W))) // FIXME: Output the state
-  val rvfi            = IO(Output(new rvfi_o))
+  val rvfi            = IO(Output(Vec(ccx.core.retireWidth, new rvfi_o))) // One channel per retired uop
 
 
   val in         = IO(Flipped(DecoupledIO(new ExecuteUop)))
-
-
-  val regs_retire      = IO(Flipped(new regs_retire_io))
+  val inExtra    = IO(Vec(ccx.core.retireWidth - 1, Flipped(DecoupledIO(new ExecuteUop)))) // Younger than in
+
+
+  val regs_retire      = IO(Vec(ccx.core.retireWidth, Flipped(new regs_retire_io)))
+  val fregs_retire    = IO(Valid(new FpRegWrite))
+  val lqReq           = IO(DecoupledIO(new LoadQueueReq))
+  val lqResolve       = IO(Flipped(Valid(new MemResolve)))
+  val lqEmpty         = IO(Input(Bool()))
+  val sbReq           = IO(DecoupledIO(new StoreBufferReq))
+  val sbResolve       = IO(Flipped(Valid(new MemResolve)))
+  val sbEmpty         = IO(Input(Bool()))
+  val prefetchI       = IO(Valid(UInt(apLen.W)))  // To Prefetch: line of prefetch.i
+  val reservationValid = IO(Input(Bool()))         // From the D-cache: LR reservation is held
+  val parked          = IO(Output(Bool()))         // To Prefetch: hart waits in WFI/WRS/pause
+  val vecReq          = IO(DecoupledIO(new VectorReq))
+  val vecResp         = IO(Flipped(Valid(new VectorResp)))
   val csrRegs         = IO(Output (new CsrRegsOutput))
+  val perf            = IO(Input  (new PerfEvents)) // Events of the other stages, Retirement adds its own
+  val topDown         = IO(Output (UInt(3.W)))      // Class of the cycle, see TopDown
 
   val ctrl            = IO(Flipped(new PipelineControlIO))
 
@@ -81,9 +96,9 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
   /*
   val saved_tlb_ptag      = Reg(chiselTypeOf(dtlb.s1.read_data.ptag))
   */
-  // If load then cache/tlb request. If store then request is sent to dbus
+  // If load then the request is sent to the load queue. If store then request is sent to the store buffer
   val WB_REQUEST_WRITE_START  = 0.U(4.W)
-  // Compare the tags, the cache tags, and decide where to proceed
+  // Wait for the load queue/store buffer to resolve the request
   val WB_COMPARE              = 1.U(4.W)
   val WB_TLBREFILL            = 2.U(4.W)
   val WB_CACHEREFILL          = 3.U(4.W)
@@ -91,25 +106,58 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
   val wbstate             = RegInit(WB_REQUEST_WRITE_START)
   val pcNext              = RegInit(0.U(apLen.W))
 
+  // WFI/WRS/pause park the hart after they retire, see WaitUnit
+  val waitUnit            = Module(new WaitUnit)
+
   /**************************************************************************/
   /*                                                                        */
   /*                COMB                                                    */
   /*                                                                        */
   /**************************************************************************/
-  /*val wb_is_atomic =
-        (in.bits.instr === LR_W) ||
-        (in.bits.instr === LR_D) ||
-        (in.bits.instr === SC_W) ||
-        (in.bits.instr === SC_D)
-  */
+  // AMOs and SC are both a load and a store. LR is a load
+  val amo           = in.bits.dec.load && in.bits.dec.store
+  val amoMisaligned = (in.bits.aluOut.asUInt & MemAccess.bytesMinus1(in.bits.instr)) =/= 0.U
+  val cmoOp         = MemAccess.cmo(in.bits.instr) // Cache block operation, see Cmo
+  val waitInstr     = (in.bits.instr === WFI) || (in.bits.instr === WRS_NTO) || (in.bits.instr === WRS_STO) || (in.bits.instr === PAUSE)
+  val parkNow       = waitUnit.park // Wait instruction retired and parks the hart
   /**************************************************************************/
   /*                Pipeline combinational signals                          */
   /**************************************************************************/
   in.ready           := false.B
-  regs_retire.commit := false.B
-  regs_retire.rd_addr  := in.bits.instr(11, 7)
-  regs_retire.rd_write := false.B
-  regs_retire.rd_wdata := in.bits.aluOut.asUInt
+  regs_retire(0).commit := false.B
+  regs_retire(0).rd_addr  := in.bits.instr(11, 7)
+  regs_retire(0).rd_write := false.B
+  regs_retire(0).rd_pending := false.B
+  regs_retire(0).rd_phys  := in.bits.rdPhys
+  regs_retire(0).rd_old_phys := in.bits.rdOldPhys
+  regs_retire(0).rd_wdata := in.bits.aluOut.asUInt
+
+  fregs_retire.valid      := false.B
+  fregs_retire.bits.addr  := in.bits.instr(11, 7)
+  fregs_retire.bits.data  := in.bits.aluOut.asUInt
+
+  lqReq.valid       := false.B
+  lqReq.bits.instr  := in.bits.instr
+  // FP registers are not renamed, FP loads write the architectural register
+  lqReq.bits.rd     := Mux(in.bits.dec.fp.rd, in.bits.instr(11, 7), Mux(in.bits.dec.rdWrite, in.bits.rdPhys, 0.U)) // Physical register 0 is never written
+  lqReq.bits.fp     := in.bits.dec.fp.rd
+  lqReq.bits.vaddr  := in.bits.aluOut.asUInt(apLen - 1, 0)
+  lqReq.bits.amo    := amo
+  lqReq.bits.data   := in.bits.rs2
+
+  prefetchI.valid   := false.B
+  prefetchI.bits    := in.bits.aluOut.asUInt(apLen - 1, 0)
+
+  sbReq.valid       := false.B
+  sbReq.bits.instr  := in.bits.instr
+  sbReq.bits.vaddr  := in.bits.aluOut.asUInt(apLen - 1, 0)
+  sbReq.bits.data   := in.bits.rs2
+
+  vecReq.valid      := false.B
+  vecReq.bits.instr := in.bits.instr
+  vecReq.bits.dec   := in.bits.dec
+  vecReq.bits.rs1   := in.bits.rs1
+  vecReq.bits.rs2   := in.bits.rs2
 
   val wdata_select = Wire(UInt((xLen).W))
   if(busBytes == (xLenBytes)) {
@@ -126,12 +174,62 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
   /**************************************************************************/
   csr.io.int           <> int
   csrRegs           := csr.io.regsOut
-  csr.io.instRetIncr  := false.B //
+  vecReq.bits.cfg   := csr.io.regsOut.vec
+  vecReq.bits.vstart := csr.io.regsOut.vstart
+
+  // Cache block operations. Below M, menvcfg enables them, and senvcfg too for U. cbo.inval may be executed as a flush
+  val envM          = csr.io.regsOut.menvcfg
+  val envS          = csr.io.regsOut.senvcfg
+  val privM         = csr.io.regsOut.priv === Privilege.M
+  val privU         = csr.io.regsOut.priv === Privilege.USER
+  val cbze          = privM || (envM.cbze && (!privU || envS.cbze))
+  val cbcfe         = privM || (envM.cbcfe && (!privU || envS.cbcfe))
+  val cbie          = privM || (envM.cbie(0) && (!privU || envS.cbie(0)))
+  val cbieInval     = privM || ((envM.cbie === 3.U) && (!privU || (envS.cbie === 3.U)))
+  val cmoIllegal    = MuxLookup(cmoOp, false.B)(Seq(Cmo.CLEAN -> !cbcfe, Cmo.FLUSH -> !cbcfe, Cmo.INVAL -> !cbie, Cmo.ZERO -> !cbze))
+  lqReq.bits.cmo    := Mux((cmoOp === Cmo.INVAL) && !cbieInval, Cmo.FLUSH, cmoOp)
+
+  // Parked hart. The front-end does not fetch meanwhile, so a spin loop makes no bus traffic
+  waitUnit.retire           := false.B
+  waitUnit.instr            := in.bits.instr
+  waitUnit.priv             := csr.io.regsOut.priv
+  waitUnit.tw               := csr.io.regsOut.tw
+  waitUnit.reservationValid := reservationValid
+  waitUnit.interruptWake    := csr.io.interruptWake
+  waitUnit.debugReq         := debugReq
+  parked                    := waitUnit.parked
+
+  val instRet0         = WireDefault(0.U(2.W)) // Retired by in
   csr.io.addr          := in.bits.instr(31, 20) // Constant
   csr.io.cause         := 0.U // FIXME: Need to be properly set
   csr.io.cmd           := csr_cmd.none
   csr.io.epc           := in.bits.pc
   csr.io.in            := 0.U // FIXME: Needs to be properly connected
+  csr.io.fflags        := 0.U
+  csr.io.fsDirty       := false.B
+  csr.io.vecConfig.valid := false.B
+  csr.io.vecConfig.bits  := VecConfig(in.bits.instr, in.bits.rs1, in.bits.rs2, csr.io.regsOut.vec)
+  csr.io.vstart.valid  := false.B
+  csr.io.vstart.bits   := 0.U
+  csr.io.vsDirty       := false.B
+  csr.io.perf          := perf
+  csr.io.perf.flush    := ctrl.flush
+
+  // FP state is disabled while mstatus.FS is Off. Reserved rounding modes are illegal, for the dynamic one too
+  val fpInstr          = in.bits.dec.fp.any || in.bits.dec.unit(ExecUnitSel.FPU)
+  val fpOff            = csr.io.regsOut.fs === 0.U
+  val rm               = in.bits.instr(14, 12)
+  val rmInvalid        = in.bits.dec.fp.rm && ((rm === 5.U) || (rm === 6.U) || ((rm === 7.U) && (csr.io.regsOut.frm >= 5.U)))
+
+  // Vector state is disabled while mstatus.VS is Off. Everything but vsetvl* needs a valid vtype.
+  // Register groups are not supported, so the loads/stores can not use an EEW that needs more than one register.
+  // Only the loads/stores resume from a nonzero vstart
+  val vecInstr         = in.bits.dec.unit(ExecUnitSel.VECTOR)
+  val vecCfg           = csr.io.regsOut.vec
+  val vecSetvl         = in.bits.dec.aluOp === VecOp.SETVL
+  val vecMem           = in.bits.dec.load || in.bits.dec.store
+  val vecIllegal       = (csr.io.regsOut.vs === 0.U) || (!vecSetvl && (vecCfg.vill ||
+                         Mux(vecMem, (in.bits.dec.memSize +& vecCfg.lmulShift) > vecCfg.vsew, csr.io.regsOut.vstart =/= 0.U)))
   
   csr.dynRegs <> dynRegs
   csr.staticRegs <> staticRegs
@@ -257,49 +355,47 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
   /*                RVFI                                                    */
   /**************************************************************************/
 
-  rvfi.valid := false.B
-  rvfi.halt := false.B
-  // rvfi.ixl  := Mux(xLen.U === 32.U, 1.U, 2.U) // TODO: RVC
-  rvfi.mode := csr.io.regsOut.priv
+  rvfi(0).valid := false.B
+  rvfi(0).halt := false.B
+  // rvfi(0).ixl  := Mux(xLen.U === 32.U, 1.U, 2.U) // TODO: RVC
+  rvfi(0).mode := csr.io.regsOut.priv
 
-  rvfi.trap := false.B // FIXME: rvfi.trap
-  rvfi.halt := false.B // FIXME: rvfi.halt
-  rvfi.intr := false.B // FIXME: rvfi.intr
+  rvfi(0).trap := false.B // FIXME: rvfi(0).trap
+  rvfi(0).halt := false.B // FIXME: rvfi(0).halt
+  rvfi(0).intr := false.B // FIXME: rvfi(0).intr
   
   val order = RegInit(0.U(64.W))
-  rvfi.order := order
-  when(rvfi.valid) {
-    order := order + 1.U
-  }
+  rvfi(0).order := order
+  order := order + PopCount(rvfi.map(_.valid))
   
-  rvfi.insn := in.bits.instr
+  rvfi(0).insn := in.bits.instr // FIXME: RVFI: Compressed instructions are reported expanded
 
-  rvfi.rs1_addr := in.bits.instr(19, 15)
-  rvfi.rs1_rdata := Mux(rvfi.rs1_addr === 0.U, 0.U, in.bits.rs1)
-  rvfi.rs2_addr := in.bits.instr(24, 20)
-  rvfi.rs2_rdata := Mux(rvfi.rs2_addr === 0.U, 0.U, in.bits.rs2)
+  rvfi(0).rs1_addr := in.bits.instr(19, 15)
+  rvfi(0).rs1_rdata := Mux(rvfi(0).rs1_addr === 0.U, 0.U, in.bits.rs1)
+  rvfi(0).rs2_addr := in.bits.instr(24, 20)
+  rvfi(0).rs2_rdata := Mux(rvfi(0).rs2_addr === 0.U, 0.U, in.bits.rs2)
   
-  rvfi.rd_addr  := 0.U // No write === 0 addr
-  rvfi.rd_wdata := 0.U // Do not write unless valid
+  rvfi(0).rd_addr  := 0.U // No write === 0 addr
+  rvfi(0).rd_wdata := 0.U // Do not write unless valid
 
 
-  rvfi.pc_rdata := in.bits.pc
-  rvfi.pc_wdata := pcNext
+  rvfi(0).pc_rdata := in.bits.pc
+  rvfi(0).pc_wdata := pcNext
 
   // This probably needs updating. Use virtual addresses instead
 
 
   // FIXME: s1_paddr cannot be zero
   val s1_paddr = 0.U(1.W)
-  rvfi.mem_addr := s1_paddr // FIXME: Need to be muxed depending on vm_enabled
-  rvfi.mem_rmask := 0.U // FIXME: rvfi.mem_rmask
-  rvfi.mem_wmask := 0.U // FIXME: rvfi.mem_wmask
-  rvfi.mem_rdata := regs_retire.rd_wdata // FIXME: rvfi.mem_rdata
+  rvfi(0).mem_addr := s1_paddr // FIXME: Need to be muxed depending on vm_enabled
+  rvfi(0).mem_rmask := 0.U // FIXME: rvfi(0).mem_rmask
+  rvfi(0).mem_wmask := 0.U // FIXME: rvfi(0).mem_wmask
+  rvfi(0).mem_rdata := regs_retire(0).rd_wdata // FIXME: rvfi(0).mem_rdata
   // FIXME: Need proper value based on bus, not on something else
 
 // TODO: Add ptes
 
-  rvfi.mem_wdata := 0.U  // FIXME: rvfi.mem_wdata
+  rvfi(0).mem_wdata := 0.U  // FIXME: rvfi(0).mem_wdata
 
   // TODO: FMAX: Add registerl slice
 
@@ -318,15 +414,16 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
   // and instRetIncr
   def instr_cplt(br_pc_valid: Bool = false.B, br_pc: UInt = in.bits.pcPlus4): Unit = {
     in.ready := true.B
-    rvfi.valid := true.B
-    csr.io.instRetIncr := true.B
+    rvfi(0).valid := true.B
+    instRet0 := Mux(in.bits.fused, 2.U, 1.U)
     
     
-    ctrl.jump := true.B
+    // Only redirects restart the pipeline. Younger uops in flight are on the sequential path
+    ctrl.jump := br_pc_valid
     ctrl.newPc := br_pc
     pcNext := br_pc
-    rvfi.pc_wdata := br_pc
-    regs_retire.commit := true.B
+    rvfi(0).pc_wdata := br_pc
+    regs_retire(0).commit := true.B
 
     csr_error_happened := false.B
     wbstate := WB_REQUEST_WRITE_START // Reset the internal states
@@ -334,6 +431,7 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
 
   def handle_trap_like(cmd: csr_cmd.Type, cause: UInt = 0.U): Unit = {
     csr.io.cmd := cmd
+    csr.io.cause := cause
     instr_cplt(true.B, csr.io.next_pc)
     assert(csr.io.err === false.B) // Should not be possible
   }
@@ -369,7 +467,7 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
   
   when(in.valid) {
 
-    assume(in.bits.pc(1, 0) === 0.U) // Make sure its aligned
+    assume(in.bits.pc(0) === 0.U) // Make sure its aligned
 
     in.ready := false.B
     /**************************************************************************/
@@ -384,11 +482,18 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
     /*               FIXME: Interrupt logic                                   */
     /*                                                                        */
     /**************************************************************************/
-    } .elsewhen(csr.io.interruptPending) {
+    } .elsewhen(csr.io.interruptPending && (wbstate === WB_REQUEST_WRITE_START)) { // Loads/stores being resolved are waited for
       log(cf"External Interrupt")
       handle_trap_like(csr_cmd.interrupt)
     /**************************************************************************/
     /*                                                                        */
+    /*               Parked by a wait instruction                             */
+    /*                                                                        */
+    /**************************************************************************/
+    } .elsewhen(waitUnit.parked) {
+      // Nothing retires until the wake up
+    /**************************************************************************/
+    /*                                                                        */
     /*               FIXME: FETCH ERROR LOGIC                                 */
     /*                                                                        */
     /**************************************************************************/
@@ -398,73 +503,58 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
     } .elsewhen (in.bits.ifetchPageFault) {
       log(cf"Instruction fetch page fault")
       handle_trap_like(csr_cmd.exception, new exc_code().INSTR_PAGE_FAULT)
+    } .elsewhen(fpInstr && (fpOff || rmInvalid)) {
+      log(cf"FP disabled instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x, fs=${csr.io.regsOut.fs}, rm=${rm}")
+      handle_trap_like(csr_cmd.exception, new exc_code().INSTR_ILLEGAL)
     
     /**************************************************************************/
     /*                                                                        */
     /*                Alu/Alu-like writeback                                  */
     /*                                                                        */
     /**************************************************************************/
-    } .elsewhen(
-      // FIXME: Add the RV64
-      (in.bits.instr === LUI) ||
-      (in.bits.instr === AUIPC) ||
-
-      (in.bits.instr === ADD) ||
-      (in.bits.instr === SUB) ||
-      (in.bits.instr === AND) ||
-      (in.bits.instr === OR)  ||
-      (in.bits.instr === XOR) ||
-      (in.bits.instr === SLL) ||
-      (in.bits.instr === SRL) ||
-      (in.bits.instr === SRA) ||
-      (in.bits.instr === SLT) ||
-      (in.bits.instr === SLTU) ||
-
-      (in.bits.instr === ADDI) ||
-      (in.bits.instr === SLTI) ||
-      (in.bits.instr === SLTIU) ||
-      (in.bits.instr === ANDI) ||
-      (in.bits.instr === ORI) ||
-      (in.bits.instr === XORI) ||
-      (in.bits.instr === SLLI) ||
-      (in.bits.instr === SRLI) ||
-      (in.bits.instr === SRAI)
-      // TODO: Add the rest of ALU out write back 
-    ) {
+    } .elsewhen(in.bits.dec.unit(ExecUnitSel.ALU) || in.bits.dec.unit(ExecUnitSel.MULDIV) || in.bits.dec.unit(ExecUnitSel.BITMANIP)) {
       log(cf"ALU-like instruction found instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x")
       
       
 
-      regs_retire.rd_wdata := in.bits.aluOut.asUInt
-      regs_retire.rd_write := true.B
+      regs_retire(0).rd_wdata := in.bits.aluOut.asUInt
+      regs_retire(0).rd_write := in.bits.dec.rdWrite
       instr_cplt()
 
 
     
+    /**************************************************************************/
+    /*                                                                        */
+    /*                FPU writeback                                           */
+    /*                                                                        */
+    /**************************************************************************/
+    } .elsewhen(in.bits.dec.unit(ExecUnitSel.FPU)) {
+      log(cf"FPU instruction found instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x, fflags=${in.bits.fflags}%x")
+
+      // Either the FP rd or the integer one (compares, classify, conversions and moves to integer)
+      regs_retire(0).rd_wdata := in.bits.aluOut.asUInt
+      regs_retire(0).rd_write := in.bits.dec.rdWrite
+      fregs_retire.valid      := in.bits.dec.fp.rd
+      csr.io.fflags           := in.bits.fflags
+      csr.io.fsDirty          := in.bits.dec.fp.rd || (in.bits.fflags =/= 0.U)
+      instr_cplt()
+
     /**************************************************************************/
     /*                                                                        */
     /*                JAL/JALR                                                */
     /*                                                                        */
     /**************************************************************************/
-    } .elsewhen(
-        (in.bits.instr === JAL) ||
-        (in.bits.instr === JALR)
-    ) {
-      regs_retire.rd_wdata := in.bits.pcPlus4
-      regs_retire.rd_write := true.B
+    } .elsewhen(in.bits.dec.unit(ExecUnitSel.JUMP)) {
+      regs_retire(0).rd_wdata := in.bits.pcPlus4
+      regs_retire(0).rd_write := in.bits.dec.rdWrite
 
-      when(in.bits.instr === JALR) {
-        val next_cu_pc = in.bits.aluOut.asUInt & (~(1.U(avLen.W)))
-        instr_cplt(true.B, next_cu_pc)
-        log(cf"JALR instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x, regs_retire.rd_wdata=0x${regs_retire.rd_wdata}%x, target=0x${next_cu_pc}%x")
-      } .otherwise {
-        instr_cplt(true.B, in.bits.aluOut.asUInt)
-        log(cf"JAL instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x, regs_retire.rd_wdata=0x${regs_retire.rd_wdata}%x, target=0x${in.bits.aluOut.asUInt}%x")
-      }
+      // JAL targets always have the LSB cleared, so it is safe to clear it for both
+      val next_cu_pc = Cat(in.bits.aluOut.asUInt(xLen - 1, 1), 0.U(1.W))
+      // Fetch already continued at the JAL target, or Execute redirected it
+      instr_cplt(!in.bits.predTaken && !in.bits.redirected, next_cu_pc)
+      log(cf"JAL/JALR instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x, regs_retire(0).rd_wdata=0x${regs_retire(0).rd_wdata}%x, target=0x${next_cu_pc}%x")
       
-      // Reset PC to zero
-      // TODO: C-ext change to (0) := 0.U
-      // FIXME: Add a check for PC to be aligned to 4 bytes or error out
+      // With RVC every 2-byte aligned target is valid, so there is no misaligned jump
       in.ready := true.B
 
     /**************************************************************************/
@@ -472,295 +562,254 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
     /*               Branching logic                                          */
     /*                                                                        */
     /**************************************************************************/
-    } .elsewhen (
-      (in.bits.instr === BEQ) || 
-      (in.bits.instr === BNE) || 
-      (in.bits.instr === BLT) || 
-      (in.bits.instr === BLTU) || 
-      (in.bits.instr === BGE) || 
-      (in.bits.instr === BGEU)
-    ) {
+    } .elsewhen (in.bits.dec.unit(ExecUnitSel.BRANCH)) {
       when(in.bits.branchTaken) {
         // TODO: New variant of branching. Always take the branch backwards in decode stage. And if mispredicted in writeback stage branch towards corrected path
         in.ready := true.B
-        instr_cplt(true.B, in.bits.aluOut.asUInt)
+        // Only mispredictions that Execute did not redirect restart the pipeline
+        instr_cplt(!in.bits.predTaken && !in.bits.redirected, in.bits.aluOut.asUInt)
         log(cf"BranchTaken instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x, target=0x${in.bits.aluOut.asUInt}%x")
       } .otherwise {
-        instr_cplt()
+        instr_cplt(in.bits.predTaken && !in.bits.redirected)
         log(cf"BranchNotTaken instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x")
         in.ready := true.B
       }
       // TODO: IMPORTANT! Branch needs to check for misaligment in this stage
     /**************************************************************************/
     /*                                                                        */
-    /*               FIXME: Load logic                                        */
+    /*               Vector                                                   */
     /*                                                                        */
     /**************************************************************************/
-    /*
-    } .elsewhen ( // TODO: RV64 add LDW/LR_W instruction
-    assert(0.U)
-        (in.bits.instr === LW)
-        || (in.bits.instr === LH)
-        || (in.bits.instr === LHU)
-        || (in.bits.instr === LB)
-        || (in.bits.instr === LBU)
-        || (in.bits.instr === LR_W)
-        
-        ) {
-      
-      
+    } .elsewhen(vecInstr && vecIllegal) {
+      log(cf"Vector illegal instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x, vs=${csr.io.regsOut.vs}, vtype=0x${vecCfg.asVtype}%x")
+      handle_trap_like(csr_cmd.exception, new exc_code().INSTR_ILLEGAL)
+    } .elsewhen(vecInstr && vecSetvl) {
+      regs_retire(0).rd_wdata := csr.io.vecConfig.bits.vl
+      regs_retire(0).rd_write := in.bits.dec.rdWrite
+      csr.io.vecConfig.valid  := true.B
+      csr.io.vstart.valid     := true.B
+      csr.io.vsDirty          := true.B
+      log(cf"VSETVL instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x, vl=${csr.io.vecConfig.bits.vl}, vtype=0x${csr.io.vecConfig.bits.asVtype}%x")
+      instr_cplt()
+    } .elsewhen(vecInstr) {
       when(wbstate === WB_REQUEST_WRITE_START) {
-        /**************************************************************************/
-        /* WB_REQUEST_WRITE_START                                                 */
-        /**************************************************************************/
-        
-        dcache.s0.cmd               := cache_cmd.none
-        dtlb.s0.cmd                 := tlb_cmd.resolve
-
-        dcache.s0.vaddr             := in.bits.aluOut.asUInt
-        dtlb.s0.virt_address_top    := in.bits.aluOut(ccx.avLen - 1, c.pgoff_len)
-
-        wbstate := WB_COMPARE
-        log(cf"LOAD start vaddr=0x%x", in.bits.aluOut)
-      } .elsewhen (wbstate === WB_COMPARE) {
-        /**************************************************************************/
-        /* WB_COMPARE                                                             */
-        /**************************************************************************/
-        
-        log(cf"LOAD compare vaddr=0x%x", in.bits.aluOut)
-        // FIXME: Misaligned
-
-        when(loadGen.io.misaligned) {
-          log(cf"LOAD Misaligned vaddr=0x%x", in.bits.aluOut)
-          handle_trap_like(csr_cmd.exception, new exc_code().LOAD_MISALIGNED)
-        } .elsewhen(vm_enabled && dtlb.s1.miss) {
-          /**************************************************************************/
-          /* TLB Miss                                                               */
-          /**************************************************************************/
-          
-          wbstate         :=  WB_TLBREFILL
-          log(cf"LOAD TLB MISS vaddr=0x%x", in.bits.aluOut)
-        } .elsewhen(vm_enabled && dpageFault.fault) {
-          /**************************************************************************/
-          /* PageFault                                                              */
-          /**************************************************************************/
-          log(cf"LOAD PageFault vaddr=0x%x", in.bits.aluOut)
-          handle_trap_like(csr_cmd.exception, new exc_code().LOAD_PAGE_FAULT)
-        } .elsewhen(!pma_defined /*|| pmp.fault*/) { // FIXME: PMP
-          /**************************************************************************/
-          /* PMA/PMP                                                                */
-          /**************************************************************************/
-          log(cf"LOAD PMA/PMP access fault vaddr=0x%x", in.bits.aluOut)
-          handle_trap_like(csr_cmd.exception, new exc_code().LOAD_ACCESS_FAULT)
+        // Vector loads/stores access the D-cache directly, so the older scalar ones have to be done
+        vecReq.valid := !vecMem || (lqEmpty && sbEmpty)
+        when(vecReq.fire) {
+          wbstate := WB_COMPARE
+          log(cf"VECTOR start instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x")
+        }
+      } .elsewhen(wbstate === WB_COMPARE) {
+        // A trapping load/store keeps the elements before the faulting one, vstart points at it
+        when(vecResp.valid) {
+          csr.io.vstart.valid   := true.B
+          csr.io.vstart.bits    := vecResp.bits.vstart
+          csr.io.vsDirty        := true.B
+          when(vecResp.bits.fault.misaligned) {
+            log(cf"VECTOR Misaligned element=${vecResp.bits.vstart}")
+            handle_trap_like(csr_cmd.exception, Mux(in.bits.dec.store, new exc_code().STORE_AMO_ADDRESS_MISALIGNED, new exc_code().LOAD_MISALIGNED))
+          } .elsewhen(vecResp.bits.fault.pageFault) {
+            log(cf"VECTOR PageFault element=${vecResp.bits.vstart}")
+            handle_trap_like(csr_cmd.exception, Mux(in.bits.dec.store, new exc_code().STORE_AMO_PAGE_FAULT, new exc_code().LOAD_PAGE_FAULT))
+          } .elsewhen(vecResp.bits.fault.accessFault) {
+            log(cf"VECTOR access fault element=${vecResp.bits.vstart}")
+            handle_trap_like(csr_cmd.exception, Mux(in.bits.dec.store, new exc_code().STORE_AMO_ACCESS_FAULT, new exc_code().LOAD_ACCESS_FAULT))
+          } .otherwise {
+            regs_retire(0).rd_wdata := vecResp.bits.rd
+            regs_retire(0).rd_write := in.bits.dec.rdWrite
+            log(cf"VECTOR complete instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x")
+            instr_cplt()
+          }
+        }
+      }
+    /**************************************************************************/
+    /*                                                                        */
+    /*               Cache block operations                                   */
+    /*                                                                        */
+    /**************************************************************************/
+    } .elsewhen(Cmo.isPrefetch(cmoOp)) {
+      // Hints: nothing waits for them and they never trap. prefetch.i goes to the I-cache through Prefetch
+      when(cmoOp === Cmo.PREFETCH_I) {
+        prefetchI.valid := true.B
+        instr_cplt()
+      } .otherwise {
+        lqReq.valid := true.B
+        when(lqReq.ready) {
+          instr_cplt()
+        }
+      }
+    } .elsewhen(Cmo.isManage(cmoOp)) {
+      when(wbstate === WB_REQUEST_WRITE_START) {
+        // Executed by the D-cache through the load queue after the older accesses, like the AMOs.
+        // The whole line is accessed, so the address does not have to be aligned
+        when(cmoIllegal) {
+          log(cf"CBO illegal op=${cmoOp}, vaddr=0x${lqReq.bits.vaddr}%x")
+          handle_trap_like(csr_cmd.exception, new exc_code().INSTR_ILLEGAL)
         } .otherwise {
-          
-
-          when(wb_is_atomic && !pma_memory) {
-            log(cf"LOAD Atomic on non atomic section vaddr=0x%x", in.bits.aluOut)
+          lqReq.valid := lqEmpty && sbEmpty
+          when(lqReq.fire) {
+            wbstate := WB_COMPARE
+            log(cf"CBO start op=${lqReq.bits.cmo}, vaddr=0x${lqReq.bits.vaddr}%x")
+          }
+        }
+      } .elsewhen(wbstate === WB_COMPARE) {
+        when(lqResolve.valid) {
+          when(lqResolve.bits.pageFault) {
+            log(cf"CBO PageFault vaddr=0x${lqReq.bits.vaddr}%x")
+            handle_trap_like(csr_cmd.exception, new exc_code().STORE_AMO_PAGE_FAULT)
+          } .elsewhen(lqResolve.bits.accessFault) {
+            log(cf"CBO access fault vaddr=0x${lqReq.bits.vaddr}%x")
             handle_trap_like(csr_cmd.exception, new exc_code().STORE_AMO_ACCESS_FAULT)
-          } .elsewhen(!wb_is_atomic && pma_memory && dcache.s1.response.miss) {
-            /**************************************************************************/
-            /* Cache miss and not atomic                                                             */
-            /**************************************************************************/
-            log(cf"LOAD marked as memory and cache miss vaddr=0x%x", in.bits.aluOut)
-            
-            wbstate           := WB_CACHEREFILL
-            saved_tlb_ptag    := dtlb.s1.read_data.ptag
-          } .elsewhen(!wb_is_atomic && pma_memory && !dcache.s1.response.miss) {
-            /**************************************************************************/
-            /* Cache hit                                                              */
-            /**************************************************************************/
-            // FIXME: Generate the load value
-            
-            regs_retire.rd_write := true.B
-            regs_retire.rd_wdata := dcache.s1.response.bus_aligned_data.asTypeOf(Vec(ccx.busBytes / (xLenBytes), UInt(xLen.W)))(wdata_select)
-            log(cf"LOAD marked as memory and cache hit vaddr=0x%x, wdata_select = 0x%x, data=0x%x", in.bits.aluOut, wdata_select, regs_retire.rd_wdata)
-            rvfi.mem_rmask := (-1.S((xLenBytes).W)).asUInt // FIXME: Needs to be properly set
-            rvfi.mem_rdata := regs_retire.rd_wdata
-            instr_cplt()
-            
           } .otherwise {
-            /**************************************************************************/
-            /*                                                                        */
-            /* Non cacheable address or atomic request Complete request on the dbus   */
-            /**************************************************************************/
-            assert(wb_is_atomic || !pma_memory)
-            
-            log(cf"LOAD marked as non cacheabble (or is atomic) vaddr=0x%x, wdata_select = 0x%x, data=0x%x", in.bits.aluOut, wdata_select, regs_retire.rd_wdata)
-            dbus.ar.bits.addr  := in.bits.aluOut.asSInt.pad(apLen)
-            // FIXME: Mask LSB accordingly
-            dbus.ar.valid := !dbus_wait_for_response
-            
-            dbus.ar.bits.size  := in.bits.instr(13, 12)
-            dbus.ar.bits.len   := 0.U
-            dbus.ar.bits.lock  := wb_is_atomic
-
-            dbus.resp.ready  := false.B
-
-            when(dbus.ar.ready) {
-              dbus_wait_for_response := true.B
-            }
-            when (dbus.resp.valid && dbus_wait_for_response) {
-              dbus.resp.ready  := true.B
-              
-              
-              regs_retire.rd_wdata := loadGen.io.out
-              
-              dbus_wait_for_response := false.B
-              // FIXME: RVFI
-              /**************************************************************************/
-              /* Atomic access that failed                                              */
-              /**************************************************************************/
-              assert(!(wb_is_atomic && dbus.resp.bits.resp === busConst.OKAY), "[BUG] LR_W/LR_D no lock response for lockable region. Implementation bug")
-              assert(dbus.resp.bits.last, "[BUG] Last should be set for all len=0 returned transactions")
-              when(wb_is_atomic && (dbus.resp.bits.resp === busConst.OKAY)) {
-                log(cf"LR_W/LR_D no lock response for lockable region. Implementation bug vaddr=0x%x", in.bits.aluOut)
-                handle_trap_like(csr_cmd.exception, new exc_code().INSTR_ILLEGAL)
-              } .elsewhen(wb_is_atomic && (dbus.resp.bits.resp === busConst.EXOKAY)) {
-                /**************************************************************************/
-                /* Atomic access that succeded                                            */
-                /**************************************************************************/
-                regs_retire.rd_write := true.B
-
-                instr_cplt() // Lock completed
-                atomic_lock := true.B
-                atomic_lock_addr := dbus.ar.bits.addr.asUInt
-                atomic_lock_doubleword := (in.bits.instr === LR_D)
-              } .elsewhen(dbus.resp.bits.resp =/= busConst.OKAY) {
-                /**************************************************************************/
-                /* Non atomic and bus returned error                                      */
-                /**************************************************************************/
-                handle_trap_like(csr_cmd.exception, new exc_code().LOAD_ACCESS_FAULT)
-              } otherwise {
-                /**************************************************************************/
-                /* Non atomic and success                                                 */
-                /**************************************************************************/
-                regs_retire.rd_write := true.B
-                instr_cplt()
-
-                assert((dbus.resp.bits.resp === busConst.OKAY) && !wb_is_atomic)
-              }
-            }
+            log(cf"CBO committed vaddr=0x${lqReq.bits.vaddr}%x")
+            instr_cplt()
           }
         }
-      } .elsewhen(wbstate === WB_CACHEREFILL) {
-        drefill.req := true.B
-        drefill.ibus <> dbus.viewAsSupertype(new ibus_t(ccx))
-        drefill.s0 <> dcache.s0
-        
-        when(drefill.cplt) {
-          wbstate := WB_REQUEST_WRITE_START
-          when(drefill.err) {
-            handle_trap_like(csr_cmd.exception, new exc_code().LOAD_ACCESS_FAULT)
+      }
+    /**************************************************************************/
+    /*                                                                        */
+    /*               AMO                                                      */
+    /*                                                                        */
+    /**************************************************************************/
+    } .elsewhen(amo) {
+      when(wbstate === WB_REQUEST_WRITE_START) {
+        // Executed by the D-cache through the load queue. The older accesses are done first and the AMO
+        // is resolved only once it is performed, so it is ordered as if aq and rl were both set
+        when(amoMisaligned) {
+          log(cf"AMO Misaligned vaddr=0x${lqReq.bits.vaddr}%x")
+          handle_trap_like(csr_cmd.exception, new exc_code().STORE_AMO_ADDRESS_MISALIGNED)
+        } .otherwise {
+          lqReq.valid := lqEmpty && sbEmpty
+          when(lqReq.fire) {
+            wbstate := WB_COMPARE
+            log(cf"AMO start vaddr=0x${lqReq.bits.vaddr}%x")
           }
         }
-      } .elsewhen(wbstate === WB_TLBREFILL) {
-        log(cf"LOAD TLB refill")
-        dptw.bus <> dbus.viewAsSupertype(new ibus_t(ccx))
-
-        dtlb.s0.virt_address_top     := in.bits.aluOut(ccx.avLen - 1, c.pgoff_len)
-        dptw.resolve_req             := true.B
-        
-        when(dptw.cplt) {
-          dtlb.s0.cmd                          := tlb_cmd.write
-          when(dptw.pageFault) {
-            handle_trap_like(csr_cmd.exception, new exc_code().LOAD_PAGE_FAULT)
-          } .elsewhen(dptw.accessFault) {
-            handle_trap_like(csr_cmd.exception, new exc_code().LOAD_ACCESS_FAULT)
+      } .elsewhen(wbstate === WB_COMPARE) {
+        when(lqResolve.valid) {
+          when(lqResolve.bits.pageFault) {
+            log(cf"AMO PageFault vaddr=0x${lqReq.bits.vaddr}%x")
+            handle_trap_like(csr_cmd.exception, new exc_code().STORE_AMO_PAGE_FAULT)
+          } .elsewhen(lqResolve.bits.accessFault) {
+            log(cf"AMO access fault vaddr=0x${lqReq.bits.vaddr}%x")
+            handle_trap_like(csr_cmd.exception, new exc_code().STORE_AMO_ACCESS_FAULT)
           } .otherwise {
-            wbstate := WB_REQUEST_WRITE_START
+            // The old value is written back by the load queue, in the same cycle at the latest
+            regs_retire(0).rd_pending := in.bits.dec.rdWrite
+            log(cf"AMO committed vaddr=0x${lqReq.bits.vaddr}%x")
+            instr_cplt()
           }
         }
       }
     /**************************************************************************/
     /*                                                                        */
-    /*               FIXME: Store logic                                       */
+    /*               Load logic                                               */
     /*                                                                        */
     /**************************************************************************/
-    
-    } .elsewhen (
-      (in.bits.instr === SW)
-      || (in.bits.instr === SH)
-      || (in.bits.instr === SB)
-      || (in.bits.instr === SC_W)
-      // || (in.bits.instr === SC_D)
-    ) {
-      // TODO: Store
-      log(cf"STORE vaddr=0x%x", in.bits.aluOut)
-      // FIXME: Misaligned
-      when(vm_enabled && dtlb.s1.miss) {
+    } .elsewhen(in.bits.dec.load) {
+      when(wbstate === WB_REQUEST_WRITE_START) {
         /**************************************************************************/
-        /* TLB Miss                                                               */
+        /* WB_REQUEST_WRITE_START                                                 */
         /**************************************************************************/
-        
-        wbstate         :=  WB_TLBREFILL
-        log(cf"STORE TLB MISS vaddr=0x%x", in.bits.aluOut)
-      } .elsewhen(vm_enabled && dpageFault.fault) {
+        lqReq.valid := true.B
+        when(lqReq.ready) {
+          wbstate := WB_COMPARE
+          log(cf"LOAD start vaddr=0x${lqReq.bits.vaddr}%x")
+        }
+      } .elsewhen(wbstate === WB_COMPARE) {
         /**************************************************************************/
-        /* PageFault                                                              */
+        /* WB_COMPARE                                                             */
         /**************************************************************************/
-        log(cf"STORE PageFault vaddr=0x%x", in.bits.aluOut)
-        handle_trap_like(csr_cmd.exception, new exc_code().STORE_AMO_PAGE_FAULT)
-      } .elsewhen(!pma_defined /*|| pmp.fault*/) { // FIXME: PMP
+        // Only wait for the translation and permission checks. Refills are handled by the load queue
+        when(lqResolve.valid) {
+          when(lqResolve.bits.misaligned) {
+            log(cf"LOAD Misaligned vaddr=0x${lqReq.bits.vaddr}%x")
+            handle_trap_like(csr_cmd.exception, new exc_code().LOAD_MISALIGNED)
+          } .elsewhen(lqResolve.bits.pageFault) {
+            log(cf"LOAD PageFault vaddr=0x${lqReq.bits.vaddr}%x")
+            handle_trap_like(csr_cmd.exception, new exc_code().LOAD_PAGE_FAULT)
+          } .elsewhen(lqResolve.bits.accessFault) {
+            log(cf"LOAD access fault vaddr=0x${lqReq.bits.vaddr}%x")
+            handle_trap_like(csr_cmd.exception, new exc_code().LOAD_ACCESS_FAULT)
+          } .otherwise {
+            // rd is renamed now, but stays busy until the load queue writes the data back
+            // FIXME: RVFI: rd_wdata/mem_rdata are not known at commit
+            regs_retire(0).rd_pending := in.bits.dec.rdWrite
+            csr.io.fsDirty            := in.bits.dec.fp.rd
+            log(cf"LOAD committed vaddr=0x${lqReq.bits.vaddr}%x")
+            instr_cplt()
+          }
+        }
+      }
+    /**************************************************************************/
+    /*                                                                        */
+    /*               Store logic                                              */
+    /*                                                                        */
+    /**************************************************************************/
+    } .elsewhen(in.bits.dec.store) {
+      when(wbstate === WB_REQUEST_WRITE_START) {
         /**************************************************************************/
-        /* PMA/PMP                                                                */
+        /* WB_REQUEST_WRITE_START                                                 */
         /**************************************************************************/
-        log(cf"STORE PMA/PMP access fault vaddr=0x%x", in.bits.aluOut)
-        handle_trap_like(csr_cmd.exception, new exc_code().STORE_AMO_ACCESS_FAULT)
-      } .otherwise {
-        when(wb_is_atomic && !pma_memory) {
-          log(cf"STORE Atomic on non atomic section vaddr=0x%x", in.bits.aluOut)
-          handle_trap_like(csr_cmd.exception, new exc_code().STORE_AMO_ACCESS_FAULT)
-        } .elsewhen(!wb_is_atomic && pma_memory) {
-
+        sbReq.valid := true.B
+        when(sbReq.ready) {
+          wbstate := WB_COMPARE
+          log(cf"STORE start vaddr=0x${sbReq.bits.vaddr}%x")
         }
-      }
-      /*
-      dbus.aw.valid := !dbus_ax_done
-      when(dbus.aw.ready) {
-        dbus_ax_done := true.B
-      }
-      
-      dbus.w.valid := !dbus_w_done
-      when(dbus.w.ready) {
-        dbus_w_done := true.B
-      }
-
-      when((dbus.aw.ready || dbus_ax_done) && (dbus.w.ready || dbus_w_done)) {
-        dbus_ax_done := false.B
-        dbus_w_done := false.B
-        dbus_wait_for_response := true.B
-      }
-
-      when(dbus_wait_for_response && dbus.b.valid) {
-        dbus_wait_for_response := false.B
-        
-        when(dbus.b.resp =/= busConst.OKAY) {
-
+      } .elsewhen(wbstate === WB_COMPARE) {
+        /**************************************************************************/
+        /* WB_COMPARE                                                             */
+        /**************************************************************************/
+        // The write itself is done by the store buffer after the commit
+        when(sbResolve.valid) {
+          when(sbResolve.bits.misaligned) {
+            log(cf"STORE Misaligned vaddr=0x${sbReq.bits.vaddr}%x")
+            handle_trap_like(csr_cmd.exception, new exc_code().STORE_AMO_ADDRESS_MISALIGNED)
+          } .elsewhen(sbResolve.bits.pageFault) {
+            log(cf"STORE PageFault vaddr=0x${sbReq.bits.vaddr}%x")
+            handle_trap_like(csr_cmd.exception, new exc_code().STORE_AMO_PAGE_FAULT)
+          } .elsewhen(sbResolve.bits.accessFault) {
+            log(cf"STORE access fault vaddr=0x${sbReq.bits.vaddr}%x")
+            handle_trap_like(csr_cmd.exception, new exc_code().STORE_AMO_ACCESS_FAULT)
+          } .otherwise {
+            // FIXME: RVFI: mem_addr/mem_wmask/mem_wdata
+            log(cf"STORE committed vaddr=0x${sbReq.bits.vaddr}%x")
+            instr_cplt()
+          }
         }
+      }
+    /**************************************************************************/
+    /*                                                                        */
+    /*               Wait instructions                                        */
+    /*                                                                        */
+    /**************************************************************************/
+    } .elsewhen(waitInstr) {
+      // WFI waits for an interrupt, WRS and pause for the LR reservation to be lost. See WaitUnit
+      waitUnit.retire := true.B
+      when(waitUnit.illegal) {
+        log(cf"Wait illegal instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x")
+        handle_trap_like(csr_cmd.exception, new exc_code().INSTR_ILLEGAL)
+      } .otherwise {
         instr_cplt()
-        // Write complete
-        // TODO: Release the writeback stage and complete the instruction
-        // TODO: Error handling
-
-        // FIXME: RVFI
-      }*/
+        when(waitUnit.park) {
+          log(cf"Park instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x")
+        }
+      }
     /**************************************************************************/
     /*                                                                        */
     /*               FIXME: CSRRW/CSRRWI                                      */
     /*                                                                        */
     /**************************************************************************/
-    */
     /*
     } .elsewhen((in.bits.instr === CSRRW) || (in.bits.instr === CSRRWI)) {
       when(!csr_error_happened) {
-        regs_retire.rd_wdata := csr.out
+        regs_retire(0).rd_wdata := csr.out
 
         when(in.bits.instr(11,  7) === 0.U) { // RD == 0; => No read
           csr.cmd := csr_cmd.write
         } .otherwise {  // RD != 0; => Read side effects
           csr.cmd := csr_cmd.read_write
-          regs_retire.rd_write := true.B
+          regs_retire(0).rd_write := true.B
         }
         when(in.bits.instr === CSRRW) {
           csr.in := in.bits.rs1
@@ -815,10 +864,13 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
     /*               Flushing instructions                                    */
     /*                                                                        */
     /**************************************************************************/
-    } .elsewhen((in.bits.instr === FENCE) || (in.bits.instr === FENCE_I) || (in.bits.instr === SFENCE_VMA)) {
-      log(cf"Flushing everything instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x")
-      instr_cplt(true.B)
-      assert(false.B, "[BUG] FENCE/SFENCE_VMA not implemented yet") // TODO: Implement FENCE/SFENCE_VMA
+    } .elsewhen(in.bits.dec.fence) {
+      // Committed loads and stores have to complete first
+      when(lqEmpty && sbEmpty) {
+        log(cf"Flushing everything instr=0x${in.bits.instr}%x, pc=0x${in.bits.pc}%x")
+        instr_cplt(true.B)
+        assert(false.B, "[BUG] FENCE/SFENCE_VMA not implemented yet") // TODO: Implement FENCE/SFENCE_VMA
+      }
     /**************************************************************************/
     /*                                                                        */
     /*               MRET                                                     */
@@ -846,11 +898,6 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
     /**************************************************************************/
     /**************************************************************************/
     /*                                                                        */
-    /*               FIXME: ATOMICS AMOOP                                     */
-    /*                                                                        */
-    /**************************************************************************/
-    /**************************************************************************/
-    /*                                                                        */
     /*               UNKNOWN INSTURCTION ERROR                                */
     /*                                                                        */
     /**************************************************************************/
@@ -860,14 +907,94 @@ class Retirement(implicit ccx: CCXParams) extends CCXModule {
     }
 
 
-    when(regs_retire.rd_write) {
-      log(cf"Write rd=0x${in.bits.instr(11,  7)}%x, value=0x${regs_retire.rd_wdata}%x")
-      rvfi.rd_addr := in.bits.instr(11,  7)
-      rvfi.rd_wdata := Mux(in.bits.instr(11, 7) === 0.U, 0.U, regs_retire.rd_wdata)
+    when(regs_retire(0).rd_write) {
+      log(cf"Write rd=0x${in.bits.instr(11,  7)}%x, value=0x${regs_retire(0).rd_wdata}%x")
+      rvfi(0).rd_addr := in.bits.instr(11,  7)
+      rvfi(0).rd_wdata := Mux(in.bits.instr(11, 7) === 0.U, 0.U, regs_retire(0).rd_wdata)
     }
     // TODO: Dont unconditionally reset the regs reservation
     
   } .otherwise {
     //log(cf"No active instruction")
   }
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Additional commit slots                                 */
+  /*                                                                        */
+  /**************************************************************************/
+  // Younger uops retire in the same cycle as in, as long as they can not trap, redirect or access memory.
+  // They only write rd, so they bypass the state machine above. The first one that can not retire stops the rest
+  def needsJump(u: ExecuteUop): Bool = Mux(u.dec.unit(ExecUnitSel.BRANCH) && !u.branchTaken, u.predTaken, !u.predTaken) && !u.redirected
+  def simple(u: ExecuteUop): Bool = !u.ifetchAccessFault && !u.ifetchPageFault && (
+    u.dec.unit(ExecUnitSel.ALU) || u.dec.unit(ExecUnitSel.MULDIV) || u.dec.unit(ExecUnitSel.BITMANIP) ||
+    ((u.dec.unit(ExecUnitSel.JUMP) || u.dec.unit(ExecUnitSel.BRANCH)) && !needsJump(u)))
+  def nextPc(u: ExecuteUop): UInt = Mux(u.dec.unit(ExecUnitSel.JUMP), Cat(u.aluOut.asUInt(xLen - 1, 1), 0.U(1.W)),
+                                    Mux(u.dec.unit(ExecUnitSel.BRANCH) && u.branchTaken, u.aluOut.asUInt, u.pcPlus4))
+
+  var allowed = in.fire && !ctrl.jump && !ctrl.kill && !ctrl.flush && !csr.io.interruptPending && !debugReq && !parkNow
+  val instRetExtra = Wire(Vec(ccx.core.retireWidth - 1, UInt(2.W)))
+  for(i <- 1 until ccx.core.retireWidth) {
+    val s       = inExtra(i - 1)
+    val u       = s.bits
+    val r       = regs_retire(i)
+    val v       = rvfi(i)
+    val commit  = allowed && s.valid && simple(u)
+    val rdWrite = commit && u.dec.rdWrite
+
+    s.ready           := commit
+    instRetExtra(i - 1) := Mux(commit, Mux(u.fused, 2.U, 1.U), 0.U)
+
+    r.commit          := commit
+    r.rd_write        := rdWrite
+    r.rd_pending      := false.B
+    r.rd_addr         := u.instr(11, 7)
+    r.rd_phys         := u.rdPhys
+    r.rd_old_phys     := u.rdOldPhys
+    r.rd_wdata        := Mux(u.dec.unit(ExecUnitSel.JUMP), u.pcPlus4, u.aluOut.asUInt)
+
+    v                 := 0.U.asTypeOf(v)
+    v.valid           := commit
+    v.order           := order + i.U
+    v.mode            := csr.io.regsOut.priv
+    v.insn            := u.instr
+    v.rs1_addr        := u.instr(19, 15)
+    v.rs1_rdata       := Mux(v.rs1_addr === 0.U, 0.U, u.rs1)
+    v.rs2_addr        := u.instr(24, 20)
+    v.rs2_rdata       := Mux(v.rs2_addr === 0.U, 0.U, u.rs2)
+    when(rdWrite) {
+      v.rd_addr       := r.rd_addr
+      v.rd_wdata      := Mux(r.rd_addr === 0.U, 0.U, r.rd_wdata)
+    }
+    v.pc_rdata        := u.pc
+    v.pc_wdata        := nextPc(u)
+
+    when(commit) {
+      pcNext          := nextPc(u)
+      log(cf"Retire slot=${i}, instr=0x${u.instr}%x, pc=0x${u.pc}%x, rd=${r.rd_addr}, value=0x${r.rd_wdata}%x")
+    }
+    allowed = commit
+  }
+
+  csr.io.instRetIncr := instRet0 +& instRetExtra.foldLeft(0.U)(_ +& _)
+
+  // Only the first slot restarts the pipeline on a misprediction, the others stop at it
+  val retireMispredict = in.fire && (in.bits.dec.unit(ExecUnitSel.JUMP) || in.bits.dec.unit(ExecUnitSel.BRANCH)) && needsJump(in.bits)
+  csr.io.perf.branchMispredict := perf.branchMispredict || retireMispredict
+
+  // Uops that stay here wait for the load queue, store buffer or vector unit if they access memory
+  val memUop = in.bits.dec.load || in.bits.dec.store
+  topDown := Mux(csr.io.instRetIncr =/= 0.U, TopDown.RETIRING,
+             Mux(ctrl.kill || ctrl.flush || ctrl.jump, TopDown.BAD_SPECULATION,
+             Mux(!in.valid, TopDown.NONE,
+             Mux(memUop, TopDown.BACKEND_MEMORY, TopDown.BACKEND_CORE))))
+
+  // Trace: a trapped uop does not retire, the restart drops it with everything younger
+  kanata(in.valid, KanataTrace.STAGE, in.bits.seq, KanataTrace.RETIREMENT)
+  kanata(instRet0 =/= 0.U, KanataTrace.RETIRE, in.bits.seq, KanataTrace.RETIREMENT)
+  for(i <- 1 until ccx.core.retireWidth) {
+    kanata(inExtra(i - 1).valid, KanataTrace.STAGE, inExtra(i - 1).bits.seq, KanataTrace.RETIREMENT)
+    kanata(inExtra(i - 1).fire, KanataTrace.RETIRE, inExtra(i - 1).bits.seq, KanataTrace.RETIREMENT)
+  }
+  kanata(ctrl.kill || ctrl.flush || ctrl.jump, KanataTrace.FLUSH_FROM, in.bits.seq, KanataTrace.RETIREMENT)
 }
@@ -0,0 +1,160 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+/**
+ * Expands a 16-bit RV64C instruction into the equivalent 32-bit instruction.
+ * Reserved and RV32-only encodings expand to zero, which Decode reports as illegal.
+ * HINT encodings (e.g. rd=0 of C.LI, C.LUI, C.ADDI) are not reserved and expand to the no-op they encode.
+ */
+object RvcExpander {
+  private val OP_LOAD     = "b0000011".U(7.W)
+  private val OP_LOAD_FP  = "b0000111".U(7.W)
+  private val OP_IMM      = "b0010011".U(7.W)
+  private val OP_IMM_32   = "b0011011".U(7.W)
+  private val OP_STORE    = "b0100011".U(7.W)
+  private val OP_STORE_FP = "b0100111".U(7.W)
+  private val OP          = "b0110011".U(7.W)
+  private val OP_32       = "b0111011".U(7.W)
+  private val OP_LUI      = "b0110111".U(7.W)
+  private val OP_BRANCH   = "b1100011".U(7.W)
+  private val OP_JALR     = "b1100111".U(7.W)
+  private val OP_JAL      = "b1101111".U(7.W)
+
+  private val ILLEGAL     = 0.U(32.W)
+  private val EBREAK      = "h00100073".U(32.W)
+
+  private def sext(x: UInt, w: Int): UInt = x.asSInt.pad(w).asUInt
+
+  private def iType(imm: UInt, rs1: UInt, funct3: Int, rd: UInt, opcode: UInt): UInt =
+    Cat(imm.pad(12)(11, 0), rs1, funct3.U(3.W), rd, opcode)
+  private def sType(imm: UInt, rs2: UInt, rs1: UInt, funct3: Int, opcode: UInt): UInt = {
+    val i = imm.pad(12)
+    Cat(i(11, 5), rs2, rs1, funct3.U(3.W), i(4, 0), opcode)
+  }
+  private def rType(funct7: Int, rs2: UInt, rs1: UInt, funct3: Int, rd: UInt, opcode: UInt): UInt =
+    Cat(funct7.U(7.W), rs2, rs1, funct3.U(3.W), rd, opcode)
+  private def bType(imm: UInt, rs2: UInt, rs1: UInt, funct3: Int): UInt = {
+    val i = sext(imm, 13)
+    Cat(i(12), i(10, 5), rs2, rs1, funct3.U(3.W), i(4, 1), i(11), OP_BRANCH)
+  }
+  private def jType(imm: UInt, rd: UInt): UInt = {
+    val i = sext(imm, 21)
+    Cat(i(20), i(10, 1), i(11), i(19, 12), rd, OP_JAL)
+  }
+
+  def apply(x: UInt): UInt = {
+    val x0      = 0.U(5.W)
+    val ra      = 1.U(5.W)
+    val sp      = 2.U(5.W)
+
+    val rd      = x(11, 7)
+    val rs2     = x(6, 2)
+    val rs1c    = Cat(1.U(2.W), x(9, 7)) // rs1'/rd' of the compressed register set
+    val rs2c    = Cat(1.U(2.W), x(4, 2)) // rs2'/rd'
+
+    val imm6    = sext(Cat(x(12), x(6, 2)), 12)
+    val shamt   = Cat(x(12), x(6, 2))
+
+    /**************************************************************************/
+    /*  Quadrant 0                                                            */
+    /**************************************************************************/
+    val addi4spnImm = Cat(x(10, 7), x(12, 11), x(5), x(6), 0.U(2.W))
+    val lwImm       = Cat(x(5), x(12, 10), x(6), 0.U(2.W))
+    val ldImm       = Cat(x(6, 5), x(12, 10), 0.U(3.W))
+
+    val addi4spn    = Mux(addi4spnImm === 0.U, ILLEGAL, iType(addi4spnImm, sp, 0, rs2c, OP_IMM))
+    val fld         = iType(ldImm, rs1c, 3, rs2c, OP_LOAD_FP)
+    val lw          = iType(lwImm, rs1c, 2, rs2c, OP_LOAD)
+    val ld          = iType(ldImm, rs1c, 3, rs2c, OP_LOAD)
+    val fsd         = sType(ldImm, rs2c, rs1c, 3, OP_STORE_FP)
+    val sw          = sType(lwImm, rs2c, rs1c, 2, OP_STORE)
+    val sd          = sType(ldImm, rs2c, rs1c, 3, OP_STORE)
+
+    /**************************************************************************/
+    /*  Quadrant 1                                                            */
+    /**************************************************************************/
+    val addi        = iType(imm6, rd, 0, rd, OP_IMM)
+    val addiw       = Mux(rd === 0.U, ILLEGAL, iType(imm6, rd, 0, rd, OP_IMM_32)) // rd=0 is reserved
+    val li          = iType(imm6, x0, 0, rd, OP_IMM)
+    val addi16spImm = sext(Cat(x(12), x(4, 3), x(5), x(2), x(6), 0.U(4.W)), 12)
+    // Zero immediate is reserved for both C.ADDI16SP and C.LUI
+    val addi16sp    = Mux(addi16spImm === 0.U, ILLEGAL, iType(addi16spImm, sp, 0, sp, OP_IMM))
+    val lui         = Mux(Cat(x(12), x(6, 2)) === 0.U, ILLEGAL, Cat(sext(Cat(x(12), x(6, 2)), 20), rd, OP_LUI))
+    val luiOrSp     = Mux(rd === sp, addi16sp, lui)
+
+    val arith       = MuxLookup(Cat(x(12), x(6, 5)), ILLEGAL)(Seq(
+      0.U -> rType(0x20, rs2c, rs1c, 0, rs1c, OP),    // C.SUB
+      1.U -> rType(0x00, rs2c, rs1c, 4, rs1c, OP),    // C.XOR
+      2.U -> rType(0x00, rs2c, rs1c, 6, rs1c, OP),    // C.OR
+      3.U -> rType(0x00, rs2c, rs1c, 7, rs1c, OP),    // C.AND
+      4.U -> rType(0x20, rs2c, rs1c, 0, rs1c, OP_32), // C.SUBW
+      5.U -> rType(0x00, rs2c, rs1c, 0, rs1c, OP_32), // C.ADDW
+    ))
+    val miscAlu     = MuxLookup(x(11, 10), arith)(Seq(
+      0.U -> iType(shamt, rs1c, 5, rs1c, OP_IMM),                   // C.SRLI
+      1.U -> iType(Cat("b010000".U(6.W), shamt), rs1c, 5, rs1c, OP_IMM), // C.SRAI
+      2.U -> iType(imm6, rs1c, 7, rs1c, OP_IMM),                    // C.ANDI
+    ))
+
+    val jImm        = Cat(x(12), x(8), x(10, 9), x(6), x(7), x(2), x(11), x(5, 3), 0.U(1.W))
+    val bImm        = Cat(x(12), x(6, 5), x(2), x(11, 10), x(4, 3), 0.U(1.W))
+    val j           = jType(jImm, x0)
+    val beqz        = bType(bImm, x0, rs1c, 0)
+    val bnez        = bType(bImm, x0, rs1c, 1)
+
+    /**************************************************************************/
+    /*  Quadrant 2                                                            */
+    /**************************************************************************/
+    val slli        = iType(shamt, rd, 1, rd, OP_IMM)
+    val lwspImm     = Cat(x(3, 2), x(12), x(6, 4), 0.U(2.W))
+    val ldspImm     = Cat(x(4, 2), x(12), x(6, 5), 0.U(3.W))
+    val swspImm     = Cat(x(8, 7), x(12, 9), 0.U(2.W))
+    val sdspImm     = Cat(x(9, 7), x(12, 10), 0.U(3.W))
+    val fldsp       = iType(ldspImm, sp, 3, rd, OP_LOAD_FP)
+    // rd=0 is reserved for C.LWSP and C.LDSP
+    val lwsp        = Mux(rd === 0.U, ILLEGAL, iType(lwspImm, sp, 2, rd, OP_LOAD))
+    val ldsp        = Mux(rd === 0.U, ILLEGAL, iType(ldspImm, sp, 3, rd, OP_LOAD))
+    val fsdsp       = sType(sdspImm, rs2, sp, 3, OP_STORE_FP)
+    val swsp        = sType(swspImm, rs2, sp, 2, OP_STORE)
+    val sdsp        = sType(sdspImm, rs2, sp, 3, OP_STORE)
+
+    val jr          = iType(0.U, rd, 0, x0, OP_JALR)
+    val mv          = rType(0x00, rs2, x0, 0, rd, OP)
+    val jalr        = iType(0.U, rd, 0, ra, OP_JALR)
+    val add         = rType(0x00, rs2, rd, 0, rd, OP)
+    val jrMvAdd     = Mux(x(12) === 0.U,
+                        Mux(rs2 === 0.U, Mux(rd === 0.U, ILLEGAL, jr), mv),
+                        Mux(rs2 === 0.U, Mux(rd === 0.U, EBREAK, jalr), add))
+
+    // Quadrant in the low bits, funct3 in the high bits
+    MuxLookup(Cat(x(1, 0), x(15, 13)), ILLEGAL)(Seq(
+      "b00000".U -> addi4spn,
+      "b00001".U -> fld,
+      "b00010".U -> lw,
+      "b00011".U -> ld,
+      "b00101".U -> fsd,
+      "b00110".U -> sw,
+      "b00111".U -> sd,
+
+      "b01000".U -> addi,
+      "b01001".U -> addiw,
+      "b01010".U -> li,
+      "b01011".U -> luiOrSp,
+      "b01100".U -> miscAlu,
+      "b01101".U -> j,
+      "b01110".U -> beqz,
+      "b01111".U -> bnez,
+
+      "b10000".U -> slli,
+      "b10001".U -> fldsp,
+      "b10010".U -> lwsp,
+      "b10011".U -> ldsp,
+      "b10100".U -> jrMvAdd,
+      "b10101".U -> fsdsp,
+      "b10110".U -> swsp,
+      "b10111".U -> sdsp,
+    ))
+  }
+}
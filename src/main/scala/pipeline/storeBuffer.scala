@@ -0,0 +1,229 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import Consts._
+
+class StoreBufferReq extends Bundle {
+  val instr       = UInt(iLen.W) // Used by StoreGen to select the size
+  val vaddr       = UInt(apLen.W)
+  val data        = UInt(xLen.W)
+}
+
+class StoreBufferEntry(implicit val ccx: CCXParams) extends Bundle {
+  val valid       = Bool()
+  val vaddr       = UInt(apLen.W) // Word aligned
+  val data        = Vec(xLenBytes, UInt(8.W))
+  val mask        = UInt(xLenBytes.W)
+  val waitLoads   = UInt(ccx.core.loadQueueEntries.W) // Older loads in the load queue, TSO: drained after them
+}
+
+// Bytes of the committed stores for the word that the load queue is about to read
+class StoreForward extends Bundle {
+  val vaddr       = Output(UInt(apLen.W))
+  val data        = Input(Vec(xLenBytes, UInt(8.W)))
+  val mask        = Input(UInt(xLenBytes.W))
+}
+
+/**
+ * Keeps the committed stores, so that Retirement does not wait for the D-cache write.
+ *
+ * Retirement sends the store here and waits for it to be resolved. The store is probed in the cache
+ * to check the translation and permissions. If it does not fault, the store is committed into the buffer
+ * and drained to the D-cache in order (TSO). Stores to the same word as the youngest entry are merged into it.
+ * The load queue reads the buffer to forward the data of the stores that are not written yet.
+ * Misaligned stores that cross a word are probed as two words, so each one is translated separately.
+ * They take two entries and are never merged.
+ */
+class StoreBuffer(implicit ccx: CCXParams) extends CCXModule {
+  /**************************************************************************/
+  /*  Interface                                                             */
+  /**************************************************************************/
+  val ctrl          = IO(new PipelineControlIO)
+  val req           = IO(Flipped(DecoupledIO(new StoreBufferReq))) // From Retirement
+  val resolve       = IO(Valid(new MemResolve))                     // To Retirement
+  val loadConflict  = IO(Input(Bool())) // Load queue has a load to the same line, the store has to wait for it
+  val loadsPending  = IO(Input(UInt(ccx.core.loadQueueEntries.W))) // Committed loads in the load queue
+  val fwd           = IO(Flipped(new StoreForward))
+  val empty         = IO(Output(Bool()))
+
+  val cacheReq      = IO(new CacheReq)
+  val cacheResp     = IO(Flipped(new CacheResp))
+
+  /**************************************************************************/
+  /*  State                                                                 */
+  /**************************************************************************/
+  val n             = ccx.core.storeBufferEntries
+  val entries       = RegInit(VecInit(Seq.fill(n)(0.U.asTypeOf(new StoreBufferEntry))))
+  val head          = RegInit(0.U(log2Ceil(n).W)) // Oldest entry, drained first
+  val tail          = RegInit(0.U(log2Ceil(n).W)) // Next entry to allocate
+
+  val probeValid    = RegInit(false.B) // Store waiting for the translation and permission check
+  val probeIssued   = RegInit(false.B)
+  val probeHigh     = RegInit(false.B) // Low word of a crossing store was checked, the high word is probed
+  val probe         = Reg(new StoreBufferReq)
+
+  val inflight      = RegInit(false.B)
+  val inflightProbe = Reg(Bool()) // Otherwise the head entry is being drained
+
+  val storeGen      = Module(new StoreGen)
+
+  def word(vaddr: UInt): UInt = vaddr(apLen - 1, log2Ceil(xLenBytes))
+
+  /**************************************************************************/
+  /*  Allocation                                                            */
+  /**************************************************************************/
+  val reqCrosses = MemAccess.crosses(req.bits.vaddr, req.bits.instr)
+  req.ready := !probeValid && !entries(tail).valid && !(reqCrosses && entries(tail + 1.U).valid) && !loadConflict
+
+  when(req.fire) {
+    probeValid  := true.B
+    probeIssued := false.B
+    probeHigh   := false.B
+    probe       := req.bits
+    log(cf"Probe vaddr=0x${req.bits.vaddr}%x, data=0x${req.bits.data}%x")
+  }
+
+  /**************************************************************************/
+  /*  Cache request                                                         */
+  /**************************************************************************/
+  val issueProbe = probeValid && !probeIssued
+  val issueDrain = !issueProbe && entries(head).valid && !entries(head).waitLoads.orR
+
+  // Probe only checks the translation and the write permission, it does not access the data
+  cacheReq.valid              := !inflight && (issueProbe || issueDrain)
+  cacheReq.bits.read          := false.B
+  cacheReq.bits.write         := !issueProbe
+  cacheReq.bits.probe         := issueProbe
+  cacheReq.bits.atomicRead    := false.B
+  cacheReq.bits.atomicWrite   := false.B
+  cacheReq.bits.amo           := false.B
+  cacheReq.bits.nonBlocking   := issueProbe
+  cacheReq.bits.line          := false.B
+  cacheReq.bits.cmo           := Cmo.NONE
+  cacheReq.bits.vaddr         := Mux(issueProbe, Mux(probeHigh, MemAccess.nextWord(probe.vaddr), probe.vaddr), entries(head).vaddr)
+
+  when(cacheReq.fire) {
+    inflight      := true.B
+    inflightProbe := issueProbe
+    when(issueProbe) {
+      probeIssued := true.B
+    }
+  }
+
+  /**************************************************************************/
+  /*  Cache response                                                        */
+  /**************************************************************************/
+  cacheResp.read              := false.B
+  cacheResp.write             := inflight && !inflightProbe
+  cacheResp.atomicRead        := false.B
+  cacheResp.atomicWrite       := false.B
+  cacheResp.amo               := false.B
+  cacheResp.amoOp             := 0.U
+  cacheResp.cmo               := Cmo.NONE
+  cacheResp.probe             := inflight && inflightProbe
+  cacheResp.writeData         := entries(head).data
+  cacheResp.writeMask         := entries(head).mask
+  cacheResp.writeLine         := 0.U.asTypeOf(cacheResp.writeLine)
+  cacheResp.writeLineMask     := 0.U
+
+  storeGen.io.vaddr           := probe.vaddr(avLen - 1, 0)
+  storeGen.io.instr           := probe.instr
+  storeGen.io.in              := probe.data
+
+  val probeResp   = inflight && inflightProbe && cacheResp.valid && probeValid // Probe is gone if it was cancelled
+  val fault       = storeGen.io.misaligned || cacheResp.accessFault || cacheResp.pageFault
+  val crosses     = MemAccess.crosses(probe.vaddr, probe.instr)
+  // Last word of the store. A fault in the low word resolves it right away
+  val last        = !crosses || probeHigh
+
+  resolve.valid               := probeResp && (last || fault)
+  resolve.bits.misaligned     := storeGen.io.misaligned
+  resolve.bits.accessFault    := cacheResp.accessFault
+  resolve.bits.pageFault      := cacheResp.pageFault
+
+  when(inflight && cacheResp.valid) {
+    inflight := false.B
+  }
+
+  // Load queue slots are free for at least one cycle before they are reused
+  for(i <- 0 until n) {
+    entries(i).waitLoads := entries(i).waitLoads & loadsPending
+  }
+
+  // Merge into the youngest entry if it is not being drained
+  val youngest  = tail - 1.U
+  val merge     = !crosses && entries(youngest).valid && (word(entries(youngest).vaddr) === word(probe.vaddr)) &&
+                  !(inflight && !inflightProbe && (youngest === head))
+  val storeData = storeGen.io.out.asTypeOf(Vec(2, Vec(xLenBytes, UInt(8.W))))
+  val storeMask = storeGen.io.mask.asTypeOf(Vec(2, UInt(xLenBytes.W)))
+
+  when(probeResp) {
+    when(!last && !fault) {
+      // Probe the high word next
+      probeIssued := false.B
+      probeHigh   := true.B
+    } .otherwise {
+      probeValid  := false.B
+    }
+    when(last && !fault) {
+      when(merge) {
+        for(b <- 0 until xLenBytes) {
+          when(storeMask(0)(b)) {
+            entries(youngest).data(b) := storeData(0)(b)
+          }
+        }
+        entries(youngest).mask := entries(youngest).mask | storeMask(0)
+        entries(youngest).waitLoads := entries(youngest).waitLoads | loadsPending
+      } .otherwise {
+        // Crossing stores take the next entry for the high word
+        for(w <- 0 until 2) {
+          val idx = tail + w.U
+          when((w == 0).B || crosses) {
+            entries(idx).valid := true.B
+            entries(idx).vaddr := Cat(word(probe.vaddr) + w.U, 0.U(log2Ceil(xLenBytes).W))
+            entries(idx).data  := storeData(w)
+            entries(idx).mask  := storeMask(w)
+            entries(idx).waitLoads := loadsPending
+          }
+        }
+        tail                := tail + Mux(crosses, 2.U, 1.U)
+      }
+    }
+    log(cf"Resolve vaddr=0x${probe.vaddr}%x, high=${probeHigh}, fault=${fault}, merge=${merge}")
+  }
+
+  when(inflight && !inflightProbe && cacheResp.valid) {
+    assert(!cacheResp.accessFault && !cacheResp.pageFault, "[BUG] Committed store faulted on drain")
+    entries(head).valid := false.B
+    head                := head + 1.U
+    log(cf"Drain vaddr=0x${entries(head).vaddr}%x, mask=0x${entries(head).mask}%x")
+  }
+
+  /**************************************************************************/
+  /*  Cancel                                                                */
+  /**************************************************************************/
+  // Retirement trapped before the store was resolved. Committed entries stay
+  when((ctrl.kill || ctrl.flush || ctrl.jump) && !(probeResp && !fault && last)) {
+    probeValid := false.B
+  }
+
+  /**************************************************************************/
+  /*  Store to load forwarding                                              */
+  /**************************************************************************/
+  // Entries are visited from the oldest to the youngest, so the youngest store wins
+  var fwdData = VecInit(Seq.fill(xLenBytes)(0.U(8.W)))
+  var fwdMask = 0.U(xLenBytes.W)
+  for(k <- 0 until n) {
+    val e   = entries(head + k.U)
+    val hit = e.valid && (word(e.vaddr) === word(fwd.vaddr))
+    fwdData = VecInit.tabulate(xLenBytes) {b => Mux(hit && e.mask(b), e.data(b), fwdData(b))}
+    fwdMask = fwdMask | Mux(hit, e.mask, 0.U)
+  }
+  fwd.data  := fwdData
+  fwd.mask  := fwdMask
+
+  empty     := !VecInit(entries.map(_.valid)).asUInt.orR && !probeValid
+  ctrl.busy := !empty
+}
@@ -0,0 +1,91 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import Consts._
+
+// Top-down class of a cycle. Every stage classifies what it did with the cycle, TopDownAccounting picks the one to blame
+object TopDown {
+  val NONE            = 0.U(3.W) // Stage is empty or waits for an older stage, it is not to blame
+  val RETIRING        = 1.U(3.W)
+  val BAD_SPECULATION = 2.U(3.W) // Restart, or the front-end refilling after one
+  val FRONTEND        = 3.U(3.W) // Front-end did not deliver a uop
+  val BACKEND_MEMORY  = 4.U(3.W) // Waiting for the load queue, store buffer or the D-cache
+  val BACKEND_CORE    = 5.U(3.W) // Waiting for an execution unit or a register
+
+  // In the class order, starting from RETIRING
+  val names = Seq("retiring", "bad_speculation", "frontend", "backend_memory", "backend_core")
+}
+
+/**
+ * Picks the class of the cycle from the stage classes. The oldest stage that is not empty is the one that holds
+ * the pipeline back. When every stage is empty the front-end is to blame, unless it is still refilling after a restart.
+ * With CoreParams.topDownReport the simulation prints the share of each class when it ends.
+ */
+class TopDownAccounting(stages: Int)(implicit ccx: CCXParams) extends CCXModule {
+  val stage       = IO(Input(Vec(stages, UInt(3.W)))) // Oldest stage first
+  val restart     = IO(Input(Bool()))                 // Kill/flush/jump or an Execute redirect
+  val refilled    = IO(Input(Bool()))                 // Uop left Decode, the front-end delivers again
+  val cycleClass  = IO(Output(UInt(3.W)))
+
+  val recovering  = RegInit(false.B)
+  when(restart) {
+    recovering := true.B
+  } .elsewhen(refilled) {
+    recovering := false.B
+  }
+
+  val blamed      = PriorityMux(stage.map(_ =/= TopDown.NONE) :+ true.B, stage :+ TopDown.FRONTEND)
+  cycleClass      := Mux((restart || recovering) && (blamed === TopDown.FRONTEND), TopDown.BAD_SPECULATION, blamed)
+
+  if(ccx.core.topDownReport) {
+    val report = Module(new TopDownReport)
+    report.io.clock       := clock
+    report.io.reset       := reset.asBool
+    report.io.cycleClass  := cycleClass
+  }
+}
+
+// Simulation only: counts the classes and prints the summary from a final block. Empty for synthesis
+class TopDownReport extends BlackBox with HasBlackBoxInline {
+  val io = IO(new Bundle {
+    val clock       = Input(Clock())
+    val reset       = Input(Bool())
+    val cycleClass  = Input(UInt(3.W))
+  })
+
+  val lines = TopDown.names.zipWithIndex.map { case (n, i) =>
+    s"""    $$display("TOPDOWN %m ${n}=%0d (%0.1f%%)", counts[${i + 1}], total == 0 ? 0.0 : 100.0 * counts[${i + 1}] / total);"""
+  }.mkString("\n")
+
+  setInline("TopDownReport.sv",
+    s"""module TopDownReport(
+       |  input       clock,
+       |  input       reset,
+       |  input [2:0] cycleClass
+       |);
+       |`ifndef SYNTHESIS
+       |  longint counts [0:7];
+       |  longint total;
+       |
+       |  initial begin
+       |    for(int i = 0; i < 8; i++) counts[i] = 0;
+       |    total = 0;
+       |  end
+       |
+       |  always @(posedge clock) begin
+       |    if(!reset) begin
+       |      counts[cycleClass] <= counts[cycleClass] + 1;
+       |      total <= total + 1;
+       |    end
+       |  end
+       |
+       |  final begin
+       |    $$display("TOPDOWN %m cycles=%0d", total);
+       |$lines
+       |  end
+       |`endif
+       |endmodule
+       |""".stripMargin)
+}
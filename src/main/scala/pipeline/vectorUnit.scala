@@ -0,0 +1,341 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import Consts._
+
+// vl and vtype. Kept in the CSR module, written by vsetvl*
+class VecConfig(implicit val ccx: CCXParams) extends Bundle {
+  val vill        = Bool()
+  val vma         = Bool()
+  val vta         = Bool()
+  val vsew        = UInt(3.W)
+  val vlmul       = UInt(3.W)
+  val vl          = UInt((log2Ceil(ccx.core.vLen) + 1).W)
+
+  def asVtype: UInt = Cat(vill, 0.U((xLen - 9).W), vma, vta, vsew, vlmul)
+
+  // log2 of 1/LMUL. Only LMUL of one and below is supported, the register groups are always a single register
+  def lmulShift: UInt = Mux(vlmul === 0.U, 0.U, 8.U(4.W) - vlmul)
+}
+
+object VecConfig {
+  // vsetvli/vsetivli/vsetvl, returns the new configuration. Unsupported settings set vill
+  def apply(instr: UInt, rs1: UInt, rs2: UInt, old: VecConfig)(implicit ccx: CCXParams): VecConfig = {
+    val c         = Wire(new VecConfig)
+    val vsetvl    = instr(31) && !instr(30)
+    val vsetivli  = instr(31) && instr(30)
+    val vtype     = Mux(vsetvl, rs2, Mux(vsetivli, instr(29, 20), instr(30, 20)).pad(xLen))
+
+    val vsew      = vtype(5, 3)
+    val vlmul     = vtype(2, 0)
+    val frac      = Mux(vlmul === 0.U, 0.U, 8.U(4.W) - vlmul)
+    // SEW of 64 at most, SEW <= ELEN * LMUL for the fractional LMUL
+    val supported = (vsew <= 3.U) && ((vlmul === 0.U) || (vlmul >= 5.U)) && ((vsew +& frac) <= 3.U)
+    val vill      = !supported || (vtype(xLen - 1, 8) =/= 0.U)
+
+    val vlmax     = ((ccx.core.vLen / 8).U >> vsew) >> frac
+    val rs1Zero   = instr(19, 15) === 0.U
+    val rdZero    = instr(11, 7) === 0.U
+    // rs1 of x0 requests VLMAX, or keeps vl with x0 as rd too
+    val avl       = Mux(vsetivli, instr(19, 15).pad(xLen), Mux(!rs1Zero, rs1, Mux(!rdZero, vlmax, old.vl)))
+
+    c             := 0.U.asTypeOf(c)
+    c.vill        := vill
+    when(!vill) {
+      c.vma       := vtype(7)
+      c.vta       := vtype(6)
+      c.vsew      := vsew
+      c.vlmul     := vlmul
+      c.vl        := Mux(avl > vlmax, vlmax, avl(c.vl.getWidth - 1, 0))
+    }
+    c
+  }
+}
+
+class VectorReq(implicit val ccx: CCXParams) extends Bundle {
+  val instr       = UInt(iLen.W)
+  val dec         = new DecodedCtrl
+  val rs1         = UInt(xLen.W) // Scalar operand or the base address
+  val rs2         = UInt(xLen.W) // Stride of the strided loads/stores
+  val cfg         = new VecConfig
+  val vstart      = UInt(log2Ceil(ccx.core.vLen).W)
+}
+
+class VectorResp(implicit val ccx: CCXParams) extends Bundle {
+  val rd          = UInt(xLen.W) // vmv.x.s result
+  val fault       = new MemResolve
+  val vstart      = UInt(log2Ceil(ccx.core.vLen).W) // Element that faulted, zero on completion
+}
+
+/**
+ * Vector register file and the V subset. Instructions are executed one at a time when they reach Retirement,
+ * so the register file needs no renaming and the memory accesses are not speculative.
+ * Arithmetic takes a single cycle. Loads and stores go to the D-cache a cache line at a time:
+ * all the pending elements that are in the same line are accessed with one request.
+ * Inactive and tail elements are left undisturbed.
+ */
+class VectorUnit(implicit ccx: CCXParams) extends CCXModule {
+  /**************************************************************************/
+  /*                                                                        */
+  /*                INPUT/OUTPUT                                            */
+  /*                                                                        */
+  /**************************************************************************/
+  val req           = IO(Flipped(DecoupledIO(new VectorReq)))
+  val resp          = IO(Valid(new VectorResp))
+  val cacheReq      = IO(new CacheReq)
+  val cacheResp     = IO(Flipped(new CacheResp))
+
+  val vLen          = ccx.core.vLen
+  val vBytes        = vLen / 8
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                STATE                                                   */
+  /*                                                                        */
+  /**************************************************************************/
+  val vregs         = Reg(Vec(32, UInt(vLen.W)))
+
+  val IDLE          = 0.U(2.W)
+  val EXEC          = 1.U(2.W)
+  val MEM_REQ       = 2.U(2.W)
+  val MEM_RESP      = 3.U(2.W)
+  val state         = RegInit(IDLE)
+
+  val r             = Reg(new VectorReq)
+  val idx           = Reg(UInt(log2Ceil(vBytes + 1).W)) // Elements below it are done
+  val reqLine       = Reg(UInt((apLen - cacheLineLog2).W))
+
+  req.ready         := state === IDLE
+  when(req.fire) {
+    r               := req.bits
+    idx             := req.bits.vstart
+    state           := Mux(req.bits.dec.load || req.bits.dec.store, MEM_REQ, EXEC)
+  }
+
+  resp.valid        := false.B
+  resp.bits         := 0.U.asTypeOf(resp.bits)
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Operands                                                */
+  /*                                                                        */
+  /**************************************************************************/
+  val instr         = r.instr
+  val vd            = instr(11, 7)
+  val vm            = instr(25)
+  val funct3        = instr(14, 12)
+  val vl            = r.cfg.vl
+  val vstart        = r.vstart
+
+  val vs2           = vregs(instr(24, 20))
+  val vs1           = vregs(instr(19, 15))
+  val old           = vregs(vd)
+  val mask          = vregs(0)
+
+  // OPIVI uses simm5, OPIVX/OPMVX the scalar register
+  val scalarForm    = funct3(2) || (funct3 === "b011".U)
+  val scalar        = Mux(funct3 === "b011".U, instr(19, 15).asSInt.pad(xLen).asUInt, r.rs1)
+
+  def elems(x: UInt, w: Int): Seq[UInt] = (0 until vLen / w).map(i => x(w * i + w - 1, w * i))
+  def body(i: Int): Bool = (i.U >= vstart) && (i.U < vl)
+  def active(i: Int): Bool = body(i) && (vm || mask(i))
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Arithmetic                                              */
+  /*                                                                        */
+  /**************************************************************************/
+  def alu(op: UInt, a: UInt, b: UInt): UInt = {
+    val w           = a.getWidth
+    val sh          = b(log2Ceil(w) - 1, 0)
+    MuxLookup(op, 0.U(w.W))(Seq(
+      VecOp.ADD     -> (a + b),
+      VecOp.SUB     -> (a - b),
+      VecOp.RSUB    -> (b - a),
+      VecOp.MINU    -> Mux(a < b, a, b),
+      VecOp.MIN     -> Mux(a.asSInt < b.asSInt, a, b),
+      VecOp.MAXU    -> Mux(a < b, b, a),
+      VecOp.MAX     -> Mux(a.asSInt < b.asSInt, b, a),
+      VecOp.AND     -> (a & b),
+      VecOp.OR      -> (a | b),
+      VecOp.XOR     -> (a ^ b),
+      VecOp.SLL     -> (a << sh)(w - 1, 0),
+      VecOp.SRL     -> (a >> sh),
+      VecOp.SRA     -> (a.asSInt >> sh).asUInt,
+      VecOp.MUL     -> (a * b)(w - 1, 0),
+    ))
+  }
+
+  def compare(op: UInt, a: UInt, b: UInt): Bool = MuxLookup(op, false.B)(Seq(
+    VecOp.MSEQ      -> (a === b),
+    VecOp.MSNE      -> (a =/= b),
+    VecOp.MSLTU     -> (a < b),
+    VecOp.MSLT      -> (a.asSInt < b.asSInt),
+    VecOp.MSLEU     -> (a <= b),
+    VecOp.MSLE      -> (a.asSInt <= b.asSInt),
+    VecOp.MSGTU     -> (a > b),
+    VecOp.MSGT      -> (a.asSInt > b.asSInt),
+  ))
+
+  // Value that leaves the reduction unchanged
+  def identity(op: UInt, w: Int): UInt = MuxLookup(op, 0.U(w.W))(Seq(
+    VecOp.AND       -> Fill(w, 1.U(1.W)),
+    VecOp.MINU      -> Fill(w, 1.U(1.W)),
+    VecOp.MIN       -> Cat(0.U(1.W), Fill(w - 1, 1.U(1.W))),
+    VecOp.MAX       -> Cat(1.U(1.W), 0.U((w - 1).W)),
+  ))
+
+  val op            = r.dec.aluOp
+  val isCompare     = (op >= VecOp.MSEQ) && (op <= VecOp.MSGT)
+  val vdZero        = (vl =/= 0.U) && (vstart === 0.U) // Element zero of vd is written by the reductions and vmv.s.x
+
+  // Computed for each SEW and selected by vsew
+  val perSew = (0 until 4).map(e => {
+    val w           = 8 << e
+    val n           = vLen / w
+    val a           = elems(vs2, w)
+    val b           = elems(vs1, w).map(x => Mux(scalarForm, scalar(w - 1, 0), x))
+    val o           = elems(old, w)
+
+    val arith       = (0 until n).map(i => Mux(
+      op === VecOp.MERGE,
+      Mux(body(i), Mux(vm || mask(i), b(i), a(i)), o(i)),
+      Mux(active(i), alu(op, a(i), b(i)), o(i))
+    ))
+    val cmp         = (0 until vLen).map(i =>
+      if(i < n) Mux(active(i), compare(op, a(i), b(i)), old(i)) else old(i)
+    )
+
+    val ident       = identity(op, w)
+    val terms       = (0 until n).map(i => Mux(active(i), a(i), ident))
+    val red         = VecInit(terms).reduceTree((x, y) => alu(op, x, y))
+    val redOut      = alu(op, red, elems(vs1, w)(0))
+    val elem0       = Mux(r.dec.vec.red, redOut, scalar(w - 1, 0))
+    val toZero      = Cat((Seq(Mux(vdZero, elem0, o(0))) ++ o.drop(1)).reverse)
+
+    val vdOut       = Mux(r.dec.vec.red || (op === VecOp.MVSX), toZero,
+                      Mux(isCompare, Cat(cmp.reverse), Cat(arith.reverse)))
+    (vdOut, a(0).asSInt.pad(xLen).asUInt)
+  })
+
+  val sew           = r.cfg.vsew(1, 0)
+  val vdResult      = VecInit(perSew.map(_._1))(sew)
+  val rdResult      = VecInit(perSew.map(_._2))(sew)
+
+  when(state === EXEC) {
+    // vmv.x.s only writes the scalar register
+    when(!r.dec.rdWrite) {
+      vregs(vd)     := vdResult
+    }
+    resp.valid      := true.B
+    resp.bits.rd    := rdResult
+    state           := IDLE
+    log(cf"VECTOR: EXEC instr=0x${instr}%x, vd=${vd}, vl=${vl}, sew=${sew}")
+  }
+
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Loads/stores                                            */
+  /*                                                                        */
+  /**************************************************************************/
+  def lineOf(a: UInt): UInt = a(apLen - 1, cacheLineLog2)
+
+  // Constant times a variable, as a sum of shifts
+  def mulConst(x: UInt, c: Int): UInt = (0 until log2Ceil(c + 1)).filter(b => ((c >> b) & 1) == 1)
+    .map(b => (x << b)(apLen - 1, 0)).foldLeft(0.U(apLen.W))(_ + _)
+
+  val eew           = r.dec.memSize
+  val strided       = instr(27, 26) === "b10".U
+  val base          = r.rs1(apLen - 1, 0)
+  val stride        = Mux(strided, r.rs2(apLen - 1, 0), UIntToOH(eew, 8).pad(apLen))
+  val addr          = (0 until vBytes).map(j => base + mulConst(stride, j))
+  val aligned       = addr.map(a => (a(2, 0) & (UIntToOH(eew, 8) - 1.U)(2, 0)) === 0.U)
+
+  val pending       = VecInit((0 until vBytes).map(j => (j.U >= idx) && (j.U < vl) && (vm || mask(j)))).asUInt
+  val first         = PriorityEncoder(pending)
+
+  // Pending elements that are in the requested line are accessed together, the run stops at the first one that is not
+  val fits          = VecInit((0 until vBytes).map(j => !pending(j) || ((lineOf(addr(j)) === reqLine) && aligned(j)))).asUInt
+  val stop          = PriorityEncoder(Cat(true.B, ~fits))
+  val taken         = VecInit((0 until vBytes).map(j => pending(j) && (j.U < stop))).asUInt
+
+  // Line data placed into the elements of vd, and the elements of vd placed into the line
+  val lineData      = cacheResp.readLine.asUInt
+  val perEew = (0 until 4).map(e => {
+    val eb          = 1 << e
+    val n           = vBytes / eb
+    val offs        = (0 until n).map(j => addr(j)(cacheLineLog2 - 1, 0))
+    val store       = elems(old, 8 * eb)
+    val loadData    = Cat((0 until n).map(j => (lineData >> Cat(offs(j), 0.U(3.W)))(8 * eb - 1, 0)).reverse)
+    val loadMask    = Cat((0 until n).map(j => Fill(eb, taken(j))).reverse)
+    val wLine       = (0 until n).map(j => Mux(taken(j), store(j).pad(8 * cacheLineBytes) << Cat(offs(j), 0.U(3.W)), 0.U)).reduce(_ | _)
+    val wMask       = (0 until n).map(j => Mux(taken(j), Fill(eb, 1.U(1.W)).pad(cacheLineBytes) << offs(j), 0.U)).reduce(_ | _)
+    (loadData, loadMask, wLine(8 * cacheLineBytes - 1, 0), wMask(cacheLineBytes - 1, 0))
+  })
+  val loadData      = VecInit(perEew.map(_._1))(eew)
+  val loadMask      = VecInit(perEew.map(_._2))(eew)
+  val loaded        = Cat((0 until vBytes).map(i => Mux(loadMask(i), loadData(8 * i + 7, 8 * i), old(8 * i + 7, 8 * i))).reverse)
+
+  cacheReq.valid              := false.B
+  cacheReq.bits.read          := r.dec.load
+  cacheReq.bits.write         := r.dec.store
+  cacheReq.bits.atomicRead    := false.B
+  cacheReq.bits.atomicWrite   := false.B
+  cacheReq.bits.amo           := false.B
+  cacheReq.bits.nonBlocking   := false.B
+  cacheReq.bits.line          := true.B
+  cacheReq.bits.cmo           := Cmo.NONE
+  cacheReq.bits.probe         := false.B
+  cacheReq.bits.vaddr         := Cat(lineOf(addr(first)), 0.U(cacheLineLog2.W))
+
+  cacheResp.read              := (state === MEM_RESP) && r.dec.load
+  cacheResp.write             := (state === MEM_RESP) && r.dec.store
+  cacheResp.atomicRead        := false.B
+  cacheResp.atomicWrite       := false.B
+  cacheResp.amo               := false.B
+  cacheResp.amoOp             := 0.U
+  cacheResp.cmo               := Cmo.NONE
+  cacheResp.probe             := false.B
+  cacheResp.writeData         := 0.U.asTypeOf(cacheResp.writeData)
+  cacheResp.writeMask         := 0.U
+  cacheResp.writeLine         := VecInit(perEew.map(_._3))(eew).asTypeOf(cacheResp.writeLine)
+  cacheResp.writeLineMask     := VecInit(perEew.map(_._4))(eew)
+
+  when(state === MEM_REQ) {
+    when(!pending.orR) {
+      resp.valid              := true.B
+      state                   := IDLE
+    } .elsewhen(!VecInit(aligned)(first)) {
+      resp.valid              := true.B
+      resp.bits.fault.misaligned := true.B
+      resp.bits.vstart        := first
+      state                   := IDLE
+      log(cf"VECTOR: Misaligned element ${first}")
+    } .otherwise {
+      cacheReq.valid          := true.B
+      when(cacheReq.fire) {
+        reqLine               := lineOf(addr(first))
+        state                 := MEM_RESP
+      }
+    }
+  } .elsewhen(state === MEM_RESP) {
+    when(cacheResp.valid) {
+      when(cacheResp.accessFault || cacheResp.pageFault) {
+        resp.valid                  := true.B
+        resp.bits.fault.accessFault := cacheResp.accessFault
+        resp.bits.fault.pageFault   := cacheResp.pageFault
+        resp.bits.vstart            := first
+        state                       := IDLE
+        log(cf"VECTOR: Fault on element ${first}")
+      } .otherwise {
+        when(r.dec.load) {
+          vregs(vd)           := loaded
+        }
+        idx                   := stop
+        state                 := MEM_REQ
+      }
+    }
+  }
+}
@@ -0,0 +1,62 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import Instructions._
+import Consts._
+
+/**
+ * WFI/WRS/pause, the hart is parked after they retire. See Wait instructions in Retirement.
+ * WFI waits for an interrupt. WRS and pause wait for the LR reservation to be lost, without one they complete
+ * at once. Below M the time limit of WFI/wrs.nto is zero when mstatus.TW is set, and always in U-mode, so they trap.
+ * Interrupts enabled in mie wake the hart even when mstatus disables them, the trap is then taken
+ * by the next instruction.
+ */
+class WaitUnit(implicit ccx: CCXParams) extends CCXModule {
+  val retire            = IO(Input(Bool()))   // Wait instruction is retiring
+  val instr             = IO(Input(UInt(iLen.W)))
+  val priv              = IO(Input(UInt(2.W)))
+  val tw                = IO(Input(Bool()))   // mstatus.TW
+  val reservationValid  = IO(Input(Bool()))   // From the D-cache: LR reservation is held
+  val interruptWake     = IO(Input(Bool()))   // From the CSR
+  val debugReq          = IO(Input(Bool()))
+
+  val illegal           = IO(Output(Bool()))  // Traps instead of retiring
+  val park              = IO(Output(Bool()))  // Retires and parks the hart from the next cycle
+  val parked            = IO(Output(Bool()))
+
+  val parkedReg           = RegInit(false.B)
+  val parkOnReservation   = Reg(Bool()) // WRS/pause: losing the reservation wakes the hart
+  val parkTimed           = Reg(Bool()) // wrs.sto/pause: wakes after wrsCycles at most
+  val parkTimer           = Reg(UInt(log2Ceil(ccx.core.wrsCycles + 1).W))
+
+  val isWfi     = instr === WFI
+  val waits     = isWfi || reservationValid
+  val limited   = isWfi || (instr === WRS_NTO)
+  val privM     = priv === Privilege.M
+  val privU     = priv === Privilege.USER
+
+  illegal       := retire && waits && limited && (privU || (!privM && tw))
+  park          := retire && waits && !illegal
+  parked        := parkedReg
+
+  val wake      = interruptWake || debugReq ||
+                  (parkOnReservation && !reservationValid) || (parkTimed && (parkTimer === 0.U))
+  when(parkedReg) {
+    when(parkTimer =/= 0.U) {
+      parkTimer := parkTimer - 1.U
+    }
+    when(wake) {
+      parkedReg := false.B
+      log(cf"Wake up, interrupt=${interruptWake}, reservation=${reservationValid}, timer=${parkTimer}")
+    }
+  }
+
+  when(park) {
+    parkedReg         := true.B
+    parkOnReservation := !isWfi
+    parkTimed         := (instr === WRS_STO) || (instr === PAUSE)
+    parkTimer         := ccx.core.wrsCycles.U
+  }
+}
@@ -10,17 +10,31 @@ class regs_retire_io extends Bundle {
   val commit    = Input (Bool())
 
   val rd_write    = Input (Bool())
+  val rd_pending  = Input (Bool()) // rd is renamed, but the data is written later by the load queue
   val rd_addr     = Input (UInt(5.W))
+  val rd_phys     = Input (UInt(physRegsLog2.W))
+  val rd_old_phys = Input (UInt(physRegsLog2.W)) // Previous mapping of rd, freed on commit
   val rd_wdata    = Input (UInt(xLen.W))
 }
 
+class RegWriteback extends Bundle {
+  val rd          = UInt(physRegsLog2.W) // Physical register
+  val data        = UInt(xLen.W)
+}
+
+class regs_load_io extends Bundle {
+  val wb        = Input (Valid(new RegWriteback))
+  val pending   = Input (UInt(physRegs.W)) // Physical registers of the committed loads, kept busy on kill/flush/jump
+}
+
 class regs_decode_io(implicit val ccx: CCXParams) extends Bundle {
   val instr_i   = Input (UInt(iLen.W))
   val commit    = Input (Bool())
+  val rd_write  = Input (Bool()) // From the decode table, rd is only renamed for instructions that write it
 
   val rs1       = new RS()
   val rs2       = new RS()
-  val rd        = new ReservedStatus()
+  val rd        = new RD()
 }
 
 class ReservedStatus extends Bundle {
@@ -29,6 +43,13 @@ class ReservedStatus extends Bundle {
 
 class RS extends ReservedStatus{
   val value = Output(UInt(xLen.W))
+  val phys  = Output(UInt(physRegsLog2.W))
+}
+
+// Reserved when no physical register is free
+class RD extends ReservedStatus {
+  val phys    = Output(UInt(physRegsLog2.W))
+  val oldPhys = Output(UInt(physRegsLog2.W))
 }
 
 class Regfile(implicit ccx: CCXParams) extends CCXModule {
@@ -39,7 +60,12 @@ class Regfile(implicit ccx: CCXParams) extends CCXModule {
   /**************************************************************************/
   val ctrl    = IO(new PipelineControlIO) // Pipeline command interface form control unit
   val decode  = IO(new regs_decode_io)
-  val retire  = IO(new regs_retire_io)
+  val retire  = IO(Vec(ccx.core.retireWidth, new regs_retire_io)) // In program order
+  val load    = IO(new regs_load_io)
+
+  // For the out of order back-end wakeup
+  val physBusy  = IO(Output(UInt(physRegs.W)))
+  val writes    = IO(Output(Vec(ccx.core.retireWidth + 1, Valid(new RegWriteback)))) // Retire and load queue writes
 
   /**************************************************************************/
   /*                                                                        */
@@ -47,60 +73,142 @@ class Regfile(implicit ccx: CCXParams) extends CCXModule {
   /*                                                                        */
   /**************************************************************************/
 
-  val regs_reservation  = RegInit(VecInit.tabulate(32) {f:Int => false.B})
-  // 2 read ports, 1 write port
-  // Use two read-write ports (no Vec element). One RW port will be used for writes when retiring.
-  val regs_mem          = SRAM(32, UInt(xLen.W), 0, 0, 2)
+  // Speculative map is used by decode. Committed map is updated by retire and
+  // is the checkpoint that the speculative map is restored from on kill/flush/jump.
+  // Execute redirects need no checkpoint. A uop is renamed when it enters the Decode output register, and Execute
+  // redirects in the cycle it takes the branch from there. That cycle Decode is killed, so the register is not refilled.
+  // Nothing younger than the branch is renamed, so the speculative map already ends at it.
+  // The out of order back-end does not redirect, its branches are resolved by retirement.
+  val specMap           = RegInit(VecInit.tabulate(32) {i: Int => i.U(physRegsLog2.W)})
+  val archMap           = RegInit(VecInit.tabulate(32) {i: Int => i.U(physRegsLog2.W)})
+  val free              = RegInit(((BigInt(1) << physRegs) - (BigInt(1) << 32)).U(physRegs.W))
+  val busy              = RegInit(0.U(physRegs.W)) // Physical registers waiting for the value
+
+  // 2 read ports. One write port per retired uop, the last one is used by the load queue
+  val n                 = ccx.core.retireWidth
+  val regs_mem          = SRAM(physRegs, UInt(xLen.W), 2, n + 1, 0)
   val hold            = RegInit(false.B)
 
   val holdRs1         = Reg(UInt(xLen.W))
   val holdRs2         = Reg(UInt(xLen.W))
 
+  val rs1Phys         = specMap(decode.instr_i(19, 15))
+  val rs2Phys         = specMap(decode.instr_i(24, 20))
+  val rs1PhysR        = RegEnable(rs1Phys, decode.commit)
+  val rs2PhysR        = RegEnable(rs2Phys, decode.commit)
+
   // Drive read addresses for rs1/rs2 using read ports
-  // Drive read addresses for rs1/rs2 using RW ports (read path)
-  regs_mem.readPorts(0).address := decode.instr_i(19, 15)
+  regs_mem.readPorts(0).address := rs1Phys
   regs_mem.readPorts(0).enable := true.B
 
-  regs_mem.readPorts(1).address := decode.instr_i(24, 20)
+  regs_mem.readPorts(1).address := rs2Phys
   regs_mem.readPorts(1).enable := true.B
 
   /**************************************************************************/
   /*                                                                        */
-  /*                Regs reservations                                       */
+  /*                Rename                                                  */
   /*                                                                        */
   /**************************************************************************/
-  
-  decode.rs1.reserved  := (decode.instr_i(19, 15) =/= 0.U) && regs_reservation(decode.instr_i(19, 15))
-  decode.rs2.reserved  := (decode.instr_i(24, 20) =/= 0.U) && regs_reservation(decode.instr_i(24, 20))
-  decode.rd.reserved   := (decode.instr_i(11,  7) =/= 0.U) && regs_reservation(decode.instr_i(11,  7))
+  // Registers that are still waiting for a load can not be reused yet
+  val allocatable     = free & ~busy
+  val newPhys         = PriorityEncoder(allocatable)
+
+  decode.rs1.reserved  := busy(rs1Phys)
+  decode.rs2.reserved  := busy(rs2Phys)
+  decode.rd.reserved   := decode.rd_write && !allocatable.orR
+  decode.rs1.phys      := rs1PhysR
+  decode.rs2.phys      := rs2PhysR
+  decode.rd.phys       := newPhys
+  decode.rd.oldPhys    := specMap(decode.instr_i(11, 7))
+
+  val rename          = decode.commit && decode.rd_write
+  val retireRename    = retire.map(r => r.commit && (r.rd_write || r.rd_pending) && (r.rd_addr =/= 0.U))
+
+  // Younger uops are applied last, so they win when several retire to the same rd
+  val archMapNext     = Wire(Vec(32, UInt(physRegsLog2.W)))
+  archMapNext         := retire.zip(retireRename).foldLeft(archMap) {case (m, (r, en)) =>
+    VecInit(m.zipWithIndex.map {case (p, i) => Mux(en && (r.rd_addr === i.U), r.rd_phys, p)})
+  }
+  archMap := archMapNext
 
-  when(decode.commit) {
-    when(decode.instr_i(11, 7) =/= 0.U) {
-      regs_reservation(decode.instr_i(11, 7)) := true.B
+  val allocMask       = Mux(rename, UIntToOH(newPhys, physRegs), 0.U)
+  val releaseMask     = retire.zip(retireRename).map {case (r, en) => Mux(en, UIntToOH(r.rd_old_phys, physRegs), 0.U)}.reduce(_ | _)
+  val writtenMask     = retire.map(r => Mux(r.commit && r.rd_write, UIntToOH(r.rd_phys, physRegs), 0.U)).reduce(_ | _) |
+                        Mux(load.wb.valid, UIntToOH(load.wb.bits.rd, physRegs), 0.U)
+
+  val freeNext        = Wire(UInt(physRegs.W))
+  val busyNext        = Wire(UInt(physRegs.W))
+
+  when(ctrl.kill || ctrl.flush || ctrl.jump) {
+    // Everything that is not committed is dropped
+    specMap   := archMapNext
+    freeNext  := ~archMapNext.map(p => UIntToOH(p, physRegs)).reduce(_ | _)
+    busyNext  := load.pending
+  } .otherwise {
+    when(rename) {
+      specMap(decode.instr_i(11, 7)) := newPhys
     }
+    freeNext  := (free & ~allocMask) | releaseMask
+    busyNext  := (busy | allocMask) & ~writtenMask
   }
+  free := freeNext
+  busy := busyNext
 
-  when(ctrl.kill || ctrl.flush || ctrl.jump) {
-    regs_reservation := 0.U.asTypeOf(chiselTypeOf(regs_reservation))
-  } .elsewhen(retire.commit) {
-    // In the future do not unconditionally unreserve it. Need proper RD logic and instruction decode map
-    regs_reservation(retire.rd_addr) := false.B
+  /**************************************************************************/
+  /*                                                                        */
+  /*                Regs writing                                            */
+  /*                                                                        */
+  /**************************************************************************/
+  // Retired uops write different physical registers, so the ports never conflict
+  for(i <- 0 until n) {
+    regs_mem.writePorts(i).address  := retire(i).rd_phys
+    regs_mem.writePorts(i).enable   := retire(i).commit && retire(i).rd_write && (retire(i).rd_addr =/= 0.U)
+    regs_mem.writePorts(i).data     := retire(i).rd_wdata
   }
 
+  // The load physical register is not allocated to anything else until it is written
+  regs_mem.writePorts(n).address  := load.wb.bits.rd
+  regs_mem.writePorts(n).enable   := load.wb.valid
+  regs_mem.writePorts(n).data     := load.wb.bits.data
+
+  val wports = regs_mem.writePorts.toSeq
+  for((w, i) <- wports.zipWithIndex) {
+    writes(i).valid     := w.enable
+    writes(i).bits.rd   := w.address
+    writes(i).bits.data := w.data
+  }
+  physBusy := busy
+
+  def writeHit(phys: UInt): Bool = wports.map(w => w.enable && (w.address === phys)).reduce(_ || _)
+  def writeData(phys: UInt): UInt = Mux1H(wports.map(w => (w.enable && (w.address === phys)) -> w.data))
+
   /**************************************************************************/
   /*                                                                        */
   /*                Regs reading                                            */
   /*                                                                        */
   /**************************************************************************/
+  // The memory returns the old value if it was written in the same cycle as read
+  val rs1Bypass       = RegNext(writeHit(rs1Phys))
+  val rs2Bypass       = RegNext(writeHit(rs2Phys))
+  val rs1BypassData   = RegNext(writeData(rs1Phys))
+  val rs2BypassData   = RegNext(writeData(rs2Phys))
+
+  // x0 is never written, so it is not read from the memory
+  val rs1Read         = Mux(rs1PhysR === 0.U, 0.U, Mux(rs1Bypass, rs1BypassData, regs_mem.readPorts(0).data))
+  val rs2Read         = Mux(rs2PhysR === 0.U, 0.U, Mux(rs2Bypass, rs2BypassData, regs_mem.readPorts(1).data))
+
+  // Held values follow the writes, so a uop waiting in decode sees the registers written after the read
   when(!hold) {
     hold := true.B
-    decode.rs1.value := regs_mem.readPorts(0).data
-    decode.rs2.value := regs_mem.readPorts(1).data
-    holdRs1 := regs_mem.readPorts(0).data
-    holdRs2 := regs_mem.readPorts(1).data
+    decode.rs1.value := rs1Read
+    decode.rs2.value := rs2Read
+    holdRs1 := Mux(writeHit(rs1PhysR), writeData(rs1PhysR), rs1Read)
+    holdRs2 := Mux(writeHit(rs2PhysR), writeData(rs2PhysR), rs2Read)
   } .otherwise {
     decode.rs1.value := holdRs1
     decode.rs2.value := holdRs2
+    holdRs1 := Mux(writeHit(rs1PhysR), writeData(rs1PhysR), holdRs1)
+    holdRs2 := Mux(writeHit(rs2PhysR), writeData(rs2PhysR), holdRs2)
   }
   
   when(decode.commit) {
@@ -108,4 +216,4 @@ class Regfile(implicit ccx: CCXParams) extends CCXModule {
   }
   
   ctrl.busy := false.B
-}
\ No newline at end of file
+}
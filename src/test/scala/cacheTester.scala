@@ -3,8 +3,11 @@ package armleocpu
 
 
 import chisel3._
+import chisel3.util._
 //import chisel3.simulator.EphemeralSimulator._
+import chisel3.simulator.scalatest.ChiselSim
 import org.scalatest.flatspec.AnyFlatSpec
+import Consts._
 
 /*
 class CacheSpec extends AnyFlatSpec {
@@ -138,4 +141,289 @@ class CacheSpec extends AnyFlatSpec {
     }
   }
 }
-*/
\ No newline at end of file
+*/
+
+// Array and write stage of the D-cache. The fill port accesses the array directly, the write request is merged
+// into the row read in the cycle before
+class CacheWriterHarness(implicit val ccx: CCXParams, implicit val cp: CacheParams) extends Module {
+  val io = IO(new Bundle {
+    val fill        = Input(Valid(new CacheArrayReq))
+    val req         = Input(Valid(new Bundle {
+      val paddr       = UInt(apLen.W)
+      val amo         = Bool()
+      val amoOp       = UInt(5.W)
+      val zero        = Bool()
+      val writeData   = Vec(xLenBytes, UInt(8.W))
+      val writeMask   = UInt(xLenBytes.W)
+    }))
+
+    val row         = Output(new CacheArrayResp)
+    val needUnique  = Output(Bool())
+    val written     = Output(Bool())
+    val readData    = Output(Vec(xLenBytes, UInt(8.W)))
+  })
+
+  val array   = Module(new CacheArray)
+  val writer  = Module(new CacheWriter)
+
+  val read = WireDefault(0.U.asTypeOf(new CacheArrayReq))
+  read.addr := io.req.bits.paddr
+
+  val s2 = RegEnable(io.req.bits, io.req.valid)
+  writer.io.valid       := RegNext(io.req.valid, false.B)
+  writer.io.paddr       := s2.paddr
+  writer.io.amo         := s2.amo
+  writer.io.amoOp       := s2.amoOp
+  writer.io.zero        := s2.zero
+  writer.io.writeData   := s2.writeData
+  writer.io.writeMask   := s2.writeMask
+  writer.io.row         := array.io.resp.bits
+  writer.io.array.ready := !io.fill.valid
+
+  array.io.req.valid  := io.fill.valid || writer.io.array.valid || io.req.valid
+  array.io.req.bits   := Mux(io.fill.valid, io.fill.bits, Mux(writer.io.array.valid, writer.io.array.bits, read))
+
+  io.row        := array.io.resp.bits
+  io.needUnique := writer.io.needUnique
+  io.written    := writer.io.array.fire
+  io.readData   := writer.io.readData
+}
+
+class CacheWriterTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+  implicit val cp: CacheParams = ccx.core.dcache
+
+  val lineAddr  = BigInt("80001040", 16)
+  val lineBytes = 1 << cacheLineLog2
+
+  def idle(dut: CacheWriterHarness): Unit = {
+    dut.io.fill.valid.poke(false.B)
+    dut.io.req.valid.poke(false.B)
+  }
+
+  // Puts the line with bytes b + 1 to way 1 of its set, way 0 is invalid
+  def fill(dut: CacheWriterHarness, unique: Boolean): Unit = {
+    dut.io.fill.valid.poke(true.B)
+    dut.io.fill.bits.addr.poke(lineAddr.U)
+    dut.io.fill.bits.metaWrite.poke(true.B)
+    dut.io.fill.bits.metaMask.poke(3.U)
+    for(w <- 0 until 2) {
+      dut.io.fill.bits.metaWdata(w).valid.poke((w == 1).B)
+      dut.io.fill.bits.metaWdata(w).dirty.poke(false.B)
+      dut.io.fill.bits.metaWdata(w).unique.poke(unique.B)
+      dut.io.fill.bits.metaWdata(w).ptag.poke((lineAddr >> (cacheLineLog2 + cp.entriesLog2)).U)
+    }
+    dut.io.fill.bits.dataWrite.poke(true.B)
+    dut.io.fill.bits.dataWayIdx.poke(1.U)
+    for(b <- 0 until lineBytes) {
+      dut.io.fill.bits.dataWdata(b).poke((b + 1).U)
+      dut.io.fill.bits.dataMask(b).poke(true.B)
+    }
+    dut.clock.step()
+    idle(dut)
+  }
+
+  // Expects the way 1 row of the set, the write has completed
+  def expectLine(dut: CacheWriterHarness, line: Seq[Int], dirty: Boolean): Unit = {
+    dut.io.fill.valid.poke(true.B)
+    dut.io.fill.bits.addr.poke(lineAddr.U)
+    dut.io.fill.bits.metaWrite.poke(false.B)
+    dut.io.fill.bits.dataWrite.poke(false.B)
+    dut.clock.step()
+    idle(dut)
+    dut.io.row.metaRdata(1).dirty.expect(dirty.B)
+    for(b <- 0 until lineBytes) dut.io.row.dataRdata(lineBytes + b).expect(line(b).U, s"Byte $b")
+  }
+
+  def write(dut: CacheWriterHarness, paddr: BigInt, amo: Boolean, amoOp: Int, data: BigInt, mask: Int, zero: Boolean = false): Unit = {
+    dut.io.req.valid.poke(true.B)
+    dut.io.req.bits.paddr.poke(paddr.U)
+    dut.io.req.bits.amo.poke(amo.B)
+    dut.io.req.bits.amoOp.poke(amoOp.U)
+    dut.io.req.bits.zero.poke(zero.B)
+    for(b <- 0 until xLenBytes) dut.io.req.bits.writeData(b).poke(((data >> (8 * b)) & 0xFF).U)
+    dut.io.req.bits.writeMask.poke(mask.U)
+    dut.clock.step()
+    idle(dut)
+  }
+
+  def expectBytes(v: Vec[UInt], value: BigInt): Unit = {
+    for(b <- 0 until xLenBytes) v(b).expect(((value >> (8 * b)) & 0xFF).U)
+  }
+
+  it should "write the AMO result and the stores to a unique line and leave a shared line alone" in {
+    simulate(new CacheWriterHarness) { dut =>
+      idle(dut)
+      fill(dut, unique = true)
+      val line = Array.tabulate(lineBytes)(b => b + 1)
+
+      // AMOADD.D: returns the old word, writes old + operand
+      write(dut, lineAddr + 8, amo = true, amoOp = 0, data = 0x100, mask = 0xFF)
+      dut.io.needUnique.expect(false.B)
+      dut.io.written.expect(true.B)
+      expectBytes(dut.io.readData, BigInt("100F0E0D0C0B0A09", 16))
+      dut.clock.step()
+      line(9) += 1
+      expectLine(dut, line.toSeq, dirty = true)
+
+      // AMOSWAP.W to the high word keeps the low word
+      write(dut, lineAddr + 20, amo = true, amoOp = 1, data = BigInt("AABBCCDD00000000", 16), mask = 0xF0)
+      dut.io.written.expect(true.B)
+      dut.clock.step()
+      Seq(0xDD, 0xCC, 0xBB, 0xAA).zipWithIndex.foreach { case (v, i) => line(20 + i) = v }
+      expectLine(dut, line.toSeq, dirty = true)
+
+      // Store writes only its bytes
+      write(dut, lineAddr + 56, amo = false, amoOp = 0, data = 0x5566, mask = 0x03)
+      dut.io.written.expect(true.B)
+      dut.clock.step()
+      line(56) = 0x66
+      line(57) = 0x55
+      expectLine(dut, line.toSeq, dirty = true)
+
+      // Shared line has to be made unique first
+      fill(dut, unique = false)
+      write(dut, lineAddr + 8, amo = true, amoOp = 0, data = 0x100, mask = 0xFF)
+      dut.io.needUnique.expect(true.B)
+      dut.io.written.expect(false.B)
+      dut.clock.step()
+      expectLine(dut, Seq.tabulate(lineBytes)(b => b + 1), dirty = false)
+
+      // Same for the miss
+      write(dut, lineAddr + 0x1000, amo = false, amoOp = 0, data = 0, mask = 0xFF)
+      dut.io.needUnique.expect(true.B)
+      dut.io.written.expect(false.B)
+    }
+  }
+
+  it should "zero the whole unique line for cbo.zero" in {
+    simulate(new CacheWriterHarness) { dut =>
+      idle(dut)
+
+      // Shared line is made unique first
+      fill(dut, unique = false)
+      write(dut, lineAddr + 0x24, amo = false, amoOp = 0, data = 0, mask = 0, zero = true)
+      dut.io.needUnique.expect(true.B)
+      dut.io.written.expect(false.B)
+      dut.clock.step()
+      expectLine(dut, Seq.tabulate(lineBytes)(b => b + 1), dirty = false)
+
+      // Any address in the line, writeData and writeMask do not matter
+      fill(dut, unique = true)
+      write(dut, lineAddr + 0x24, amo = false, amoOp = 0, data = BigInt("FFFFFFFFFFFFFFFF", 16), mask = 0x0F, zero = true)
+      dut.io.needUnique.expect(false.B)
+      dut.io.written.expect(true.B)
+      dut.clock.step()
+      expectLine(dut, Seq.fill(lineBytes)(0), dirty = true)
+    }
+  }
+}
+
+// The test acts as the D-cache and the L3 bank
+class CacheFarRequesterTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+  implicit val bp: BusParams = new BusParams(addrWidth = 32, busBytes = 64, idWidth = 1, lenWidth = 1)
+
+  it should "send the far AMO to the bank and return the old word with the contended hint" in {
+    simulate(new CacheFarRequester) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      dut.io.bus.ar.ready.poke(true.B)
+      dut.io.bus.aw.ready.poke(false.B)
+      dut.io.bus.w.ready.poke(true.B)
+      dut.io.bus.r.valid.poke(false.B)
+      dut.io.bus.b.valid.poke(false.B)
+
+      // AMOADD.W to the high half of the second word
+      dut.io.req.ready.expect(true.B)
+      dut.io.req.valid.poke(true.B)
+      dut.io.req.bits.paddr.poke(0x80001048L.U)
+      dut.io.req.bits.amoOp.poke(0.U)
+      for(b <- 0 until xLenBytes) dut.io.req.bits.writeData(b).poke((if(b >= 4) b else 0).U)
+      dut.io.req.bits.writeMask.poke(0xF0.U)
+      dut.io.req.bits.cmo.poke(Cmo.NONE)
+      dut.clock.step()
+      dut.io.req.valid.poke(false.B)
+      dut.io.req.ready.expect(false.B)
+
+      // W goes first, AW waits for its ready
+      dut.io.bus.aw.valid.expect(true.B)
+      dut.io.bus.aw.bits.op.expect((0x40).U)
+      dut.io.bus.aw.bits.addr.expect(0x80001048L.U)
+      dut.io.bus.w.valid.expect(true.B)
+      dut.io.bus.w.bits.strb.expect((BigInt(0xF0) << 8).U)
+      dut.io.bus.w.bits.data.expect(((0 until 8).map(i => BigInt("0706050400000000", 16) << (64 * i)).sum).U)
+      dut.clock.step()
+      dut.io.bus.w.valid.expect(false.B)
+      dut.io.bus.aw.ready.poke(true.B)
+      dut.io.bus.aw.valid.expect(true.B)
+      dut.clock.step()
+      dut.io.bus.aw.valid.expect(false.B)
+
+      // Old line comes back, the peers had to give it up
+      dut.io.bus.r.ready.expect(true.B)
+      dut.io.bus.r.valid.poke(true.B)
+      dut.io.bus.r.bits.data.poke((BigInt("1122334455667788", 16) << 64).U)
+      dut.io.bus.r.bits.resp.poke((1 << busConst.SNOOPEDBITNUM).U)
+      dut.clock.step()
+      dut.io.bus.r.valid.poke(false.B)
+
+      dut.io.resp.valid.expect(false.B)
+      dut.io.bus.b.valid.poke(true.B)
+      dut.io.bus.b.bits.resp.poke(busConst.OKAY)
+      dut.io.resp.valid.expect(true.B)
+      dut.io.resp.bits.contended.expect(true.B)
+      dut.io.resp.bits.accessFault.expect(false.B)
+      for(b <- 0 until xLenBytes) dut.io.resp.bits.readData(b).expect(((BigInt("1122334455667788", 16) >> (8 * b)) & 0xFF).U)
+      dut.clock.step()
+      dut.io.bus.b.valid.poke(false.B)
+      dut.io.req.ready.expect(true.B)
+    }
+  }
+
+  it should "send the cache block operations as line ops without W" in {
+    simulate(new CacheFarRequester) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      dut.io.bus.ar.ready.poke(true.B)
+      dut.io.bus.aw.ready.poke(true.B)
+      dut.io.bus.w.ready.poke(true.B)
+      dut.io.bus.r.valid.poke(false.B)
+      dut.io.bus.b.valid.poke(false.B)
+      dut.io.req.bits.amoOp.poke(0.U)
+      for(b <- 0 until xLenBytes) dut.io.req.bits.writeData(b).poke(0.U)
+      dut.io.req.bits.writeMask.poke(0.U)
+
+      for((cmo, op) <- Seq(Cmo.CLEAN -> busConst.CleanLine, Cmo.FLUSH -> busConst.FlushLine, Cmo.INVAL -> busConst.InvalLine)) {
+        dut.io.req.ready.expect(true.B)
+        dut.io.req.valid.poke(true.B)
+        dut.io.req.bits.paddr.poke(0x80001040L.U)
+        dut.io.req.bits.cmo.poke(cmo)
+        dut.clock.step()
+        dut.io.req.valid.poke(false.B)
+
+        dut.io.bus.aw.valid.expect(true.B)
+        dut.io.bus.aw.bits.op.expect(op)
+        dut.io.bus.aw.bits.addr.expect(0x80001040L.U)
+        dut.io.bus.w.valid.expect(false.B)
+        dut.clock.step()
+
+        // No R, the bank answers on B once every copy is given up
+        dut.io.bus.aw.valid.expect(false.B)
+        dut.io.bus.r.ready.expect(false.B)
+        dut.io.bus.b.ready.expect(true.B)
+        dut.io.resp.valid.expect(false.B)
+        dut.clock.step()
+        dut.io.bus.b.valid.poke(true.B)
+        dut.io.bus.b.bits.resp.poke(busConst.OKAY)
+        dut.io.resp.valid.expect(true.B)
+        dut.io.resp.bits.contended.expect(false.B)
+        dut.io.resp.bits.accessFault.expect(false.B)
+        dut.clock.step()
+        dut.io.bus.b.valid.poke(false.B)
+      }
+    }
+  }
+}
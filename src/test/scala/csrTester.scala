@@ -0,0 +1,245 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+
+class CsrTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  val flushEvent  = 10 // Position of flush in PerfEvents.all plus one
+  val mtVector    = BigInt("40000000", 16)
+  val allOnes     = (BigInt(1) << 64) - 1
+
+  def idle(dut: CSR): Unit = {
+    dut.io.cmd.poke(csr_cmd.none)
+    dut.io.addr.poke(0.U)
+    dut.io.in.poke(0.U)
+    dut.io.epc.poke(0.U)
+    dut.io.cause.poke(0.U)
+    dut.io.instRetIncr.poke(0.U)
+    dut.io.fflags.poke(0.U)
+    dut.io.fsDirty.poke(false.B)
+    dut.io.vecConfig.valid.poke(false.B)
+    dut.io.vstart.valid.poke(false.B)
+    dut.io.vsDirty.poke(false.B)
+    dut.io.int.meip.poke(false.B)
+    dut.io.int.mtip.poke(false.B)
+    dut.io.int.msip.poke(false.B)
+    dut.io.int.seip.poke(false.B)
+    dut.io.int.stip.poke(false.B)
+    dut.io.int.ssip.poke(false.B)
+    dut.io.perf.icacheHit.poke(false.B)
+    dut.io.perf.icacheMiss.poke(false.B)
+    dut.io.perf.dcacheHit.poke(false.B)
+    dut.io.perf.dcacheMiss.poke(false.B)
+    dut.io.perf.itlbMiss.poke(false.B)
+    dut.io.perf.dtlbMiss.poke(false.B)
+    dut.io.perf.ptwCycle.poke(false.B)
+    dut.io.perf.branchMispredict.poke(false.B)
+    dut.io.perf.decodeStall.poke(false.B)
+    dut.io.perf.flush.poke(false.B)
+    dut.io.perf.l3Snoop.poke(false.B)
+    dut.io.perf.topDown.poke(0.U)
+  }
+
+  def start(dut: CSR): Unit = {
+    dut.dynRegs.resetVector.poke(0.U)
+    dut.dynRegs.mtVector.poke(mtVector.U)
+    dut.dynRegs.stVector.poke(mtVector.U)
+    dut.dynRegs.mvendorid.poke(0.U)
+    dut.dynRegs.marchid.poke(0.U)
+    dut.dynRegs.mimpid.poke(0.U)
+    dut.dynRegs.mhartid.poke(0.U)
+    dut.dynRegs.mconfigptr.poke(0.U)
+    for(i <- 0 until ccx.pmpCount) {
+      dut.staticRegs.pmpcfg_default(i).poke(0.U)
+      dut.staticRegs.pmpaddr_default(i).poke(0.U)
+    }
+    idle(dut)
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+  }
+
+  // Reads within the cycle, nothing changes
+  def read(dut: CSR, addr: Int, err: Boolean = false): BigInt = {
+    dut.io.cmd.poke(csr_cmd.read)
+    dut.io.addr.poke(addr.U)
+    dut.io.err.expect(err.B, f"CSR read of 0x$addr%x")
+    val value = dut.io.out.peek().litValue
+    dut.io.cmd.poke(csr_cmd.none)
+    value
+  }
+
+  def write(dut: CSR, addr: Int, value: BigInt): Unit = {
+    dut.io.cmd.poke(csr_cmd.write)
+    dut.io.addr.poke(addr.U)
+    dut.io.in.poke(value.U)
+    dut.io.err.expect(false.B, f"CSR write of 0x$addr%x")
+    dut.clock.step()
+    dut.io.cmd.poke(csr_cmd.none)
+  }
+
+  // MRET to the privilege in MPP
+  def enter(dut: CSR, priv: Int): Unit = {
+    write(dut, 0x300, BigInt(priv) << 11)
+    dut.io.cmd.poke(csr_cmd.mret)
+    dut.clock.step()
+    dut.io.cmd.poke(csr_cmd.none)
+    dut.io.regsOut.priv.expect(priv.U)
+  }
+
+  // Back to machine mode
+  def trap(dut: CSR): Unit = {
+    dut.io.cmd.poke(csr_cmd.exception)
+    dut.io.cause.poke(2.U)
+    dut.clock.step()
+    dut.io.cmd.poke(csr_cmd.none)
+    dut.io.regsOut.priv.expect(3.U)
+  }
+
+  it should "trap the user counter reads that mcounteren/scounteren do not enable" in {
+    simulate(new CSR) { dut =>
+      start(dut)
+      read(dut, 0xC00)
+      read(dut, 0xC03)
+
+      // Nothing enabled
+      enter(dut, 1)
+      read(dut, 0xC00, err = true)
+      read(dut, 0xC03, err = true)
+      trap(dut)
+      enter(dut, 0)
+      read(dut, 0xC00, err = true)
+      trap(dut)
+
+      // CY and HPM3 for S, U also needs scounteren
+      write(dut, 0x306, 0x9)
+      enter(dut, 1)
+      read(dut, 0xC00)
+      read(dut, 0xC03)
+      read(dut, 0xC02, err = true)
+      read(dut, 0xC04, err = true)
+      trap(dut)
+      enter(dut, 0)
+      read(dut, 0xC00, err = true)
+      trap(dut)
+
+      write(dut, 0x106, 0x1)
+      enter(dut, 0)
+      read(dut, 0xC00)
+      read(dut, 0xC03, err = true)
+      trap(dut)
+
+      // TM is not implemented, its enable bit reads zero
+      write(dut, 0x306, 0xF)
+      assert(read(dut, 0x306) == 0xD)
+    }
+  }
+
+  it should "stop the counters with mcountinhibit and the mode inhibit bits" in {
+    simulate(new CSR) { dut =>
+      start(dut)
+      write(dut, 0x323, flushEvent)
+      write(dut, 0xB03, 0)
+
+      // Counts the cycles with the event
+      dut.io.perf.flush.poke(true.B)
+      dut.clock.step(5)
+      dut.io.perf.flush.poke(false.B)
+      dut.clock.step(3)
+      assert(read(dut, 0xB03) == 5)
+      assert(read(dut, 0xC03) == 5)
+
+      // Inhibited: cycle, instret and HPM3
+      write(dut, 0x320, 0xD)
+      val cycle = read(dut, 0xB00)
+      dut.io.instRetIncr.poke(1.U)
+      dut.io.perf.flush.poke(true.B)
+      dut.clock.step(4)
+      assert(read(dut, 0xB00) == cycle)
+      assert(read(dut, 0xB02) == 0)
+      assert(read(dut, 0xB03) == 5)
+
+      // Counting again, from the cycle after the write
+      write(dut, 0x320, 0)
+      dut.clock.step(2)
+      assert(read(dut, 0xB00) > cycle)
+      assert(read(dut, 0xB02) == 2)
+      assert(read(dut, 0xB03) == 7)
+
+      // MINH stops it in machine mode only. The cycle of the write and the one of the trap still count
+      write(dut, 0x323, (BigInt(1) << 62) | flushEvent)
+      dut.clock.step(3)
+      assert(read(dut, 0xB03) == 8)
+      enter(dut, 0)
+      dut.clock.step(3)
+      trap(dut)
+      assert(read(dut, 0xB03) == 12)
+    }
+  }
+
+  it should "set OF and raise LCOFI when a counter overflows" in {
+    simulate(new CSR) { dut =>
+      start(dut)
+      write(dut, 0x323, flushEvent)
+      write(dut, 0xB03, allOnes - 1)
+      write(dut, 0x304, 1 << 13) // LCOFIE
+
+      dut.io.perf.flush.poke(true.B)
+      dut.clock.step()
+      assert(read(dut, 0xB03) == allOnes)
+      assert(read(dut, 0x323) == flushEvent)
+      dut.clock.step()
+      dut.io.perf.flush.poke(false.B)
+      assert(read(dut, 0xB03) == 0)
+      assert(read(dut, 0x323) == ((BigInt(1) << 63) | flushEvent))
+      assert(read(dut, 0x344) == (1 << 13))
+      assert(read(dut, 0xDA0) == (1 << 3))
+
+      // Wakes WFI, but is taken only below machine mode
+      dut.io.interruptWake.expect(true.B)
+      dut.io.interruptPending.expect(false.B)
+      enter(dut, 0)
+      dut.io.interruptPending.expect(true.B)
+      dut.io.cmd.poke(csr_cmd.interrupt)
+      dut.io.epc.poke(0x1000.U)
+      dut.io.err.expect(false.B)
+      dut.io.next_pc.expect(mtVector.U)
+      dut.clock.step()
+      dut.io.cmd.poke(csr_cmd.none)
+      assert(read(dut, 0x342) == ((BigInt(1) << 63) | 13))
+      assert(read(dut, 0x341) == 0x1000)
+
+      // S-mode sees OF of the counters mcounteren lets it read
+      enter(dut, 1)
+      assert(read(dut, 0xDA0) == 0)
+      trap(dut)
+      write(dut, 0x306, 1 << 3)
+      enter(dut, 1)
+      assert(read(dut, 0xDA0) == (1 << 3))
+      trap(dut)
+
+      // OF that is already set does not raise LCOFIP again
+      write(dut, 0x344, 0)
+      write(dut, 0xB03, allOnes)
+      dut.io.perf.flush.poke(true.B)
+      dut.clock.step()
+      dut.io.perf.flush.poke(false.B)
+      assert(read(dut, 0xB03) == 0)
+      assert(read(dut, 0x344) == 0)
+      dut.io.interruptWake.expect(false.B)
+
+      // Cleared OF arms it again
+      write(dut, 0x323, flushEvent)
+      write(dut, 0xB03, allOnes)
+      dut.io.perf.flush.poke(true.B)
+      dut.clock.step()
+      dut.io.perf.flush.poke(false.B)
+      assert(read(dut, 0x344) == (1 << 13))
+    }
+  }
+}
@@ -0,0 +1,122 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+
+class DecodeTableHarness extends Module {
+  val io = IO(new Bundle {
+    val instr = Input(UInt(32.W))
+    val dec   = Output(new DecodedCtrl)
+  })
+  io.dec := DecodeTable(io.instr)
+}
+
+class DecodeTableTest extends AnyFlatSpec with ChiselSim {
+  val mask = (BigInt(1) << 64) - 1
+  def x(v: BigInt): BigInt = v & mask // Sign extended immediate
+
+  // Expected control of one instruction. Fields that do not matter for it are left as None
+  case class Ctrl(
+    unit: Int,
+    aluOp: UInt = AluOp.ADD,
+    word: Boolean = false,
+    op1Sel: UInt = Op1Sel.RS1,
+    op2Imm: Boolean = false,
+    imm: Option[BigInt] = None,
+    rdWrite: Boolean = true,
+    load: Boolean = false,
+    store: Boolean = false,
+    memSize: Option[UInt] = None,
+    memSigned: Option[Boolean] = None,
+    fence: Boolean = false,
+  )
+
+  def check(dut: DecodeTableHarness, instr: BigInt, name: String, c: Ctrl): Unit = {
+    dut.io.instr.poke(instr.U)
+    dut.io.dec.illegal.expect(false.B, name)
+    dut.io.dec.unit.expect(if(c.unit < 0) ExecUnitSel.NONE else ExecUnitSel(c.unit), name)
+    dut.io.dec.aluOp.expect(c.aluOp, name)
+    dut.io.dec.word.expect(c.word.B, name)
+    dut.io.dec.op1Sel.expect(c.op1Sel, name)
+    dut.io.dec.op2Imm.expect(c.op2Imm.B, name)
+    c.imm.foreach(i => dut.io.dec.imm.expect(x(i).U, name))
+    dut.io.dec.rdWrite.expect(c.rdWrite.B, name)
+    dut.io.dec.load.expect(c.load.B, name)
+    dut.io.dec.store.expect(c.store.B, name)
+    c.memSize.foreach(s => dut.io.dec.memSize.expect(s, name))
+    c.memSigned.foreach(s => dut.io.dec.memSigned.expect(s.B, name))
+    dut.io.dec.fence.expect(c.fence.B, name)
+  }
+
+  import ExecUnitSel._
+
+  // Encoding, name, expected control
+  val vectors = Seq(
+    (BigInt("FFF10093", 16), "addi x1, x2, -1",     Ctrl(ALU, op2Imm = true, imm = Some(BigInt(-1)))),
+    (BigInt("00000013", 16), "nop does not write",  Ctrl(ALU, op2Imm = true, imm = Some(BigInt(0)), rdWrite = false)),
+    (BigInt("0210E093", 16), "ori x1, x1, 33",      Ctrl(ALU, aluOp = AluOp.OR, op2Imm = true, imm = Some(BigInt(33)))),
+    (BigInt("800002B7", 16), "lui x5, 0x80000",     Ctrl(ALU, op1Sel = Op1Sel.ZERO, op2Imm = true, imm = Some(BigInt(-0x80000000L)))),
+    (BigInt("00001097", 16), "auipc x1, 1",         Ctrl(ALU, op1Sel = Op1Sel.PC, op2Imm = true, imm = Some(BigInt(0x1000)))),
+    (BigInt("003100BB", 16), "addw x1, x2, x3",     Ctrl(ALU, word = true)),
+
+    (BigInt("FFDFF0EF", 16), "jal x1, -4",          Ctrl(JUMP, op1Sel = Op1Sel.PC, op2Imm = true, imm = Some(BigInt(-4)))),
+    (BigInt("FE208CE3", 16), "beq x1, x2, -8",      Ctrl(BRANCH, aluOp = AluOp.SEQ, imm = Some(BigInt(-8)), rdWrite = false)),
+
+    (BigInt("00524183", 16), "lbu x3, 5(x4)",       Ctrl(LOADSTORE, op2Imm = true, imm = Some(BigInt(5)), load = true, memSize = Some(MemSize.B), memSigned = Some(false))),
+    (BigInt("00013083", 16), "ld x1, 0(x2)",        Ctrl(LOADSTORE, op2Imm = true, imm = Some(BigInt(0)), load = true, memSize = Some(MemSize.D), memSigned = Some(true))),
+    (BigInt("FE20AE23", 16), "sw x2, -4(x1)",       Ctrl(LOADSTORE, op2Imm = true, imm = Some(BigInt(-4)), rdWrite = false, store = true, memSize = Some(MemSize.W))),
+    // The atomics address rs1 without an offset, the rs2 field is not an immediate
+    (BigInt("1001202F", 16), "lr.w x1, (x2)",       Ctrl(LOADSTORE, op2Imm = true, imm = Some(BigInt(0)), load = true, memSize = Some(MemSize.W))),
+    (BigInt("003130AF", 16), "amoadd.d x1, x3, (x2)", Ctrl(LOADSTORE, op2Imm = true, imm = Some(BigInt(0)), load = true, store = true, memSize = Some(MemSize.D))),
+    // ORI with rd = 0 is a prefetch, the low offset bits select it
+    (BigInt("0210E013", 16), "prefetch.r 32(x1)",   Ctrl(LOADSTORE, op2Imm = true, imm = Some(BigInt(32)), rdWrite = false, load = true)),
+
+    (BigInt("023100BB", 16), "mulw x1, x2, x3",     Ctrl(MULDIV, aluOp = AluOp.MUL, word = true)),
+    (BigInt("0FF0000F", 16), "fence",               Ctrl(-1, aluOp = AluOp.X, op1Sel = Op1Sel.X, rdWrite = false, fence = true)),
+  )
+
+  it should "decode the control of each instruction class" in {
+    simulate(new DecodeTableHarness) { dut =>
+      for((instr, name, c) <- vectors) {
+        check(dut, instr, name, c)
+      }
+    }
+  }
+
+  it should "flag the unknown encodings illegal" in {
+    simulate(new DecodeTableHarness) { dut =>
+      for(instr <- Seq(BigInt(0), BigInt("FFFFFFFF", 16), BigInt("0000707F", 16))) {
+        dut.io.instr.poke(instr.U)
+        dut.io.dec.illegal.expect(true.B, f"0x$instr%x")
+        dut.io.dec.unit.expect(ExecUnitSel.NONE)
+        dut.io.dec.rdWrite.expect(false.B)
+        dut.io.dec.load.expect(false.B)
+        dut.io.dec.store.expect(false.B)
+      }
+    }
+  }
+
+  it should "mark the FP register operands" in {
+    simulate(new DecodeTableHarness) { dut =>
+      // flw f1, 0(x2) writes the FP register file, not x1
+      dut.io.instr.poke(BigInt("00012087", 16).U)
+      dut.io.dec.load.expect(true.B)
+      dut.io.dec.rdWrite.expect(false.B)
+      dut.io.dec.fp.rd.expect(true.B)
+      dut.io.dec.fp.rs1.expect(false.B)
+
+      // fadd.s f1, f2, f3, dyn
+      dut.io.instr.poke(BigInt("003170D3", 16).U)
+      dut.io.dec.unit.expect(ExecUnitSel(ExecUnitSel.FPU))
+      dut.io.dec.aluOp.expect(FpuOp.FADD)
+      dut.io.dec.fp.rs1.expect(true.B)
+      dut.io.dec.fp.rs2.expect(true.B)
+      dut.io.dec.fp.rs3.expect(false.B)
+      dut.io.dec.fp.rd.expect(true.B)
+      dut.io.dec.fp.rm.expect(true.B)
+    }
+  }
+}
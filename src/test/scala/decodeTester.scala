@@ -0,0 +1,148 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import Consts._
+
+// The test acts as Fetch, the register files and Execute
+class DecodeTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  def lui(rd: Int, imm: Int): Int = (imm << 12) | (rd << 7) | 0x37
+  def addi(rd: Int, rs1: Int, imm: Int): Int = (imm << 20) | (rs1 << 15) | (rd << 7) | 0x13
+  def slli(rd: Int, rs1: Int, shamt: Int): Int = (shamt << 20) | (rs1 << 15) | (1 << 12) | (rd << 7) | 0x13
+  def srli(rd: Int, rs1: Int, shamt: Int): Int = (shamt << 20) | (rs1 << 15) | (5 << 12) | (rd << 7) | 0x13
+
+  def start(dut: Decode): Unit = {
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+    dut.ctrl.kill.poke(false.B)
+    dut.ctrl.jump.poke(false.B)
+    dut.ctrl.flush.poke(false.B)
+    dut.ctrl.newPc.poke(0.U)
+    dut.memPending.poke(false.B)
+    dut.in.valid.poke(false.B)
+    dut.in.bits.instr.poke(0.U)
+    dut.in.bits.pc.poke(0.U)
+    dut.in.bits.pcPlus4.poke(0.U)
+    dut.in.bits.ifetchPageFault.poke(false.B)
+    dut.in.bits.ifetchAccessFault.poke(false.B)
+    dut.in.bits.predTaken.poke(false.B)
+    dut.in.bits.rvc.poke(false.B)
+    for(rs <- Seq(dut.regs_decode.rs1, dut.regs_decode.rs2)) {
+      rs.reserved.poke(false.B)
+      rs.value.poke(0.U)
+      rs.phys.poke(0.U)
+    }
+    dut.regs_decode.rd.reserved.poke(false.B)
+    dut.regs_decode.rd.phys.poke(40.U)
+    dut.regs_decode.rd.oldPhys.poke(5.U)
+    dut.fregs_decode.reserved.poke(false.B)
+    dut.fregs_decode.rs1.poke(0.U)
+    dut.fregs_decode.rs2.poke(0.U)
+    dut.fregs_decode.rs3.poke(0.U)
+    dut.out.ready.poke(true.B)
+  }
+
+  // Sends the instruction and returns whether it was taken this cycle
+  def send(dut: Decode, pc: Int, instr: Int): Boolean = {
+    dut.in.valid.poke(true.B)
+    dut.in.bits.pc.poke(pc.U)
+    dut.in.bits.pcPlus4.poke((pc + 4).U)
+    dut.in.bits.instr.poke((instr.toLong & 0xFFFFFFFFL).U)
+    val taken = dut.in.ready.peek().litToBoolean
+    dut.clock.step()
+    dut.in.valid.poke(false.B)
+    taken
+  }
+
+  it should "fuse the known pairs into one uop" in {
+    simulate(new Decode) { dut =>
+      start(dut)
+
+      // 32-bit constant: lui x5, 0x12345; addi x5, x5, 0x678
+      assert(send(dut, 0x100, lui(5, 0x12345)))
+      dut.in.valid.poke(true.B)
+      dut.in.bits.pc.poke(0x104.U)
+      dut.in.bits.pcPlus4.poke(0x108.U)
+      dut.in.bits.instr.poke(addi(5, 5, 0x678).U)
+      // Merged into the held uop, nothing is sent down and the tail is not renamed
+      dut.out.valid.expect(false.B)
+      dut.in.ready.expect(true.B)
+      dut.regs_decode.commit.expect(false.B)
+      dut.clock.step()
+      dut.in.valid.poke(false.B)
+
+      dut.out.valid.expect(true.B)
+      dut.out.bits.fused.expect(true.B)
+      dut.out.bits.pc.expect(0x100.U)
+      dut.out.bits.pcPlus4.expect(0x108.U)
+      dut.out.bits.rdPhys.expect(40.U)
+      dut.out.bits.dec.op1Sel.expect(Op1Sel.ZERO)
+      dut.out.bits.dec.aluOp.expect(AluOp.ADD)
+      dut.out.bits.dec.imm.expect(0x12345678.U)
+      dut.clock.step()
+      dut.out.valid.expect(false.B)
+
+      // Zero extension: slli x10, x10, 32; srli x10, x10, 32 is an AND with the low word mask
+      assert(send(dut, 0x200, slli(10, 10, 32)))
+      assert(send(dut, 0x204, srli(10, 10, 32)))
+      dut.out.valid.expect(true.B)
+      dut.out.bits.fused.expect(true.B)
+      dut.out.bits.pcPlus4.expect(0x208.U)
+      dut.out.bits.dec.aluOp.expect(AluOp.AND)
+      dut.out.bits.dec.op2Imm.expect(true.B)
+      dut.out.bits.dec.imm.expect(0xFFFFFFFFL.U)
+    }
+  }
+
+  it should "not fuse the pairs that do not chain" in {
+    simulate(new Decode) { dut =>
+      start(dut)
+
+      // Different rd: both uops go down on their own
+      assert(send(dut, 0x100, lui(5, 0x12345)))
+      dut.in.valid.poke(true.B)
+      dut.in.bits.pc.poke(0x104.U)
+      dut.in.bits.pcPlus4.poke(0x108.U)
+      dut.in.bits.instr.poke(addi(6, 5, 0x678).U)
+      dut.out.valid.expect(true.B)
+      dut.out.bits.fused.expect(false.B)
+      dut.out.bits.dec.imm.expect(0x12345000.U)
+      dut.clock.step()
+      dut.in.valid.poke(false.B)
+      dut.out.valid.expect(true.B)
+      dut.out.bits.pc.expect(0x104.U)
+      dut.out.bits.fused.expect(false.B)
+      dut.clock.step()
+
+      // Not sequential: the tail is a branch target
+      assert(send(dut, 0x200, lui(5, 0x12345)))
+      dut.in.valid.poke(true.B)
+      dut.in.bits.pc.poke(0x300.U)
+      dut.in.bits.pcPlus4.poke(0x304.U)
+      dut.in.bits.instr.poke(addi(5, 5, 0x678).U)
+      dut.out.valid.expect(true.B)
+      dut.out.bits.fused.expect(false.B)
+      dut.clock.step()
+      dut.in.valid.poke(false.B)
+      dut.clock.step()
+
+      // A fused uop is not merged again
+      dut.out.ready.poke(false.B)
+      assert(send(dut, 0x400, lui(5, 0x12345)))
+      assert(send(dut, 0x404, addi(5, 5, 0x678)))
+      dut.in.valid.poke(true.B)
+      dut.in.bits.pc.poke(0x408.U)
+      dut.in.bits.pcPlus4.poke(0x40C.U)
+      dut.in.bits.instr.poke(addi(5, 5, 1).U)
+      dut.out.valid.expect(true.B)
+      dut.out.bits.fused.expect(true.B)
+      dut.in.ready.expect(false.B)
+    }
+  }
+}
@@ -0,0 +1,141 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import Consts._
+
+// Acts as Decode: decodes the instruction and sends it with the operand values
+class ExecuteHarness(implicit ccx: CCXParams) extends Module {
+  val io = IO(new Bundle {
+    val valid       = Input(Bool())
+    val instr       = Input(UInt(32.W))
+    val pc          = Input(UInt(apLen.W))
+    val rs1         = Input(UInt(xLen.W))
+    val rs2         = Input(UInt(xLen.W))
+    val predTaken   = Input(Bool())
+    val outReady    = Input(Bool())
+    val kill        = Input(Bool())
+
+    val inReady     = Output(Bool())
+    val redirect    = Output(Valid(UInt(apLen.W)))
+    val outValid    = Output(Bool())
+    val outRedirected = Output(Bool())
+  })
+  val execute = Module(new Execute)
+  val uop = Wire(new DecodeUop)
+  uop             := 0.U.asTypeOf(uop)
+  uop.pc          := io.pc
+  uop.pcPlus4     := io.pc + 4.U
+  uop.instr       := io.instr
+  uop.predTaken   := io.predTaken
+  uop.rs1         := io.rs1
+  uop.rs2         := io.rs2
+  uop.dec         := DecodeTable(io.instr)
+
+  execute.ctrl.kill   := io.kill
+  execute.ctrl.jump   := false.B
+  execute.ctrl.flush  := false.B
+  execute.ctrl.newPc  := 0.U
+  execute.frm         := 0.U
+  execute.in.valid    := io.valid
+  execute.in.bits     := uop
+  execute.out.ready   := io.outReady
+  execute.outExtra.foreach(_.ready := io.outReady)
+
+  io.inReady        := execute.in.ready
+  io.redirect       := execute.redirect
+  io.outValid       := execute.out.valid
+  io.outRedirected  := execute.out.bits.redirected
+}
+
+class ExecuteTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  val BEQ_FWD   = BigInt("00208463", 16) // beq x1, x2, 8
+  val BEQ_BACK  = BigInt("FE208CE3", 16) // beq x1, x2, -8
+  val JALR      = BigInt("01008067", 16) // jalr x0, 16(x1)
+  val ADD       = BigInt("002081B3", 16) // add x3, x1, x2
+
+  def start(dut: ExecuteHarness): Unit = {
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+    dut.io.valid.poke(false.B)
+    dut.io.instr.poke(0.U)
+    dut.io.pc.poke(0.U)
+    dut.io.rs1.poke(0.U)
+    dut.io.rs2.poke(0.U)
+    dut.io.predTaken.poke(false.B)
+    dut.io.outReady.poke(true.B)
+    dut.io.kill.poke(false.B)
+  }
+
+  // Sends one uop and checks the redirect in the cycle it leaves Execute
+  def execute(dut: ExecuteHarness, instr: BigInt, rs1: BigInt, rs2: BigInt, predTaken: Boolean,
+              redirect: Option[Int], name: String): Unit = {
+    dut.io.valid.poke(true.B)
+    dut.io.pc.poke(0x100.U)
+    dut.io.instr.poke(instr.U)
+    dut.io.rs1.poke(rs1.U)
+    dut.io.rs2.poke(rs2.U)
+    dut.io.predTaken.poke(predTaken.B)
+    dut.io.inReady.expect(true.B, name)
+    dut.io.redirect.valid.expect(redirect.isDefined.B, name)
+    redirect.foreach(r => dut.io.redirect.bits.expect(r.U, name))
+    dut.clock.step()
+    dut.io.valid.poke(false.B)
+    // Retirement does not redirect the uop again
+    dut.io.outValid.expect(true.B, name)
+    dut.io.outRedirected.expect(redirect.isDefined.B, name)
+    dut.clock.step()
+  }
+
+  it should "redirect the front-end on the mispredicted branches and jumps" in {
+    simulate(new ExecuteHarness) { dut =>
+      start(dut)
+      execute(dut, BEQ_FWD,  5, 5, predTaken = false, Some(0x108), "taken branch predicted not taken")
+      execute(dut, BEQ_FWD,  5, 5, predTaken = true,  None,        "taken branch predicted taken")
+      execute(dut, BEQ_BACK, 5, 6, predTaken = true,  Some(0x104), "not taken branch predicted taken")
+      execute(dut, BEQ_BACK, 5, 6, predTaken = false, None,        "not taken branch predicted not taken")
+      // Target is rs1 + 16 with the low bit cleared
+      execute(dut, JALR, 0x1001, 0, predTaken = false, Some(0x1010), "JALR")
+      execute(dut, ADD,  1, 2,      predTaken = false, None,         "ADD")
+    }
+  }
+
+  it should "redirect only when the uop leaves Execute" in {
+    simulate(new ExecuteHarness) { dut =>
+      start(dut)
+      // Retirement is busy with the older uop: the branch waits
+      dut.io.outReady.poke(false.B)
+      dut.io.valid.poke(true.B)
+      dut.io.pc.poke(0x200.U)
+      dut.io.instr.poke(ADD.U)
+      dut.clock.step()
+      dut.io.pc.poke(0x204.U)
+      dut.io.instr.poke(BEQ_FWD.U)
+      dut.io.rs1.poke(5.U)
+      dut.io.rs2.poke(5.U)
+      dut.io.inReady.expect(false.B)
+      dut.io.redirect.valid.expect(false.B)
+      dut.clock.step()
+      dut.io.redirect.valid.expect(false.B)
+
+      dut.io.outReady.poke(true.B)
+      dut.io.redirect.valid.expect(true.B)
+      dut.io.redirect.bits.expect(0x20C.U)
+
+      // Killed uop does not redirect
+      dut.io.kill.poke(true.B)
+      dut.io.inReady.expect(false.B)
+      dut.io.redirect.valid.expect(false.B)
+      dut.clock.step()
+      dut.io.kill.poke(false.B)
+      dut.io.valid.poke(false.B)
+      dut.io.outValid.expect(false.B)
+    }
+  }
+}
@@ -0,0 +1,116 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+
+// The test acts as Prefetch and Fetch
+class FetchTargetQueueTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  def start(dut: FetchTargetQueue): Unit = {
+    dut.dynRegs.resetVector.poke(0x1000.U)
+    dut.ctrl.kill.poke(false.B)
+    dut.ctrl.jump.poke(false.B)
+    dut.ctrl.flush.poke(false.B)
+    dut.ctrl.newPc.poke(0.U)
+    dut.redirect.valid.poke(false.B)
+    dut.redirect.bits.poke(0.U)
+    dut.update.valid.poke(false.B)
+    dut.update.bits.pc.poke(0.U)
+    dut.update.bits.target.poke(0.U)
+    dut.update.bits.taken.poke(false.B)
+    dut.out.ready.poke(false.B)
+    dut.hint.ready.poke(false.B)
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+  }
+
+  // Takes the oldest block: pc, predicted next pc, predicted taken
+  def take(dut: FetchTargetQueue): (Int, Int, Boolean) = {
+    dut.out.valid.expect(true.B)
+    val b = (dut.out.bits.pc.peek().litValue.toInt, dut.out.bits.pcPlus4.peek().litValue.toInt, dut.out.bits.predTaken.peek().litToBoolean)
+    dut.out.ready.poke(true.B)
+    dut.clock.step()
+    dut.out.ready.poke(false.B)
+    b
+  }
+
+  def train(dut: FetchTargetQueue, pc: Int, target: Int, taken: Boolean): Unit = {
+    dut.update.valid.poke(true.B)
+    dut.update.bits.pc.poke(pc.U)
+    dut.update.bits.target.poke(target.U)
+    dut.update.bits.taken.poke(taken.B)
+    dut.clock.step()
+    dut.update.valid.poke(false.B)
+  }
+
+  def redirect(dut: FetchTargetQueue, pc: Int): Unit = {
+    dut.redirect.valid.poke(true.B)
+    dut.redirect.bits.poke(pc.U)
+    dut.clock.step()
+    dut.redirect.valid.poke(false.B)
+    dut.out.valid.expect(false.B)
+    dut.clock.step()
+  }
+
+  it should "queue the sequential blocks ahead of Prefetch" in {
+    simulate(new FetchTargetQueue) { dut =>
+      start(dut)
+      // Prediction runs ahead until the queue is full
+      dut.clock.step(ccx.core.ftqEntries + 2)
+      for(i <- 0 until ccx.core.ftqEntries) {
+        assert(take(dut) == ((0x1000 + 8 * i, 0x1008 + 8 * i, false)))
+      }
+      dut.clock.step()
+      assert(take(dut) == ((0x1000 + 8 * ccx.core.ftqEntries, 0x1008 + 8 * ccx.core.ftqEntries, false)))
+    }
+  }
+
+  it should "predict the trained jump and forget it when it is not taken" in {
+    simulate(new FetchTargetQueue) { dut =>
+      start(dut)
+      // Jump ends in the last parcel of the block
+      train(dut, 0x1006, 0x3000, taken = true)
+      redirect(dut, 0x1000)
+      dut.out.bits.end.expect(3.U)
+      assert(take(dut) == ((0x1000, 0x3000, true)))
+      assert(take(dut) == ((0x3000, 0x3008, false)))
+
+      // Block entered after the jump does not end with it
+      redirect(dut, 0x1006)
+      assert(take(dut) == ((0x1006, 0x3000, true)))
+      train(dut, 0x1002, 0x4000, taken = true)
+      redirect(dut, 0x1004)
+      assert(take(dut) == ((0x1004, 0x1008, false)))
+
+      // Fetch found no jump there
+      train(dut, 0x1002, 0, taken = false)
+      redirect(dut, 0x1000)
+      assert(take(dut) == ((0x1000, 0x1008, false)))
+    }
+  }
+
+  it should "send the newest predicted line as a prefetch hint" in {
+    simulate(new FetchTargetQueue) { dut =>
+      start(dut)
+      train(dut, 0x2006, 0x8000, taken = true)
+      redirect(dut, 0x2000)
+      dut.hint.valid.expect(true.B)
+      dut.hint.bits.expect(0x2000.U)
+      dut.clock.step()
+      // Predicted target is in another line, the hint moves to it
+      dut.hint.valid.expect(true.B)
+      dut.hint.bits.expect(0x8000.U)
+      dut.hint.ready.poke(true.B)
+      dut.clock.step()
+      dut.hint.ready.poke(false.B)
+      // Next blocks are in the same line
+      dut.clock.step()
+      dut.hint.valid.expect(false.B)
+    }
+  }
+}
@@ -0,0 +1,147 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import Consts._
+
+// The I-cache answers in the same cycle as the block is requested
+class FetchHarness(implicit ccx: CCXParams) extends Module {
+  val io = IO(new Bundle {
+    val blockValid    = Input(Bool())
+    val blockPc       = Input(UInt(apLen.W))
+    val blockData     = Input(UInt(xLen.W))
+    val outReady      = Input(Bool())
+    val kill          = Input(Bool())
+
+    val outValid      = Output(Bool())
+    val outPc         = Output(UInt(apLen.W))
+    val outInstr      = Output(UInt(iLen.W))
+    val outPredTaken  = Output(Bool())
+    val redirect      = Output(Valid(UInt(apLen.W)))
+    val btbUpdate     = Output(Valid(new BtbUpdate))
+  })
+  val fetch = Module(new Fetch)
+  fetch.ctrl.kill         := io.kill
+  fetch.ctrl.jump         := false.B
+  fetch.ctrl.flush        := false.B
+  fetch.ctrl.newPc        := 0.U
+  fetch.dynRegs           := 0.U.asTypeOf(fetch.dynRegs)
+  fetch.csr               := 0.U.asTypeOf(fetch.csr)
+
+  // Sequential blocks, the fetch target queue did not predict a jump
+  fetch.in.valid          := io.blockValid
+  fetch.in.bits           := 0.U.asTypeOf(fetch.in.bits)
+  fetch.in.bits.pc        := io.blockPc
+  fetch.in.bits.pcPlus4   := io.blockPc + xLenBytes.U
+
+  fetch.cacheResp         := DontCare
+  fetch.cacheResp.valid   := io.blockValid
+  fetch.cacheResp.readData := io.blockData.asTypeOf(fetch.cacheResp.readData)
+  fetch.cacheResp.accessFault := false.B
+  fetch.cacheResp.pageFault := false.B
+
+  fetch.out.ready         := io.outReady
+  io.outValid             := fetch.out.valid
+  io.outPc                := fetch.out.bits.pc
+  io.outInstr             := fetch.out.bits.instr
+  io.outPredTaken         := fetch.out.bits.predTaken
+  io.redirect             := fetch.redirect
+  io.btbUpdate            := fetch.btbUpdate
+}
+
+class FetchTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  val ADDI_X1   = BigInt("00100093", 16) // addi x1, x0, 1
+  val JAL_256   = BigInt("1000006F", 16) // jal x0, 0x100
+  val BEQ_FWD   = BigInt("00000463", 16) // beq x0, x0, 8
+  val BEQ_BACK  = BigInt("FE000CE3", 16) // beq x0, x0, -8
+
+  def start(dut: FetchHarness): Unit = {
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+    dut.io.blockValid.poke(false.B)
+    dut.io.blockPc.poke(0.U)
+    dut.io.blockData.poke(0.U)
+    dut.io.outReady.poke(true.B)
+    dut.io.kill.poke(false.B)
+  }
+
+  // Two 32-bit instructions, the first one at the lower address
+  def block(dut: FetchHarness, pc: Int, first: BigInt, second: BigInt): Unit = {
+    dut.io.blockValid.poke(true.B)
+    dut.io.blockPc.poke(pc.U)
+    dut.io.blockData.poke(((second << 32) | first).U)
+  }
+
+  def expectOut(dut: FetchHarness, pc: Int, instr: BigInt, predTaken: Boolean): Unit = {
+    dut.io.outValid.expect(true.B)
+    dut.io.outPc.expect(pc.U)
+    dut.io.outInstr.expect(instr.U)
+    dut.io.outPredTaken.expect(predTaken.B)
+  }
+
+  it should "redirect on JAL and drop the younger instructions" in {
+    simulate(new FetchHarness) { dut =>
+      start(dut)
+      block(dut, 0x1000, JAL_256, ADDI_X1)
+      expectOut(dut, 0x1000, JAL_256, predTaken = true)
+      dut.io.redirect.valid.expect(true.B)
+      dut.io.redirect.bits.expect(0x1100.U)
+      dut.io.btbUpdate.valid.expect(true.B)
+      dut.io.btbUpdate.bits.pc.expect(0x1002.U)
+      dut.io.btbUpdate.bits.target.expect(0x1100.U)
+      dut.io.btbUpdate.bits.taken.expect(true.B)
+      dut.clock.step()
+      dut.io.blockValid.poke(false.B)
+
+      // The add after the jump is on the wrong path
+      dut.io.outValid.expect(false.B)
+      dut.io.redirect.valid.expect(false.B)
+
+      // Target block is fetched as usual
+      block(dut, 0x1100, ADDI_X1, ADDI_X1)
+      expectOut(dut, 0x1100, ADDI_X1, predTaken = false)
+      dut.io.redirect.valid.expect(false.B)
+    }
+  }
+
+  it should "redirect on the backward branches only" in {
+    simulate(new FetchHarness) { dut =>
+      start(dut)
+      block(dut, 0x2000, BEQ_FWD, BEQ_BACK)
+      // Forward branch is predicted not taken, Execute resolves it
+      expectOut(dut, 0x2000, BEQ_FWD, predTaken = false)
+      dut.io.redirect.valid.expect(false.B)
+      dut.clock.step()
+      dut.io.blockValid.poke(false.B)
+
+      // Backward branch closes a loop, it is predicted taken
+      expectOut(dut, 0x2004, BEQ_BACK, predTaken = true)
+      dut.io.redirect.valid.expect(true.B)
+      dut.io.redirect.bits.expect(0x1FFC.U)
+    }
+  }
+
+  it should "not redirect an instruction that is not taken by Decode" in {
+    simulate(new FetchHarness) { dut =>
+      start(dut)
+      dut.io.outReady.poke(false.B)
+      block(dut, 0x1000, JAL_256, ADDI_X1)
+      dut.io.redirect.valid.expect(false.B)
+      dut.clock.step()
+      dut.io.blockValid.poke(false.B)
+
+      // The jump waits in the buffer and redirects once it is sent down
+      dut.io.redirect.valid.expect(false.B)
+      dut.io.outReady.poke(true.B)
+      expectOut(dut, 0x1000, JAL_256, predTaken = true)
+      dut.io.redirect.valid.expect(true.B)
+      dut.io.redirect.bits.expect(0x1100.U)
+    }
+  }
+}
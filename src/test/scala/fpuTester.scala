@@ -0,0 +1,130 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+
+// Operands and results are in the 64-bit register format, single precision values are NaN-boxed
+class FpHarness extends Module {
+  val io = IO(new Bundle {
+    val a         = Input(UInt(64.W))
+    val b         = Input(UInt(64.W))
+    val c         = Input(UInt(64.W))
+    val rm        = Input(UInt(3.W))
+    val double    = Input(Bool())
+
+    val fma       = Output(UInt(64.W)) // a * b + c
+    val fmaFlags  = Output(UInt(5.W))
+    val cvt       = Output(UInt(64.W)) // a from the other format
+    val cvtFlags  = Output(UInt(5.W))
+  })
+  val (fma, fmaFlags) = FpFma(Fp.unpack(io.a, io.double), Fp.unpack(io.b, io.double), Fp.unpack(io.c, io.double), io.rm, io.double)
+  val (cvt, cvtFlags) = Fp.convert(io.a, io.rm, io.double)
+  io.fma      := fma
+  io.fmaFlags := fmaFlags
+  io.cvt      := cvt
+  io.cvtFlags := cvtFlags
+}
+
+class FpuTest extends AnyFlatSpec with ChiselSim {
+  val RNE = 0
+  val RTZ = 1
+  val RDN = 2
+  val RUP = 3
+  val RMM = 4
+
+  val NV  = 0x10
+  val OF  = 0x04
+  val UF  = 0x02
+  val NX  = 0x01
+
+  def s(bits: Long): BigInt = (BigInt(0xFFFFFFFFL) << 32) | BigInt(bits) // NaN-boxed single
+  def d(hex: String): BigInt = BigInt(hex, 16)
+
+  val sOne    = s(0x3F800000L)
+  val sZero   = s(0x00000000L)
+
+  // a, b, c, rm, double, expected result, expected flags
+  val fmaTests = Seq(
+    // 1 + half an ulp is a tie
+    (sOne, sOne, s(0x33800000L), RNE, false, s(0x3F800000L), NX),
+    (sOne, sOne, s(0x33800000L), RTZ, false, s(0x3F800000L), NX),
+    (sOne, sOne, s(0x33800000L), RDN, false, s(0x3F800000L), NX),
+    (sOne, sOne, s(0x33800000L), RUP, false, s(0x3F800001L), NX),
+    (sOne, sOne, s(0x33800000L), RMM, false, s(0x3F800001L), NX),
+    // Same with the negative sign
+    (s(0xBF800000L), sOne, s(0xB3800000L), RDN, false, s(0xBF800001L), NX),
+    (s(0xBF800000L), sOne, s(0xB3800000L), RUP, false, s(0xBF800000L), NX),
+    (d("3ff0000000000000"), d("3ff0000000000000"), d("3ca0000000000000"), RNE, true, d("3ff0000000000000"), NX),
+    (d("3ff0000000000000"), d("3ff0000000000000"), d("3ca0000000000000"), RUP, true, d("3ff0000000000001"), NX),
+
+    // Exact subnormal result does not underflow
+    (s(0x00800000L), s(0x3F000000L), sZero, RNE, false, s(0x00400000L), 0),
+    // Half of the smallest subnormal
+    (s(0x00000001L), s(0x3F000000L), sZero, RNE, false, s(0x00000000L), UF | NX),
+    (s(0x00000001L), s(0x3F000000L), sZero, RUP, false, s(0x00000001L), UF | NX),
+
+    // Largest finite value times two
+    (s(0x7F7FFFFFL), s(0x40000000L), sZero, RNE, false, s(0x7F800000L), OF | NX),
+    (s(0x7F7FFFFFL), s(0x40000000L), sZero, RTZ, false, s(0x7F7FFFFFL), OF | NX),
+
+    // Single that is not NaN-boxed reads as the canonical NaN, it is quiet
+    (BigInt(0x3F800000L), sOne, sZero, RNE, false, s(0x7FC00000L), 0),
+    // Signaling NaN
+    (s(0x7F800001L), sOne, sZero, RNE, false, s(0x7FC00000L), NV),
+    // Infinity times zero
+    (s(0x7F800000L), sZero, sZero, RNE, false, s(0x7FC00000L), NV),
+  )
+
+  // a, rm, double (the destination), expected result, expected flags
+  val cvtTests = Seq(
+    // FCVT.D.S is exact
+    (sOne, RNE, true, d("3ff0000000000000"), 0),
+    (s(0x00000001L), RNE, true, d("36a0000000000000"), 0),
+    (s(0x7F800001L), RNE, true, d("7ff8000000000000"), NV),
+    (BigInt(0x3F800000L), RNE, true, d("7ff8000000000000"), 0),
+    (s(0xFF800000L), RNE, true, d("fff0000000000000"), 0),
+
+    // FCVT.S.D rounds
+    (d("3ff0000010000000"), RNE, false, s(0x3F800000L), NX),
+    (d("3ff0000010000000"), RUP, false, s(0x3F800001L), NX),
+    (d("3ff0000010000001"), RNE, false, s(0x3F800001L), NX),
+    (d("3ff0000010000001"), RTZ, false, s(0x3F800000L), NX),
+    (d("47f0000000000000"), RNE, false, s(0x7F800000L), OF | NX),
+    (d("47f0000000000000"), RTZ, false, s(0x7F7FFFFFL), OF | NX),
+    (d("36a0000000000000"), RNE, false, s(0x00000001L), 0),
+    (d("3690000000000000"), RNE, false, s(0x00000000L), UF | NX),
+    (d("3690000000000000"), RUP, false, s(0x00000001L), UF | NX),
+    (d("7ff0000000000001"), RNE, false, s(0x7FC00000L), NV),
+  )
+
+  it should "round, underflow, overflow and propagate NaNs in the fused multiply-add" in {
+    simulate(new FpHarness) { dut =>
+      for(((a, b, c, rm, double, result, flags), i) <- fmaTests.zipWithIndex) {
+        dut.io.a.poke(a.U)
+        dut.io.b.poke(b.U)
+        dut.io.c.poke(c.U)
+        dut.io.rm.poke(rm.U)
+        dut.io.double.poke(double.B)
+        dut.io.fma.expect(result.U, s"FMA test $i")
+        dut.io.fmaFlags.expect(flags.U, s"FMA test $i flags")
+      }
+    }
+  }
+
+  it should "convert between the single and double formats" in {
+    simulate(new FpHarness) { dut =>
+      for(((a, rm, double, result, flags), i) <- cvtTests.zipWithIndex) {
+        dut.io.a.poke(a.U)
+        dut.io.b.poke(0.U)
+        dut.io.c.poke(0.U)
+        dut.io.rm.poke(rm.U)
+        dut.io.double.poke(double.B)
+        dut.io.cvt.expect(result.U, s"FCVT test $i")
+        dut.io.cvtFlags.expect(flags.U, s"FCVT test $i flags")
+      }
+    }
+  }
+}
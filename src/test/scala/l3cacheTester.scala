@@ -5,6 +5,10 @@ package armleocpu
 import chisel3._
 import chisel3.util._
 import chisel3.util.random._
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import armleocpu.memory.l3cache.{Bank, Params}
+import busConst._
 /*
 
 class L3CacheTesterIO extends Bundle {
@@ -71,3 +75,283 @@ class L3CacheSpec extends AnyFlatSpec {
     }
   }
 }*/
+
+// The test acts as the cores above the bank and as the memory below it
+class L3BankTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams(coreCount = 2, l3 = new Params(cacheEntriesLog2 = 2, cacheWaysLog2 = 1))
+  implicit val bp: BusParams = new BusParams(addrWidth = 16, busBytes = 64, idWidth = 1, lenWidth = 1)
+
+  val wordMask = (BigInt(1) << 64) - 1
+
+  // Three lines of the same set
+  val lineA = 0x1040
+  val lineB = 0x2040
+  val lineC = 0x3040
+
+  def line(seed: Int): BigInt = (0 until 64).map(b => BigInt((seed + b) & 0xFF) << (8 * b)).sum
+  def word(l: BigInt, idx: Int): BigInt = (l >> (64 * idx)) & wordMask
+  def setWord(l: BigInt, idx: Int, v: BigInt): BigInt = (l & ~(wordMask << (64 * idx))) | ((v & wordMask) << (64 * idx))
+
+  def idle(dut: Bank): Unit = {
+    for(c <- 0 until ccx.coreCount) {
+      val up = dut.io.up(c)
+      up.aw.valid.poke(false.B)
+      up.ar.valid.poke(false.B)
+      up.w.valid.poke(false.B)
+      up.r.ready.poke(true.B)
+      up.b.ready.poke(true.B)
+      up.creq.ready.poke(true.B)
+      up.cresp.valid.poke(false.B)
+      up.cdata.valid.poke(false.B)
+    }
+    dut.io.down.ar.ready.poke(true.B)
+    dut.io.down.r.valid.poke(false.B)
+    dut.io.down.aw.ready.poke(true.B)
+    dut.io.down.w.ready.poke(true.B)
+    dut.io.down.b.valid.poke(false.B)
+  }
+
+  def waitFor(dut: Bank, what: String)(cond: => Boolean): Unit = {
+    var cycles = 0
+    while(!cond) {
+      assert(cycles < 100, s"Timeout waiting for $what")
+      dut.clock.step()
+      cycles += 1
+    }
+  }
+
+  def sendAr(dut: Bank, core: Int, op: UInt, addr: Int): Unit = {
+    val ar = dut.io.up(core).ar
+    ar.valid.poke(true.B)
+    ar.bits.op.poke(op)
+    ar.bits.addr.poke(addr.U)
+    ar.bits.id.poke(0.U)
+    waitFor(dut, "AR")(ar.ready.peek().litToBoolean)
+    dut.clock.step()
+    ar.valid.poke(false.B)
+  }
+
+  // Far AMO with the operand in the lanes of its word. W waits for the execution
+  def sendAmo(dut: Bank, core: Int, funct5: Int, addr: Int, operand: BigInt): Unit = {
+    val up = dut.io.up(core)
+    val wordIdx = (addr >> 3) & 7
+    up.aw.valid.poke(true.B)
+    up.aw.bits.op.poke((0x40 | funct5).U)
+    up.aw.bits.addr.poke(addr.U)
+    up.aw.bits.id.poke(0.U)
+    up.w.valid.poke(true.B)
+    up.w.bits.data.poke(((operand & wordMask) << (64 * wordIdx)).U)
+    up.w.bits.strb.poke((BigInt(0xFF) << (8 * wordIdx)).U)
+    up.w.bits.last.poke(true.B)
+    waitFor(dut, "AW")(up.aw.ready.peek().litToBoolean)
+    dut.clock.step()
+    up.aw.valid.poke(false.B)
+  }
+
+  def refill(dut: Bank, addr: Int, data: BigInt): Unit = {
+    waitFor(dut, "refill AR")(dut.io.down.ar.valid.peek().litToBoolean)
+    dut.io.down.ar.bits.addr.expect(addr.U)
+    dut.io.down.ar.bits.op.expect(ReadOnce)
+    dut.clock.step()
+    dut.io.down.r.valid.poke(true.B)
+    dut.io.down.r.bits.data.poke(data.U)
+    dut.io.down.r.bits.resp.poke(OKAY)
+    dut.clock.step()
+    dut.io.down.r.valid.poke(false.B)
+  }
+
+  def writeback(dut: Bank, addr: Int, data: BigInt): Unit = {
+    waitFor(dut, "writeback AW")(dut.io.down.aw.valid.peek().litToBoolean)
+    dut.io.down.aw.bits.addr.expect(addr.U)
+    dut.io.down.aw.bits.op.expect(WriteOnce)
+    dut.io.down.w.valid.expect(true.B)
+    dut.io.down.w.bits.data.expect(data.U)
+    dut.clock.step()
+    dut.io.down.b.valid.poke(true.B)
+    dut.io.down.b.bits.resp.poke(OKAY)
+    dut.clock.step()
+    dut.io.down.b.valid.poke(false.B)
+  }
+
+  // Core gives the line up, a dirty copy is returned
+  def snoop(dut: Bank, core: Int, op: UInt, addr: Int, data: Option[BigInt]): Unit = {
+    val up = dut.io.up(core)
+    waitFor(dut, "snoop")(up.creq.valid.peek().litToBoolean)
+    up.creq.bits.op.expect(op)
+    up.creq.bits.addr.expect(addr.U)
+    dut.clock.step()
+    up.cresp.valid.poke(true.B)
+    up.cresp.bits.resp.poke((if(data.isDefined) (1 << RETURNDATABITNUM) | (1 << DIRTYBITNUM) else 0).U)
+    dut.clock.step()
+    up.cresp.valid.poke(false.B)
+    for(d <- data) {
+      up.cdata.valid.poke(true.B)
+      up.cdata.bits.data.poke(d.U)
+      dut.clock.step()
+      up.cdata.valid.poke(false.B)
+    }
+  }
+
+  // Clean holders of the line give it up together
+  def snoopClean(dut: Bank, cores: Seq[Int], op: UInt, addr: Int): Unit = {
+    waitFor(dut, "snoop")(dut.io.up(cores.head).creq.valid.peek().litToBoolean)
+    for(c <- cores) {
+      dut.io.up(c).creq.valid.expect(true.B)
+      dut.io.up(c).creq.bits.op.expect(op)
+      dut.io.up(c).creq.bits.addr.expect(addr.U)
+    }
+    dut.clock.step()
+    for(c <- cores) {
+      dut.io.up(c).cresp.valid.poke(true.B)
+      dut.io.up(c).cresp.bits.resp.poke(0.U)
+    }
+    dut.clock.step()
+    for(c <- cores) dut.io.up(c).cresp.valid.poke(false.B)
+  }
+
+  // Cache block operation, AW without W
+  def sendLineOp(dut: Bank, core: Int, op: UInt, addr: Int): Unit = {
+    val aw = dut.io.up(core).aw
+    aw.valid.poke(true.B)
+    aw.bits.op.poke(op)
+    aw.bits.addr.poke(addr.U)
+    aw.bits.id.poke(0.U)
+    waitFor(dut, "AW")(aw.ready.peek().litToBoolean)
+    dut.clock.step()
+    aw.valid.poke(false.B)
+  }
+
+  def expectR(dut: Bank, core: Int, data: BigInt, unique: Boolean = false, snooped: Boolean = false): Unit = {
+    val r = dut.io.up(core).r
+    waitFor(dut, "R")(r.valid.peek().litToBoolean)
+    r.bits.data.expect(data.U)
+    r.bits.resp.expect(((if(unique) 1 << UNIQUEBITNUM else 0) | (if(snooped) 1 << SNOOPEDBITNUM else 0)).U)
+    dut.clock.step()
+  }
+
+  def expectB(dut: Bank, core: Int): Unit = {
+    val up = dut.io.up(core)
+    up.w.valid.poke(false.B)
+    waitFor(dut, "B")(up.b.valid.peek().litToBoolean)
+    up.b.bits.resp.expect(OKAY)
+    dut.clock.step()
+  }
+
+  def start(dut: Bank): Unit = {
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+    idle(dut)
+  }
+
+  it should "execute the far AMOs, refilling the missed lines and writing the dirty victim back" in {
+    simulate(new Bank) { dut =>
+      start(dut)
+
+      // AMOADD.D misses and is executed on the refilled line
+      sendAmo(dut, 0, 0x00, lineA + 8, 5)
+      refill(dut, lineA, line(1))
+      expectR(dut, 0, line(1))
+      expectB(dut, 0)
+
+      // Hit, the line was written by the previous AMO
+      val a1 = setWord(line(1), 1, word(line(1), 1) + 5)
+      sendAmo(dut, 0, 0x00, lineA + 8, 5)
+      expectR(dut, 0, a1)
+      expectB(dut, 0)
+      val a2 = setWord(a1, 1, word(a1, 1) + 5)
+
+      // AMOSWAP.D takes the free way
+      sendAmo(dut, 0, 0x01, lineB, 0x1234)
+      refill(dut, lineB, line(2))
+      expectR(dut, 0, line(2))
+      expectB(dut, 0)
+
+      // Both ways are dirty: the first one is written back and replaced
+      sendAmo(dut, 0, 0x01, lineC + 0x38, 0x5678)
+      writeback(dut, lineA, a2)
+      refill(dut, lineC, line(3))
+      expectR(dut, 0, line(3))
+      expectB(dut, 0)
+
+      // Way of line B was kept
+      sendAmo(dut, 0, 0x01, lineB, 0)
+      expectR(dut, 0, setWord(line(2), 0, 0x1234))
+      expectB(dut, 0)
+    }
+  }
+
+  it should "take the line from its holders for the far AMOs and the unique reads" in {
+    simulate(new Bank) { dut =>
+      start(dut)
+
+      // Core 1 holds the line unique
+      sendAr(dut, 1, ReadUnique, lineA)
+      refill(dut, lineA, line(1))
+      expectR(dut, 1, line(1), unique = true)
+
+      // Far AMO of core 0 takes the dirty copy from core 1 and reports the contention
+      sendAmo(dut, 0, 0x00, lineA + 8, 1)
+      snoop(dut, 1, ReadUnique, lineA, Some(line(7)))
+      expectR(dut, 0, line(7), snooped = true)
+      expectB(dut, 0)
+      val a = setWord(line(7), 1, word(line(7), 1) + 1)
+
+      // Nobody holds the line after the far AMO, both cores read it shared
+      sendAr(dut, 1, ReadShared, lineA)
+      expectR(dut, 1, a)
+      sendAr(dut, 0, ReadShared, lineA)
+      expectR(dut, 0, a)
+
+      // Unique read invalidates the other shared copy
+      sendAr(dut, 1, ReadUnique, lineA)
+      snoop(dut, 0, Invalidate, lineA, None)
+      expectR(dut, 1, a, unique = true, snooped = true)
+
+      // No other holder, so the next far AMO of core 1 is not contended
+      sendAmo(dut, 1, 0x01, lineA, 0)
+      snoop(dut, 1, ReadUnique, lineA, None)
+      expectR(dut, 1, a)
+      expectB(dut, 1)
+    }
+  }
+
+  it should "clean, flush and invalidate the line in every holder" in {
+    simulate(new Bank) { dut =>
+      start(dut)
+
+      // Miss: the L3 is inclusive, nobody holds the line
+      sendLineOp(dut, 0, CleanLine, lineA)
+      expectB(dut, 0)
+
+      // Clean takes the dirty copy from the unique holder and writes it to memory. The L3 keeps the line
+      sendAr(dut, 1, ReadUnique, lineA)
+      refill(dut, lineA, line(1))
+      expectR(dut, 1, line(1), unique = true)
+      sendLineOp(dut, 0, CleanLine, lineA)
+      snoop(dut, 1, ReadUnique, lineA, Some(line(5)))
+      writeback(dut, lineA, line(5))
+      expectB(dut, 0)
+      sendAr(dut, 0, ReadShared, lineA)
+      expectR(dut, 0, line(5))
+
+      // Flush snoops every shared holder, the requester too. The clean line is dropped without a writeback
+      sendAr(dut, 1, ReadShared, lineA)
+      expectR(dut, 1, line(5))
+      sendLineOp(dut, 1, FlushLine, lineA)
+      snoopClean(dut, Seq(0, 1), ReadUnique, lineA)
+      expectB(dut, 1)
+      sendAr(dut, 0, ReadUnique, lineA)
+      refill(dut, lineA, line(6))
+      expectR(dut, 0, line(6), unique = true)
+
+      // Inval drops the dirty copy of the requester, memory keeps the old data
+      sendLineOp(dut, 0, InvalLine, lineA)
+      snoop(dut, 0, Invalidate, lineA, Some(line(9)))
+      expectB(dut, 0)
+      sendAr(dut, 1, ReadShared, lineA)
+      refill(dut, lineA, line(6))
+      expectR(dut, 1, line(6))
+    }
+  }
+}
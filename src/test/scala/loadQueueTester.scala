@@ -0,0 +1,343 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import Consts._
+
+// The test acts as Retirement, the store buffer and the D-cache
+class LoadQueueTest extends AnyFlatSpec with ChiselSim {
+  val LD = 0x3003 // ld x0, 0(x0), the rd is taken from the request
+  val LW = 0x2003
+  val CBO_FLUSH = 0x0020200F // cbo.flush (x0)
+
+  def idle(dut: LoadQueue): Unit = {
+    dut.ctrl.kill.poke(false.B)
+    dut.ctrl.jump.poke(false.B)
+    dut.ctrl.flush.poke(false.B)
+    dut.ctrl.newPc.poke(0.U)
+    dut.req.valid.poke(false.B)
+    dut.fwd.mask.poke(0.U)
+    for(b <- 0 until xLenBytes) dut.fwd.data(b).poke(0.U)
+    dut.lineCheck.vaddr.poke(0.U)
+    dut.lineCheck.instr.poke(0.U)
+    dut.cacheReq.ready.poke(true.B)
+    dut.cacheResp.valid.poke(false.B)
+    dut.cacheResp.miss.poke(false.B)
+    dut.cacheResp.accessFault.poke(false.B)
+    dut.cacheResp.pageFault.poke(false.B)
+    dut.cacheResp.scFail.poke(false.B)
+    dut.cacheResp.refill.valid.poke(false.B)
+    dut.cacheResp.refill.bits.poke(0.U)
+  }
+
+  def push(dut: LoadQueue, rd: Int, vaddr: BigInt, instr: Int = LD, cmo: UInt = Cmo.NONE): Unit = {
+    dut.req.ready.expect(true.B)
+    dut.req.valid.poke(true.B)
+    dut.req.bits.instr.poke(instr.U)
+    dut.req.bits.rd.poke(rd.U)
+    dut.req.bits.vaddr.poke(vaddr.U)
+    dut.req.bits.fp.poke(false.B)
+    dut.req.bits.amo.poke(false.B)
+    dut.req.bits.data.poke(0.U)
+    dut.req.bits.cmo.poke(cmo)
+    dut.clock.step()
+    dut.req.valid.poke(false.B)
+  }
+
+  // Expects the request in this cycle and answers it in the next one
+  def issue(dut: LoadQueue, vaddr: BigInt): Unit = {
+    dut.cacheReq.valid.expect(true.B)
+    dut.cacheReq.bits.vaddr.expect(vaddr.U)
+    dut.clock.step()
+  }
+
+  def respond(dut: LoadQueue, data: BigInt, miss: Boolean): Unit = {
+    dut.cacheResp.valid.poke(true.B)
+    dut.cacheResp.miss.poke(miss.B)
+    for(b <- 0 until xLenBytes) dut.cacheResp.readData(b).poke(((data >> (8 * b)) & 0xFF).U)
+  }
+
+  def done(dut: LoadQueue): Unit = {
+    dut.clock.step()
+    dut.cacheResp.valid.poke(false.B)
+    dut.cacheResp.miss.poke(false.B)
+  }
+
+  it should "let a younger load hit under a miss and write it back after the older one" in {
+    simulate(new LoadQueue()(new CCXParams())) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+
+      // Older load misses, it is resolved and waits for the refill
+      push(dut, 5, 0x1000)
+      issue(dut, 0x1000)
+      respond(dut, 0, miss = true)
+      dut.resolve.valid.expect(true.B)
+      dut.wb.valid.expect(false.B)
+      dut.pending.expect((1 << 5).U)
+      done(dut)
+      dut.cacheReq.valid.expect(false.B)
+
+      // Younger load hits. It is resolved, but its data waits for the older load
+      push(dut, 6, 0x2000)
+      issue(dut, 0x2000)
+      respond(dut, 0x2222, miss = false)
+      dut.resolve.valid.expect(true.B)
+      dut.wb.valid.expect(false.B)
+      done(dut)
+      dut.cacheReq.valid.expect(false.B)
+      dut.pending.expect(((1 << 5) | (1 << 6)).U)
+
+      // Refill of another set does not wake the older load up
+      dut.cacheResp.refill.valid.poke(true.B)
+      dut.cacheResp.refill.bits.poke(0x80003040L.U)
+      dut.clock.step()
+      dut.cacheReq.valid.expect(false.B)
+
+      dut.cacheResp.refill.bits.poke(0x80005000L.U)
+      dut.clock.step()
+      dut.cacheResp.refill.valid.poke(false.B)
+
+      // Older load is replayed and written first, then the younger one is read again
+      issue(dut, 0x1000)
+      respond(dut, 0x1111, miss = false)
+      dut.wb.valid.expect(true.B)
+      dut.wb.bits.rd.expect(5.U)
+      dut.wb.bits.data.expect(0x1111.U)
+      done(dut)
+
+      issue(dut, 0x2000)
+      respond(dut, 0x3333, miss = false)
+      dut.wb.valid.expect(true.B)
+      dut.wb.bits.rd.expect(6.U)
+      dut.wb.bits.data.expect(0x3333.U)
+      done(dut)
+
+      dut.empty.expect(true.B)
+      dut.pending.expect(0.U)
+    }
+  }
+
+  def refill(dut: LoadQueue, paddr: BigInt): Unit = {
+    dut.cacheResp.refill.valid.poke(true.B)
+    dut.cacheResp.refill.bits.poke(paddr.U)
+    dut.clock.step()
+    dut.cacheResp.refill.valid.poke(false.B)
+  }
+
+  it should "keep the age order when the queue fills up and wraps around" in {
+    simulate(new LoadQueue()(new CCXParams())) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+
+      // Every load misses in its own set and waits for the refill
+      val loads = Seq((5, 0x1040), (6, 0x2080), (7, 0x30C0), (8, 0x4100))
+      for((rd, vaddr) <- loads) {
+        push(dut, rd, vaddr)
+        issue(dut, vaddr)
+        respond(dut, 0, miss = true)
+        dut.resolve.valid.expect(true.B)
+        done(dut)
+      }
+      dut.req.ready.expect(false.B)
+
+      // Oldest load is written, its slot is free but head has not passed it yet
+      refill(dut, 0x80001040L)
+      issue(dut, 0x1040)
+      respond(dut, 0x1111, miss = false)
+      dut.wb.valid.expect(true.B)
+      dut.wb.bits.rd.expect(5.U)
+      done(dut)
+      dut.req.ready.expect(false.B)
+      dut.clock.step()
+
+      // Wrapped around into the first slot. It is the youngest load, so its data is dropped
+      push(dut, 9, 0x5140)
+      issue(dut, 0x5140)
+      respond(dut, 0x5555, miss = false)
+      dut.resolve.valid.expect(true.B)
+      dut.wb.valid.expect(false.B)
+      done(dut)
+      dut.pending.expect(((1 << 6) | (1 << 7) | (1 << 8) | (1 << 9)).U)
+
+      for((rd, vaddr) <- loads.tail) {
+        dut.cacheReq.valid.expect(false.B)
+        refill(dut, 0x80000000L + vaddr)
+        issue(dut, vaddr)
+        respond(dut, rd, miss = false)
+        dut.wb.valid.expect(true.B)
+        dut.wb.bits.rd.expect(rd.U)
+        dut.wb.bits.data.expect(rd.U)
+        done(dut)
+      }
+
+      // Youngest load is the oldest now, it is read again
+      issue(dut, 0x5140)
+      respond(dut, 0x5656, miss = false)
+      dut.wb.valid.expect(true.B)
+      dut.wb.bits.rd.expect(9.U)
+      dut.wb.bits.data.expect(0x5656.U)
+      done(dut)
+
+      dut.empty.expect(true.B)
+      dut.pending.expect(0.U)
+    }
+  }
+
+  it should "forward the store buffer bytes over the cache data" in {
+    simulate(new LoadQueue()(new CCXParams())) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+
+      // Low half comes from the store buffer
+      push(dut, 7, 0x3000)
+      dut.fwd.vaddr.expect(0x3000.U)
+      dut.fwd.mask.poke(0x0F.U)
+      for(b <- 0 until xLenBytes) dut.fwd.data(b).poke((0xA0 + b).U)
+      issue(dut, 0x3000)
+      idle(dut)
+      respond(dut, BigInt("1122334455667788", 16), miss = false)
+      dut.wb.valid.expect(true.B)
+      dut.wb.bits.data.expect(BigInt("11223344A3A2A1A0", 16).U)
+      done(dut)
+
+      // Every byte is forwarded, the miss does not matter
+      push(dut, 8, 0x4000)
+      dut.fwd.mask.poke(0xFF.U)
+      for(b <- 0 until xLenBytes) dut.fwd.data(b).poke((0xB0 + b).U)
+      issue(dut, 0x4000)
+      idle(dut)
+      respond(dut, 0, miss = true)
+      dut.resolve.valid.expect(true.B)
+      dut.wb.valid.expect(true.B)
+      dut.wb.bits.data.expect(BigInt("B7B6B5B4B3B2B1B0", 16).U)
+      done(dut)
+
+      dut.empty.expect(true.B)
+    }
+  }
+
+  it should "not flag the cache block operations misaligned" in {
+    simulate(new LoadQueue()(new CCXParams())) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+
+      // Any address in the line names the whole line
+      push(dut, 0, 0x5043, instr = CBO_FLUSH, cmo = Cmo.FLUSH)
+      dut.cacheReq.bits.read.expect(false.B)
+      dut.cacheReq.bits.cmo.expect(Cmo.FLUSH)
+      issue(dut, 0x5043)
+      respond(dut, 0, miss = false)
+      dut.resolve.valid.expect(true.B)
+      dut.resolve.bits.misaligned.expect(false.B)
+      dut.resolve.bits.accessFault.expect(false.B)
+      dut.wb.valid.expect(false.B)
+      done(dut)
+
+      dut.empty.expect(true.B)
+    }
+  }
+
+  it should "read a load that crosses a word as two words and merge them" in {
+    simulate(new LoadQueue()(new CCXParams())) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+
+      // Low word does not resolve the load
+      push(dut, 5, 0x1006, instr = LW)
+      issue(dut, 0x1006)
+      respond(dut, BigInt("8877665544332211", 16), miss = false)
+      dut.resolve.valid.expect(false.B)
+      dut.wb.valid.expect(false.B)
+      done(dut)
+
+      // High word is read from the next word address. Upper bytes of the low word come first
+      issue(dut, 0x1008)
+      respond(dut, BigInt("CCBBAA99", 16), miss = false)
+      dut.resolve.valid.expect(true.B)
+      dut.wb.valid.expect(true.B)
+      dut.wb.bits.rd.expect(5.U)
+      dut.wb.bits.data.expect(BigInt("FFFFFFFFAA998877", 16).U)
+      done(dut)
+
+      dut.empty.expect(true.B)
+    }
+  }
+
+  it should "replay only the high word of a load that crosses a line and misses in it" in {
+    simulate(new LoadQueue()(new CCXParams())) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+
+      push(dut, 6, 0x107C)
+      issue(dut, 0x107C)
+      respond(dut, BigInt("8877665544332211", 16), miss = false)
+      dut.resolve.valid.expect(false.B)
+      done(dut)
+
+      // High word is in the next line. The miss resolves the load, the low word is kept
+      issue(dut, 0x1080)
+      respond(dut, 0, miss = true)
+      dut.resolve.valid.expect(true.B)
+      dut.wb.valid.expect(false.B)
+      dut.pending.expect((1 << 6).U)
+      done(dut)
+      dut.cacheReq.valid.expect(false.B)
+
+      // Woken up by the refill of the high word line
+      refill(dut, 0x80001080L)
+      issue(dut, 0x1080)
+      respond(dut, BigInt("DDCCBBAA", 16), miss = false)
+      dut.wb.valid.expect(true.B)
+      dut.wb.bits.rd.expect(6.U)
+      dut.wb.bits.data.expect(BigInt("DDCCBBAA88776655", 16).U)
+      done(dut)
+
+      dut.empty.expect(true.B)
+      dut.pending.expect(0.U)
+    }
+  }
+
+  it should "fault a load whose high word is on an unmapped page" in {
+    simulate(new LoadQueue()(new CCXParams())) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+
+      push(dut, 7, 0x1FFC)
+      issue(dut, 0x1FFC)
+      respond(dut, BigInt("8877665544332211", 16), miss = false)
+      dut.resolve.valid.expect(false.B)
+      done(dut)
+
+      // Each word is translated on its own
+      issue(dut, 0x2000)
+      respond(dut, 0, miss = false)
+      dut.cacheResp.pageFault.poke(true.B)
+      dut.resolve.valid.expect(true.B)
+      dut.resolve.bits.pageFault.expect(true.B)
+      dut.wb.valid.expect(false.B)
+      dut.pending.expect(0.U)
+      done(dut)
+      dut.cacheResp.pageFault.poke(false.B)
+
+      dut.empty.expect(true.B)
+    }
+  }
+}
@@ -0,0 +1,118 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+
+// The test acts as fetch_storage and Decode. Only the pc and the prediction matter to the buffer
+class LoopBufferTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  // addi x1, x1, 1; addi x2, x2, 1; bne x1, x3, -8
+  val body = Seq((0x100, false), (0x104, false), (0x108, true))
+
+  def start(dut: LoopBuffer): Unit = {
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+    dut.ctrl.kill.poke(false.B)
+    dut.ctrl.jump.poke(false.B)
+    dut.ctrl.flush.poke(false.B)
+    dut.ctrl.newPc.poke(0.U)
+    dut.in.valid.poke(false.B)
+    dut.in.bits.pc.poke(0.U)
+    dut.in.bits.pcPlus4.poke(0.U)
+    dut.in.bits.instr.poke(0.U)
+    dut.in.bits.ifetchPageFault.poke(false.B)
+    dut.in.bits.ifetchAccessFault.poke(false.B)
+    dut.in.bits.predTaken.poke(false.B)
+    dut.in.bits.rvc.poke(false.B)
+    dut.out.ready.poke(true.B)
+  }
+
+  // Fetched uop passes through to Decode. Returns whether the buffer took over the loop
+  def fetch(dut: LoopBuffer, pc: Int, predTaken: Boolean): Boolean = {
+    dut.in.valid.poke(true.B)
+    dut.in.bits.pc.poke(pc.U)
+    dut.in.bits.pcPlus4.poke((pc + 4).U)
+    dut.in.bits.instr.poke(pc.U)
+    dut.in.bits.predTaken.poke(predTaken.B)
+    dut.active.expect(false.B)
+    dut.out.valid.expect(true.B)
+    dut.out.bits.pc.expect(pc.U)
+    dut.in.ready.expect(true.B)
+    val flush = dut.flushFrontEnd.peek().litToBoolean
+    dut.clock.step()
+    dut.in.valid.poke(false.B)
+    flush
+  }
+
+  def iteration(dut: LoopBuffer): Seq[Boolean] = body.map {case (pc, taken) => fetch(dut, pc, taken)}
+
+  it should "capture the loop body and replay it until the redirect" in {
+    simulate(new LoopBuffer) { dut =>
+      start(dut)
+      // The first iteration finds the backward branch, the second one is captured
+      assert(iteration(dut) == Seq(false, false, false))
+      assert(iteration(dut) == Seq(false, false, true))
+
+      // Front-end is stopped, the buffer sends the body in a loop and drops the fetched uops
+      dut.in.valid.poke(true.B)
+      dut.in.bits.pc.poke(0x10C.U)
+      for(_ <- 0 until 3; (pc, taken) <- body) {
+        dut.active.expect(true.B)
+        dut.in.ready.expect(true.B)
+        dut.out.valid.expect(true.B)
+        dut.out.bits.pc.expect(pc.U)
+        dut.out.bits.instr.expect(pc.U)
+        dut.out.bits.predTaken.expect(taken.B)
+        dut.clock.step()
+      }
+      dut.in.valid.poke(false.B)
+
+      // Decode stalls: the same uop is held
+      dut.out.ready.poke(false.B)
+      dut.clock.step(2)
+      dut.out.bits.pc.expect(0x100.U)
+      dut.out.ready.poke(true.B)
+      dut.clock.step()
+      dut.out.bits.pc.expect(0x104.U)
+
+      // Loop branch resolved not taken: the redirect ends the replay in the same cycle
+      dut.ctrl.jump.poke(true.B)
+      dut.ctrl.newPc.poke(0x10C.U)
+      dut.out.valid.expect(false.B)
+      dut.clock.step()
+      dut.ctrl.jump.poke(false.B)
+      dut.active.expect(false.B)
+      dut.out.valid.expect(false.B)
+
+      // Fetched uops pass through again
+      assert(!fetch(dut, 0x10C, false))
+    }
+  }
+
+  it should "not capture a body that is not sequential or does not fit" in {
+    simulate(new LoopBuffer) { dut =>
+      start(dut)
+      // A taken forward jump in the body
+      fetch(dut, 0x108, true)
+      fetch(dut, 0x100, true)
+      fetch(dut, 0x200, false)
+      fetch(dut, 0x204, false)
+      assert(!fetch(dut, 0x108, true))
+      dut.active.expect(false.B)
+
+      // Body longer than the buffer
+      val far = 0x1000 + ccx.core.loopBufferEntries * 4
+      fetch(dut, far, true)
+      for(pc <- 0x1000 until far by 4) {
+        assert(!fetch(dut, pc, false))
+      }
+      assert(!fetch(dut, far, true))
+      dut.active.expect(false.B)
+    }
+  }
+}
@@ -0,0 +1,191 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+
+// Decodes the instruction and holds it in the unit, the way Execute does
+class MulDivHarness(implicit ccx: CCXParams) extends Module {
+  val io = IO(new Bundle {
+    val valid     = Input(Bool())
+    val instr     = Input(UInt(32.W))
+    val rs1       = Input(UInt(64.W))
+    val rs2       = Input(UInt(64.W))
+    val accepted  = Input(Bool())
+    val kill      = Input(Bool())
+
+    val handled   = Output(Bool())
+    val done      = Output(Bool())
+    val result    = Output(UInt(64.W))
+  })
+  val unit = Module(new ExecuteMulDivUnit)
+  val uop = Wire(new DecodeUop)
+  uop           := 0.U.asTypeOf(uop)
+  uop.instr     := io.instr
+  uop.rs1       := io.rs1
+  uop.rs2       := io.rs2
+  uop.dec       := DecodeTable(io.instr)
+
+  unit.in.valid     := io.valid
+  unit.in.uop       := uop
+  unit.in.kill      := io.kill
+  unit.in.accepted  := io.accepted
+  unit.in.frm       := 0.U
+
+  io.handled    := unit.out.handled
+  io.done       := unit.out.done
+  io.result     := unit.out.aluOut.asUInt
+}
+
+class MulDivTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  // rd = x1, the operands are poked directly
+  def rtype(funct3: Int, word: Boolean): BigInt = BigInt((1 << 25) | (funct3 << 12) | (1 << 7) | (if(word) 0x3B else 0x33))
+  val MUL     = rtype(0, false)
+  val MULH    = rtype(1, false)
+  val MULHSU  = rtype(2, false)
+  val MULHU   = rtype(3, false)
+  val DIV     = rtype(4, false)
+  val DIVU    = rtype(5, false)
+  val REM     = rtype(6, false)
+  val REMU    = rtype(7, false)
+  val MULW    = rtype(0, true)
+  val DIVW    = rtype(4, true)
+  val DIVUW   = rtype(5, true)
+  val REMW    = rtype(6, true)
+  val REMUW   = rtype(7, true)
+
+  val mask    = (BigInt(1) << 64) - 1
+  def x(v: BigInt): BigInt = v & mask // Two's complement register value
+  val MIN     = BigInt(1) << 63
+  val ONES    = mask
+
+  def start(dut: MulDivHarness): Unit = {
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+    dut.io.valid.poke(false.B)
+    dut.io.instr.poke(0.U)
+    dut.io.rs1.poke(0.U)
+    dut.io.rs2.poke(0.U)
+    dut.io.accepted.poke(false.B)
+    dut.io.kill.poke(false.B)
+  }
+
+  // Holds the uop until the unit is done, takes the result and returns the cycles it took
+  def execute(dut: MulDivHarness, instr: BigInt, rs1: BigInt, rs2: BigInt, expected: BigInt, name: String): Int = {
+    dut.io.valid.poke(true.B)
+    dut.io.instr.poke(instr.U)
+    dut.io.rs1.poke(x(rs1).U)
+    dut.io.rs2.poke(x(rs2).U)
+    dut.io.handled.expect(true.B, name)
+    var cycles = 0
+    while(!dut.io.done.peek().litToBoolean) {
+      require(cycles < 64, s"$name never finished")
+      dut.clock.step()
+      cycles += 1
+    }
+    dut.io.result.expect(x(expected).U, name)
+    dut.io.accepted.poke(true.B)
+    dut.clock.step()
+    dut.io.accepted.poke(false.B)
+    dut.io.valid.poke(false.B)
+    dut.clock.step()
+    cycles
+  }
+
+  // instr, rs1, rs2, expected result, name
+  val vectors = Seq(
+    (MUL,     BigInt(-3),       BigInt(7),        BigInt(-21),                  "MUL"),
+    (MULH,    MIN,              MIN,              BigInt("4000000000000000", 16), "MULH of the smallest values"),
+    (MULHSU,  BigInt(-1),       ONES,             BigInt(-1),                   "MULHSU with the unsigned all ones"),
+    (MULHU,   ONES,             ONES,             BigInt("fffffffffffffffe", 16), "MULHU of all ones"),
+    (MULW,    BigInt(0x7FFFFFFF), BigInt(2),      BigInt(-2),                   "MULW is sign extended"),
+    (MULW,    BigInt("100000003", 16), BigInt(5), BigInt(15),                   "MULW ignores the upper bits"),
+
+    // Overflow
+    (DIV,     MIN,              BigInt(-1),       MIN,                          "DIV overflow"),
+    (REM,     MIN,              BigInt(-1),       BigInt(0),                    "REM overflow"),
+    (DIVW,    BigInt(0x80000000L), BigInt(-1),    BigInt(-0x80000000L),         "DIVW overflow"),
+    (REMW,    BigInt(0x80000000L), BigInt(-1),    BigInt(0),                    "REMW overflow"),
+
+    // Division by zero
+    (DIV,     BigInt(42),       BigInt(0),        BigInt(-1),                   "DIV by zero"),
+    (DIVU,    BigInt(42),       BigInt(0),        ONES,                         "DIVU by zero"),
+    (REM,     BigInt(-42),      BigInt(0),        BigInt(-42),                  "REM by zero"),
+    (REMU,    BigInt(42),       BigInt(0),        BigInt(42),                   "REMU by zero"),
+    (DIVW,    BigInt(5),        BigInt("100000000", 16), BigInt(-1),            "DIVW by zero in the low word"),
+    (DIVUW,   BigInt(5),        BigInt(0),        BigInt(-1),                   "DIVUW by zero"),
+    (REMW,    BigInt("180000000", 16), BigInt(0), BigInt(-0x80000000L),         "REMW by zero"),
+    (REMUW,   BigInt(0x80000000L), BigInt(0),     BigInt(-0x80000000L),         "REMUW by zero is sign extended"),
+
+    // Signs and W forms
+    (DIV,     BigInt(-7),       BigInt(2),        BigInt(-3),                   "DIV rounds toward zero"),
+    (REM,     BigInt(-7),       BigInt(2),        BigInt(-1),                   "REM takes the dividend sign"),
+    (REM,     BigInt(7),        BigInt(-2),       BigInt(1),                    "REM with a negative divisor"),
+    (DIVW,    BigInt("1234567800000010", 16), BigInt("ffffffff00000004", 16), BigInt(4), "DIVW ignores the upper bits"),
+    (DIVUW,   BigInt(0x80000000L), BigInt(1),     BigInt(-0x80000000L),         "DIVUW is sign extended"),
+    (REMW,    BigInt(-7),       BigInt(2),        BigInt(-1),                   "REMW"),
+    (REMUW,   BigInt(0xFFFFFFFFL), BigInt(0x10),  BigInt(0xF),                  "REMUW"),
+  )
+
+  it should "compute the MUL/DIV/REM corner cases" in {
+    simulate(new MulDivHarness) { dut =>
+      start(dut)
+      for((instr, rs1, rs2, expected, name) <- vectors) {
+        execute(dut, instr, rs1, rs2, expected, name)
+      }
+    }
+  }
+
+  it should "finish small divides early" in {
+    simulate(new MulDivHarness) { dut =>
+      start(dut)
+      // Quotient is zero, no iterations
+      assert(execute(dut, DIV, 3, 5, 0, "DIV smaller dividend") <= 2)
+      // Two leading significant bit pairs
+      val small = execute(dut, DIVU, 7, 2, 3, "DIVU small dividend")
+      assert(small <= 4, s"Small divide took $small cycles")
+      // No leading zeros, every bit pair is iterated
+      val large = execute(dut, DIVU, ONES, 3, BigInt("5555555555555555", 16), "DIVU large dividend")
+      assert(large >= 32, s"Large divide took $large cycles")
+    }
+  }
+
+  it should "drop the killed multiply and divide" in {
+    simulate(new MulDivHarness) { dut =>
+      start(dut)
+      dut.io.valid.poke(true.B)
+      dut.io.instr.poke(MUL.U)
+      dut.io.rs1.poke(3.U)
+      dut.io.rs2.poke(5.U)
+      dut.clock.step()
+      dut.io.kill.poke(true.B)
+      dut.clock.step()
+      dut.io.kill.poke(false.B)
+      dut.io.valid.poke(false.B)
+      for(_ <- 0 until ccx.core.mulLatency + 1) {
+        dut.io.done.expect(false.B)
+        dut.clock.step()
+      }
+
+      dut.io.valid.poke(true.B)
+      dut.io.instr.poke(DIVU.U)
+      dut.io.rs1.poke(ONES.U)
+      dut.io.rs2.poke(3.U)
+      dut.clock.step(4)
+      dut.io.kill.poke(true.B)
+      dut.clock.step()
+      dut.io.kill.poke(false.B)
+      dut.io.valid.poke(false.B)
+      dut.clock.step()
+
+      // The next uop does not see the results of the killed ones
+      execute(dut, MUL, 6, 7, 42, "MUL after the kill")
+      execute(dut, DIV, 100, 7, 14, "DIV after the kill")
+    }
+  }
+}
@@ -0,0 +1,171 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import Consts._
+
+// Acts as Decode and Retirement: sends renamed uops with the operand values and takes the finished ones
+class OooHarness(implicit ccx: CCXParams) extends Module {
+  val io = IO(new Bundle {
+    val valid     = Input(Bool())
+    val instr     = Input(UInt(32.W))
+    val pc        = Input(UInt(apLen.W))
+    val rs1       = Input(UInt(xLen.W))
+    val rs2       = Input(UInt(xLen.W))
+    val rs1Phys   = Input(UInt(physRegsLog2.W))
+    val rs2Phys   = Input(UInt(physRegsLog2.W))
+    val rdPhys    = Input(UInt(physRegsLog2.W))
+    val physBusy  = Input(UInt(physRegs.W))
+    val outReady  = Input(Bool())
+    val kill      = Input(Bool())
+
+    val inReady   = Output(Bool())
+    val outValid  = Output(Bool())
+    val outPc     = Output(UInt(apLen.W))
+    val outRd     = Output(UInt(physRegsLog2.W))
+    val outResult = Output(UInt(xLen.W))
+    val busy      = Output(Bool())
+  })
+  val backend = Module(new OooBackend)
+  val uop = Wire(new DecodeUop)
+  uop           := 0.U.asTypeOf(uop)
+  uop.pc        := io.pc
+  uop.pcPlus4   := io.pc + 4.U
+  uop.instr     := io.instr
+  uop.rs1       := io.rs1
+  uop.rs2       := io.rs2
+  uop.rs1Phys   := io.rs1Phys
+  uop.rs2Phys   := io.rs2Phys
+  uop.rdPhys    := io.rdPhys
+  uop.dec       := DecodeTable(io.instr)
+
+  backend.ctrl.kill   := io.kill
+  backend.ctrl.jump   := false.B
+  backend.ctrl.flush  := false.B
+  backend.ctrl.newPc  := 0.U
+  backend.frm         := 0.U
+  backend.physBusy    := io.physBusy
+  backend.regWrites.foreach(w => {
+    w.valid := false.B
+    w.bits  := 0.U.asTypeOf(w.bits)
+  })
+
+  backend.in.valid    := io.valid
+  backend.in.bits     := uop
+  backend.out.ready   := io.outReady
+  backend.outExtra.foreach(_.ready := io.outReady)
+
+  io.inReady    := backend.in.ready
+  io.outValid   := backend.out.valid
+  io.outPc      := backend.out.bits.pc
+  io.outRd      := backend.out.bits.rdPhys
+  io.outResult  := backend.out.bits.aluOut.asUInt
+  io.busy       := backend.ctrl.busy
+}
+
+class OooBackendTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  def rtype(funct7: Int, funct3: Int, rd: Int, rs1: Int, rs2: Int): Int =
+    (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | 0x33
+  def add(rd: Int, rs1: Int, rs2: Int): Int = rtype(0, 0, rd, rs1, rs2)
+  def mul(rd: Int, rs1: Int, rs2: Int): Int = rtype(1, 0, rd, rs1, rs2)
+
+  def start(dut: OooHarness): Unit = {
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+    dut.io.valid.poke(false.B)
+    dut.io.instr.poke(0.U)
+    dut.io.pc.poke(0.U)
+    dut.io.rs1.poke(0.U)
+    dut.io.rs2.poke(0.U)
+    dut.io.rs1Phys.poke(0.U)
+    dut.io.rs2Phys.poke(0.U)
+    dut.io.rdPhys.poke(0.U)
+    dut.io.physBusy.poke(0.U)
+    dut.io.outReady.poke(false.B)
+    dut.io.kill.poke(false.B)
+  }
+
+  // Sources not renamed yet are mapped to their own number, the renamed ones are passed in
+  def dispatch(dut: OooHarness, pc: Int, instr: Int, rs1: BigInt, rs2: BigInt, rdPhys: Int,
+               rs1Phys: Option[Int] = None, rs2Phys: Option[Int] = None): Unit = {
+    dut.io.valid.poke(true.B)
+    dut.io.pc.poke(pc.U)
+    dut.io.instr.poke(instr.U)
+    dut.io.rs1.poke(rs1.U)
+    dut.io.rs2.poke(rs2.U)
+    dut.io.rs1Phys.poke(rs1Phys.getOrElse((instr >> 15) & 0x1F).U)
+    dut.io.rs2Phys.poke(rs2Phys.getOrElse((instr >> 20) & 0x1F).U)
+    dut.io.rdPhys.poke(rdPhys.U)
+    dut.io.inReady.expect(true.B)
+    dut.clock.step()
+    dut.io.valid.poke(false.B)
+  }
+
+  // Takes count retired uops and returns their pc, rd and result in the retire order
+  def collect(dut: OooHarness, count: Int): Seq[(Int, Int, BigInt)] = {
+    dut.io.outReady.poke(true.B)
+    val retired = scala.collection.mutable.ArrayBuffer[(Int, Int, BigInt)]()
+    var cycles = 0
+    while(retired.size < count) {
+      require(cycles < 64, s"Only ${retired.size} of $count uops retired")
+      if(dut.io.outValid.peek().litToBoolean) {
+        retired += ((dut.io.outPc.peek().litValue.toInt, dut.io.outRd.peek().litValue.toInt, dut.io.outResult.peek().litValue))
+      }
+      dut.clock.step()
+      cycles += 1
+    }
+    dut.io.outReady.poke(false.B)
+    retired.toSeq
+  }
+
+  it should "issue the independent uop around the waiting one and retire in program order" in {
+    simulate(new OooHarness) { dut =>
+      start(dut)
+      // Renamed destinations are busy until their producers complete
+      dut.io.physBusy.poke(((BigInt(1) << 40) | (BigInt(1) << 41) | (BigInt(1) << 42)).U)
+
+      // x10 = 3 * 5, x11 = x10 + 7 waits for the multiply, x12 = 10 + 20 does not
+      dispatch(dut, 0x100, mul(10, 1, 2), 3, 5, 40)
+      dispatch(dut, 0x104, add(11, 10, 3), 0, 7, 41, rs1Phys = Some(40))
+      dispatch(dut, 0x108, add(12, 4, 5), 10, 20, 42)
+
+      assert(collect(dut, 3) == Seq((0x100, 40, BigInt(15)), (0x104, 41, BigInt(22)), (0x108, 42, BigInt(30))))
+      dut.io.busy.expect(false.B)
+    }
+  }
+
+  it should "drop everything on kill" in {
+    simulate(new OooHarness) { dut =>
+      start(dut)
+      dut.io.physBusy.poke((BigInt(1) << 40).U)
+      dispatch(dut, 0x100, mul(10, 1, 2), 3, 5, 40)
+      dispatch(dut, 0x104, add(11, 10, 3), 0, 7, 41, rs1Phys = Some(40))
+      dut.io.busy.expect(true.B)
+
+      dut.io.kill.poke(true.B)
+      dut.io.inReady.expect(false.B)
+      dut.clock.step()
+      dut.io.kill.poke(false.B)
+      dut.io.busy.expect(false.B)
+
+      // Killed multiply never completes
+      dut.io.outReady.poke(true.B)
+      for(_ <- 0 until ccx.core.mulLatency + 4) {
+        dut.io.outValid.expect(false.B)
+        dut.clock.step()
+      }
+      dut.io.outReady.poke(false.B)
+
+      // The back-end restarts from an empty ROB
+      dut.io.physBusy.poke(0.U)
+      dispatch(dut, 0x200, add(12, 4, 5), 10, 20, 42)
+      assert(collect(dut, 1) == Seq((0x200, 42, BigInt(30))))
+    }
+  }
+}
@@ -0,0 +1,179 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import Consts._
+
+// The test acts as Decode, Retirement and the load queue
+class RegfileTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  def addi(rd: Int, rs1: Int, imm: Int = 0): Int = (imm << 20) | (rs1 << 15) | (rd << 7) | 0x13
+  def ld(rd: Int): Int = (3 << 12) | (rd << 7) | 0x03
+
+  def start(dut: Regfile): Unit = {
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+    dut.ctrl.kill.poke(false.B)
+    dut.ctrl.jump.poke(false.B)
+    dut.ctrl.flush.poke(false.B)
+    dut.ctrl.newPc.poke(0.U)
+    dut.decode.instr_i.poke(0.U)
+    dut.decode.commit.poke(false.B)
+    dut.decode.rd_write.poke(false.B)
+    for(r <- dut.retire) {
+      r.commit.poke(false.B)
+      r.rd_write.poke(false.B)
+      r.rd_pending.poke(false.B)
+      r.rd_addr.poke(0.U)
+      r.rd_phys.poke(0.U)
+      r.rd_old_phys.poke(0.U)
+      r.rd_wdata.poke(0.U)
+    }
+    dut.load.wb.valid.poke(false.B)
+    dut.load.wb.bits.rd.poke(0.U)
+    dut.load.wb.bits.data.poke(0.U)
+    dut.load.pending.poke(0.U)
+  }
+
+  // Renames rd of the instruction and returns the new and the old physical register
+  def rename(dut: Regfile, instr: Int): (Int, Int) = {
+    dut.decode.instr_i.poke(instr.U)
+    dut.decode.rd_write.poke(true.B)
+    dut.decode.rd.reserved.expect(false.B)
+    val phys    = dut.decode.rd.phys.peek().litValue.toInt
+    val oldPhys = dut.decode.rd.oldPhys.peek().litValue.toInt
+    dut.decode.commit.poke(true.B)
+    dut.clock.step()
+    dut.decode.commit.poke(false.B)
+    dut.decode.rd_write.poke(false.B)
+    (phys, oldPhys)
+  }
+
+  def retire(dut: Regfile, rd: Int, phys: Int, oldPhys: Int, data: BigInt = 0, pending: Boolean = false): Unit = {
+    val r = dut.retire(0)
+    r.commit.poke(true.B)
+    r.rd_write.poke((!pending).B)
+    r.rd_pending.poke(pending.B)
+    r.rd_addr.poke(rd.U)
+    r.rd_phys.poke(phys.U)
+    r.rd_old_phys.poke(oldPhys.U)
+    r.rd_wdata.poke(data.U)
+    dut.clock.step()
+    r.commit.poke(false.B)
+    r.rd_write.poke(false.B)
+    r.rd_pending.poke(false.B)
+  }
+
+  def kill(dut: Regfile): Unit = {
+    dut.ctrl.kill.poke(true.B)
+    dut.clock.step()
+    dut.ctrl.kill.poke(false.B)
+  }
+
+  // Mapping of the architectural register, seen as the old physical register of a rename
+  def expectMap(dut: Regfile, rd: Int, phys: Int): Unit = {
+    dut.decode.instr_i.poke(addi(rd, 0).U)
+    dut.decode.rd.oldPhys.expect(phys.U, s"x$rd")
+  }
+
+  it should "rename rd, free the old register on retire and restore the committed map on kill" in {
+    simulate(new Regfile) { dut =>
+      start(dut)
+
+      // Every architectural register starts on its own number, the rest are free
+      val (p5, old5) = rename(dut, addi(5, 0, 1))
+      assert(p5 == 32 && old5 == 5)
+      dut.physBusy.expect((BigInt(1) << 32).U)
+
+      // Source waits for the renamed register
+      dut.decode.instr_i.poke(addi(6, 5, 1).U)
+      dut.decode.rs1.reserved.expect(true.B)
+      val (p6, old6) = rename(dut, addi(6, 5, 1))
+      assert(p6 == 33 && old6 == 6)
+
+      // Second write to x5 frees the first mapping only when it retires
+      val (p5b, old5b) = rename(dut, addi(5, 5, 2))
+      assert(p5b == 34 && old5b == p5)
+      expectMap(dut, 5, p5b)
+
+      // Oldest uop retires, its old register is free again and it is the lowest one
+      retire(dut, 5, p5, old5, data = 1)
+      dut.physBusy.expect(((BigInt(1) << p6) | (BigInt(1) << p5b)).U)
+      dut.decode.instr_i.poke(addi(7, 0).U)
+      dut.decode.rd_write.poke(true.B)
+      dut.decode.rd.phys.expect(5.U)
+      dut.decode.rd_write.poke(false.B)
+
+      // Younger uops are dropped. x5 goes back to its committed mapping, x6 to the initial one
+      kill(dut)
+      expectMap(dut, 5, p5)
+      expectMap(dut, 6, 6)
+      dut.physBusy.expect(0.U)
+
+      // Registers of the dropped uops are free, the committed one is not
+      val (p7, _) = rename(dut, addi(7, 0))
+      assert(p7 == 5)
+      val (p8, _) = rename(dut, addi(8, 0))
+      assert(p8 == 33)
+    }
+  }
+
+  it should "stall the rename when no register is free and recover it on kill" in {
+    simulate(new Regfile) { dut =>
+      start(dut)
+      for(i <- 0 until physRegs - 32) {
+        val (phys, _) = rename(dut, addi(1, 0))
+        assert(phys == 32 + i)
+      }
+      dut.decode.instr_i.poke(addi(1, 0).U)
+      dut.decode.rd_write.poke(true.B)
+      dut.decode.rd.reserved.expect(true.B)
+
+      // Uops that do not write rd are not stalled
+      dut.decode.rd_write.poke(false.B)
+      dut.decode.rd.reserved.expect(false.B)
+
+      kill(dut)
+      dut.decode.rd_write.poke(true.B)
+      dut.decode.rd.reserved.expect(false.B)
+      dut.decode.rd.phys.expect(32.U)
+      expectMap(dut, 1, 1)
+    }
+  }
+
+  it should "keep the register of a committed load busy across a kill" in {
+    simulate(new Regfile) { dut =>
+      start(dut)
+      val (p8, old8) = rename(dut, ld(8))
+      assert(p8 == 32)
+
+      // Load is committed, the data comes later from the load queue
+      retire(dut, 8, p8, old8, pending = true)
+      dut.load.pending.poke((BigInt(1) << p8).U)
+      kill(dut)
+
+      expectMap(dut, 8, p8)
+      dut.physBusy.expect((BigInt(1) << p8).U)
+      dut.decode.instr_i.poke(addi(9, 8).U)
+      dut.decode.rs1.reserved.expect(true.B)
+      // The old mapping is free, the load register is not reused
+      dut.decode.rd_write.poke(true.B)
+      dut.decode.rd.phys.expect(old8.U)
+      dut.decode.rd_write.poke(false.B)
+
+      dut.load.pending.poke(0.U)
+      dut.load.wb.valid.poke(true.B)
+      dut.load.wb.bits.rd.poke(p8.U)
+      dut.load.wb.bits.data.poke(0x1234.U)
+      dut.clock.step()
+      dut.load.wb.valid.poke(false.B)
+      dut.physBusy.expect(0.U)
+      dut.decode.rs1.reserved.expect(false.B)
+    }
+  }
+}
@@ -0,0 +1,197 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import Consts._
+
+// D-cache array with its snooper and the reservation. The fill port accesses the array directly
+class ReservationHarness(implicit val ccx: CCXParams, implicit val cp: CacheParams, implicit val bp: BusParams) extends Module {
+  val io = IO(new Bundle {
+    val fill    = Input(Valid(new CacheArrayReq))
+    val row     = Output(new CacheArrayResp)
+
+    val lr      = Input(Valid(UInt((apLen - cacheLineLog2).W)))
+    val sc      = Input(Valid(UInt((apLen - cacheLineLog2).W)))
+    val evict   = Input(Valid(UInt((apLen - cacheLineLog2).W)))
+    val scOk    = Output(Bool())
+    val held    = Output(Bool())
+
+    val creq    = Flipped(Decoupled(new CoherenceRequest))
+    val cresp   = Decoupled(new CoherenceResponse)
+    val cdata   = Decoupled(new CoherenceData)
+  })
+
+  val array       = Module(new CacheArray)
+  val snooper     = Module(new CacheSnooper)
+  val reservation = Module(new Reservation(ccx.core.lrscCycles))
+
+  array.io.req.valid      := io.fill.valid || snooper.io.array.valid
+  array.io.req.bits       := Mux(io.fill.valid, io.fill.bits, snooper.io.array.bits)
+  snooper.io.array.ready  := !io.fill.valid
+  snooper.io.arrayResp    := array.io.resp
+  io.row                  := array.io.resp.bits
+
+  reservation.io.lr       := io.lr
+  reservation.io.sc       := io.sc
+  reservation.io.evict    := io.evict
+  reservation.io.snoop    := snooper.io.snoop
+  snooper.io.snoopStall   := reservation.io.snoopStall
+  io.scOk                 := reservation.io.scOk
+  io.held                 := reservation.io.held
+
+  snooper.io.creq <> io.creq
+  io.cresp <> snooper.io.cresp
+  io.cdata <> snooper.io.cdata
+}
+
+class ReservationTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+  implicit val cp: CacheParams = ccx.core.dcache
+  implicit val bp: BusParams = new BusParams(addrWidth = apLen, busBytes = 64, idWidth = 1, lenWidth = 1)
+
+  val lineAddr  = BigInt("80001040", 16)
+  val lineIdx   = lineAddr >> cacheLineLog2
+  val lineBytes = 1 << cacheLineLog2
+  val lineData  = (0 until lineBytes).map(b => BigInt(b + 1) << (8 * b)).sum
+
+  def idle(dut: ReservationHarness): Unit = {
+    dut.io.fill.valid.poke(false.B)
+    dut.io.lr.valid.poke(false.B)
+    dut.io.sc.valid.poke(false.B)
+    dut.io.evict.valid.poke(false.B)
+    dut.io.lr.bits.poke(lineIdx.U)
+    dut.io.sc.bits.poke(lineIdx.U)
+    dut.io.evict.bits.poke(lineIdx.U)
+    dut.io.creq.valid.poke(false.B)
+    dut.io.cresp.ready.poke(true.B)
+    dut.io.cdata.ready.poke(true.B)
+  }
+
+  // Dirty unique line with bytes b + 1 in way 1
+  def fill(dut: ReservationHarness): Unit = {
+    dut.io.fill.valid.poke(true.B)
+    dut.io.fill.bits.addr.poke(lineAddr.U)
+    dut.io.fill.bits.metaWrite.poke(true.B)
+    dut.io.fill.bits.metaMask.poke(3.U)
+    for(w <- 0 until 2) {
+      dut.io.fill.bits.metaWdata(w).valid.poke((w == 1).B)
+      dut.io.fill.bits.metaWdata(w).dirty.poke(true.B)
+      dut.io.fill.bits.metaWdata(w).unique.poke(true.B)
+      dut.io.fill.bits.metaWdata(w).ptag.poke((lineAddr >> (cacheLineLog2 + cp.entriesLog2)).U)
+    }
+    dut.io.fill.bits.dataWrite.poke(true.B)
+    dut.io.fill.bits.dataWayIdx.poke(1.U)
+    for(b <- 0 until lineBytes) {
+      dut.io.fill.bits.dataWdata(b).poke((b + 1).U)
+      dut.io.fill.bits.dataMask(b).poke(true.B)
+    }
+    dut.clock.step()
+    dut.io.fill.valid.poke(false.B)
+  }
+
+  def lr(dut: ReservationHarness): Unit = {
+    dut.io.lr.valid.poke(true.B)
+    dut.clock.step()
+    dut.io.lr.valid.poke(false.B)
+    dut.io.held.expect(true.B)
+  }
+
+  def sc(dut: ReservationHarness, ok: Boolean): Unit = {
+    dut.io.sc.valid.poke(true.B)
+    dut.io.scOk.expect(ok.B)
+    dut.clock.step()
+    dut.io.sc.valid.poke(false.B)
+    dut.io.held.expect(false.B)
+  }
+
+  // Cycles until the snoop is accepted
+  def snoopAccepted(dut: ReservationHarness): Int = {
+    dut.io.creq.valid.poke(true.B)
+    dut.io.creq.bits.op.poke(busConst.ReadUnique)
+    dut.io.creq.bits.addr.poke(lineAddr.U)
+    var cycles = 0
+    while(!dut.io.creq.ready.peek().litToBoolean) {
+      assert(cycles < 2 * ccx.core.lrscCycles, "Snoop was never accepted")
+      dut.clock.step()
+      cycles += 1
+    }
+    dut.clock.step()
+    dut.io.creq.valid.poke(false.B)
+    cycles
+  }
+
+  // Dirty copy comes back and the line is invalidated
+  def snoopDone(dut: ReservationHarness): Unit = {
+    var cycles = 0
+    while(!dut.io.cresp.valid.peek().litToBoolean) {
+      assert(cycles < 10, "Snoop response timeout")
+      dut.clock.step()
+      cycles += 1
+    }
+    dut.io.cresp.bits.resp.expect(((1 << busConst.RETURNDATABITNUM) | (1 << busConst.DIRTYBITNUM)).U)
+    dut.clock.step()
+    dut.io.cdata.valid.expect(true.B)
+    dut.io.cdata.bits.data.expect(lineData.U)
+    dut.clock.step()
+
+    dut.io.fill.valid.poke(true.B)
+    dut.io.fill.bits.metaWrite.poke(false.B)
+    dut.io.fill.bits.dataWrite.poke(false.B)
+    dut.clock.step()
+    dut.io.fill.valid.poke(false.B)
+    dut.io.row.metaRdata(1).valid.expect(false.B)
+  }
+
+  it should "hold the snoop to the reserved line until the SC" in {
+    simulate(new ReservationHarness) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+      fill(dut)
+
+      lr(dut)
+      dut.io.creq.valid.poke(true.B)
+      dut.io.creq.bits.op.poke(busConst.ReadUnique)
+      dut.io.creq.bits.addr.poke(lineAddr.U)
+      for(_ <- 0 until 8) {
+        dut.io.creq.ready.expect(false.B)
+        dut.clock.step()
+      }
+
+      // SC finds its reservation, then the snoop takes the line
+      sc(dut, ok = true)
+      assert(snoopAccepted(dut) == 0)
+      snoopDone(dut)
+    }
+  }
+
+  it should "let the snoop take the line after the window and fail the SC" in {
+    simulate(new ReservationHarness) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+      fill(dut)
+
+      lr(dut)
+      val cycles = snoopAccepted(dut)
+      assert(cycles >= ccx.core.lrscCycles - 2 && cycles <= ccx.core.lrscCycles, s"Snoop waited $cycles cycles")
+      dut.io.held.expect(false.B)
+      snoopDone(dut)
+      sc(dut, ok = false)
+
+      // Replaced line loses the reservation too
+      fill(dut)
+      lr(dut)
+      dut.io.evict.valid.poke(true.B)
+      dut.clock.step()
+      dut.io.evict.valid.poke(false.B)
+      dut.io.held.expect(false.B)
+      sc(dut, ok = false)
+    }
+  }
+}
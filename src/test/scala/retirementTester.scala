@@ -0,0 +1,177 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import Consts._
+
+// Acts as the back-end: sends one uop to each retire slot. Memory, interrupts and the vector unit are idle
+class RetirementHarness(implicit ccx: CCXParams) extends Module {
+  val w = ccx.core.retireWidth
+  val io = IO(new Bundle {
+    val valid     = Input(Vec(w, Bool()))
+    val instr     = Input(Vec(w, UInt(32.W)))
+    val pc        = Input(Vec(w, UInt(apLen.W)))
+    val result    = Input(Vec(w, UInt(xLen.W)))
+    val rdPhys    = Input(Vec(w, UInt(physRegsLog2.W)))
+    val predTaken = Input(Vec(w, Bool()))
+
+    val ready     = Output(Vec(w, Bool()))
+    val commit    = Output(Vec(w, Bool()))
+    val rdWrite   = Output(Vec(w, Bool()))
+    val rdPhysOut = Output(Vec(w, UInt(physRegsLog2.W)))
+    val wdata     = Output(Vec(w, UInt(xLen.W)))
+    val rvfiValid = Output(Vec(w, Bool()))
+    val rvfiOrder = Output(Vec(w, UInt(64.W)))
+    val rvfiNext  = Output(Vec(w, UInt(apLen.W)))
+    val jump      = Output(Bool())
+  })
+  val retire = Module(new Retirement)
+  retire.dynRegs          := 0.U.asTypeOf(retire.dynRegs)
+  retire.staticRegs       := 0.U.asTypeOf(retire.staticRegs)
+  retire.int              := 0.U.asTypeOf(retire.int)
+  retire.debugReq         := false.B
+  retire.dmHaltAddr       := 0.U
+  retire.lqReq.ready      := false.B
+  retire.lqResolve        := 0.U.asTypeOf(retire.lqResolve)
+  retire.lqEmpty          := true.B
+  retire.sbReq.ready      := false.B
+  retire.sbResolve        := 0.U.asTypeOf(retire.sbResolve)
+  retire.sbEmpty          := true.B
+  retire.reservationValid := false.B
+  retire.vecReq.ready     := false.B
+  retire.vecResp          := 0.U.asTypeOf(retire.vecResp)
+  retire.perf             := 0.U.asTypeOf(retire.perf)
+  retire.ctrl.busy        := false.B
+
+  val slots = retire.in +: retire.inExtra
+  for(i <- 0 until w) {
+    val uop = Wire(new ExecuteUop)
+    uop           := 0.U.asTypeOf(uop)
+    uop.pc        := io.pc(i)
+    uop.pcPlus4   := io.pc(i) + 4.U
+    uop.instr     := io.instr(i)
+    uop.predTaken := io.predTaken(i)
+    uop.dec       := DecodeTable(io.instr(i))
+    uop.rdPhys    := io.rdPhys(i)
+    uop.aluOut    := io.result(i).asSInt
+    // Branch outcome is given by the result: nonzero is taken, to the result
+    uop.branchTaken := io.result(i) =/= 0.U
+
+    slots(i).valid        := io.valid(i)
+    slots(i).bits         := uop
+    io.ready(i)           := slots(i).ready
+    io.commit(i)          := retire.regs_retire(i).commit
+    io.rdWrite(i)         := retire.regs_retire(i).rd_write
+    io.rdPhysOut(i)       := retire.regs_retire(i).rd_phys
+    io.wdata(i)           := retire.regs_retire(i).rd_wdata
+    io.rvfiValid(i)       := retire.rvfi(i).valid
+    io.rvfiOrder(i)       := retire.rvfi(i).order
+    io.rvfiNext(i)        := retire.rvfi(i).pc_wdata
+  }
+  io.jump := retire.ctrl.jump
+}
+
+class RetirementTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams(core = new CoreParams(retireWidth = 2))
+
+  val ADDI_X1   = 0x00500093 // addi x1, x0, 5
+  val ADDI_X2   = 0x00700113 // addi x2, x0, 7
+  val LD_X3     = 0x00023183 // ld x3, 0(x4)
+  val BEQ       = 0x00208463 // beq x1, x2, 8
+
+  def start(dut: RetirementHarness): Unit = {
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+    for(i <- 0 until 2) {
+      dut.io.valid(i).poke(false.B)
+      dut.io.instr(i).poke(0.U)
+      dut.io.pc(i).poke(0.U)
+      dut.io.result(i).poke(0.U)
+      dut.io.rdPhys(i).poke(0.U)
+      dut.io.predTaken(i).poke(false.B)
+    }
+  }
+
+  def send(dut: RetirementHarness, slot: Int, pc: Int, instr: Int, result: BigInt, rdPhys: Int = 0, predTaken: Boolean = false): Unit = {
+    dut.io.valid(slot).poke(true.B)
+    dut.io.pc(slot).poke(pc.U)
+    dut.io.instr(slot).poke(instr.U)
+    dut.io.result(slot).poke(result.U)
+    dut.io.rdPhys(slot).poke(rdPhys.U)
+    dut.io.predTaken(slot).poke(predTaken.B)
+  }
+
+  it should "retire two uops in one cycle" in {
+    simulate(new RetirementHarness) { dut =>
+      start(dut)
+      send(dut, 0, 0x100, ADDI_X1, 5, rdPhys = 32)
+      send(dut, 1, 0x104, ADDI_X2, 7, rdPhys = 33)
+      for(i <- 0 until 2) {
+        dut.io.ready(i).expect(true.B)
+        dut.io.commit(i).expect(true.B)
+        dut.io.rdWrite(i).expect(true.B)
+        dut.io.rvfiValid(i).expect(true.B)
+        dut.io.rvfiOrder(i).expect(i.U)
+      }
+      dut.io.rdPhysOut(0).expect(32.U)
+      dut.io.rdPhysOut(1).expect(33.U)
+      dut.io.wdata(0).expect(5.U)
+      dut.io.wdata(1).expect(7.U)
+      dut.io.rvfiNext(0).expect(0x104.U)
+      dut.io.rvfiNext(1).expect(0x108.U)
+      dut.io.jump.expect(false.B)
+      dut.clock.step()
+
+      // Order counts both channels. A correctly predicted branch retires in the second slot too
+      send(dut, 0, 0x108, ADDI_X1, 5, rdPhys = 34)
+      send(dut, 1, 0x10C, BEQ, 0)
+      dut.io.rvfiOrder(0).expect(2.U)
+      dut.io.rvfiOrder(1).expect(3.U)
+      dut.io.ready(1).expect(true.B)
+      dut.io.rdWrite(1).expect(false.B)
+      dut.io.rvfiNext(1).expect(0x110.U)
+    }
+  }
+
+  it should "retire the younger uop only with the older one" in {
+    simulate(new RetirementHarness) { dut =>
+      start(dut)
+      // Older load waits for the load queue
+      send(dut, 0, 0x100, LD_X3, 0x1000)
+      send(dut, 1, 0x104, ADDI_X2, 7, rdPhys = 33)
+      dut.io.ready(0).expect(false.B)
+      dut.io.ready(1).expect(false.B)
+      dut.io.commit(1).expect(false.B)
+      dut.io.rvfiValid(1).expect(false.B)
+
+      // Nothing in the first slot
+      dut.io.valid(0).poke(false.B)
+      dut.io.ready(1).expect(false.B)
+      dut.io.commit(1).expect(false.B)
+    }
+  }
+
+  it should "leave the younger mispredicted branch for the first slot" in {
+    simulate(new RetirementHarness) { dut =>
+      start(dut)
+      // Branch is not taken, but the front-end followed the target
+      send(dut, 0, 0x100, ADDI_X1, 5, rdPhys = 32)
+      send(dut, 1, 0x104, BEQ, 0, predTaken = true)
+      dut.io.ready(0).expect(true.B)
+      dut.io.ready(1).expect(false.B)
+      dut.io.rvfiValid(1).expect(false.B)
+      dut.clock.step()
+
+      // Next cycle it is the oldest uop and restarts the pipeline
+      send(dut, 0, 0x104, BEQ, 0, predTaken = true)
+      dut.io.valid(1).poke(false.B)
+      dut.io.ready(0).expect(true.B)
+      dut.io.jump.expect(true.B)
+      dut.io.rvfiNext(0).expect(0x108.U)
+    }
+  }
+}
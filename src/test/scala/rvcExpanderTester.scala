@@ -0,0 +1,71 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+
+class RvcExpanderHarness extends Module {
+  val io = IO(new Bundle {
+    val in  = Input(UInt(16.W))
+    val out = Output(UInt(32.W))
+  })
+  io.out := RvcExpander(io.in)
+}
+
+class RvcExpanderTest extends AnyFlatSpec with ChiselSim {
+  // Compressed instruction, expected expansion. Zero is the illegal instruction
+  val tests = Seq(
+    (0x0000, 0x00000000L), // Zero C.ADDI4SPN immediate is reserved
+    (0x2005, 0x00000000L), // C.ADDIW with rd=0 is reserved
+    (0x2505, 0x0015051BL), // c.addiw x10, 1
+    (0x6501, 0x00000000L), // C.LUI with zero immediate is reserved
+    (0x6505, 0x00001537L), // c.lui x10, 1
+    (0x757D, 0xFFFFF537L), // c.lui x10, 0xfffff
+    (0x6101, 0x00000000L), // C.ADDI16SP with zero immediate is reserved
+    (0x4002, 0x00000000L), // C.LWSP with rd=0 is reserved
+    (0x4502, 0x00012503L), // c.lwsp x10, 0(sp)
+    (0x6002, 0x00000000L), // C.LDSP with rd=0 is reserved
+    (0x9002, 0x00100073L), // c.ebreak
+
+    // Jumps and branches
+    (0xBFFD, 0xFFFFF06FL), // c.j -2
+    (0xAFFD, 0x7FE0006FL), // c.j 0x7fe
+    (0xB001, 0x801FF06FL), // c.j -0x800
+    (0xD001, 0xF00400E3L), // c.beqz x8, -256
+    (0xCFFD, 0x0E078F63L), // c.beqz x15, 254
+    (0xE48D, 0x02049563L), // c.bnez x9, 42
+    (0xFD6D, 0xFE051DE3L), // c.bnez x10, -6
+
+    // Doubleword loads and stores
+    (0x7CE8, 0x0F84B503L), // c.ld x10, 248(x9)
+    (0xE5B0, 0x04C5B423L), // c.sd x12, 72(x11)
+    (0xFF86, 0x1E113C23L), // c.sdsp ra, 504(sp)
+
+    // Stack pointer adjustment
+    (0x7101, 0xE0010113L), // c.addi16sp -512
+    (0x617D, 0x1F010113L), // c.addi16sp 496
+    (0x1FE0, 0x3FC10413L), // c.addi4spn x8, 1020
+    (0x005C, 0x00410793L), // c.addi4spn x15, 4
+
+    // Register-immediate and register-register ALU
+    (0x947D, 0x43F45413L), // c.srai x8, 63
+    (0x98FD, 0xFFF4F493L), // c.andi x9, -1
+    (0x88FD, 0x01F4F493L), // c.andi x9, 31
+    (0x8D0D, 0x40B50533L), // c.sub x10, x11
+    (0x9D0D, 0x40B5053BL), // c.subw x10, x11
+
+    // C.JAL is RV32 only, its encoding is C.ADDIW on RV64
+    (0x3FFD, 0xFFFF8F9BL), // c.addiw x31, -1
+  )
+
+  it should "expand the compressed instructions and reject the reserved encodings" in {
+    simulate(new RvcExpanderHarness) { dut =>
+      for((in, out) <- tests) {
+        dut.io.in.poke(in.U)
+        dut.io.out.expect(out.U, f"0x$in%04x")
+      }
+    }
+  }
+}
@@ -0,0 +1,244 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import Consts._
+
+// The test acts as Retirement, the load queue and the D-cache
+class StoreBufferTest extends AnyFlatSpec with ChiselSim {
+  val SW = 0x2023
+  val SD = 0x3023
+
+  def idle(dut: StoreBuffer): Unit = {
+    dut.ctrl.kill.poke(false.B)
+    dut.ctrl.jump.poke(false.B)
+    dut.ctrl.flush.poke(false.B)
+    dut.ctrl.newPc.poke(0.U)
+    dut.req.valid.poke(false.B)
+    dut.loadConflict.poke(false.B)
+    dut.loadsPending.poke(0.U)
+    dut.fwd.vaddr.poke(0.U)
+    dut.cacheReq.ready.poke(true.B)
+    dut.cacheResp.valid.poke(false.B)
+    dut.cacheResp.miss.poke(false.B)
+    dut.cacheResp.accessFault.poke(false.B)
+    dut.cacheResp.pageFault.poke(false.B)
+    dut.cacheResp.scFail.poke(false.B)
+    dut.cacheResp.refill.valid.poke(false.B)
+    dut.cacheResp.refill.bits.poke(0.U)
+  }
+
+  def expectBytes(v: Vec[UInt], value: BigInt): Unit = {
+    for(b <- 0 until xLenBytes) v(b).expect(((value >> (8 * b)) & 0xFF).U)
+  }
+
+  // Sends the store and answers its probe
+  def store(dut: StoreBuffer, instr: Int, vaddr: BigInt, data: BigInt): Unit = {
+    dut.req.ready.expect(true.B)
+    dut.req.valid.poke(true.B)
+    dut.req.bits.instr.poke(instr.U)
+    dut.req.bits.vaddr.poke(vaddr.U)
+    dut.req.bits.data.poke(data.U)
+    dut.clock.step()
+    dut.req.valid.poke(false.B)
+
+    // Probe checks the write permission without touching the line
+    dut.cacheReq.valid.expect(true.B)
+    dut.cacheReq.bits.probe.expect(true.B)
+    dut.cacheReq.bits.read.expect(false.B)
+    dut.cacheReq.bits.write.expect(false.B)
+    dut.cacheReq.bits.vaddr.expect(vaddr.U)
+    dut.clock.step()
+
+    dut.cacheResp.probe.expect(true.B)
+    dut.cacheResp.valid.poke(true.B)
+    dut.resolve.valid.expect(true.B)
+    dut.resolve.bits.accessFault.expect(false.B)
+    dut.resolve.bits.misaligned.expect(false.B)
+    dut.clock.step()
+    dut.cacheResp.valid.poke(false.B)
+  }
+
+  it should "merge the stores to one word, forward them and drain them as one write" in {
+    simulate(new StoreBuffer()(new CCXParams())) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+
+      // Older load holds the drain, so that the stores stay in the buffer
+      dut.loadsPending.poke(1.U)
+      store(dut, SD, 0x100, BigInt("1111111111111111", 16))
+      store(dut, SW, 0x104, BigInt("AABBCCDD", 16))
+      dut.cacheReq.valid.expect(false.B)
+
+      dut.fwd.vaddr.poke(0x100.U)
+      dut.fwd.mask.expect(0xFF.U)
+      expectBytes(dut.fwd.data, BigInt("AABBCCDD11111111", 16))
+
+      dut.fwd.vaddr.poke(0x108.U)
+      dut.fwd.mask.expect(0.U)
+
+      // Store to another word takes its own entry and is forwarded on its own
+      store(dut, SW, 0x10C, BigInt("55667788", 16))
+      dut.fwd.vaddr.poke(0x108.U)
+      dut.fwd.mask.expect(0xF0.U)
+
+      // Drained in order, the merged word as one write
+      dut.loadsPending.poke(0.U)
+      dut.clock.step()
+      dut.cacheReq.valid.expect(true.B)
+      dut.cacheReq.bits.write.expect(true.B)
+      dut.cacheReq.bits.probe.expect(false.B)
+      dut.cacheReq.bits.vaddr.expect(0x100.U)
+      dut.clock.step()
+      dut.cacheResp.write.expect(true.B)
+      dut.cacheResp.writeMask.expect(0xFF.U)
+      expectBytes(dut.cacheResp.writeData, BigInt("AABBCCDD11111111", 16))
+      dut.cacheResp.valid.poke(true.B)
+      dut.clock.step()
+      dut.cacheResp.valid.poke(false.B)
+
+      dut.cacheReq.valid.expect(true.B)
+      dut.cacheReq.bits.vaddr.expect(0x108.U)
+      dut.clock.step()
+      dut.cacheResp.writeMask.expect(0xF0.U)
+      dut.cacheResp.valid.poke(true.B)
+      dut.clock.step()
+      dut.cacheResp.valid.poke(false.B)
+
+      dut.empty.expect(true.B)
+    }
+  }
+
+  def send(dut: StoreBuffer, instr: Int, vaddr: BigInt, data: BigInt): Unit = {
+    dut.req.ready.expect(true.B)
+    dut.req.valid.poke(true.B)
+    dut.req.bits.instr.poke(instr.U)
+    dut.req.bits.vaddr.poke(vaddr.U)
+    dut.req.bits.data.poke(data.U)
+    dut.clock.step()
+    dut.req.valid.poke(false.B)
+  }
+
+  // Answers the probe of one word. Returns whether the store was resolved with it
+  def probe(dut: StoreBuffer, vaddr: BigInt, pageFault: Boolean = false): Boolean = {
+    dut.cacheReq.valid.expect(true.B)
+    dut.cacheReq.bits.probe.expect(true.B)
+    dut.cacheReq.bits.vaddr.expect(vaddr.U)
+    dut.clock.step()
+    dut.cacheResp.valid.poke(true.B)
+    dut.cacheResp.pageFault.poke(pageFault.B)
+    val resolved = dut.resolve.valid.peek().litToBoolean
+    if(resolved) dut.resolve.bits.pageFault.expect(pageFault.B)
+    dut.clock.step()
+    dut.cacheResp.valid.poke(false.B)
+    dut.cacheResp.pageFault.poke(false.B)
+    resolved
+  }
+
+  def drain(dut: StoreBuffer, vaddr: BigInt, mask: Int, data: BigInt): Unit = {
+    dut.cacheReq.valid.expect(true.B)
+    dut.cacheReq.bits.write.expect(true.B)
+    dut.cacheReq.bits.vaddr.expect(vaddr.U)
+    dut.clock.step()
+    dut.cacheResp.writeMask.expect(mask.U)
+    for(b <- 0 until xLenBytes) if(((mask >> b) & 1) == 1) dut.cacheResp.writeData(b).expect(((data >> (8 * b)) & 0xFF).U)
+    dut.cacheResp.valid.poke(true.B)
+    dut.clock.step()
+    dut.cacheResp.valid.poke(false.B)
+  }
+
+  it should "split a store that crosses a page into two entries and merge into the high one" in {
+    simulate(new StoreBuffer()(new CCXParams())) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+      dut.loadsPending.poke(1.U)
+
+      // Each word is translated on its own. The low word does not resolve the store
+      send(dut, SD, 0xFFC, BigInt("8877665544332211", 16))
+      assert(!probe(dut, 0xFFC))
+      assert(probe(dut, 0x1000))
+
+      dut.fwd.vaddr.poke(0xFF8.U)
+      dut.fwd.mask.expect(0xF0.U)
+      for(b <- 4 until xLenBytes) dut.fwd.data(b).expect((0x11 * (b - 3)).U)
+      dut.fwd.vaddr.poke(0x1000.U)
+      dut.fwd.mask.expect(0x0F.U)
+      for(b <- 0 until 4) dut.fwd.data(b).expect((0x11 * (b + 5)).U)
+
+      // Younger store to the high word is merged into its entry
+      store(dut, SW, 0x1004, BigInt("AABBCCDD", 16))
+      dut.fwd.vaddr.poke(0x1000.U)
+      dut.fwd.mask.expect(0xFF.U)
+      expectBytes(dut.fwd.data, BigInt("AABBCCDD88776655", 16))
+
+      // Both words are drained in order
+      dut.loadsPending.poke(0.U)
+      dut.clock.step()
+      drain(dut, 0xFF8, 0xF0, BigInt("4433221100000000", 16))
+      drain(dut, 0x1000, 0xFF, BigInt("AABBCCDD88776655", 16))
+      dut.empty.expect(true.B)
+    }
+  }
+
+  it should "wait for two free entries before taking a crossing store" in {
+    simulate(new StoreBuffer()(new CCXParams(core = new CoreParams(storeBufferEntries = 4)))) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+      dut.loadsPending.poke(1.U)
+
+      // Three words are taken, only the last entry is free
+      store(dut, SD, 0x100, 1)
+      store(dut, SD, 0x108, 2)
+      store(dut, SD, 0x110, 3)
+      dut.req.valid.poke(true.B)
+      dut.req.bits.instr.poke(SD.U)
+      dut.req.bits.vaddr.poke(0x11C.U)
+      dut.req.ready.expect(false.B)
+
+      // Aligned store fits
+      dut.req.bits.vaddr.poke(0x118.U)
+      dut.req.ready.expect(true.B)
+      dut.req.valid.poke(false.B)
+
+      // Oldest word is drained, the crossing store still needs the entry after the tail
+      dut.loadsPending.poke(0.U)
+      dut.clock.step()
+      drain(dut, 0x100, 0xFF, 1)
+      dut.loadsPending.poke(1.U)
+      dut.req.valid.poke(true.B)
+      dut.req.bits.vaddr.poke(0x11C.U)
+      dut.req.ready.expect(true.B)
+      dut.req.valid.poke(false.B)
+    }
+  }
+
+  it should "not commit a crossing store when either word faults" in {
+    simulate(new StoreBuffer()(new CCXParams())) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      idle(dut)
+
+      // High word is on an unmapped page
+      send(dut, SW, 0x1FFE, BigInt("AABBCCDD", 16))
+      assert(!probe(dut, 0x1FFE))
+      assert(probe(dut, 0x2000, pageFault = true))
+      dut.empty.expect(true.B)
+
+      // Low word faults, the high one is not probed
+      send(dut, SW, 0x2FFE, BigInt("AABBCCDD", 16))
+      assert(probe(dut, 0x2FFE, pageFault = true))
+      dut.cacheReq.valid.expect(false.B)
+      dut.empty.expect(true.B)
+    }
+  }
+}
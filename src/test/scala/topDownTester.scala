@@ -0,0 +1,55 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+
+// The test acts as the stages: Retirement, Execute, Decode
+class TopDownTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  def classify(dut: TopDownAccounting, stages: Seq[UInt], expected: UInt, restart: Boolean = false, refilled: Boolean = false): Unit = {
+    for((s, i) <- stages.zipWithIndex) dut.stage(i).poke(s)
+    dut.restart.poke(restart.B)
+    dut.refilled.poke(refilled.B)
+    dut.cycleClass.expect(expected)
+    dut.clock.step()
+    dut.restart.poke(false.B)
+    dut.refilled.poke(false.B)
+  }
+
+  it should "blame the oldest stage that is not empty" in {
+    simulate(new TopDownAccounting(3)) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      val none = TopDown.NONE
+      classify(dut, Seq(TopDown.RETIRING, TopDown.BACKEND_CORE, none), TopDown.RETIRING)
+      classify(dut, Seq(none, TopDown.BACKEND_CORE, TopDown.BACKEND_MEMORY), TopDown.BACKEND_CORE)
+      classify(dut, Seq(none, none, TopDown.BACKEND_MEMORY), TopDown.BACKEND_MEMORY)
+      // Nothing reached the back-end
+      classify(dut, Seq(none, none, none), TopDown.FRONTEND)
+    }
+  }
+
+  it should "count the empty cycles after a restart as bad speculation until the front-end delivers" in {
+    simulate(new TopDownAccounting(3)) { dut =>
+      dut.reset.poke(true.B)
+      dut.clock.step()
+      dut.reset.poke(false.B)
+      val none = TopDown.NONE
+      classify(dut, Seq(none, none, none), TopDown.BAD_SPECULATION, restart = true)
+      classify(dut, Seq(none, none, none), TopDown.BAD_SPECULATION)
+      // A stage that holds the pipeline back is still blamed
+      classify(dut, Seq(none, TopDown.BACKEND_CORE, none), TopDown.BACKEND_CORE)
+      classify(dut, Seq(none, none, none), TopDown.BAD_SPECULATION, refilled = true)
+      classify(dut, Seq(none, none, none), TopDown.FRONTEND)
+
+      // Restart wins over the refill in the same cycle
+      classify(dut, Seq(none, none, none), TopDown.BAD_SPECULATION, restart = true, refilled = true)
+      classify(dut, Seq(none, none, none), TopDown.BAD_SPECULATION)
+    }
+  }
+}
@@ -0,0 +1,221 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+import scala.collection.mutable
+import Consts._
+
+// Acts as Retirement and the CSR module: vsetvl* instructions update vl/vtype, the others are sent to the unit
+class VectorHarness(implicit ccx: CCXParams) extends Module {
+  val io = IO(new Bundle {
+    val set       = Input(Bool()) // vsetvl*, applied to the configuration
+    val valid     = Input(Bool())
+    val instr     = Input(UInt(32.W))
+    val rs1       = Input(UInt(xLen.W))
+    val rs2       = Input(UInt(xLen.W))
+
+    val ready     = Output(Bool())
+    val cfg       = Output(new VecConfig)
+    val resp      = Output(Valid(new VectorResp))
+  })
+  val cacheReq    = IO(new CacheReq)
+  val cacheResp   = IO(Flipped(new CacheResp))
+
+  val vec         = Module(new VectorUnit)
+  val cfg         = RegInit(0.U.asTypeOf(new VecConfig))
+  when(io.set) {
+    cfg := VecConfig(io.instr, io.rs1, io.rs2, cfg)
+  }
+
+  vec.req.valid             := io.valid
+  vec.req.bits.instr        := io.instr
+  vec.req.bits.dec          := DecodeTable(io.instr)
+  vec.req.bits.rs1          := io.rs1
+  vec.req.bits.rs2          := io.rs2
+  vec.req.bits.cfg          := cfg
+  vec.req.bits.vstart       := 0.U
+
+  io.ready        := vec.req.ready
+  io.cfg          := cfg
+  io.resp         := vec.resp
+  cacheReq        <> vec.cacheReq
+  vec.cacheResp   <> cacheResp
+}
+
+class VectorUnitTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  val VSETVLI_E32       = 0x010372D7 // vsetvli x5, x6, e32, m1
+  val VSETVLI_E32_MAX   = 0x010072D7 // vsetvli x5, x0, e32, m1
+  val VSETVLI_E64_MF2   = 0x01F372D7 // vsetvli x5, x6, e64, mf2
+  val VLE32_V1          = 0x02056087 // vle32.v v1, (x10)
+  val VLE32_V2          = 0x02056107 // vle32.v v2, (x10)
+  val VLSE32_V4         = 0x0AB56207 // vlse32.v v4, (x10), x11
+  val VSE32_V1          = 0x020560A7 // vse32.v v1, (x10)
+  val VSE32_V3          = 0x020561A7 // vse32.v v3, (x10)
+  val VSE32_V4          = 0x02056227 // vse32.v v4, (x10)
+  val VSE32_V2_MASKED   = 0x00056127 // vse32.v v2, (x10), v0.t
+  val VADD_VV           = 0x021101D7 // vadd.vv v3, v1, v2
+  val VADD_VI_MASKED    = 0x0012B0D7 // vadd.vi v1, v1, 5, v0.t
+  val VMSEQ_VI          = 0x62113057 // vmseq.vi v0, v1, 2
+  val VREDSUM           = 0x0230A2D7 // vredsum.vs v5, v3, v1
+  val VREDSUM_MASKED    = 0x0030A357 // vredsum.vs v6, v3, v1, v0.t
+  val VREDMAXU          = 0x1A20A3D7 // vredmaxu.vs v7, v2, v1
+  val VMV_X_S_V5        = 0x425022D7 // vmv.x.s x5, v5
+  val VMV_X_S_V6        = 0x426022D7 // vmv.x.s x5, v6
+  val VMV_X_S_V7        = 0x427022D7 // vmv.x.s x5, v7
+
+  // Memory behind the line port, by byte address. Unwritten bytes are 0xEE
+  val mem = mutable.Map[BigInt, Int]().withDefaultValue(0xEE)
+
+  def write32(addr: BigInt, value: Int): Unit = for(b <- 0 until 4) mem(addr + b) = (value >> (8 * b)) & 0xFF
+  def read32(addr: BigInt): Int = (0 until 4).map(b => mem(addr + b) << (8 * b)).sum
+
+  def start(dut: VectorHarness): Unit = {
+    mem.clear()
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+    dut.io.set.poke(false.B)
+    dut.io.valid.poke(false.B)
+    dut.io.instr.poke(0.U)
+    dut.io.rs1.poke(0.U)
+    dut.io.rs2.poke(0.U)
+    dut.cacheReq.ready.poke(true.B)
+    dut.cacheResp.valid.poke(false.B)
+    dut.cacheResp.accessFault.poke(false.B)
+    dut.cacheResp.pageFault.poke(false.B)
+    dut.cacheResp.miss.poke(false.B)
+  }
+
+  def vsetvl(dut: VectorHarness, instr: Int, avl: Int): Unit = {
+    dut.io.set.poke(true.B)
+    dut.io.instr.poke(instr.U)
+    dut.io.rs1.poke(avl.U)
+    dut.clock.step()
+    dut.io.set.poke(false.B)
+  }
+
+  // Runs one instruction and answers its line requests from mem in the next cycle.
+  // Returns the lines that were requested and the scalar result
+  def run(dut: VectorHarness, instr: Int, rs1: BigInt = 0, rs2: BigInt = 0): (Seq[BigInt], BigInt) = {
+    dut.io.ready.expect(true.B)
+    dut.io.valid.poke(true.B)
+    dut.io.instr.poke(instr.U)
+    dut.io.rs1.poke(rs1.U)
+    dut.io.rs2.poke(rs2.U)
+    dut.clock.step()
+    dut.io.valid.poke(false.B)
+
+    val lines = mutable.ArrayBuffer[BigInt]()
+    var cycles = 0
+    while(!dut.io.resp.valid.peek().litToBoolean) {
+      if(dut.cacheReq.valid.peek().litToBoolean) {
+        dut.cacheReq.bits.line.expect(true.B)
+        val line = dut.cacheReq.bits.vaddr.peek().litValue
+        lines += line
+        dut.clock.step()
+        for(b <- 0 until cacheLineBytes) dut.cacheResp.readLine(b).poke(mem(line + b).U)
+        if(dut.cacheResp.write.peek().litToBoolean) {
+          val mask = dut.cacheResp.writeLineMask.peek().litValue
+          for(b <- 0 until cacheLineBytes if mask.testBit(b)) mem(line + b) = dut.cacheResp.writeLine(b).peek().litValue.toInt
+        }
+        dut.cacheResp.valid.poke(true.B)
+      }
+      dut.clock.step()
+      dut.cacheResp.valid.poke(false.B)
+      cycles += 1
+      assert(cycles < 50, "Vector instruction did not finish")
+    }
+    dut.io.resp.bits.fault.misaligned.expect(false.B)
+    dut.io.resp.bits.fault.accessFault.expect(false.B)
+    dut.io.resp.bits.fault.pageFault.expect(false.B)
+    val rd = dut.io.resp.bits.rd.peek().litValue
+    dut.clock.step()
+    (lines.toSeq, rd)
+  }
+
+  it should "set vl from the AVL and VLMAX, and flag the unsupported vtype" in {
+    simulate(new VectorHarness) { dut =>
+      start(dut)
+      vsetvl(dut, VSETVLI_E32, 3)
+      dut.io.cfg.vill.expect(false.B)
+      dut.io.cfg.vsew.expect(2.U)
+      dut.io.cfg.vl.expect(3.U)
+
+      // Four 32-bit elements in a register
+      vsetvl(dut, VSETVLI_E32, 10)
+      dut.io.cfg.vl.expect(4.U)
+      vsetvl(dut, VSETVLI_E32_MAX, 0)
+      dut.io.cfg.vl.expect(4.U)
+
+      // SEW of 64 does not fit half a register of ELEN 64
+      vsetvl(dut, VSETVLI_E64_MF2, 1)
+      dut.io.cfg.vill.expect(true.B)
+      dut.io.cfg.vl.expect(0.U)
+    }
+  }
+
+  it should "access all the elements of a line with one request" in {
+    simulate(new VectorHarness) { dut =>
+      start(dut)
+      vsetvl(dut, VSETVLI_E32, 4)
+      Seq(1, 2, 3, 4).zipWithIndex.foreach {case (v, i) => write32(0x1000 + 4 * i, v)}
+      Seq(10, 20, 30, 40).zipWithIndex.foreach {case (v, i) => write32(0x1038 + 4 * i, v)}
+      Seq(5, 6, 7, 8).zipWithIndex.foreach {case (v, i) => write32(0x3000 + 0x40 * i, v)}
+
+      assert(run(dut, VLE32_V1, 0x1000)._1 == Seq(BigInt(0x1000)))
+      // Two elements on each side of the line boundary
+      assert(run(dut, VLE32_V2, 0x1038)._1 == Seq(BigInt(0x1000), BigInt(0x1040)))
+      // Stride of a line, each element is a request
+      assert(run(dut, VLSE32_V4, 0x3000, 0x40)._1 == Seq(BigInt(0x3000), BigInt(0x3040), BigInt(0x3080), BigInt(0x30C0)))
+
+      run(dut, VADD_VV)
+      assert(run(dut, VSE32_V3, 0x2000)._1 == Seq(BigInt(0x2000)))
+      assert((0 until 4).map(i => read32(0x2000 + 4 * i)) == Seq(11, 22, 33, 44))
+      assert(mem(0x2010) == 0xEE)
+
+      run(dut, VSE32_V4, 0x2020)
+      assert((0 until 4).map(i => read32(0x2020 + 4 * i)) == Seq(5, 6, 7, 8))
+
+      // Tail elements are not written
+      vsetvl(dut, VSETVLI_E32, 3)
+      run(dut, VSE32_V3, 0x2040)
+      assert((0 until 4).map(i => read32(0x2040 + 4 * i)) == Seq(11, 22, 33, 0xEEEEEEEE))
+    }
+  }
+
+  it should "skip the masked off elements and reduce the active ones" in {
+    simulate(new VectorHarness) { dut =>
+      start(dut)
+      vsetvl(dut, VSETVLI_E32, 4)
+      Seq(1, 2, 3, 4).zipWithIndex.foreach {case (v, i) => write32(0x1000 + 4 * i, v)}
+      Seq(10, 20, 30, 40).zipWithIndex.foreach {case (v, i) => write32(0x1010 + 4 * i, v)}
+      run(dut, VLE32_V1, 0x1000)
+      run(dut, VLE32_V2, 0x1010)
+      run(dut, VADD_VV)
+
+      // Sum starts from element zero of vs1
+      run(dut, VREDSUM)
+      assert(run(dut, VMV_X_S_V5)._2 == 1 + 11 + 22 + 33 + 44)
+      run(dut, VREDMAXU)
+      assert(run(dut, VMV_X_S_V7)._2 == 40)
+
+      // Only element one is active
+      run(dut, VMSEQ_VI)
+      run(dut, VREDSUM_MASKED)
+      assert(run(dut, VMV_X_S_V6)._2 == 1 + 22)
+
+      run(dut, VADD_VI_MASKED)
+      run(dut, VSE32_V1, 0x2000)
+      assert((0 until 4).map(i => read32(0x2000 + 4 * i)) == Seq(1, 7, 3, 4))
+
+      // Only the active bytes are in the write mask
+      assert(run(dut, VSE32_V2_MASKED, 0x2040)._1 == Seq(BigInt(0x2040)))
+      assert((0 until 4).map(i => read32(0x2040 + 4 * i)) == Seq(0xEEEEEEEE, 20, 0xEEEEEEEE, 0xEEEEEEEE))
+    }
+  }
+}
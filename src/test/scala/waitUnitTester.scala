@@ -0,0 +1,143 @@
+package armleocpu
+
+import chisel3._
+import chisel3.util._
+
+import chisel3.simulator.scalatest.ChiselSim
+import org.scalatest.flatspec.AnyFlatSpec
+
+// The test acts as Retirement, the CSR and the D-cache
+class WaitUnitTest extends AnyFlatSpec with ChiselSim {
+  implicit val ccx: CCXParams = new CCXParams()
+
+  val WFI     = BigInt("10500073", 16)
+  val WRS_NTO = BigInt("00D00073", 16)
+  val WRS_STO = BigInt("01D00073", 16)
+  val PAUSE   = BigInt("0100000F", 16)
+
+  val U = 0
+  val S = 1
+  val M = 3
+
+  def start(dut: WaitUnit): Unit = {
+    dut.reset.poke(true.B)
+    dut.clock.step()
+    dut.reset.poke(false.B)
+    dut.retire.poke(false.B)
+    dut.instr.poke(0.U)
+    dut.priv.poke(M.U)
+    dut.tw.poke(false.B)
+    dut.reservationValid.poke(false.B)
+    dut.interruptWake.poke(false.B)
+    dut.debugReq.poke(false.B)
+  }
+
+  // Retires the instruction, expects it to trap or to park the hart
+  def retire(dut: WaitUnit, instr: BigInt, priv: Int, illegal: Boolean, park: Boolean): Unit = {
+    dut.parked.expect(false.B)
+    dut.retire.poke(true.B)
+    dut.instr.poke(instr.U)
+    dut.priv.poke(priv.U)
+    dut.illegal.expect(illegal.B, f"Illegal of 0x$instr%x in $priv")
+    dut.park.expect(park.B, f"Park of 0x$instr%x in $priv")
+    dut.clock.step()
+    dut.retire.poke(false.B)
+    dut.parked.expect(park.B)
+  }
+
+  // Stays parked until the wake up
+  def expectParked(dut: WaitUnit, cycles: Int = 10): Unit = {
+    for(_ <- 0 until cycles) {
+      dut.parked.expect(true.B)
+      dut.clock.step()
+    }
+    dut.parked.expect(true.B)
+  }
+
+  def wake(dut: WaitUnit, signal: Bool): Unit = {
+    signal.poke(true.B)
+    dut.clock.step()
+    signal.poke(false.B)
+    dut.parked.expect(false.B)
+  }
+
+  it should "park on WFI until an interrupt or a debug request" in {
+    simulate(new WaitUnit) { dut =>
+      start(dut)
+
+      retire(dut, WFI, M, illegal = false, park = true)
+      expectParked(dut)
+      wake(dut, dut.interruptWake)
+
+      // Not timed and the reservation does not matter
+      dut.reservationValid.poke(true.B)
+      retire(dut, WFI, S, illegal = false, park = true)
+      expectParked(dut, ccx.core.wrsCycles + 2)
+      dut.reservationValid.poke(false.B)
+      expectParked(dut)
+      wake(dut, dut.debugReq)
+    }
+  }
+
+  it should "trap WFI and wrs.nto below M with TW and in U-mode, if they would wait" in {
+    simulate(new WaitUnit) { dut =>
+      start(dut)
+
+      // U-mode traps whatever TW says
+      retire(dut, WFI, U, illegal = true, park = false)
+      dut.tw.poke(true.B)
+      retire(dut, WFI, U, illegal = true, park = false)
+      retire(dut, WFI, S, illegal = true, park = false)
+      // M-mode ignores TW
+      retire(dut, WFI, M, illegal = false, park = true)
+      wake(dut, dut.interruptWake)
+
+      // Without a reservation wrs.nto does not wait, so it does not trap
+      retire(dut, WRS_NTO, U, illegal = false, park = false)
+      retire(dut, WRS_NTO, S, illegal = false, park = false)
+      dut.reservationValid.poke(true.B)
+      retire(dut, WRS_NTO, U, illegal = true, park = false)
+      retire(dut, WRS_NTO, S, illegal = true, park = false)
+      dut.tw.poke(false.B)
+      retire(dut, WRS_NTO, U, illegal = true, park = false)
+      retire(dut, WRS_NTO, S, illegal = false, park = true)
+      expectParked(dut, ccx.core.wrsCycles + 2)
+      dut.reservationValid.poke(false.B)
+      dut.clock.step()
+      dut.parked.expect(false.B)
+
+      // Timed ones never trap
+      dut.tw.poke(true.B)
+      dut.reservationValid.poke(true.B)
+      retire(dut, WRS_STO, U, illegal = false, park = true)
+      wake(dut, dut.interruptWake)
+      retire(dut, PAUSE, U, illegal = false, park = true)
+      wake(dut, dut.interruptWake)
+    }
+  }
+
+  it should "wake wrs.sto and pause on the lost reservation or after wrsCycles" in {
+    simulate(new WaitUnit) { dut =>
+      start(dut)
+
+      // Without a reservation they complete at once
+      retire(dut, WRS_STO, M, illegal = false, park = false)
+      retire(dut, PAUSE, M, illegal = false, park = false)
+
+      // Snoop takes the reserved line
+      dut.reservationValid.poke(true.B)
+      retire(dut, WRS_STO, M, illegal = false, park = true)
+      expectParked(dut)
+      dut.reservationValid.poke(false.B)
+      dut.clock.step()
+      dut.parked.expect(false.B)
+
+      // Reservation is kept, the time limit ends the wait
+      dut.reservationValid.poke(true.B)
+      retire(dut, PAUSE, S, illegal = false, park = true)
+      expectParked(dut, ccx.core.wrsCycles)
+      dut.clock.step()
+      dut.parked.expect(false.B)
+    }
+  }
+}